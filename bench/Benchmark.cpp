@@ -0,0 +1,150 @@
+
+#include "Benchmark.h"
+
+#include <algorithm>	// std::sort
+#include <chrono>		// std::chrono::steady_clock
+#include <iomanip>		// std::setw
+#include <ostream>		// std::ostream
+
+namespace bench
+{
+	namespace
+	{
+		using clock = std::chrono::steady_clock;
+
+		double time_iterations(const Workload & workload, std::size_t iterations)
+		{
+			const auto start = clock::now();
+			for (std::size_t i = 0; i < iterations; ++i)
+				workload.run();
+			const auto end = clock::now();
+
+			return std::chrono::duration<double, std::nano>(end - start).count();
+		}
+
+		/// \brief	Doubles the iteration count until a sample takes at least 'min_seconds'.
+		std::size_t calibrate(const Workload & workload, double min_seconds)
+		{
+			const double min_ns = min_seconds * 1e9;
+
+			std::size_t iterations = 1;
+			while (time_iterations(workload, iterations) < min_ns)
+				iterations *= 2;
+
+			return iterations;
+		}
+
+		Result measure(const std::string & name, const Workload & workload, const Config & config)
+		{
+			Result result;
+			result.name = name;
+			result.bytes_per_run = workload.bytes_per_run;
+
+			// warm up caches and any lazy initialization (i.e. type info statics)
+			workload.run();
+
+			result.iterations = config.quick ? 1 : calibrate(workload, config.min_sample_seconds);
+			result.samples = config.quick ? 1 : config.samples;
+
+			std::vector<double> ns_per_iteration;
+			ns_per_iteration.reserve(result.samples);
+			for (std::size_t i = 0; i < result.samples; ++i)
+			{
+				const double ns = time_iterations(workload, result.iterations);
+				ns_per_iteration.push_back(ns / static_cast<double>(result.iterations));
+			}
+
+			std::sort(ns_per_iteration.begin(), ns_per_iteration.end());
+			result.min_ns = ns_per_iteration.front();
+			result.median_ns = ns_per_iteration[ns_per_iteration.size() / 2];
+
+			if (result.bytes_per_run > 0 && result.median_ns > 0.0)
+			{
+				const double seconds = result.median_ns * 1e-9;
+				result.mb_per_second = (static_cast<double>(result.bytes_per_run) / (1024.0 * 1024.0)) / seconds;
+			}
+
+			return result;
+		}
+
+		void write_json_string(std::ostream & os, const std::string & str)
+		{
+			os << '"';
+			for (const char c : str)
+			{
+				if (c == '"' || c == '\\')	os << '\\';
+				os << c;
+			}
+			os << '"';
+		}
+	}
+
+	void Registry::add(std::string name, workload_factory factory)
+	{
+		m_entries.push_back(Entry{ std::move(name), std::move(factory) });
+	}
+
+	std::vector<Result> Registry::run(const Config & config, std::ostream & log) const
+	{
+		std::vector<Result> results;
+		for (const auto & entry : m_entries)
+		{
+			if (!config.filter.empty() && entry.m_name.find(config.filter) == std::string::npos)
+				continue;
+
+			const Workload workload = entry.m_factory();
+			results.push_back(measure(entry.m_name, workload, config));
+
+			const auto & result = results.back();
+			log << std::left << std::setw(48) << result.name
+				<< std::right << std::setw(16) << std::fixed << std::setprecision(1) << result.median_ns << " ns";
+			if (result.bytes_per_run > 0)
+				log << std::setw(12) << std::setprecision(2) << result.mb_per_second << " MB/s";
+			log << '\n';
+		}
+
+		return results;
+	}
+
+	void write_json(std::ostream & os, const Config & config, const std::vector<Result> & results)
+	{
+		os << "{\n";
+		os << "  \"format_version\": 1,\n";
+		os << "  \"quick\": " << (config.quick ? "true" : "false") << ",\n";
+		os << "  \"benchmarks\": [";
+
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			const auto & result = results[i];
+			os << (i == 0 ? "\n" : ",\n");
+			os << "    { \"name\": ";
+			write_json_string(os, result.name);
+			os << std::fixed << std::setprecision(3)
+				<< ", \"iterations\": " << result.iterations
+				<< ", \"samples\": " << result.samples
+				<< ", \"min_ns\": " << result.min_ns
+				<< ", \"median_ns\": " << result.median_ns
+				<< ", \"bytes_per_run\": " << result.bytes_per_run
+				<< ", \"mb_per_second\": " << result.mb_per_second
+				<< " }";
+		}
+
+		os << "\n  ]\n}\n";
+	}
+
+	void write_csv(std::ostream & os, const std::vector<Result> & results)
+	{
+		os << "name,iterations,samples,min_ns,median_ns,bytes_per_run,mb_per_second\n";
+		for (const auto & result : results)
+		{
+			os << result.name << ','
+				<< result.iterations << ','
+				<< result.samples << ','
+				<< std::fixed << std::setprecision(3)
+				<< result.min_ns << ','
+				<< result.median_ns << ','
+				<< result.bytes_per_run << ','
+				<< result.mb_per_second << '\n';
+		}
+	}
+}
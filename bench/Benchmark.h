@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>		// std::size_t
+#include <functional>	// std::function
+#include <iosfwd>		// std::ostream
+#include <string>		// std::string
+#include <vector>		// std::vector
+
+namespace bench
+{
+	/// \brief	What a benchmark needs to run, 'run' is called once per iteration and
+	///			everything that should not be measured (parsing the script, binding
+	///			functions...) needs to be done before returning the workload.
+	struct Workload
+	{
+		std::function<void()> run;
+
+		/// Bytes processed by each call to 'run', used to report throughput (i.e. MB/s
+		///	when parsing), zero if throughput does not make sense for the benchmark.
+		std::size_t bytes_per_run{ 0 };
+	};
+
+	struct Config
+	{
+		/// Runs every benchmark only once, used to check that they still work.
+		bool quick{ false };
+		/// Only benchmarks whose name contains this string are run.
+		std::string filter;
+		/// Minimum time each sample needs to take, iterations are doubled until reached.
+		double min_sample_seconds{ 0.05 };
+		/// Number of timed samples per benchmark, the reported values are taken from them.
+		std::size_t samples{ 5 };
+	};
+
+	struct Result
+	{
+		std::string name;
+		std::size_t iterations{ 0 };	///< iterations per sample
+		std::size_t samples{ 0 };
+		double min_ns{ 0.0 };			///< fastest sample, nanoseconds per iteration
+		double median_ns{ 0.0 };		///< median sample, nanoseconds per iteration
+		std::size_t bytes_per_run{ 0 };
+		double mb_per_second{ 0.0 };	///< computed from the median, zero if there are no bytes
+	};
+
+	class Registry
+	{
+	public:
+		using workload_factory = std::function<Workload()>;
+
+		/// \brief	Benchmark names are hierarchical, separated by '/' (i.e. "parse/flat/1000").
+		///			The factory is only called if the benchmark passes the filter.
+		void add(std::string name, workload_factory factory);
+
+		std::vector<Result> run(const Config & config, std::ostream & log) const;
+
+	private:
+		struct Entry
+		{
+			std::string m_name;
+			workload_factory m_factory;
+		};
+
+		std::vector<Entry> m_entries;
+	};
+
+	/// \brief	Machine readable output, so that results can be stored and compared between runs.
+	void write_json(std::ostream & os, const Config & config, const std::vector<Result> & results);
+	void write_csv(std::ostream & os, const std::vector<Result> & results);
+}
@@ -0,0 +1,237 @@
+
+#include "ScriptGenerator.h"
+
+#include <array>	// std::array
+
+namespace bench
+{
+	std::uint32_t Random::next()
+	{
+		// xorshift32
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+	std::size_t Random::next(std::size_t max)
+	{
+		return static_cast<std::size_t>(next()) % max;
+	}
+
+	namespace
+	{
+		static const std::array<const char *, 8u> s_variables =
+		{
+			"a", "b", "count", "value_1", "total", "idx", "speed", "result"
+		};
+		static const std::array<const char *, 10u> s_operators =
+		{
+			"+", "-", "*", "/", "%", "<", ">=", "==", "&&", "|"
+		};
+		static const std::array<const char *, 5u> s_compound_operators =
+		{
+			"+=", "-=", "*=", "/=", "<<="
+		};
+
+		class ScriptWriter
+		{
+		public:
+			explicit ScriptWriter(std::uint32_t seed) : m_rand{ seed } {}
+
+			const char * variable() { return s_variables[m_rand.next(s_variables.size())]; }
+
+			void value()
+			{
+				switch (m_rand.next(5))
+				{
+					case 0:	m_script += std::to_string(m_rand.next(1000));	break;
+					case 1:	m_script += std::to_string(m_rand.next(100)) + "." + std::to_string(m_rand.next(100));	break;
+					case 2:	m_script += m_rand.next(2) ? "true" : "false";	break;
+					case 3:	m_script += variable();	break;
+					case 4:	m_script += "\"str_" + std::to_string(m_rand.next(100)) + "\"";	break;
+				}
+			}
+
+			void equation(std::size_t max_operations, std::size_t depth = 0)
+			{
+				const std::size_t operations = 1 + m_rand.next(max_operations);
+				value();
+				for (std::size_t i = 0; i < operations; ++i)
+				{
+					m_script += ' ';
+					m_script += s_operators[m_rand.next(s_operators.size())];
+					m_script += ' ';
+
+					// bracketed sub-equations, limited so that equations do not grow forever
+					if (depth < 2 && m_rand.next(4) == 0)
+					{
+						m_script += '(';
+						equation(2, depth + 1);
+						m_script += ')';
+					}
+					else
+						value();
+				}
+			}
+
+			void simple_statement()
+			{
+				switch (m_rand.next(8))
+				{
+					case 0:
+						m_script += "var ";
+						m_script += variable();
+						m_script += " = ";
+						equation(3);
+						break;
+					case 1:
+						m_script += variable();
+						m_script += " = ";
+						equation(4);
+						break;
+					case 2:
+						m_script += variable();
+						m_script += ' ';
+						m_script += s_compound_operators[m_rand.next(s_compound_operators.size())];
+						m_script += ' ';
+						equation(2);
+						break;
+					case 3:
+						m_script += m_rand.next(2) ? "++" : "--";
+						m_script += variable();
+						break;
+					case 4:
+						m_script += "var v = [1, 2.5, \"three\", true, [4, 5]]";
+						break;
+					case 5:
+						m_script += variable();
+						m_script += " = v[";
+						m_script += std::to_string(m_rand.next(4));
+						m_script += "] + v[4][";
+						m_script += std::to_string(m_rand.next(2));
+						m_script += "]";
+						break;
+					case 6:
+						m_script += "foo(";
+						value();
+						m_script += ", ";
+						equation(2);
+						m_script += ")";
+						break;
+					case 7:
+						m_script += variable();
+						m_script += " = v.size() + obj.member.get(";
+						value();
+						m_script += ")";
+						break;
+				}
+				new_line();
+			}
+
+			void statement()
+			{
+				switch (m_rand.next(8))
+				{
+					case 0:
+						if_statement();
+						break;
+					case 1:
+						m_script += "while (";
+						equation(2);
+						m_script += ") ";
+						simple_statement();
+						break;
+					case 2:
+						m_script += "for (var i = 0; i < ";
+						m_script += std::to_string(m_rand.next(100));
+						m_script += "; ++i) ";
+						simple_statement();
+						break;
+					case 3:
+						m_script += "// comment number ";
+						m_script += std::to_string(m_rand.next(1000));
+						new_line();
+						break;
+					default:
+						simple_statement();
+						break;
+				}
+			}
+
+			void if_statement()
+			{
+				m_script += "if (";
+				equation(2);
+				m_script += ") ";
+				simple_statement();
+				if (m_rand.next(2))
+				{
+					m_script += "else ";
+					simple_statement();
+				}
+			}
+
+			void open_nested_scope()
+			{
+				switch (m_rand.next(3))
+				{
+					case 0:	m_script += "if (";	equation(2);	m_script += ")";	break;
+					case 1:	m_script += "while (";	equation(2);	m_script += ")";	break;
+					case 2:	m_script += "for (var i = 0; i < 10; i++)";	break;
+				}
+				m_script += " {";
+				++m_indentation;
+				new_line();
+			}
+			void close_nested_scope()
+			{
+				--m_indentation;
+				m_script.pop_back();	// remove the indentation of the last new line
+				m_script += "}";
+				new_line();
+			}
+
+			void new_line()
+			{
+				m_script += '\n';
+				m_script.append(m_indentation, '\t');
+			}
+
+			std::string m_script;
+
+		private:
+			Random m_rand;
+			std::size_t m_indentation{ 0 };
+		};
+	}
+
+	std::string generate_flat_script(std::size_t statements, std::uint32_t seed)
+	{
+		ScriptWriter writer{ seed };
+		for (std::size_t i = 0; i < statements; ++i)
+			writer.statement();
+
+		return std::move(writer.m_script);
+	}
+
+	std::string generate_nested_script(std::size_t depth, std::size_t statements_per_level,
+									   std::uint32_t seed)
+	{
+		ScriptWriter writer{ seed };
+
+		for (std::size_t level = 0; level < depth; ++level)
+		{
+			for (std::size_t i = 0; i < statements_per_level; ++i)
+				writer.simple_statement();
+			writer.open_nested_scope();
+		}
+
+		for (std::size_t i = 0; i < statements_per_level; ++i)
+			writer.simple_statement();
+
+		for (std::size_t level = 0; level < depth; ++level)
+			writer.close_nested_scope();
+
+		return std::move(writer.m_script);
+	}
+}
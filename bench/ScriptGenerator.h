@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>	// std::size_t
+#include <cstdint>	// std::uint32_t
+#include <string>	// std::string
+
+namespace bench
+{
+	/// \brief	Small deterministic pseudo random generator, the std distributions are
+	///			implementation defined so they would generate different scripts depending
+	///			on the standard library, this one generates the same ones everywhere.
+	class Random
+	{
+	public:
+		explicit Random(std::uint32_t seed) : m_state{ seed ? seed : 1u } {}
+
+		std::uint32_t next();
+		/// \return	A value in the range [0, max)
+		std::size_t next(std::size_t max);
+
+	private:
+		std::uint32_t m_state;
+	};
+
+	/// \brief	Generates a script with 'statements' top level statements, mixes declarations,
+	///			equations, ifs, loops, vectors, function calls and comments.
+	///			The generated script is meant to be parsed, not evaluated.
+	std::string generate_flat_script(std::size_t statements, std::uint32_t seed);
+
+	/// \brief	Generates a script where scopes are nested 'depth' times (using ifs, whiles and fors),
+	///			each level contains 'statements_per_level' statements besides the nested scope.
+	///			The generated script is meant to be parsed, not evaluated.
+	std::string generate_nested_script(std::size_t depth, std::size_t statements_per_level,
+									   std::uint32_t seed);
+}
@@ -0,0 +1,526 @@
+
+#include "Benchmark.h"
+#include "ScriptGenerator.h"
+
+#include "Parse/Parser.h"				// parse::Parser
+#include "Runtime/FlatTree.h"			// ast::FlatTree
+#include "Runtime/DispatchEngine.h"		// runtime::DispatchEngine
+
+#include <algorithm>	// std::max
+#include <cstring>		// std::strncmp
+#include <fstream>		// std::ofstream
+#include <iostream>		// std::cout, std::cerr
+#include <memory>		// std::shared_ptr
+
+namespace
+{
+	/// Seed used by all the generated scripts, changing it changes the workloads.
+	static const std::uint32_t s_seed = 2017u;
+
+	/// \brief	Holds everything an evaluation benchmark needs, the engine and the already
+	///			parsed script, so that only the evaluation is measured.
+	struct ParsedScript
+	{
+		runtime::DispatchEngine m_engine;
+		std::unique_ptr<ast::ASTNode> m_root;
+	};
+
+	template <typename BindFn>
+	std::shared_ptr<ParsedScript> make_parsed_script(const std::string & script, BindFn bind)
+	{
+		auto parsed = std::make_shared<ParsedScript>();
+		bind(parsed->m_engine);
+
+		parse::Parser parser;
+		parser.parse(script);
+		parsed->m_root = parser.get_root();
+		return parsed;
+	}
+
+	template <typename BindFn>
+	bench::Workload make_evaluation_workload(const std::string & script, BindFn bind)
+	{
+		auto parsed = make_parsed_script(script, bind);
+
+		bench::Workload workload;
+		workload.run = [parsed]() { parsed->m_engine.evaluate(*parsed->m_root); };
+		return workload;
+	}
+	bench::Workload make_evaluation_workload(const std::string & script)
+	{
+		return make_evaluation_workload(script, [](runtime::DispatchEngine &) {});
+	}
+	/// \brief	As make_evaluation_workload, with the types of the script inferred after parsing.
+	bench::Workload make_typed_evaluation_workload(const std::string & script)
+	{
+		auto parsed = make_parsed_script(script, [](runtime::DispatchEngine &) {});
+		ast::infer_types(parsed->m_root, parsed->m_engine);
+
+		bench::Workload workload;
+		workload.run = [parsed]() { parsed->m_engine.evaluate(*parsed->m_root); };
+		return workload;
+	}
+	/// \brief	As make_evaluation_workload, evaluating the script as an ast::FlatTree.
+	bench::Workload make_flat_evaluation_workload(const std::string & script)
+	{
+		auto parsed = make_parsed_script(script, [](runtime::DispatchEngine &) {});
+		auto flat = std::make_shared<ast::FlatTree>(*parsed->m_root);
+
+		bench::Workload workload;
+		workload.run = [parsed, flat]() { parsed->m_engine.evaluate(*flat); };
+		return workload;
+	}
+
+	bench::Workload make_parse_workload(std::string script)
+	{
+		auto parser = std::make_shared<parse::Parser>();
+		auto source = std::make_shared<std::string>(std::move(script));
+
+		bench::Workload workload;
+		workload.bytes_per_run = source->size();
+		workload.run = [parser, source]()
+		{
+			parser->parse(*source);
+			parser->get_root();
+		};
+		return workload;
+	}
+
+	struct Counter
+	{
+		int add(int x) { m_count += x; return m_count; }
+		int m_count{ 0 };
+	};
+
+	int mix(int a) { return a + 1; }
+	float mix(float a) { return a * 0.5f; }
+	int mix(int a, int b) { return a * b; }
+	float mix(int a, float b) { return a * b; }
+	double scale(double a) { return a * 0.5; }
+	double scale(double a, double b) { return a * b; }
+
+	std::vector<BoxedValue> make_big_vector()
+	{
+		std::vector<BoxedValue> v;
+		v.reserve(10000);
+		for (int i = 0; i < 10000; ++i)
+			v.emplace_back(i);
+		return v;
+	}
+
+	void bind_mix(runtime::DispatchEngine & eng)
+	{
+		eng.add("mix", binds::func(static_cast<int(*)(int)>(mix)));
+		eng.add("mix", binds::func(static_cast<float(*)(float)>(mix)));
+		eng.add("mix", binds::func(static_cast<int(*)(int, int)>(mix)));
+		eng.add("mix", binds::func(static_cast<float(*)(int, float)>(mix)));
+	}
+	/// \brief	Overloads whose calls from scripts always convert their float arguments.
+	void bind_scale(runtime::DispatchEngine & eng)
+	{
+		eng.add("scale", binds::func(static_cast<double(*)(double)>(scale)));
+		eng.add("scale", binds::func(static_cast<double(*)(double, double)>(scale)));
+	}
+
+	/// \brief	Probes 100 times a call without a valid overload, as the scripts that try
+	///			calls speculatively do, 'evaluate' decides how the failure is reported.
+	template <typename EvaluateFn>
+	bench::Workload make_failed_call_workload(EvaluateFn evaluate)
+	{
+		auto parsed = make_parsed_script("mix(\"text\")", bind_mix);
+
+		bench::Workload workload;
+		workload.run = [parsed, evaluate]()
+		{
+			for (int i = 0; i < 100; ++i)
+				evaluate(parsed->m_engine, *parsed->m_root);
+		};
+		return workload;
+	}
+
+	void add_parse_benchmarks(bench::Registry & registry)
+	{
+		for (const std::size_t statements : { 100u, 1000u, 10000u })
+		{
+			registry.add("parse/flat/" + std::to_string(statements), [statements]()
+			{
+				return make_parse_workload(bench::generate_flat_script(statements, s_seed));
+			});
+		}
+
+		for (const std::size_t depth : { 4u, 16u, 64u })
+		{
+			registry.add("parse/nested/" + std::to_string(depth), [depth]()
+			{
+				return make_parse_workload(bench::generate_nested_script(depth, 8u, s_seed));
+			});
+		}
+	}
+
+	void add_evaluation_benchmarks(bench::Registry & registry)
+	{
+		static const char * const s_while_script = R"script(
+var i = 0
+while (i < 1000) ++i
+)script";
+		registry.add("eval/while_loop", []()
+		{
+			return make_evaluation_workload(s_while_script);
+		});
+		registry.add("eval/while_loop_flat", []()
+		{
+			return make_flat_evaluation_workload(s_while_script);
+		});
+
+		registry.add("eval/for_loop", []()
+		{
+			return make_evaluation_workload(R"script(
+var sum = 0
+for (var i = 0; i < 1000; ++i)
+{
+	sum += i
+}
+)script");
+		});
+
+		registry.add("eval/nested_for_loop", []()
+		{
+			return make_evaluation_workload(R"script(
+var count = 0
+for (var a = 0; a < 32; ++a)
+{
+	for (var b = 0; b < 32; ++b)
+		count += 1
+}
+)script");
+		});
+
+		static const char * const s_arithmetic_script = R"script(
+var a = 1
+var b = 2.5
+var c = 0
+for (var i = 0; i < 1000; ++i)
+{
+	a = (a * 3 + 7) % 1000
+	b = b * 0.5 + a / 2
+	c = (a << 2) ^ (i & 255)
+}
+)script";
+		registry.add("eval/arithmetic", []()
+		{
+			return make_evaluation_workload(s_arithmetic_script);
+		});
+		registry.add("eval/arithmetic_typed", []()
+		{
+			return make_typed_evaluation_workload(s_arithmetic_script);
+		});
+
+		registry.add("eval/string_compare", []()
+		{
+			return make_evaluation_workload(R"script(
+var name = "player"
+var hits = 0
+for (var i = 0; i < 1000; ++i)
+{
+	if (name == "player") hits += 1
+}
+)script");
+		});
+
+		registry.add("eval/vector_access", []()
+		{
+			return make_evaluation_workload(R"script(
+var v = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]
+var sum = 0
+for (var i = 0; i < 1000; ++i)
+{
+	sum += v[i % 10]
+}
+)script");
+		});
+
+		registry.add("eval/vector_size_loop", []()
+		{
+			return make_evaluation_workload(R"script(
+var v = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]
+var sum = 0
+for (var i = 0; i < v.size(); ++i)
+{
+	sum += v[i]
+}
+)script");
+		});
+
+		registry.add("eval/loop_invariant_call", []()
+		{
+			return make_evaluation_workload(R"script(
+var v = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]
+var scale = 3
+var sum = 0
+for (var i = 0; i < 1000; ++i)
+{
+	sum += v[i % v.size()] * scale
+}
+)script");
+		});
+
+		registry.add("eval/member_call", []()
+		{
+			return make_evaluation_workload(R"script(
+var counter = Counter()
+for (var i = 0; i < 1000; ++i)
+{
+	counter.add(1)
+}
+)script", [](runtime::DispatchEngine & eng)
+			{
+				eng.add("Counter", binds::ctor<Counter()>());
+				eng.add("add", binds::func(&Counter::add));
+			});
+		});
+
+		// same body, one leaves the loop with its condition and the other with a break,
+		// an early exit needs to cost the same as a normal iteration
+		registry.add("eval/while_condition_exit", []()
+		{
+			return make_evaluation_workload(R"script(
+var i = 0
+while (i < 1000) {
+	++i
+	if (i == 2000) { break }
+}
+)script");
+		});
+
+		registry.add("eval/while_break_exit", []()
+		{
+			return make_evaluation_workload(R"script(
+var i = 0
+while (true) {
+	++i
+	if (i == 1000) { break }
+}
+)script");
+		});
+
+		registry.add("eval/for_continue", []()
+		{
+			return make_evaluation_workload(R"script(
+var sum = 0
+for (var i = 0; i < 1000; ++i)
+{
+	if (i % 2 == 0) { continue }
+	sum += i
+}
+)script");
+		});
+
+		registry.add("eval/string_literal_compare", []()
+		{
+			return make_evaluation_workload(R"script(
+var s = "a string long enough to not fit in the small string buffer"
+var n = 0
+for (var i = 0; i < 1000; ++i)
+{
+	if (s == "a string long enough to not fit in the small string buffer") { ++n }
+}
+)script");
+		});
+
+		registry.add("eval/copy_big_vector", []()
+		{
+			return make_evaluation_workload(R"script(
+def count(v) { return v.size() }
+var big = make_big_vector()
+var r = 0
+for (var i = 0; i < 100; ++i)
+{
+	var copy = big
+	r = count(copy)
+}
+)script", [](runtime::DispatchEngine & eng)
+			{
+				eng.add("make_big_vector", binds::func(make_big_vector));
+			});
+		});
+
+		registry.add("eval/script_function_call", []()
+		{
+			return make_evaluation_workload(R"script(
+def add(a, b)
+{
+	var sum = a + b
+	return sum
+}
+var r = 0
+for (var i = 0; i < 1000; ++i)
+{
+	r = add(r, i)
+}
+)script");
+		});
+
+		registry.add("eval/script_recursion", []()
+		{
+			return make_evaluation_workload(R"script(
+def fib(n)
+{
+	if (n < 2) { return n }
+	return fib(n - 1) + fib(n - 2)
+}
+var r = fib(15)
+)script");
+		});
+
+		registry.add("eval/overloaded_global_call", []()
+		{
+			return make_evaluation_workload(R"script(
+var r = 0
+for (var i = 0; i < 1000; ++i)
+{
+	r = mix(i)
+	r = mix(i, 2)
+	mix(i, 0.5)
+}
+)script", bind_mix);
+		});
+
+		registry.add("eval/overloaded_converted_call", []()
+		{
+			return make_evaluation_workload(R"script(
+var f = 1.5
+for (var i = 0; i < 1000; ++i)
+{
+	scale(f)
+	scale(f, 2.0)
+}
+)script", bind_scale);
+		});
+
+		registry.add("eval/failed_call_exception", []()
+		{
+			return make_failed_call_workload([](runtime::DispatchEngine & eng, ast::ASTNode & root)
+			{
+				try { eng.evaluate(root); }
+				catch (const except::RuntimeException &) {}
+			});
+		});
+
+		registry.add("eval/failed_call_error_code", []()
+		{
+			return make_failed_call_workload([](runtime::DispatchEngine & eng, ast::ASTNode & root)
+			{
+				eng.try_evaluate(root);
+			});
+		});
+	}
+
+	void add_engine_benchmarks(bench::Registry & registry)
+	{
+		registry.add("engine/construction", []()
+		{
+			bench::Workload workload;
+			workload.run = []() { runtime::DispatchEngine eng; };
+			return workload;
+		});
+		registry.add("engine/fork", []()
+		{
+			// an image with many globals, forking must not depend on their number
+			auto parsed = make_parsed_script(R"script(
+var i = 0
+while (i < 1000) { i += 1 }
+def add(a, b) { return a + b }
+)script", [](runtime::DispatchEngine &) {});
+			for (int i = 0; i < 1000; ++i)
+				parsed->m_engine.add("global_" + std::to_string(i), binds::GlobalVariableBinding{ BoxedValue{ i } });
+			parsed->m_engine.evaluate(*parsed->m_root);
+			std::shared_ptr<const runtime::EngineImage> image = parsed->m_engine.snapshot();
+
+			bench::Workload workload;
+			workload.run = [image]() { runtime::DispatchEngine eng{ image }; };
+			return workload;
+		});
+	}
+
+	bool parse_argument(const char * arg, const char * name, std::string & value)
+	{
+		const std::size_t length = std::strlen(name);
+		if (std::strncmp(arg, name, length) != 0 || arg[length] != '=')
+			return false;
+
+		value = arg + length + 1;
+		return true;
+	}
+
+	void print_usage()
+	{
+		std::cerr <<
+			"usage: scripting_bench [options]\n"
+			"  --filter=<str>    only run benchmarks whose name contains <str>\n"
+			"  --format=json|csv output format (default json)\n"
+			"  --out=<file>      file where the results are written, '-' for stdout (default)\n"
+			"  --samples=<n>     timed samples per benchmark (default 5)\n"
+			"  --quick           run each benchmark once, for checking they still work\n";
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	bench::Config config;
+	std::string format = "json";
+	std::string out = "-";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string value;
+		if (std::strcmp(argv[i], "--quick") == 0)			config.quick = true;
+		else if (parse_argument(argv[i], "--filter", value))	config.filter = value;
+		else if (parse_argument(argv[i], "--format", value))	format = value;
+		else if (parse_argument(argv[i], "--out", value))		out = value;
+		else if (parse_argument(argv[i], "--samples", value))	config.samples = std::max<std::size_t>(1u, std::stoul(value));
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (format != "json" && format != "csv")
+	{
+		print_usage();
+		return 1;
+	}
+
+	bench::Registry registry;
+	add_parse_benchmarks(registry);
+	add_evaluation_benchmarks(registry);
+	add_engine_benchmarks(registry);
+
+	std::vector<bench::Result> results;
+	try
+	{
+		results = registry.run(config, std::cerr);
+	}
+	catch (const std::exception & ex)
+	{
+		std::cerr << "benchmark failed: " << ex.what() << '\n';
+		return 1;
+	}
+
+	std::ofstream file;
+	if (out != "-")
+	{
+		file.open(out);
+		if (!file)
+		{
+			std::cerr << "cannot open output file '" << out << "'\n";
+			return 1;
+		}
+	}
+	std::ostream & os = (out != "-") ? static_cast<std::ostream &>(file) : std::cout;
+
+	if (format == "json")	bench::write_json(os, config, results);
+	else					bench::write_csv(os, results);
+
+	return 0;
+}
@@ -1,11 +1,12 @@
 #pragma once
 
 class BoxedValue;
-enum OperatorType;
+enum OperatorType : int;
 
 namespace ast
 {
 	class ASTNode;
+	class ProfiledNode;
 }
 
 namespace parse
@@ -19,6 +20,13 @@ namespace runtime
 {
 	class Stack;
 	class DispatchEngine;
+	class Profiler;
+	class ScriptFunction;
+
+	namespace jit
+	{
+		class CompiledLoop;
+	}
 }
 
 namespace bindings
@@ -18,6 +18,7 @@ namespace parse
 		void parse_variable_impl(const char *, std::size_t, bool) override {}
 		void parse_bool_value_impl(bool) override {}
 		void tie_assignment_operator_impl() override {}
+		void begin_scope_impl() override {}
 		void tie_scope_impl(std::size_t) override {}
 		void tie_if_impl(bool) override {}
 		void tie_while_impl() override {}
@@ -27,6 +28,12 @@ namespace parse
 		void tie_global_function_call_impl(const char *, std::size_t, std::size_t) override {}
 		void tie_member_function_call_impl(const char *, std::size_t, std::size_t) override {}
 		void parse_member_variable_impl(const char *, std::size_t) override {}
+		void parse_function_def_impl(const char *, std::size_t) override {}
+		void parse_function_param_impl(const char *, std::size_t) override {}
+		void tie_function_def_impl(std::size_t) override {}
+		void tie_return_impl(bool) override {}
+		void parse_break_impl() override {}
+		void parse_continue_impl() override {}
 	};
 }
 
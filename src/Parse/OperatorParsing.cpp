@@ -3,6 +3,7 @@
 
 #include <vector>	// std::vector
 #include <array>	// std::array
+#include <algorithm>	// std::find
 
 namespace
 {
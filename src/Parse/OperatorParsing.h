@@ -1,7 +1,7 @@
 #pragma once
 
-#include "Runtime\OperatorType.h"
-#include "Parse\StaticString.h"
+#include "Runtime/OperatorType.h"
+#include "Parse/StaticString.h"
 
 namespace parse
 {
@@ -2,8 +2,8 @@
 #include "Parser.h"
 
 #include "Alphabet.h"				// parser::Alphabet
-#include "Runtime\OperatorType.h"	// OperatorType
-#include "Parse\OperatorParsing.h"	// parser::get_operator_type
+#include "Runtime/OperatorType.h"	// OperatorType
+#include "Parse/OperatorParsing.h"	// parser::get_operator_type
 
 namespace parse
 {
@@ -23,13 +23,28 @@ namespace parse
 		return ast::make_statements(std::move(m_nodes));
 	}
 
+	void Parser::set_profiling(bool enabled)
+	{
+		m_profiling = enabled;
+	}
+
+	void Parser::define_constant(std::string name, BoxedValue value)
+	{
+		m_constants[std::move(name)] = std::move(value);
+	}
+
 	void Parser::reset_impl()
 	{
 		m_nodes.clear();
+		m_functions.clear();
+		m_block_declarations.clear();
+		m_scope_lines.clear();
+		m_first_line = 0;
+		m_last_constant = nullptr;
 	}
 	void Parser::parse_character_impl(char c)
 	{
-		push_node(ast::make_value(c));
+		push_node(ast::make_value(c), "value");
 	}
 	void Parser::parse_number_impl()
 	{
@@ -38,12 +53,12 @@ namespace parse
 			case parse::NumericValueType::INT:
 			{
 				const int i = parse::parse_integer(get_current_location());
-				push_node(ast::make_value(i));
+				push_node(ast::make_value(i), "value");
 			} break;
 			case parse::NumericValueType::FLOAT:
 			{
 				const float f = parse::parse_floating_point(get_current_location());
-				push_node(ast::make_value(f));
+				push_node(ast::make_value(f), "value");
 			} break;
 		}
 
@@ -53,23 +68,75 @@ namespace parse
 		// unary plus has no effect
 		if (op != OperatorType::UNARY_PLUS)
 		{
+			// the constant was replaced by its value, the increment would be lost
+			if (op <= OperatorType::PRE_DEC && m_last_constant && m_nodes.back().get() == m_last_constant)
+				throw std::runtime_error{ "Incrementing the constant " + m_last_constant_name };
+
 			if (::parse::is_unary_operator(op))
-				push_node(ast::make_unary_operator(op, pop_last_node()));
+				push_node(ast::make_unary_operator(op, pop_last_node()), get_operator_str(op).c_str());
 			else
 				push_node(ast::make_operator(op));
 		}
 	}
 	void Parser::parse_variable_impl(const char * str, std::size_t count, bool declaration)
 	{
-		push_node(ast::make_named_variable(std::string{ str, count }, declaration));
+		std::string name{ str, count };
+		std::string label = (declaration ? "var " : "") + name;
+		m_last_constant = nullptr;
+
+		// the locals of the function being parsed hide the constants
+		const auto constant = m_constants.find(name);
+		if (constant != m_constants.end() &&
+			(m_functions.empty() || !m_functions.back().find_local(name)))
+		{
+			if (declaration)
+				throw std::runtime_error{ "Declaring a variable with the name of the constant " + name };
+
+			// the constant is replaced by its value, an assignment would be lost
+			const OperatorType next = ::parse::get_operator_type(advance_while<::parse::is_space>(str + count));
+			if (next == OperatorType::POST_INC || next == OperatorType::POST_DEC ||
+				(next >= OperatorType::EQ && next < OperatorType::MAX_TYPES))
+				throw std::runtime_error{ "Assigning the constant " + name };
+
+			push_node(std::make_unique<ast::Value>(BoxedValue{ constant->second }), std::move(label));
+			m_last_constant = m_nodes.back().get();
+			m_last_constant_name = constant->first;
+			return;
+		}
+
+		if (m_functions.empty())
+		{
+			if (declaration && !m_block_declarations.empty())
+				++m_block_declarations.back();
+			push_node(ast::make_named_variable(std::move(name), declaration), std::move(label));
+		}
+		else if (declaration)
+		{
+			const std::size_t slot = m_functions.back().declare_local(std::move(name));
+			push_node(ast::make_local_variable(slot, true), std::move(label));
+		}
+		else if (const std::size_t * slot = m_functions.back().find_local(name))
+			push_node(ast::make_local_variable(*slot), std::move(label));
+		else
+		{
+			// the frame of the enclosing functions is not the one of the call, functions
+			// do not capture
+			for (auto function = m_functions.rbegin() + 1; function != m_functions.rend(); ++function)
+			{
+				if (function->find_local(name))
+					throw std::runtime_error{ "Using the local variable " + name + " of the enclosing function " +
+											  function->m_name + " in " + m_functions.back().m_name };
+			}
+			push_node(ast::make_top_level_variable(std::move(name)), std::move(label));
+		}
 	}
 	void Parser::parse_bool_value_impl(bool value)
 	{
-		push_node(ast::make_value(value));
+		push_node(ast::make_value(value), "value");
 	}
 	void Parser::parse_string_impl(const char * str, std::size_t count)
 	{
-		push_node(ast::make_value(std::string{ str, count }));
+		push_node(ast::make_value(std::string{ str, count }), "value");
 	}
 
 	void Parser::tie_equation_impl(std::size_t operations)
@@ -95,19 +162,54 @@ namespace parse
 		//			/		\
 		//		variable	value
 		auto new_op = ast::make_operator(OperatorType::EQ);
+		set_first_line(**std::prev(back_it));
 		new_op->set_operands(std::move(*std::prev(back_it)),
 							 std::move(*back_it));
 
 		// put the '=' node at the end
 		m_nodes.pop_back();
-		m_nodes.back() = std::move(new_op);
+		m_nodes.back() = make_profiled(std::move(new_op), "=");
+	}
+	void Parser::begin_scope_impl()
+	{
+		m_scope_lines.push_back(get_curr_line_num());
+
+		if (!m_functions.empty())
+			m_functions.back().m_blocks.emplace_back();
+		else
+			m_block_declarations.push_back(0);
 	}
 	void Parser::tie_scope_impl(std::size_t statement_num)
 	{
-		if (statement_num > 0)
-			push_node(ast::make_scope(pop_last_nodes(statement_num)));
+		// the variables of a function already have their own slot, the scopes inside functions
+		// and the ones that declare no variable don't need to push scopes into the stack
+		bool needs_scope = false;
+		if (!m_functions.empty())
+		{
+			m_functions.back().m_blocks.pop_back();
+		}
 		else
+		{
+			needs_scope = m_block_declarations.back() > 0;
+			m_block_declarations.pop_back();
+		}
+
+		const std::size_t scope_line = m_scope_lines.back();
+		m_scope_lines.pop_back();
+		if (statement_num == 0)
+		{
 			push_node(ast::make_noop());
+			return;
+		}
+
+		auto statements = pop_last_nodes(statement_num);
+		// the scope starts at its '{', not at its first statement
+		if (m_profiling)
+			m_first_line = scope_line;
+		if (needs_scope)
+			push_node(ast::make_scope(std::move(statements)), "scope");
+		else
+			push_node(ast::make_statements(std::move(statements)), "scope");
 	}
 	void Parser::tie_if_impl(bool has_else)
 	{
@@ -116,13 +218,39 @@ namespace parse
 		auto else_ = pop_last_node_if(has_else);
 		auto statement = pop_last_node();
 		auto condition = pop_last_node();
-		push_node(ast::make_if(std::move(condition), std::move(statement), std::move(else_)));
+
+		// only the branch taken is kept when the condition is constant
+		switch (ast::impl::get_constant_condition(*condition))
+		{
+			case ast::impl::ConstantCondition::ALWAYS_TRUE:
+				push_node(std::move(statement));
+				return;
+			case ast::impl::ConstantCondition::ALWAYS_FALSE:
+				push_node(else_ ? std::move(else_) : ast::make_noop());
+				return;
+			case ast::impl::ConstantCondition::UNKNOWN:
+				break;
+		}
+		push_node(ast::make_if(std::move(condition), std::move(statement), std::move(else_)), "if");
 	}
 	void Parser::tie_while_impl()
 	{
 		auto statements = pop_last_node();
 		auto condition = pop_last_node();
-		push_node(ast::make_while(std::move(condition), std::move(statements)));
+
+		// loops that never iterate are dropped and the ones that always do need no condition
+		switch (ast::impl::get_constant_condition(*condition))
+		{
+			case ast::impl::ConstantCondition::ALWAYS_TRUE:
+				condition.reset();
+				break;
+			case ast::impl::ConstantCondition::ALWAYS_FALSE:
+				push_node(ast::make_noop());
+				return;
+			case ast::impl::ConstantCondition::UNKNOWN:
+				break;
+		}
+		push_node(ast::make_while(std::move(condition), std::move(statements)), "while");
 	}
 	void Parser::tie_for_impl(bool left, bool mid, bool right)
 	{
@@ -134,39 +262,105 @@ namespace parse
 		auto right_node = pop_last_node_if(right);
 		auto condition_node = pop_last_node_if(mid);
 		auto left_node = pop_last_node_if(left);
+
+		// as in the while, but the initialization is still evaluated
+		const auto constant = condition_node ? ast::impl::get_constant_condition(*condition_node)
+											 : ast::impl::ConstantCondition::ALWAYS_TRUE;
+		if (constant == ast::impl::ConstantCondition::ALWAYS_FALSE)
+		{
+			push_node(left_node ? std::move(left_node) : ast::make_noop());
+			return;
+		}
+		else if (constant == ast::impl::ConstantCondition::ALWAYS_TRUE)
+			condition_node.reset();
+
 		push_node(ast::make_for(std::move(left_node),
 								std::move(condition_node),
 								std::move(right_node),
-								std::move(statements)));
+								std::move(statements)), "for");
 	}
 	void Parser::tie_vector_decl_impl(std::size_t init_list_size)
 	{
-		push_node(ast::make_vector_decl(pop_last_nodes(init_list_size)));
+		push_node(ast::make_vector_decl(pop_last_nodes(init_list_size)), "[...]");
 	}
 	void Parser::tie_vector_access_impl()
 	{
 		auto index = pop_last_node();
-		push_node(ast::make_vector_access(pop_last_node(), std::move(index)));
+		push_node(ast::make_vector_access(pop_last_node(), std::move(index)), "[]");
 	}
 	void Parser::tie_global_function_call_impl(const char * fn_name, std::size_t count,
 										std::size_t param_num)
 	{
+		const std::string label = std::string{ fn_name, count } + "()";
 		if (param_num > 0)
-			push_node(ast::make_global_fn_call({ fn_name, count }, pop_last_nodes(param_num)));
+			push_node(ast::make_global_fn_call({ fn_name, count }, pop_last_nodes(param_num)), label);
 		else
-			push_node(ast::make_global_fn_call({ fn_name, count }, {}));
+			push_node(ast::make_global_fn_call({ fn_name, count }, {}), label);
 	}
 	void Parser::tie_member_function_call_impl(const char * fn_name, std::size_t count,
 											   std::size_t param_num)
 	{
+		const std::string label = '.' + std::string{ fn_name, count } + "()";
 		if (param_num > 0)
 		{
 			auto params = pop_last_nodes(param_num);
 			auto inst = pop_last_node();
-			push_node(ast::make_member_fn_call({ fn_name, count }, std::move(inst), std::move(params)));
+			push_node(ast::make_member_fn_call({ fn_name, count }, std::move(inst), std::move(params)), label);
 		}
 		else
-			push_node(ast::make_member_fn_call({ fn_name, count }, pop_last_node(), {}));
+			push_node(ast::make_member_fn_call({ fn_name, count }, pop_last_node(), {}), label);
+	}
+
+	void Parser::parse_function_def_impl(const char * fn_name, std::size_t count)
+	{
+		// the first block holds the parameters
+		m_functions.emplace_back();
+		m_functions.back().m_name.assign(fn_name, count);
+		m_functions.back().m_blocks.emplace_back();
+	}
+	void Parser::parse_function_param_impl(const char * param_name, std::size_t count)
+	{
+		m_functions.back().declare_local({ param_name, count });
+	}
+	void Parser::tie_function_def_impl(std::size_t param_num)
+	{
+		auto body = pop_last_node();
+		FunctionContext context = std::move(m_functions.back());
+		m_functions.pop_back();
+
+		const std::string label = "def " + context.m_name;
+		push_node(ast::make_function_definition(std::move(context.m_name), param_num,
+												context.m_local_num, std::move(body)), label);
+	}
+	void Parser::tie_return_impl(bool has_value)
+	{
+		push_node(ast::make_return(pop_last_node_if(has_value)), "return");
+	}
+	void Parser::parse_break_impl()
+	{
+		push_node(ast::make_break(), "break");
+	}
+	void Parser::parse_continue_impl()
+	{
+		push_node(ast::make_continue(), "continue");
+	}
+
+	std::size_t Parser::FunctionContext::declare_local(std::string && name)
+	{
+		m_blocks.back().emplace_back(std::move(name), m_local_num);
+		return m_local_num++;
+	}
+	const std::size_t * Parser::FunctionContext::find_local(const std::string & name) const
+	{
+		for (auto block = m_blocks.rbegin(); block != m_blocks.rend(); ++block)
+		{
+			for (auto local = block->rbegin(); local != block->rend(); ++local)
+			{
+				if (local->first == name)
+					return &local->second;
+			}
+		}
+		return nullptr;
 	}
 
 	std::vector<std::unique_ptr<ast::ASTNode>> Parser::pop_last_nodes(std::size_t n)
@@ -175,6 +369,7 @@ namespace parse
 		temp.reserve(n);
 
 		auto first = std::prev(m_nodes.end(), n);
+		if (n > 0)	set_first_line(**first);
 		std::move(first, m_nodes.end(), std::back_inserter(temp));
 		m_nodes.erase(first, m_nodes.end());
 		return temp;
@@ -183,6 +378,7 @@ namespace parse
 	{
 		auto last = std::move(m_nodes.back());
 		m_nodes.pop_back();
+		set_first_line(*last);
 		return last;
 	}
 	std::unique_ptr<ast::ASTNode> Parser::pop_last_node_if(bool b)
@@ -194,6 +390,33 @@ namespace parse
 	void Parser::push_node(std::unique_ptr<ast::ASTNode>&& node)
 	{
 		m_nodes.emplace_back(std::move(node));
+		m_first_line = 0;
+	}
+	void Parser::push_node(std::unique_ptr<ast::ASTNode> && node, std::string label)
+	{
+		m_nodes.emplace_back(make_profiled(std::move(node), std::move(label)));
+	}
+	std::unique_ptr<ast::ASTNode> Parser::make_profiled(std::unique_ptr<ast::ASTNode> && node,
+														std::string && label)
+	{
+		if (!m_profiling)
+			return std::move(node);
+
+		const std::size_t line = m_first_line != 0 ? m_first_line : get_curr_line_num();
+		m_first_line = 0;
+		return ast::make_profiled(std::move(node), line, std::move(label));
+	}
+	void Parser::set_first_line(const ast::ASTNode & node)
+	{
+		// nodes are popped from the back, so the last one popped is the first in the script,
+		// but some of them may have no line (i.e. noops)
+		if (!m_profiling)	return;
+
+		if (const auto * profiled = dynamic_cast<const ast::ProfiledNode *>(&node))
+		{
+			if (m_first_line == 0 || profiled->get_line() < m_first_line)
+				m_first_line = profiled->get_line();
+		}
 	}
 
 	std::size_t Parser::tie_equation_precedence(std::size_t preferece, std::size_t remaining_opers)
@@ -219,9 +442,11 @@ namespace parse
 				// merge the operation into one node, if we have nodes (A B C D) and 
 				// we are processing (A B C), we would merge (A B C) in E and end up 
 				// with (E X X D), where X are empty nodes
+				set_first_line(**std::prev(it));
 				pOper->set_operands(std::move(*std::prev(it)),
 									std::move(*std::next(it)));
-				*std::prev(it) = std::move(*it);
+				*std::prev(it) = make_profiled(std::move(*it),
+											   get_operator_str(pOper->get_operator_type()).c_str());
 
 				// move the empty nodes to the end, after this the nodes would be (E D X X)
 				std::move(std::next(it, 2), m_nodes.end(), it);
@@ -2,7 +2,9 @@
 
 #include "ParserBase.h"
 
-#include "Runtime\AST.h"	// namespace ast
+#include "Runtime/AST.h"	// namespace ast
+
+#include <unordered_map>	// std::unordered_map
 
 namespace parse
 {
@@ -11,6 +13,17 @@ namespace parse
 	public:
 		std::unique_ptr<ast::ASTNode> get_root();
 
+		/// \brief	When enabled the nodes of the following parsed scripts are wrapped in
+		///			ast::ProfiledNode, tagged with the line where they start, so that a
+		///			runtime::Profiler can measure them. Disabled by default.
+		void set_profiling(bool enabled);
+		/// \brief	The following parsed scripts read 'value' where they use a variable named
+		///			'name' (i.e. flags as DEBUG), so the branches they decide are pruned when
+		///			parsing. Constants cannot be declared, assigned nor incremented by the
+		///			scripts (std::runtime_error is thrown when parsing), and the locals of the
+		///			functions hide them.
+		void define_constant(std::string name, BoxedValue value);
+
 	private:
 		void reset_impl() override;
 		void parse_character_impl(char c) override;
@@ -22,6 +35,7 @@ namespace parse
 
 		void tie_equation_impl(std::size_t operations) override;
 		void tie_assignment_operator_impl() override;
+		void begin_scope_impl() override;
 		void tie_scope_impl(std::size_t) override;
 		void tie_if_impl(bool has_else) override;
 		void tie_while_impl() override;
@@ -33,17 +47,59 @@ namespace parse
 		void tie_member_function_call_impl(const char * fn_name, std::size_t count,
 										   std::size_t param_num) override;
 		void parse_member_variable_impl(const char * fn_name, std::size_t count) override;
+		void parse_function_def_impl(const char * fn_name, std::size_t count) override;
+		void parse_function_param_impl(const char * param_name, std::size_t count) override;
+		void tie_function_def_impl(std::size_t param_num) override;
+		void tie_return_impl(bool has_value) override;
+		void parse_break_impl() override;
+		void parse_continue_impl() override;
+
+	private:
+		/// \brief	Locals of a function being parsed, each block holds the variables
+		///			declared in one of the scopes of the function and their slots.
+		struct FunctionContext
+		{
+			std::string m_name;
+			std::vector<std::vector<std::pair<std::string, std::size_t>>> m_blocks;
+			std::size_t m_local_num{ 0 };
+
+			std::size_t declare_local(std::string && name);
+			/// \brief	Searches from the innermost block, nullptr if it is not a local.
+			const std::size_t * find_local(const std::string & name) const;
+		};
 
 	private:
 		std::vector<std::unique_ptr<ast::ASTNode>> pop_last_nodes(std::size_t n);
 		std::unique_ptr<ast::ASTNode> pop_last_node();
 		std::unique_ptr<ast::ASTNode> pop_last_node_if(bool b);
 		void push_node(std::unique_ptr < ast::ASTNode > && node);
+		void push_node(std::unique_ptr<ast::ASTNode> && node, std::string label);
+		std::unique_ptr<ast::ASTNode> make_profiled(std::unique_ptr<ast::ASTNode> && node,
+													std::string && label);
+		void set_first_line(const ast::ASTNode & node);
 
 		std::size_t tie_equation_precedence(std::size_t precedence,
 											std::size_t remaining_opers);
 
 	private:
 		std::vector<std::unique_ptr<ast::ASTNode>> m_nodes;
+		/// functions being parsed, the last one is the innermost
+		std::vector<FunctionContext> m_functions;
+		/// variables declared in each of the blocks being parsed outside functions, the last one
+		/// is the innermost. Blocks that declare nothing do not need an scope in the stack.
+		std::vector<std::size_t> m_block_declarations;
+
+		std::unordered_map<std::string, BoxedValue> m_constants;
+		/// node of the constant read by the last parsed variable (nullptr if it was not a
+		/// constant) and its name, an increment right after it would modify the constant
+		const ast::ASTNode * m_last_constant{ nullptr };
+		std::string m_last_constant_name;
+
+		bool m_profiling{ false };
+		/// Line where each of the scopes being parsed opens, the last one is the innermost.
+		std::vector<std::size_t> m_scope_lines;
+		/// Line of the first node popped since the last push, zero if none. When nodes are tied
+		/// the parser is already past them, this is the line where the tied node starts.
+		std::size_t m_first_line{ 0 };
 	};
 }
@@ -16,15 +16,21 @@ namespace keywords
 	static const parse::StaticString s_else{ "else" };
 	static const parse::StaticString s_while{ "while" };
 	static const parse::StaticString s_for{ "for" };
+	static const parse::StaticString s_def{ "def" };
+	static const parse::StaticString s_return{ "return" };
+	static const parse::StaticString s_break{ "break" };
+	static const parse::StaticString s_continue{ "continue" };
 
 	bool is_keyword(const char * str)
 	{
-		static const std::array<parse::StaticString, 7u> all_keywords =
+		static const std::array<parse::StaticString, 11u> all_keywords =
 		{
 			s_var,
 			s_true, s_false,
 			s_if, s_else,
-			s_while, s_for
+			s_while, s_for,
+			s_def, s_return,
+			s_break, s_continue
 		};
 
 		for (const auto & keyword : all_keywords)
@@ -216,12 +222,16 @@ namespace parse
 	bool ParserBase::is_keyword(const StaticString & keyword) const
 	{
 		const char * const curr_loc = get_current_location();
-		const char lchar = curr_loc[keyword.size()];
 
 		// at this point we only care about the fact this word been the input keyword,
 		// error handling because the statatement is not well formed will come later
-		return keyword.same_beggining(curr_loc) &&
-			!parse::is_letter(lchar) &&
+		// NOTE: check the beggining first, if the script ends before the keyword size
+		// reading the next character would read past the end of the script
+		if (!keyword.same_beggining(curr_loc))
+			return false;
+
+		const char lchar = curr_loc[keyword.size()];
+		return !parse::is_letter(lchar) &&
 			!parse::is_number(lchar);
 	}
 
@@ -329,6 +339,22 @@ namespace parse
 	{
 		return is_function_call(get_current_location());
 	}
+	bool ParserBase::is_function_def() const
+	{
+		return is_keyword(keywords::s_def);
+	}
+	bool ParserBase::is_return() const
+	{
+		return is_keyword(keywords::s_return);
+	}
+	bool ParserBase::is_break() const
+	{
+		return is_keyword(keywords::s_break);
+	}
+	bool ParserBase::is_continue() const
+	{
+		return is_keyword(keywords::s_continue);
+	}
 
 	void ParserBase::error_if(bool b, const char * err) const
 	{
@@ -411,6 +437,10 @@ namespace parse
 		else if (is_if())		parse_if();
 		else if (is_while())	parse_while();
 		else if (is_for())		parse_for();
+		else if (is_function_def())	parse_function_def();
+		else if (is_return())	parse_return();
+		else if (is_break())	parse_break();
+		else if (is_continue())	parse_continue();
 		else if (is_scope())	parse_scope();
 		else if (is_function_call())	parse_global_function_call();
 		else if (is_variable_decl())
@@ -638,6 +668,8 @@ namespace parse
 	}
 	void ParserBase::parse_scope()
 	{
+		begin_scope_impl();
+
 		if (is_char('{'))	parse_multi_line_scope();
 		else				parse_single_line_scope();
 	}
@@ -699,7 +731,7 @@ namespace parse
 		parse_or_error(')', "While statement condition must end with ')'.");
 
 		// statements to be exexuted if condition evaluates to true
-		parse_scope();
+		parse_loop_scope();
 
 		tie_while_impl();
 	}
@@ -731,10 +763,74 @@ namespace parse
 
 		parse_or_error(')', "For statement must end with ')'.");
 		eat_all_untill_next_token();
-		parse_scope();
+		parse_loop_scope();
 
 		tie_for_impl(left, mid, right);
 	}
+	void ParserBase::parse_function_def()
+	{
+		advance(keywords::s_def.size());
+
+		error_if(!is_identifier() || is_keyword(), "Expected the function name after 'def'.");
+		const auto fn_name = get_identifier();
+		advance(fn_name.get_length());
+		parse_function_def_impl(fn_name.get_str(), fn_name.get_length());
+
+		// parameters, just their names (i.e. def foo(a, b, c))
+		parse_or_error('(', "Function parameter list needs to start with an '('");
+		std::size_t param_num = 0;
+		while (!parse_char(')'))
+		{
+			error_if(!is_identifier() || is_keyword(), "Function parameters need to be identifiers.");
+			const auto param = get_identifier();
+			parse_function_param_impl(param.get_str(), param.get_length());
+			advance(param.get_length());
+			param_num++;
+
+			if (!parse_char(','))
+				error_if(!is_char(')'), "Function parameters need to be separated by comas ','.");
+		}
+
+		eat_all_untill_next_token();
+		error_if(!is_scope(), "Function body needs to start with '{'.");
+
+		// the loops the function is defined in cannot be stopped from its body
+		const std::size_t loop_depth = m_loop_depth;
+		m_loop_depth = 0;
+		parse_scope();
+		m_loop_depth = loop_depth;
+
+		tie_function_def_impl(param_num);
+	}
+	void ParserBase::parse_return()
+	{
+		advance(keywords::s_return.size());
+
+		// a return without value ends the line or the scope
+		const bool has_value = !is_new_line() && !is_end_of_script() && !is_char('}') && !is_comment();
+		if (has_value)
+			parse_statement();
+
+		tie_return_impl(has_value);
+	}
+	void ParserBase::parse_break()
+	{
+		error_if(m_loop_depth == 0, "Found 'break' outside of a loop.");
+		advance(keywords::s_break.size());
+		parse_break_impl();
+	}
+	void ParserBase::parse_continue()
+	{
+		error_if(m_loop_depth == 0, "Found 'continue' outside of a loop.");
+		advance(keywords::s_continue.size());
+		parse_continue_impl();
+	}
+	void ParserBase::parse_loop_scope()
+	{
+		++m_loop_depth;
+		parse_scope();
+		--m_loop_depth;
+	}
 	void ParserBase::parse_vector_decl()
 	{
 		parse_char('[');
@@ -828,6 +924,7 @@ namespace parse
 		// if this is the first time we are parsing, no need to reset
 		if (m_curr)	reset();
 
+		m_loop_depth = 0;
 		m_file_contents = file_contents;
 		m_curr = m_file_contents.c_str();
 	}
@@ -136,6 +136,10 @@ namespace parse
 		bool is_while() const;
 		bool is_for() const;
 		bool is_function_call() const;
+		bool is_function_def() const;
+		bool is_return() const;
+		bool is_break() const;
+		bool is_continue() const;
 
 		bool parse_char(char c);
 		bool parse_new_line();
@@ -164,6 +168,12 @@ namespace parse
 		void parse_if();
 		void parse_while();
 		void parse_for();
+		void parse_function_def();
+		void parse_return();
+		void parse_break();
+		void parse_continue();
+		/// \brief	Parses the body of a loop, where break and continue can be used.
+		void parse_loop_scope();
 		void parse_vector_decl();
 		void parse_vector_access();
 		void parse_function_call(Identifier & ident, std::size_t & params);
@@ -218,6 +228,9 @@ namespace parse
 		///			to tie the '1 + 3' part. Then we will parse - and 4 and tie_equation(2)
 		///			will be called to parse the remaining operators * and -.
 		virtual void tie_equation_impl(std::size_t operations) = 0;
+		///	\brief	Called before parsing the statements of an scope, each call is followed by
+		///			a call to tie_scope_impl once the scope ends.
+		virtual void begin_scope_impl() = 0;
 		///	\brief	Called once all the statements in an scope have been parsed.
 		///	\param	statement_num	Number of statements inside the scope (can be zero)
 		virtual void tie_scope_impl(std::size_t statement_num) = 0;
@@ -249,6 +262,16 @@ namespace parse
 		virtual void tie_member_function_call_impl(const char * fn_name, std::size_t count,
 												   std::size_t param_num) = 0;
 		virtual void parse_member_variable_impl(const char * fn_name, std::size_t count) = 0;
+		/// \brief	Called when a function definition starts (i.e. 'def foo'), before its parameters.
+		virtual void parse_function_def_impl(const char * fn_name, std::size_t count) = 0;
+		/// \brief	Called for each of the parameters of the function being defined.
+		virtual void parse_function_param_impl(const char * param_name, std::size_t count) = 0;
+		/// \brief	Called after the body of the function has been parsed, the last node is the body.
+		virtual void tie_function_def_impl(std::size_t param_num) = 0;
+		/// \brief	Called after a return statement, if it returns a value it is the last node.
+		virtual void tie_return_impl(bool has_value) = 0;
+		virtual void parse_break_impl() = 0;
+		virtual void parse_continue_impl() = 0;
 
 	private:
 		void set_new_file_contents(const std::string & file_contents);
@@ -259,5 +282,7 @@ namespace parse
 		std::string m_file_contents;
 
 		std::size_t m_curr_line{ 1 };
+		/// loops the statement being parsed is in, break and continue are only valid inside one
+		std::size_t m_loop_depth{ 0 };
 	};
 }
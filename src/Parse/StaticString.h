@@ -33,10 +33,10 @@ namespace parse
 		const char * const m_str;
 		const std::size_t m_size;
 	};
-}
 
-inline std::ostream & operator<<(std::ostream & os, const parse::StaticString & str)
-{
-	os << str.c_str();
-	return os;
+	inline std::ostream & operator<<(std::ostream & os, const StaticString & str)
+	{
+		os << str.c_str();
+		return os;
+	}
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Operators\OperatorType.h"
+#include "Operators/OperatorType.h"
 
 #include <vector>	// std::vector
 
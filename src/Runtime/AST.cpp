@@ -1,30 +1,388 @@
 
 #include "AST.h"
 
-#include "Runtime\OperatorType.h"
+#include "Runtime/OperatorType.h"
 #include "DispatchEngine.h"	// runtime::DispatchEngine
+#include "Profiler.h"		// runtime::Profiler
+#include "Jit.h"			// runtime::jit::compile_loop
+#include "ScriptFunction.h"	// runtime::ScriptFunction
 #include "RuntimeException.h"
 
-#include "Parse\OperatorParsing.h"
+#include "Parse/OperatorParsing.h"
 
 #include "static_if.h"		// meta::static_if
 
+#include <algorithm>	// std::all_of
+#include <limits>	// std::numeric_limits
 #include <map>	// std::map
+#include <typeinfo>	// typeid
+#include <unordered_map>	// std::unordered_map
+#include <utility>	// std::pair
 
 namespace ast
 {
+	namespace impl
+	{
+		/// \brief	Returns a local value to the parent node, which belongs to the same statement,
+		///			so there is no need to move it out of the scratch arena.
+		BoxedValue pass_up(BoxedValue & bv)
+		{
+			return BoxedValue{ BoxedValueKeepBorrowed_t{}, std::move(bv) };
+		}
+
+		void LoopWrites::add(const LoopWrites & other)
+		{
+			m_names.insert(other.m_names.begin(), other.m_names.end());
+			m_slots.insert(other.m_slots.begin(), other.m_slots.end());
+			m_unknown = m_unknown || other.m_unknown;
+		}
+
+		/// \brief	Types known of the variables while ast::infer_types walks the tree, in the
+		///			order it is evaluated. Variables not in the state may store anything.
+		class TypeInference
+		{
+		public:
+			struct State
+			{
+				/// \brief	Keeps the types that are the same in both paths.
+				void join(const State & other);
+				bool operator==(const State & rhs) const
+				{
+					return m_reachable == rhs.m_reachable && m_names == rhs.m_names && m_slots == rhs.m_slots;
+				}
+
+				std::unordered_map<std::string, const TypeInfo *> m_names;	///< named variables
+				std::unordered_map<std::size_t, const TypeInfo *> m_slots;	///< locals
+				bool m_reachable{ true };	///< false after a jump, until another path joins
+			};
+
+			/// \brief	Operation found for the proven types of the operands of an operator.
+			struct Decision
+			{
+				binds::BinaryOperators::operation_fn m_fn;
+				const TypeInfo * m_lhs_type;
+				const TypeInfo * m_rhs_type;
+			};
+
+			explicit TypeInference(const runtime::DispatchEngine & en) : m_engine(en) {}
+
+			const runtime::DispatchEngine & get_engine() const { return m_engine; }
+
+			const TypeInfo * get_type(const std::string & name) const;
+			const TypeInfo * get_type(std::size_t slot) const;
+			/// \brief	Sets the type of the variable 'target' refers to, a null one forgets it.
+			///			Targets that are not variables (i.e. 'v[0]') keep their type.
+			void set_type(const ASTNode & target, const TypeInfo * type);
+			/// \brief	The variable is created empty, hiding the one with the same name until
+			///			the scope ends.
+			void declare(const std::string & name);
+			/// \brief	Called after calling functions that may assign any named variable,
+			///			locals cannot be reached from them.
+			void forget_names();
+
+			void push_scope() { m_scopes.emplace_back(); }
+			void pop_scope();
+
+			void add_break();
+			void add_continue();
+			void add_return() { m_state.m_reachable = false; }
+
+			/// \brief	Infers the types of an if, both branches join after it.
+			void infer_branches(ASTNode & statements, ASTNode * else_);
+			/// \brief	Infers the iterations of a loop until the types at their start do not
+			///			change, they only lose types so it ends. Null parts are not evaluated.
+			void infer_loop(ASTNode * condition, ASTNode & statements, ASTNode * increment);
+
+			/// \brief	A null decision leaves the operator generic, as the last time it is
+			///			inferred is the one that counts (i.e. the last iteration of a loop).
+			void decide(const BinaryOperator & op, const Decision * decision);
+			const Decision * get_decision(const BinaryOperator & op) const;
+
+			/// \brief	Bodies of the script functions defined, inferred after the tree.
+			void add_function(std::unique_ptr<ASTNode> & body);
+			std::vector<std::unique_ptr<ASTNode> *> take_functions() { return std::move(m_functions); }
+
+		private:
+			/// \brief	Names declared in a scope with the types of the variables they hid.
+			using ScopeNames = std::vector<std::pair<std::string, const TypeInfo *>>;
+
+			struct Loop
+			{
+				std::size_t m_scope_num;	///< scopes open when the loop started
+				std::vector<State> m_breaks;
+				std::vector<State> m_continues;
+			};
+
+			static void set_type(State & state, const std::string & name, const TypeInfo * type);
+			/// \brief	Restores the variables hidden by the scopes opened after the first 'scope_num'.
+			void leave_scopes(State & state, std::size_t scope_num) const;
+
+			const runtime::DispatchEngine & m_engine;
+			State m_state;
+			std::vector<ScopeNames> m_scopes;
+			std::vector<Loop> m_loops;
+			std::unordered_map<const BinaryOperator *, Decision> m_decisions;
+			std::vector<std::unique_ptr<ASTNode> *> m_functions;
+		};
+
+		void TypeInference::State::join(const State & other)
+		{
+			if (!other.m_reachable)
+				return;
+			if (!m_reachable)
+			{
+				*this = other;
+				return;
+			}
+
+			const auto keep_same = [](auto & types, const auto & other_types)
+			{
+				for (auto it = types.begin(); it != types.end();)
+				{
+					const auto other_it = other_types.find(it->first);
+					if (other_it != other_types.end() && *other_it->second == *it->second)
+						++it;
+					else
+						it = types.erase(it);
+				}
+			};
+			keep_same(m_names, other.m_names);
+			keep_same(m_slots, other.m_slots);
+		}
+
+		const TypeInfo * TypeInference::get_type(const std::string & name) const
+		{
+			const auto it = m_state.m_names.find(name);
+			return m_state.m_reachable && it != m_state.m_names.end() ? it->second : nullptr;
+		}
+		const TypeInfo * TypeInference::get_type(std::size_t slot) const
+		{
+			const auto it = m_state.m_slots.find(slot);
+			return m_state.m_reachable && it != m_state.m_slots.end() ? it->second : nullptr;
+		}
+		void TypeInference::set_type(const ASTNode & target, const TypeInfo * type)
+		{
+			const std::type_info & target_type = typeid(target);
+			if (target_type == typeid(NamedVariable))
+			{
+				set_type(m_state, static_cast<const NamedVariable &>(target).get_name(), type);
+			}
+			else if (target_type == typeid(LocalVariable))
+			{
+				const std::size_t slot = static_cast<const LocalVariable &>(target).get_slot();
+				if (type)	m_state.m_slots[slot] = type;
+				else		m_state.m_slots.erase(slot);
+			}
+			else if (target_type == typeid(ProfiledNode))
+			{
+				set_type(static_cast<const ProfiledNode &>(target).get_node(), type);
+			}
+		}
+		void TypeInference::set_type(State & state, const std::string & name, const TypeInfo * type)
+		{
+			if (type)	state.m_names[name] = type;
+			else		state.m_names.erase(name);
+		}
+		void TypeInference::declare(const std::string & name)
+		{
+			if (!m_scopes.empty())
+			{
+				ScopeNames & names = m_scopes.back();
+				const bool declared = std::any_of(names.begin(), names.end(),
+												  [&name](const auto & hidden) { return hidden.first == name; });
+				if (!declared)
+					names.emplace_back(name, get_type(name));
+			}
+
+			set_type(m_state, name, nullptr);
+		}
+		void TypeInference::forget_names()
+		{
+			m_state.m_names.clear();
+
+			// the hidden variables may be assigned through the functions too
+			for (auto & names : m_scopes)
+			{
+				for (auto & hidden : names)
+					hidden.second = nullptr;
+			}
+		}
+
+		void TypeInference::pop_scope()
+		{
+			leave_scopes(m_state, m_scopes.size() - 1);
+			m_scopes.pop_back();
+		}
+		void TypeInference::leave_scopes(State & state, std::size_t scope_num) const
+		{
+			if (!state.m_reachable)
+				return;
+
+			for (std::size_t i = m_scopes.size(); i > scope_num; --i)
+			{
+				const ScopeNames & names = m_scopes[i - 1];
+				for (auto it = names.rbegin(); it != names.rend(); ++it)
+					set_type(state, it->first, it->second);
+			}
+		}
+
+		void TypeInference::add_break()
+		{
+			if (m_state.m_reachable && !m_loops.empty())
+			{
+				m_loops.back().m_breaks.push_back(m_state);
+				leave_scopes(m_loops.back().m_breaks.back(), m_loops.back().m_scope_num);
+			}
+			m_state.m_reachable = false;
+		}
+		void TypeInference::add_continue()
+		{
+			if (m_state.m_reachable && !m_loops.empty())
+			{
+				m_loops.back().m_continues.push_back(m_state);
+				leave_scopes(m_loops.back().m_continues.back(), m_loops.back().m_scope_num);
+			}
+			m_state.m_reachable = false;
+		}
+
+		void TypeInference::infer_branches(ASTNode & statements, ASTNode * else_)
+		{
+			State before = m_state;
+			statements.infer_type(*this);
+			std::swap(before, m_state);
+			if (else_)
+				else_->infer_type(*this);
+
+			m_state.join(before);
+		}
+		void TypeInference::infer_loop(ASTNode * condition, ASTNode & statements, ASTNode * increment)
+		{
+			State start = m_state;
+			for (;;)
+			{
+				m_state = start;
+				m_loops.push_back(Loop{ m_scopes.size(), {}, {} });
+
+				if (condition)
+					condition->infer_type(*this);
+				// without condition the loop only ends with a break
+				State exit = m_state;
+				exit.m_reachable = exit.m_reachable && condition;
+
+				statements.infer_type(*this);
+				for (const State & state : m_loops.back().m_continues)
+					m_state.join(state);
+				if (increment)
+					increment->infer_type(*this);
+
+				const Loop loop = std::move(m_loops.back());
+				m_loops.pop_back();
+
+				State next_start = start;
+				next_start.join(m_state);
+				if (next_start == start)
+				{
+					m_state = std::move(exit);
+					for (const State & state : loop.m_breaks)
+						m_state.join(state);
+					return;
+				}
+				start = std::move(next_start);
+			}
+		}
+
+		void TypeInference::decide(const BinaryOperator & op, const Decision * decision)
+		{
+			if (decision && m_state.m_reachable)	m_decisions[&op] = *decision;
+			else									m_decisions.erase(&op);
+		}
+		const TypeInference::Decision * TypeInference::get_decision(const BinaryOperator & op) const
+		{
+			const auto it = m_decisions.find(&op);
+			return it != m_decisions.end() ? &it->second : nullptr;
+		}
+
+		void TypeInference::add_function(std::unique_ptr<ASTNode> & body)
+		{
+			// the definitions inside loops are inferred once per iteration inferred
+			if (std::find(m_functions.begin(), m_functions.end(), &body) == m_functions.end())
+				m_functions.push_back(&body);
+		}
+	}
+
+	void ASTNode::collect_writes(impl::LoopWrites & writes)
+	{
+		for_each_child([&writes](std::unique_ptr<ASTNode> & child) { child->collect_writes(writes); });
+	}
+	const TypeInfo * ASTNode::infer_type(impl::TypeInference & inference)
+	{
+		for_each_child([&inference](std::unique_ptr<ASTNode> & child) { child->infer_type(inference); });
+		inference.forget_names();
+		return nullptr;
+	}
+
+	namespace impl
+	{
+		/// \brief	Statements that always leave the block, the ones after them are unreachable.
+		bool is_jump(const ASTNode & node)
+		{
+			const std::type_info & type = typeid(node);
+			if (type == typeid(ProfiledNode))
+				return is_jump(static_cast<const ProfiledNode &>(node).get_node());
+
+			return type == typeid(Break) || type == typeid(Continue) || type == typeid(Return);
+		}
+	}
+
 	Statements::Statements(std::vector<std::unique_ptr<ASTNode>> && statements)
-		: m_statements{ std::move(statements) }
-	{}
+	{
+		m_statements.reserve(statements.size());
+		for (auto & statement : statements)
+		{
+			if (typeid(*statement) == typeid(Noop))
+				continue;
+
+			m_statements.push_back(std::move(statement));
+			if (impl::is_jump(*m_statements.back()))
+				break;
+		}
+	}
 	BoxedValue Statements::evaluate(runtime::DispatchEngine & en) const
 	{
 		if (m_statements.empty())	return{};
 
 		for (unsigned i = 0; i < m_statements.size() - 1; ++i)
-			m_statements[i]->evaluate(en);
+		{
+			// the value of the statement is discarded, nothing it allocated is needed anymore
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			m_statements[i]->execute(en);
+			if (en.get_completion() != runtime::Completion::NORMAL)
+				return{};
+		}
 
 		return m_statements.back()->evaluate(en);
 	}
+	void Statements::execute(runtime::DispatchEngine & en) const
+	{
+		for (const auto & statement : m_statements)
+		{
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			statement->execute(en);
+			if (en.get_completion() != runtime::Completion::NORMAL)
+				return;
+		}
+	}
+	void Statements::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		for (auto & statement : m_statements)
+			fn(statement);
+	}
+	const TypeInfo * Statements::infer_type(impl::TypeInference & inference)
+	{
+		for (auto & statement : m_statements)
+			statement->infer_type(inference);
+		return nullptr;
+	}
 
 	Scope::Scope(std::vector<std::unique_ptr<ASTNode>> && statements)
 		: Statements(std::move(statements))
@@ -34,34 +392,86 @@ namespace ast
 		auto scope = en.new_scope();
 		return Statements::evaluate(en);
 	}
+	void Scope::execute(runtime::DispatchEngine & en) const
+	{
+		auto scope = en.new_scope();
+		Statements::execute(en);
+	}
+	const TypeInfo * Scope::infer_type(impl::TypeInference & inference)
+	{
+		inference.push_scope();
+		Statements::infer_type(inference);
+		inference.pop_scope();
+		return nullptr;
+	}
 
 	BinaryOperator::BinaryOperator(OperatorType op)
 		: m_operator(op)
 	{}
 	BoxedValue BinaryOperator::evaluate(runtime::DispatchEngine & en) const
+	{
+		return evaluate_impl(en, false);
+	}
+	void BinaryOperator::execute(runtime::DispatchEngine & en) const
+	{
+		evaluate_impl(en, true);
+	}
+	BoxedValue BinaryOperator::evaluate_impl(runtime::DispatchEngine & en, bool discard_result) const
 	{
 		BoxedValue lhs = m_lhs->evaluate(en);
+		if (en.has_error())	return{};
 		BoxedValue rhs = m_rhs->evaluate(en);
-		BoxedValue & real_lhs = resolve_ref(lhs);
-		BoxedValue & real_rhs = resolve_ref(rhs);
+		if (en.has_error())	return{};
 
-		if (m_operator == OperatorType::EQ && real_lhs.empty())
+		return apply(en, lhs, rhs, discard_result);
+	}
+	BoxedValue BinaryOperator::apply(runtime::DispatchEngine & en, BoxedValue & lhs, BoxedValue & rhs,
+									 bool discard_result) const
+	{
+		return impl::apply_binary_operator(en, m_operator, lhs, rhs, discard_result);
+	}
+	BoxedValue BinaryOperator::operate(runtime::DispatchEngine & en, BoxedValue & lhs,
+									   const BoxedValue & rhs) const
+	{
+		return impl::operate(en, m_operator, lhs, rhs);
+	}
+	namespace impl
+	{
+		BoxedValue operate(runtime::DispatchEngine & en, OperatorType op, BoxedValue & lhs, const BoxedValue & rhs)
 		{
-			// we need to change the value of the variable real_lhs is storing
-			real_lhs = real_rhs;
+			const auto * fn = en.get_binary_operator(lhs.get_type_info(), op, rhs.get_type_info());
+			if (fn)
+			{
+				// only the builtin operators are known to be pure, the ones bound for the
+				// rest of the types may modify anything
+				if (!lhs.get_type_info().is_arithmetic() || !rhs.get_type_info().is_arithmetic())
+					en.count_impure_call();
+				return (*fn)(lhs, rhs);
+			}
 
-			// operator= returns *this
-			return lhs;
+			return en.set_error(except::ErrorCode::INVALID_OPERATION, "Cannot perform operation: ",
+								lhs.get_type_info().get_std_type_info().name(),
+								parse::get_operator_str(op).c_str(),
+								rhs.get_type_info().get_std_type_info().name());
 		}
+		BoxedValue apply_binary_operator(runtime::DispatchEngine & en, OperatorType op,
+										 BoxedValue & lhs, BoxedValue & rhs, bool discard_result)
+		{
+			BoxedValue & real_lhs = resolve_ref(lhs);
+			BoxedValue & real_rhs = resolve_ref(rhs);
 
-		const auto * op = en.get_binary_operator(real_lhs.get_type_info(), m_operator,
-												 real_rhs.get_type_info());
-		if (op)		return (*op)(real_lhs, real_rhs);
+			if (op == OperatorType::EQ && real_lhs.empty())
+			{
+				// we need to change the value of the variable real_lhs is storing
+				real_lhs = real_rhs;
 
-		SCR_RUNTIME_EXCEPTION("Cannot perform operation: ", 
-							  real_lhs.get_type_info().get_std_type_info().name(),
-							  parse::get_operator_str(m_operator).c_str(),
-							  real_rhs.get_type_info().get_std_type_info().name());
+				// operator= returns *this
+				if (discard_result)	return{};
+				return pass_up(lhs);
+			}
+
+			return operate(en, op, real_lhs, real_rhs);
+		}
 	}
 	void BinaryOperator::set_operands(std::unique_ptr<ASTNode> && lhs,
 									  std::unique_ptr<ASTNode> && rhs)
@@ -77,46 +487,148 @@ namespace ast
 		return (m_lhs != nullptr);
 	}
 
+	void BinaryOperator::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_lhs);
+		fn(m_rhs);
+	}
+	void BinaryOperator::collect_writes(impl::LoopWrites & writes)
+	{
+		if (modifies_lhs())
+			m_lhs->collect_assigned(writes);
+
+		ASTNode::collect_writes(writes);
+	}
+	bool BinaryOperator::is_invariant(const impl::LoopWrites & writes) const
+	{
+		// the operators bound for other than arithmetic types count as impure calls when
+		// they are evaluated (see impl::operate), so their results are not kept
+		return !modifies_lhs() && m_lhs->is_invariant(writes) && m_rhs->is_invariant(writes);
+	}
+
+	namespace impl
+	{
+		/// \brief	The builtin operators, the engines start with the same ones.
+		const binds::BinaryOperators & get_builtin_binary_operators()
+		{
+			static const binds::BinaryOperators s_operators = []
+			{
+				binds::BinaryOperators operators;
+				binds::add_default_binary_operations(operators);
+				return operators;
+			}();
+			return s_operators;
+		}
+
+		/// \brief	Divisions and modulos may be by zero and shifts may be out of range, folding
+		///			them would crash the parser in branches that are never executed.
+		bool may_trap(OperatorType op)
+		{
+			return op == OperatorType::DIV || op == OperatorType::MOD ||
+				   op == OperatorType::LEFT_SHIFT || op == OperatorType::RIGHT_SHIFT;
+		}
+	}
+
+	BoxedValue BinaryOperator::evaluate_constant() const
+	{
+		if (modifies_lhs() || impl::may_trap(m_operator))
+			return{};
+
+		BoxedValue lhs = m_lhs->evaluate_constant();
+		if (lhs.empty())	return{};
+		const BoxedValue rhs = m_rhs->evaluate_constant();
+		if (rhs.empty())	return{};
+
+		const auto * op = impl::get_builtin_binary_operators().get_operator(lhs.get_type_info(), m_operator,
+																			 rhs.get_type_info());
+		if (op)		return (*op)(lhs, rhs);
+		return{};
+	}
+	namespace impl
+	{
+		/// \brief	The variable 'node' refers to is created by it, so it is empty.
+		bool is_declaration(const ASTNode & node)
+		{
+			const std::type_info & type = typeid(node);
+			if (type == typeid(NamedVariable))
+				return static_cast<const NamedVariable &>(node).is_declaration();
+			else if (type == typeid(LocalVariable))
+				return static_cast<const LocalVariable &>(node).is_declaration();
+			else if (type == typeid(ProfiledNode))
+				return is_declaration(static_cast<const ProfiledNode &>(node).get_node());
+			return false;
+		}
+	}
+
+	const TypeInfo * BinaryOperator::infer_type(impl::TypeInference & inference)
+	{
+		const TypeInfo * lhs_type = m_lhs->infer_type(inference);
+		const TypeInfo * rhs_type = m_rhs->infer_type(inference);
+
+		const TypeInfo * result_type = nullptr;
+		const binds::BinaryOperators::operation_fn * op = nullptr;
+		if (lhs_type && rhs_type)
+		{
+			const auto & en = inference.get_engine();
+			op = en.get_binary_operator(*lhs_type, m_operator, *rhs_type);
+			result_type = en.get_binary_operator_result(*lhs_type, m_operator, *rhs_type);
+		}
+
+		const impl::TypeInference::Decision decision{ op ? *op : nullptr, lhs_type, rhs_type };
+		inference.decide(*this, op ? &decision : nullptr);
+
+		if (m_operator == OperatorType::EQ)
+		{
+			// an empty variable takes the value, the rest convert it to their type (see apply)
+			const TypeInfo * assigned = impl::is_declaration(*m_lhs) ? rhs_type : lhs_type;
+			inference.set_type(*m_lhs, assigned);
+			return assigned;
+		}
+
+		// compound assignments keep the type of the variable
+		return result_type;
+	}
+
 	namespace impl
 	{
 		template <typename T>
-		BoxedValue perform_common_unary_operation(T & x, OperatorType op)
+		BoxedValue perform_common_unary_operation(const T & x, OperatorType op)
 		{
 			switch (op)
 			{
 				case OperatorType::POST_INC:
 				case OperatorType::PRE_INC:
-					return BoxedValue{ x + 1 };
+					return BoxedValue{ BoxedValueTemporary_t{}, x + 1 };
 				case OperatorType::PRE_DEC:
 				case OperatorType::POST_DEC:
-					return BoxedValue{ x - 1 };
+					return BoxedValue{ BoxedValueTemporary_t{}, x - 1 };
 
-				case OperatorType::UNARY_MINUS:	return BoxedValue{ -x };
-				case OperatorType::LOGIC_NOT:	return BoxedValue{ !x };
+				case OperatorType::UNARY_MINUS:	return BoxedValue{ BoxedValueTemporary_t{}, -x };
+				case OperatorType::LOGIC_NOT:	return BoxedValue{ BoxedValueTemporary_t{}, !x };
 			}
 
-			SCR_RUNTIME_EXCEPTION("Invalid unary operator ", parse::get_operator_str(op));
+			return except::make_boxed_runtime_error();
 		}
 
 		template <typename T>
-		BoxedValue perform_unary_operation(T & x, OperatorType op)
+		BoxedValue perform_unary_operation(const T & x, OperatorType op)
 		{
 			return meta::static_if(std::is_same<T, bool>{})
 				.then([](auto & x, OperatorType op)
 			{
 				switch (op)
 				{
-					case OperatorType::LOGIC_NOT:	return BoxedValue{ !x };
+					case OperatorType::LOGIC_NOT:	return BoxedValue{ BoxedValueTemporary_t{}, !x };
 				}
 
-				SCR_RUNTIME_EXCEPTION("Invalid unary operator for type bool ", parse::get_operator_str(op));
+				return except::make_boxed_runtime_error();
 			})
 				.else_if(std::is_integral<T>{})
 				.then([](auto & x, OperatorType op)
 			{
 				switch (op)
 				{
-					case OperatorType::BITWISE_NOT:	return BoxedValue{ ~x };
+					case OperatorType::BITWISE_NOT:	return BoxedValue{ BoxedValueTemporary_t{}, ~x };
 				}
 
 				return perform_common_unary_operation(x, op);
@@ -127,7 +639,8 @@ namespace ast
 			})(x, op);
 		}
 
-		BoxedValue perform_unary_operation(BoxedValue & bv, OperatorType op)
+		/// \brief	Returns a boxed error if the operator cannot be used with the value.
+		BoxedValue perform_unary_operation(const BoxedValue & bv, OperatorType op)
 		{
 			const auto & typeinfo = bv.get_type_info();
 
@@ -138,7 +651,7 @@ namespace ast
 			else if (typeinfo == get_type_info<bool>())
 				return perform_unary_operation(boxed_cast<bool>(bv), op);
 
-			SCR_RUNTIME_EXCEPTION("Invalid unary operator ", parse::get_operator_str(op));
+			return except::make_boxed_runtime_error();
 		}
 	}
 
@@ -147,33 +660,124 @@ namespace ast
 		, m_variable(std::move(var))
 	{}
 	BoxedValue UnaryOperator::evaluate(runtime::DispatchEngine & en) const
+	{
+		return evaluate_impl(en, false);
+	}
+	void UnaryOperator::execute(runtime::DispatchEngine & en) const
+	{
+		evaluate_impl(en, true);
+	}
+	BoxedValue UnaryOperator::evaluate_impl(runtime::DispatchEngine & en, bool discard_result) const
 	{
 		BoxedValue bv = m_variable->evaluate(en);
-		BoxedValue & real_val = resolve_ref(bv);
-
-		if (m_operator == OperatorType::UNARY_PLUS)	return real_val;
+		if (en.has_error())	return{};
 
-		// STUDY(Borja): in here we could create less boxed values
-		// in the pre-increment and pre-decrement we could change directly the variable stored in the boxed value
-		// and avoid creating the boxed value returned by impl::preform_unary_operation
-		if (m_operator == OperatorType::PRE_DEC || m_operator == OperatorType::PRE_INC)
+		return impl::apply_unary_operator(en, m_operator, bv, discard_result);
+	}
+	namespace impl
+	{
+		BoxedValue apply_unary_operator(runtime::DispatchEngine & en, OperatorType op, BoxedValue & value,
+										bool discard_result)
 		{
-			real_val = impl::perform_unary_operation(real_val, m_operator);
-			return real_val;
+			BoxedValue & real_val = resolve_ref(value);
+
+			if (op == OperatorType::UNARY_PLUS)	return real_val;
+
+			// STUDY(Borja): in here we could create less boxed values
+			// in the pre-increment and pre-decrement we could change directly the variable stored in the boxed value
+			// and avoid creating the boxed value returned by impl::preform_unary_operation
+			BoxedValue result = perform_unary_operation(real_val, op);
+			if (except::is_boxed_error(result))
+			{
+				return en.set_error(except::ErrorCode::INVALID_OPERATION, "Invalid unary operator ",
+									parse::get_operator_str(op), " for type ",
+									real_val.get_type_info().get_bare_std_type_info().name());
+			}
+
+			if (op <= OperatorType::PRE_DEC && discard_result)
+			{
+				real_val = std::move(result);
+				return{};
+			}
+
+			if (op == OperatorType::PRE_DEC || op == OperatorType::PRE_INC)
+			{
+				real_val = std::move(result);
+				return real_val;
+			}
+			else if (op == OperatorType::POST_DEC || op == OperatorType::POST_INC)
+			{
+				auto temp = real_val;
+				real_val = std::move(result);
+				return temp;
+			}
+
+			return pass_up(result);
 		}
-		else if (m_operator == OperatorType::POST_DEC || m_operator == OperatorType::POST_INC)
+	}
+
+	void UnaryOperator::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_variable);
+	}
+	void UnaryOperator::collect_writes(impl::LoopWrites & writes)
+	{
+		if (modifies_value())
+			m_variable->collect_assigned(writes);
+
+		ASTNode::collect_writes(writes);
+	}
+	bool UnaryOperator::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return !modifies_value() && m_variable->is_invariant(writes);
+	}
+	BoxedValue UnaryOperator::evaluate_constant() const
+	{
+		if (modifies_value())	return{};
+
+		const BoxedValue value = m_variable->evaluate_constant();
+		if (value.empty())	return{};
+
+		BoxedValue result = impl::perform_unary_operation(value, m_operator);
+		if (except::is_boxed_error(result))
+			return{};
+		return result;
+	}
+	namespace impl
+	{
+		/// \brief	Type of the result of the unary operator, nullptr if it is not valid for 'type'.
+		const TypeInfo * get_unary_result_type(const TypeInfo & type, OperatorType op)
 		{
-			auto temp = real_val;
-			real_val = impl::perform_unary_operation(real_val, m_operator);
-			return temp;
+			BoxedValue sample;
+			if (type == get_type_info<int>())			sample = BoxedValue{ 0 };
+			else if (type == get_type_info<float>())	sample = BoxedValue{ 0.f };
+			else if (type == get_type_info<bool>())		sample = BoxedValue{ false };
+			else										return nullptr;
+
+			if (op == OperatorType::UNARY_PLUS)
+				return &type;
+
+			const BoxedValue result = perform_unary_operation(sample, op);
+			if (except::is_boxed_error(result))
+				return nullptr;
+			return &result.get_type_info();
 		}
+	}
 
-		return impl::perform_unary_operation(real_val, m_operator);
+	const TypeInfo * UnaryOperator::infer_type(impl::TypeInference & inference)
+	{
+		// increments and decrements keep the type of the variable
+		const TypeInfo * type = m_variable->infer_type(inference);
+		return type ? impl::get_unary_result_type(*type, m_operator) : nullptr;
 	}
 
 	BoxedValue Value::evaluate(runtime::DispatchEngine &) const
 	{
-		return BoxedValue{ m_value };
+		return BoxedValue::borrow(m_value);
+	}
+	const TypeInfo * Value::infer_type(impl::TypeInference &)
+	{
+		return m_value.empty() ? nullptr : &m_value.get_type_info();
 	}
 
 	NamedVariable::NamedVariable(std::string && name, bool declaration)
@@ -182,25 +786,237 @@ namespace ast
 	{}
 	BoxedValue NamedVariable::evaluate(runtime::DispatchEngine & en) const
 	{
+		return impl::get_named_variable(en, m_variable_name, m_declaration);
+	}
+	namespace impl
+	{
+		BoxedValue get_named_variable(runtime::DispatchEngine & en, const std::string & name, bool declaration)
+		{
+			if (declaration)
+				return make_temporary_ref(en.create_variable(name));
+
+			if (auto * var = en.get_variable(name))
+				return make_temporary_ref(*var);
+
+			return en.set_error(except::ErrorCode::UNKNOWN_VARIABLE, "Trying to get an unused variable '",
+								name, "'.");
+		}
+	}
+	void NamedVariable::collect_writes(impl::LoopWrites & writes)
+	{
+		// declared in each iteration, it may hide a variable with the same name
 		if (m_declaration)
-			return make_ref(en.create_variable(m_variable_name));
+			writes.m_names.insert(m_variable_name);
+	}
+	void NamedVariable::collect_assigned(impl::LoopWrites & writes)
+	{
+		writes.m_names.insert(m_variable_name);
+	}
+	bool NamedVariable::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return !m_declaration && !writes.writes(m_variable_name);
+	}
+	const TypeInfo * NamedVariable::infer_type(impl::TypeInference & inference)
+	{
+		if (!m_declaration)
+			return inference.get_type(m_variable_name);
+
+		inference.declare(m_variable_name);
+		return nullptr;
+	}
+
+	LocalVariable::LocalVariable(std::size_t slot, bool declaration)
+		: m_slot(slot)
+		, m_declaration(declaration)
+	{}
+	BoxedValue LocalVariable::evaluate(runtime::DispatchEngine & en) const
+	{
+		return impl::get_local_variable(en, m_slot, m_declaration);
+	}
+	namespace impl
+	{
+		BoxedValue get_local_variable(runtime::DispatchEngine & en, std::size_t slot, bool declaration)
+		{
+			BoxedValue & var = en.get_local(slot);
 
-		if (auto * var = en.get_variable(m_variable_name))
-			return make_ref(*var);
+			// a declaration inside a loop has to start empty in every iteration
+			if (declaration)
+				var = BoxedValue{};
 
-		SCR_RUNTIME_EXCEPTION("Trying to get an unused variable.");
+			return make_temporary_ref(var);
+		}
+	}
+	void LocalVariable::collect_writes(impl::LoopWrites & writes)
+	{
+		if (m_declaration)
+			writes.m_slots.insert(m_slot);
+	}
+	void LocalVariable::collect_assigned(impl::LoopWrites & writes)
+	{
+		writes.m_slots.insert(m_slot);
+	}
+	bool LocalVariable::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return !m_declaration && !writes.writes(m_slot);
+	}
+	const TypeInfo * LocalVariable::infer_type(impl::TypeInference & inference)
+	{
+		if (!m_declaration)
+			return inference.get_type(m_slot);
+
+		inference.set_type(*this, nullptr);
+		return nullptr;
+	}
+
+	TopLevelVariable::TopLevelVariable(std::string && name)
+		: m_variable_name(std::move(name))
+	{}
+	BoxedValue TopLevelVariable::evaluate(runtime::DispatchEngine & en) const
+	{
+		if (auto * var = en.get_top_level_variable(m_variable_name))
+			return make_temporary_ref(*var);
+
+		return en.set_error(except::ErrorCode::UNKNOWN_VARIABLE, "Trying to get an unused variable '",
+							m_variable_name, "'.");
+	}
+	void TopLevelVariable::collect_assigned(impl::LoopWrites & writes)
+	{
+		writes.m_names.insert(m_variable_name);
+	}
+	bool TopLevelVariable::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return !writes.writes(m_variable_name);
+	}
+
+	FunctionDefinition::FunctionDefinition(std::string && name, std::size_t param_num,
+										   std::size_t local_num, std::unique_ptr<ASTNode> && body)
+		: m_name(std::move(name))
+		, m_function(std::make_shared<runtime::ScriptFunction>(param_num, local_num, std::move(body)))
+	{}
+	BoxedValue FunctionDefinition::evaluate(runtime::DispatchEngine & en) const
+	{
+		en.define_function(m_name, m_function);
+		return{};
+	}
+	const TypeInfo * FunctionDefinition::infer_type(impl::TypeInference & inference)
+	{
+		// once added the definition may be running in an engine
+		if (m_function.use_count() == 1)
+			inference.add_function(m_function->get_body());
+		return nullptr;
+	}
+
+	Return::Return(std::unique_ptr<ASTNode> && value)
+		: m_value(std::move(value))
+	{}
+	BoxedValue Return::evaluate(runtime::DispatchEngine & en) const
+	{
+		BoxedValue result;
+		if (m_value)
+		{
+			// references to locals would outlive the frame, the value is copied
+			result = m_value->evaluate(en);
+			if (en.has_error())	return{};
+
+			const BoxedValue & real_result = resolve_ref(result);
+			if (&real_result != &result)
+				result = BoxedValue{ real_result };
+		}
+
+		en.set_return_value(std::move(result));
+		return{};
+	}
+	void Return::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		if (m_value)
+			fn(m_value);
+	}
+	const TypeInfo * Return::infer_type(impl::TypeInference & inference)
+	{
+		if (m_value)
+			m_value->infer_type(inference);
+		inference.add_return();
+		return nullptr;
+	}
+
+	BoxedValue Break::evaluate(runtime::DispatchEngine & en) const
+	{
+		en.set_completion(runtime::Completion::BREAK);
+		return{};
+	}
+	const TypeInfo * Break::infer_type(impl::TypeInference & inference)
+	{
+		inference.add_break();
+		return nullptr;
+	}
+	BoxedValue Continue::evaluate(runtime::DispatchEngine & en) const
+	{
+		en.set_completion(runtime::Completion::CONTINUE);
+		return{};
+	}
+	const TypeInfo * Continue::infer_type(impl::TypeInference & inference)
+	{
+		inference.add_continue();
+		return nullptr;
 	}
 
 	namespace impl
 	{
-		bool evaluates_to_true(const BoxedValue & bv)
+		bool loop_must_stop(runtime::DispatchEngine & en)
+		{
+			switch (en.get_completion())
+			{
+				case runtime::Completion::NORMAL:
+					return false;
+				case runtime::Completion::CONTINUE:
+					en.set_completion(runtime::Completion::NORMAL);
+					return false;
+				case runtime::Completion::BREAK:
+					en.set_completion(runtime::Completion::NORMAL);
+					return true;
+				case runtime::Completion::RETURN:
+				case runtime::Completion::FAILED:
+					break;
+			}
+
+			// returns and errors leave the loop but need to reach the function being called
+			return true;
+		}
+
+		bool is_true(runtime::DispatchEngine & en, const BoxedValue & result)
 		{
+			const BoxedValue & bv = resolve_ref(result);
 			const auto & typeinfo = bv.get_type_info();
 			if (typeinfo == get_type_info<bool>())			return boxed_cast<bool>(bv);
 			else if (typeinfo == get_type_info<int>())		return boxed_cast<int>(bv) != 0;
 			else if (typeinfo == get_type_info<float>())	return boxed_cast<float>(bv) != 0.f;
 
-			SCR_RUNTIME_EXCEPTION("Value of type ", typeinfo.get_bare_std_type_info().name(), " cannot be evaluated to true or false.");
+			en.set_error(except::ErrorCode::INVALID_CONDITION, "Value of type ",
+						 typeinfo.get_bare_std_type_info().name(), " cannot be evaluated to true or false.");
+			return false;
+		}
+		/// \brief	Evaluates the condition of an if or a loop, false if it fails.
+		bool evaluate_condition(runtime::DispatchEngine & en, const ASTNode & condition)
+		{
+			const BoxedValue result = condition.evaluate(en);
+			if (en.has_error())	return false;
+
+			return is_true(en, result);
+		}
+
+		ConstantCondition get_constant_condition(const ASTNode & condition)
+		{
+			const BoxedValue bv = condition.evaluate_constant();
+			if (bv.empty())	return ConstantCondition::UNKNOWN;
+
+			bool result = false;
+			const auto & typeinfo = bv.get_type_info();
+			if (typeinfo == get_type_info<bool>())			result = boxed_cast<bool>(bv);
+			else if (typeinfo == get_type_info<int>())		result = boxed_cast<int>(bv) != 0;
+			else if (typeinfo == get_type_info<float>())	result = boxed_cast<float>(bv) != 0.f;
+			else											return ConstantCondition::UNKNOWN;
+
+			return result ? ConstantCondition::ALWAYS_TRUE : ConstantCondition::ALWAYS_FALSE;
 		}
 	}
 
@@ -214,32 +1030,367 @@ namespace ast
 
 	BoxedValue If::evaluate(runtime::DispatchEngine & en) const
 	{
-		const BoxedValue condition_result = m_condition->evaluate(en);
-		if (impl::evaluates_to_true(resolve_ref(condition_result)))
-			m_statements->evaluate(en);
-		else if (m_else)
-			m_else->evaluate(en);
-
+		execute(en);
 		return{};
 	}
+	void If::execute(runtime::DispatchEngine & en) const
+	{
+		if (impl::evaluate_condition(en, *m_condition))
+			m_statements->execute(en);
+		else if (m_else && !en.has_error())
+			m_else->execute(en);
+	}
+	void If::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_condition);
+		fn(m_statements);
+		if (m_else)
+			fn(m_else);
+	}
+	const TypeInfo * If::infer_type(impl::TypeInference & inference)
+	{
+		m_condition->infer_type(inference);
+		inference.infer_branches(*m_statements, m_else.get());
+		return nullptr;
+	}
 
 	While::While(std::unique_ptr<ASTNode> && cond,
 				 std::unique_ptr<ASTNode> && statements)
 		: m_condition(std::move(cond))
 		, m_statements(std::move(statements))
+		, m_invariant_num(impl::hoist_loop_invariants(*this, { &m_condition, &m_statements }, m_writes))
 	{}
 
 	BoxedValue While::evaluate(runtime::DispatchEngine & en) const
 	{
-		BoxedValue cond = m_condition->evaluate(en);
-		while (impl::evaluates_to_true(resolve_ref(cond)))
+		execute(en);
+		return{};
+	}
+	void While::execute(runtime::DispatchEngine & en) const
+	{
+		if (m_invariant_num == 0)
+		{
+			iterate(en);
+			return;
+		}
+
+		const auto loop = en.push_loop(*this, m_invariant_num);
+		iterate(en);
+	}
+	void While::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		if (m_condition)
+			fn(m_condition);
+		fn(m_statements);
+	}
+	void While::collect_writes(impl::LoopWrites & writes)
+	{
+		writes.add(m_writes);
+	}
+	const TypeInfo * While::infer_type(impl::TypeInference & inference)
+	{
+		inference.infer_loop(m_condition.get(), *m_statements, nullptr);
+		return nullptr;
+	}
+	void While::iterate(runtime::DispatchEngine & en) const
+	{
+		for (;;)
+		{
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			if (m_condition && !impl::evaluate_condition(en, *m_condition))
+				break;
+
+			m_statements->execute(en);
+			if (impl::loop_must_stop(en))
+				break;
+		}
+	}
+
+	namespace impl
+	{
+		/// \brief	True if 'node' uses the variable of 'loop' without declaring it.
+		bool is_counter(const ASTNode & node, const CountedLoop & loop)
+		{
+			const std::type_info & type = typeid(node);
+			if (type == typeid(NamedVariable))
+			{
+				const auto & var = static_cast<const NamedVariable &>(node);
+				return !loop.m_name.empty() && var.get_name() == loop.m_name && !var.is_declaration();
+			}
+			else if (type == typeid(LocalVariable))
+			{
+				const auto & var = static_cast<const LocalVariable &>(node);
+				return loop.m_name.empty() && var.get_slot() == loop.m_slot && !var.is_declaration();
+			}
+			return false;
+		}
+
+		/// \brief	True if evaluating 'node' may read the variable of 'loop'.
+		bool may_read_counter(ASTNode & node, const CountedLoop & loop)
+		{
+			const std::type_info & type = typeid(node);
+			if (type == typeid(LocalVariable))
+				return loop.m_name.empty() && static_cast<const LocalVariable &>(node).get_slot() == loop.m_slot;
+			else if (type == typeid(NamedVariable))
+				return static_cast<const NamedVariable &>(node).get_name() == loop.m_name;
+			// named variables can be read by the functions called, the locals cannot
+			else if (type == typeid(GlobalFunctionCall) || type == typeid(MemberFunctionCall))
+			{
+				if (!loop.m_name.empty())
+					return true;
+			}
+
+			bool reads = false;
+			node.for_each_child([&reads, &loop](std::unique_ptr<ASTNode> & child)
+			{
+				reads = reads || may_read_counter(*child, loop);
+			});
+			return reads;
+		}
+
+		/// \brief	True if both nodes read the same variable.
+		bool is_same_variable(const ASTNode & lhs, const ASTNode & rhs)
+		{
+			const std::type_info & type = typeid(lhs);
+			if (type != typeid(rhs))
+				return false;
+
+			if (type == typeid(NamedVariable))
+			{
+				const auto & lhs_var = static_cast<const NamedVariable &>(lhs);
+				const auto & rhs_var = static_cast<const NamedVariable &>(rhs);
+				return !lhs_var.is_declaration() && !rhs_var.is_declaration() &&
+					   lhs_var.get_name() == rhs_var.get_name();
+			}
+			else if (type == typeid(LocalVariable))
+			{
+				const auto & lhs_var = static_cast<const LocalVariable &>(lhs);
+				const auto & rhs_var = static_cast<const LocalVariable &>(rhs);
+				return !lhs_var.is_declaration() && !rhs_var.is_declaration() &&
+					   lhs_var.get_slot() == rhs_var.get_slot();
+			}
+			return false;
+		}
+
+		bool has_calls(ASTNode & node)
+		{
+			const std::type_info & type = typeid(node);
+			if (type == typeid(GlobalFunctionCall) || type == typeid(MemberFunctionCall))
+				return true;
+
+			bool calls = false;
+			node.for_each_child([&calls](std::unique_ptr<ASTNode> & child)
+			{
+				calls = calls || has_calls(*child);
+			});
+			return calls;
+		}
+
+		void set_in_range(ASTNode & node, const CountedLoop & loop, const ASTNode & vector)
+		{
+			if (typeid(node) == typeid(VectorAccess))
+			{
+				auto & access = static_cast<VectorAccess &>(node);
+				if (is_same_variable(access.get_vector(), vector) && is_counter(access.get_index(), loop))
+					access.set_in_range();
+			}
+
+			node.for_each_child([&loop, &vector](std::unique_ptr<ASTNode> & child)
+			{
+				set_in_range(*child, loop, vector);
+			});
+		}
+
+		/// \brief	Literal that is not negative.
+		bool is_non_negative(const ASTNode & node)
+		{
+			if (typeid(node) != typeid(Value))
+				return false;
+
+			const BoxedValue & value = static_cast<const Value &>(node).get_value();
+			return value.is_storing<std::size_t>() || (value.is_storing<int>() && boxed_cast<int>(value) >= 0);
+		}
+
+		/// \brief	With a condition 'i < v.size()' the accesses 'v[i]' are in range as long as
+		///			nothing can change the size of 'v' between the condition and the access,
+		///			and 'i' cannot be negative: it starts at a literal that is not and grows.
+		void mark_accesses_in_range(ASTNode & statements, const CountedLoop & loop, const ASTNode & start,
+									const LoopWrites & writes)
+		{
+			if (loop.m_condition->get_operator_type() != OperatorType::LESS || loop.m_step <= 0 ||
+				!is_non_negative(start))
+			{
+				return;
+			}
+
+			// the size is hoisted, the vector is not modified in the loop
+			const ASTNode * bound = &loop.m_condition->get_rhs();
+			if (typeid(*bound) == typeid(LoopInvariant))
+				bound = &static_cast<const LoopInvariant *>(bound)->get_value();
+			if (typeid(*bound) != typeid(MemberFunctionCall))
+				return;
+
+			const auto & size_call = static_cast<const MemberFunctionCall &>(*bound);
+			if (size_call.get_name() != "size" || size_call.get_param_num() != 0)
+				return;
+
+			const ASTNode & vector = size_call.get_instance();
+			if (typeid(vector) == typeid(NamedVariable))
+			{
+				if (writes.writes(static_cast<const NamedVariable &>(vector).get_name()))
+					return;
+			}
+			else if (typeid(vector) == typeid(LocalVariable))
+			{
+				if (writes.writes(static_cast<const LocalVariable &>(vector).get_slot()))
+					return;
+			}
+			else
+				return;
+
+			if (!has_calls(statements))
+				set_in_range(statements, loop, vector);
+		}
+
+		std::unique_ptr<CountedLoop> make_counted_loop(const ASTNode * left, const ASTNode * condition,
+													   const ASTNode * right, ASTNode & statements)
+		{
+			if (!left || !condition || !right)
+				return nullptr;
+
+			// 'var i = a'
+			const ASTNode & init = *left;
+			if (typeid(init) != typeid(BinaryOperator))
+				return nullptr;
+			const auto & init_op = static_cast<const BinaryOperator &>(init);
+			if (init_op.get_operator_type() != OperatorType::EQ)
+				return nullptr;
+
+			auto loop = std::make_unique<CountedLoop>();
+			const ASTNode & var = init_op.get_lhs();
+			if (typeid(var) == typeid(NamedVariable))
+				loop->m_name = static_cast<const NamedVariable &>(var).get_name();
+			else if (typeid(var) == typeid(LocalVariable))
+				loop->m_slot = static_cast<const LocalVariable &>(var).get_slot();
+			else
+				return nullptr;
+
+			// 'i < b'
+			const ASTNode & compare = *condition;
+			if (typeid(compare) != typeid(BinaryOperator))
+				return nullptr;
+			loop->m_condition = static_cast<const BinaryOperator *>(&compare);
+			switch (loop->m_condition->get_operator_type())
+			{
+				case OperatorType::LESS:		case OperatorType::LESS_EQ:
+				case OperatorType::GREATER:		case OperatorType::GREATER_EQ:
+				case OperatorType::NOT_EQ:
+					break;
+				default:
+					return nullptr;
+			}
+			if (!is_counter(loop->m_condition->get_lhs(), *loop))
+				return nullptr;
+
+			// '++i'
+			const ASTNode & increment = *right;
+			if (typeid(increment) != typeid(UnaryOperator))
+				return nullptr;
+			const auto & increment_op = static_cast<const UnaryOperator &>(increment);
+			switch (increment_op.get_operator_type())
+			{
+				case OperatorType::PRE_INC:	case OperatorType::POST_INC:	loop->m_step = 1;	break;
+				case OperatorType::PRE_DEC:	case OperatorType::POST_DEC:	loop->m_step = -1;	break;
+				default:
+					return nullptr;
+			}
+			if (!is_counter(increment_op.get_variable(), *loop))
+				return nullptr;
+
+			// only the increment may assign the variable, the tree is still being built so the
+			// bound can be visited as the rest of the nodes
+			ASTNode & bound = const_cast<ASTNode &>(loop->m_condition->get_rhs());
+			LoopWrites writes;
+			statements.collect_writes(writes);
+			bound.collect_writes(writes);
+			if (writes.m_unknown || (loop->m_name.empty() ? writes.writes(loop->m_slot) : writes.writes(loop->m_name)))
+				return nullptr;
+
+			loop->m_write_back = may_read_counter(statements, *loop) || may_read_counter(bound, *loop);
+			mark_accesses_in_range(statements, *loop, init_op.get_rhs(), writes);
+			return loop;
+		}
+
+		template <typename T>
+		bool compare_counter(int counter, OperatorType op, T bound)
+		{
+			// the builtin operators, which do not convert an int compared with a size_t
+			switch (op)
+			{
+				case OperatorType::LESS:		return opts::Less::call(counter, bound);
+				case OperatorType::LESS_EQ:		return opts::LessEq::call(counter, bound);
+				case OperatorType::GREATER:		return opts::Greater::call(counter, bound);
+				case OperatorType::GREATER_EQ:	return opts::GreaterEq::call(counter, bound);
+				default:						return opts::NotEq::call(counter, bound);
+			}
+		}
+		/// \brief	Compares natively with the bounds of builtin types, false if it fails.
+		bool compare_counter(runtime::DispatchEngine & en, const CountedLoop & loop, int counter,
+							 const BoxedValue & bound)
 		{
-			m_statements->evaluate(en);
+			const OperatorType op = loop.m_condition->get_operator_type();
+			const auto & typeinfo = bound.get_type_info();
+			if (typeinfo == get_type_info<int>())
+				return compare_counter(counter, op, boxed_cast<int>(bound));
+			else if (typeinfo == get_type_info<std::size_t>())
+				return compare_counter(counter, op, boxed_cast<std::size_t>(bound));
+			else if (typeinfo == get_type_info<float>())
+				return compare_counter(counter, op, boxed_cast<float>(bound));
 
-			cond = m_condition->evaluate(en);
+			BoxedValue lhs{ counter };
+			const BoxedValue result = loop.m_condition->operate(en, lhs, bound);
+			return !en.has_error() && is_true(en, result);
 		}
 
-		return{};
+		/// \brief	Looks up the variable of a counted loop again only if the stack changed
+		///			(see runtime::VariableHandle).
+		class CounterVariable
+		{
+		public:
+			CounterVariable(runtime::DispatchEngine & en, const CountedLoop & loop)
+				: m_engine(en)
+				, m_loop(loop)
+			{}
+
+			/// \brief	nullptr if the variable is no longer in the stack.
+			BoxedValue * get()
+			{
+				if (m_loop.m_name.empty())
+					return &m_engine.get_local(m_loop.m_slot);
+
+				const std::size_t generation = m_engine.get_stack_generation();
+				if (!m_variable || m_generation != generation)
+				{
+					m_variable = m_engine.get_variable(m_loop.m_name);
+					m_generation = generation;
+				}
+				return m_variable;
+			}
+			void store(int counter)
+			{
+				if (BoxedValue * var = get())
+				{
+					if (var->is_storing<int>())	boxed_cast<int>(*var) = counter;
+					else						*var = BoxedValue{ counter };
+				}
+			}
+
+		private:
+			runtime::DispatchEngine & m_engine;
+			const CountedLoop & m_loop;
+			BoxedValue * m_variable{ nullptr };
+			std::size_t m_generation{ 0 };
+		};
 	}
 
 	For::For(std::unique_ptr<ASTNode> && left,
@@ -250,20 +1401,126 @@ namespace ast
 		, m_condition(std::move(mid))
 		, m_right(std::move(right))
 		, m_statements(std::move(statements))
-	{}
+		, m_invariant_num(impl::hoist_loop_invariants(*this, { &m_condition, &m_right, &m_statements },
+													  m_writes))
+		, m_counted(impl::make_counted_loop(m_left.get(), m_condition.get(), m_right.get(), *m_statements))
+	{
+#ifdef SCRIPTING_JIT
+		if (m_counted)
+			m_compiled = runtime::jit::compile_loop(*m_counted, *m_statements);
+#endif
+	}
+	For::~For() = default;
 	BoxedValue For::evaluate(runtime::DispatchEngine & en) const
 	{
-		m_left->evaluate(en);
+		execute(en);
+		return{};
+	}
+	void For::execute(runtime::DispatchEngine & en) const
+	{
+		if (m_left)
+		{
+			m_left->execute(en);
+			if (en.has_error())	return;
+		}
 
-		BoxedValue cond = m_condition->evaluate(en);
-		while (impl::evaluates_to_true(resolve_ref(cond)))
+		if (m_invariant_num == 0)
 		{
-			m_statements->evaluate(en);
-			m_right->evaluate(en);
-			cond = m_condition->evaluate(en);
+			iterate(en);
+			return;
 		}
 
-		return{};
+		const auto loop = en.push_loop(*this, m_invariant_num);
+		iterate(en);
+	}
+	void For::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		if (m_left)			fn(m_left);
+		if (m_condition)	fn(m_condition);
+		if (m_right)		fn(m_right);
+		fn(m_statements);
+	}
+	void For::collect_writes(impl::LoopWrites & writes)
+	{
+		if (m_left)
+			m_left->collect_writes(writes);
+		writes.add(m_writes);
+	}
+	const TypeInfo * For::infer_type(impl::TypeInference & inference)
+	{
+		if (m_left)
+			m_left->infer_type(inference);
+		inference.infer_loop(m_condition.get(), *m_statements, m_right.get());
+		return nullptr;
+	}
+	void For::iterate(runtime::DispatchEngine & en) const
+	{
+#ifdef SCRIPTING_JIT
+		if (m_compiled && m_compiled->run(en))
+			return;
+#endif
+		if (m_counted && iterate_counted(en))
+			return;
+
+		for (;;)
+		{
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			if (m_condition && !impl::evaluate_condition(en, *m_condition))
+				break;
+
+			m_statements->execute(en);
+			if (impl::loop_must_stop(en))
+				break;
+
+			if (m_right)
+			{
+				m_right->execute(en);
+				if (en.has_error())
+					break;
+			}
+		}
+	}
+	bool For::iterate_counted(runtime::DispatchEngine & en) const
+	{
+		impl::CounterVariable variable{ en, *m_counted };
+		const BoxedValue * initial = variable.get();
+		if (!initial || !initial->is_storing<int>())
+			return false;
+
+		const ASTNode & bound = m_counted->m_condition->get_rhs();
+		int counter = boxed_cast<int>(*initial);
+		for (;;)
+		{
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			if (m_counted->m_write_back)
+				variable.store(counter);
+
+			const BoxedValue bound_value = bound.evaluate(en);
+			if (en.has_error() || !impl::compare_counter(en, *m_counted, counter, resolve_ref(bound_value)))
+				break;
+
+			const std::size_t impure_calls = en.get_impure_calls();
+			m_statements->execute(en);
+			if (impl::loop_must_stop(en))
+				break;
+
+			// the functions called may have assigned a named variable
+			if (m_counted->m_write_back && en.get_impure_calls() != impure_calls)
+			{
+				const BoxedValue * var = variable.get();
+				if (!var || !var->is_storing<int>())
+				{
+					// what is left of the iteration is done by the generic loop
+					m_right->execute(en);
+					return en.has_error();
+				}
+				counter = boxed_cast<int>(*var);
+			}
+			counter += m_counted->m_step;
+		}
+
+		variable.store(counter);
+		return true;
 	}
 
 	namespace impl
@@ -277,14 +1534,162 @@ namespace ast
 			std::vector<BoxedValue> results;
 			results.reserve(m_statement_list.size());
 			for (const auto & node : m_statement_list)
+			{
 				results.emplace_back(node->evaluate(en));
+				if (en.has_error())	break;
+			}
 
 			return results;
 		}
+		void StatementList::evaluate_arguments(runtime::DispatchEngine & en,
+											   std::vector<BoxedValue> & args) const
+		{
+			// reserved so that the values are not moved (which would take ownership of them)
+			args.reserve(m_statement_list.size());
+			for (const auto & node : m_statement_list)
+			{
+				args.emplace_back(BoxedValueKeepBorrowed_t{}, node->evaluate(en));
+				if (en.has_error())	break;
+			}
+		}
 		std::size_t StatementList::get_num() const
 		{
 			return m_statement_list.size();
 		}
+
+		void StatementList::for_each(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+		{
+			for (auto & node : m_statement_list)
+				fn(node);
+		}
+		bool StatementList::are_invariant(const LoopWrites & writes) const
+		{
+			return std::all_of(m_statement_list.begin(), m_statement_list.end(),
+							   [&writes](const std::unique_ptr<ASTNode> & node) { return node->is_invariant(writes); });
+		}
+	}
+
+	LoopInvariant::LoopInvariant(std::unique_ptr<ASTNode> && value, const ASTNode & loop, std::size_t slot)
+		: m_value(std::move(value))
+		, m_loop(&loop)
+		, m_slot(slot)
+	{}
+	BoxedValue LoopInvariant::evaluate(runtime::DispatchEngine & en) const
+	{
+		const auto * hoisted = en.get_hoisted_value(*m_loop, m_slot);
+		if (!hoisted)
+			return m_value->evaluate(en);
+
+		const std::size_t impure_calls = en.get_impure_calls();
+		if (hoisted->m_computed && hoisted->m_impure_calls == impure_calls)
+			return BoxedValue::borrow(hoisted->m_value);
+
+		BoxedValue result = m_value->evaluate(en);
+
+		// references (i.e. to a variable or to an element of a vector) are not kept, the
+		// value they refer to may be modified in the loop without modifying a variable
+		const bool owns_value = !result.empty() &&
+			result.get_type_info().get_std_type_info() == result.get_type_info().get_bare_std_type_info();
+		if (en.has_error() || en.get_impure_calls() != impure_calls || !owns_value)
+			return impl::pass_up(result);
+
+		// looked up again, a nested loop may have made room for its values meanwhile
+		auto * value = en.get_hoisted_value(*m_loop, m_slot);
+		value->m_value = std::move(result);
+		value->m_impure_calls = impure_calls;
+		value->m_computed = true;
+		return BoxedValue::borrow(value->m_value);
+	}
+	void LoopInvariant::execute(runtime::DispatchEngine & en) const
+	{
+		m_value->execute(en);
+	}
+	void LoopInvariant::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_value);
+	}
+	void LoopInvariant::collect_assigned(impl::LoopWrites & writes)
+	{
+		m_value->collect_assigned(writes);
+	}
+	bool LoopInvariant::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return m_value->is_invariant(writes);
+	}
+	const TypeInfo * LoopInvariant::infer_type(impl::TypeInference & inference)
+	{
+		return m_value->infer_type(inference);
+	}
+
+	namespace impl
+	{
+		/// \brief	Reading a variable or a literal costs the same as reading the hoisted value.
+		bool is_worth_hoisting(const ASTNode & node)
+		{
+			// the node classes are final, comparing the type is enough
+			const std::type_info & type = typeid(node);
+			return type != typeid(Value) && type != typeid(NamedVariable) && type != typeid(LocalVariable) &&
+				   type != typeid(TopLevelVariable) && type != typeid(LoopInvariant);
+		}
+
+		/// \brief	What is invariant in a loop is invariant in the loops nested in it too, which
+		///			already hoisted it.
+		bool is_loop(const ASTNode & node)
+		{
+			const std::type_info & type = typeid(node);
+			return type == typeid(While) || type == typeid(For);
+		}
+
+		struct Hoisting
+		{
+			const ASTNode & m_loop;
+			const LoopWrites & m_writes;
+			std::size_t m_invariant_num;
+		};
+
+		void hoist_invariants(std::unique_ptr<ASTNode> & node, Hoisting & hoisting)
+		{
+			if (is_loop(*node))
+				return;
+
+			if (!node->is_invariant(hoisting.m_writes))
+			{
+				// one capture, small enough for std::function to not allocate
+				node->for_each_child([&hoisting](std::unique_ptr<ASTNode> & child)
+				{
+					hoist_invariants(child, hoisting);
+				});
+			}
+			else if (is_worth_hoisting(*node))
+			{
+				node = std::make_unique<LoopInvariant>(std::move(node), hoisting.m_loop,
+													   hoisting.m_invariant_num++);
+			}
+		}
+
+		std::size_t hoist_loop_invariants(const ASTNode & loop,
+										  std::initializer_list<std::unique_ptr<ASTNode> *> parts,
+										  LoopWrites & writes)
+		{
+			// the parts of a for may be empty
+			for (auto * part : parts)
+			{
+				if (*part)
+					(*part)->collect_writes(writes);
+			}
+
+			if (writes.m_unknown)
+				return 0;
+
+			Hoisting hoisting{ loop, writes, 0 };
+			for (auto * part : parts)
+			{
+				if (*part)
+					hoist_invariants(*part, hoisting);
+			}
+
+			return hoisting.m_invariant_num;
+		}
 	}
 
 	VectorDecl::VectorDecl(std::vector<std::unique_ptr<ASTNode>> && init_list)
@@ -292,18 +1697,60 @@ namespace ast
 	{}
 	BoxedValue VectorDecl::evaluate(runtime::DispatchEngine & en) const
 	{
-		return BoxedValue{ m_init_list.evaluate_all(en) };
+		auto values = m_init_list.evaluate_all(en);
+		if (en.has_error())	return{};
+
+		return BoxedValue{ std::move(values) };
+	}
+	void VectorDecl::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		m_init_list.for_each(fn);
+	}
+	const TypeInfo * VectorDecl::infer_type(impl::TypeInference & inference)
+	{
+		m_init_list.for_each([&inference](std::unique_ptr<ASTNode> & value) { value->infer_type(inference); });
+		return &get_type_info<std::vector<BoxedValue>>();
 	}
 
 	namespace impl
 	{
+		/// \brief	Arguments of a call, the memory of the vector is reused by the next calls.
+		class ScratchArguments
+		{
+		public:
+			explicit ScratchArguments(runtime::ScratchArena & arena)
+				: m_arena(arena)
+				, m_values(arena.take_vector())
+			{}
+			~ScratchArguments() { m_arena.give_back_vector(std::move(m_values)); }
+			ScratchArguments(const ScratchArguments &) = delete;
+			ScratchArguments& operator=(const ScratchArguments &) = delete;
+
+			std::vector<BoxedValue> & get() { return m_values; }
+
+		private:
+			runtime::ScratchArena & m_arena;
+			std::vector<BoxedValue> m_values;
+		};
+
 		BoxedValue perform_member_function_call(runtime::DispatchEngine & en, const std::string & fn_name,
 												BoxedValue & inst, std::vector<BoxedValue> & params)
 		{
 			if (const auto * class_bindings = en.get_class_bindings(inst.get_type_info()))
 			{
 				if (const auto * member_fn = class_bindings->get_member_func(fn_name))
-					return member_fn->do_call(en, inst, params);
+				{
+					if (!member_fn->is_pure())
+						en.count_impure_call();
+
+					BoxedValue result = member_fn->do_call(en, inst, params);
+					if (except::is_boxed_error(result))
+					{
+						return en.set_error(except::ErrorCode::NO_MATCHING_CALL,
+											"Not found a valid call to member function '", fn_name, "'.");
+					}
+					return impl::pass_up(result);
+				}
 				else
 				{
 					if (auto * maybe_callable_var = class_bindings->get_member_var(fn_name))
@@ -315,14 +1762,15 @@ namespace ast
 					}
 					else
 					{
-						SCR_RUNTIME_EXCEPTION("Type ",
-											  inst.get_type_info().get_bare_std_type_info().name(),
-											  " does not have the function '", fn_name, "' bound.");
+						return en.set_error(except::ErrorCode::UNBOUND_MEMBER, "Type ",
+											inst.get_type_info().get_bare_std_type_info().name(),
+											" does not have the function '", fn_name, "' bound.");
 					}
 				}
 			}
 
-			SCR_RUNTIME_EXCEPTION("No data for type ", inst.get_type_info().get_bare_std_type_info().name(), " found.");
+			return en.set_error(except::ErrorCode::UNBOUND_MEMBER, "No data for type ",
+								inst.get_type_info().get_bare_std_type_info().name(), " found.");
 		}
 	}
 
@@ -333,31 +1781,65 @@ namespace ast
 	{}
 	BoxedValue GlobalFunctionCall::evaluate(runtime::DispatchEngine & en) const
 	{
-		BoxedValue result;
 		if (const auto * fn = en.get_global_fn(m_fn_name))
 		{
-			auto args = m_parameters.evaluate_all(en);
-			result = fn->do_call(en, args);
+			impl::ScratchArguments args{ en.get_scratch_arena() };
+			m_parameters.evaluate_arguments(en, args.get());
+			if (en.has_error())	return{};
 
+			if (!fn->is_pure())
+				en.count_impure_call();
+
+			BoxedValue result = fn->do_call(en, args.get());
 			if (except::is_boxed_error(result))
-				SCR_RUNTIME_EXCEPTION("Not found a valid call to function '", m_fn_name, "'.");
+			{
+				return en.set_error(except::ErrorCode::NO_MATCHING_CALL,
+									"Not found a valid call to function '", m_fn_name, "'.");
+			}
 
-			return std::move(result);
+			return impl::pass_up(result);
 		}
 		else if (BoxedValue * global_var = en.get_variable(m_fn_name))
 		{
 			if (const auto * class_binds = en.get_class_bindings(global_var->get_type_info()))
 			{
-				auto args = m_parameters.evaluate_all(en);
-				return impl::perform_member_function_call(en, "()", *global_var, args);
+				impl::ScratchArguments args{ en.get_scratch_arena() };
+				m_parameters.evaluate_arguments(en, args.get());
+				if (en.has_error())	return{};
+
+				return impl::perform_member_function_call(en, "()", *global_var, args.get());
 			}
 			else
 			{
-				SCR_RUNTIME_EXCEPTION("Trying to call function '", m_fn_name, "' found global variable of type '", global_var->get_type_info().get_bare_std_type_info().name(), "', but this type has not bound data.");
+				return en.set_error(except::ErrorCode::UNBOUND_MEMBER, "Trying to call function '", m_fn_name,
+									"' found global variable of type '",
+									global_var->get_type_info().get_bare_std_type_info().name(),
+									"', but this type has not bound data.");
 			}
 		}
 
-		SCR_RUNTIME_EXCEPTION("No function or callable object found with name '", m_fn_name, "'.");
+		return en.set_error(except::ErrorCode::UNKNOWN_FUNCTION,
+							"No function or callable object found with name '", m_fn_name, "'.");
+	}
+	void GlobalFunctionCall::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		m_parameters.for_each(fn);
+	}
+	bool GlobalFunctionCall::is_invariant(const impl::LoopWrites & writes) const
+	{
+		// the name may be a callable variable
+		return !writes.writes(m_fn_name) && m_parameters.are_invariant(writes);
+	}
+	const TypeInfo * GlobalFunctionCall::infer_type(impl::TypeInference & inference)
+	{
+		m_parameters.for_each([&inference](std::unique_ptr<ASTNode> & param) { param->infer_type(inference); });
+
+		// callable variables are not bindings, they may do anything
+		const auto * fn = inference.get_engine().get_global_fn(m_fn_name);
+		if (!fn || !fn->is_pure())
+			inference.forget_names();
+
+		return fn ? fn->get_return_type() : nullptr;
 	}
 	
 	MemberFunctionCall::MemberFunctionCall(std::string && fn_name,
@@ -372,9 +1854,36 @@ namespace ast
 	{
 		BoxedValue inst = m_instance->evaluate(en);
 		BoxedValue & real_inst = resolve_ref(inst);
-		auto params = m_parameters.evaluate_all(en);
+		impl::ScratchArguments params{ en.get_scratch_arena() };
+		m_parameters.evaluate_arguments(en, params.get());
+		if (en.has_error())	return{};
+
+		return impl::perform_member_function_call(en, m_fn_name, real_inst, params.get());
+	}
+	void MemberFunctionCall::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_instance);
+		m_parameters.for_each(fn);
+	}
+	bool MemberFunctionCall::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return m_instance->is_invariant(writes) && m_parameters.are_invariant(writes);
+	}
+	const TypeInfo * MemberFunctionCall::infer_type(impl::TypeInference & inference)
+	{
+		const TypeInfo * instance_type = m_instance->infer_type(inference);
+		m_parameters.for_each([&inference](std::unique_ptr<ASTNode> & param) { param->infer_type(inference); });
+
+		const binds::IMemberFunctionBinding * fn = nullptr;
+		if (instance_type)
+		{
+			if (const auto * class_binds = inference.get_engine().get_class_bindings(*instance_type))
+				fn = class_binds->get_member_func(m_fn_name);
+		}
+		if (!fn || !fn->is_pure())
+			inference.forget_names();
 
-		return impl::perform_member_function_call(en, m_fn_name, real_inst, params);
+		return fn ? fn->get_return_type() : nullptr;
 	}
 	
 	MemberVariableAccess::MemberVariableAccess(std::string && var_name,
@@ -386,6 +1895,8 @@ namespace ast
 	BoxedValue MemberVariableAccess::evaluate(runtime::DispatchEngine & en) const
 	{
 		BoxedValue inst = m_instance->evaluate(en);
+		if (en.has_error())	return{};
+
 		BoxedValue & real_inst = resolve_ref(inst);
 
 		if (const auto * class_bind = en.get_class_bindings(real_inst.get_type_info()))
@@ -393,11 +1904,64 @@ namespace ast
 			if (const auto * member_var = class_bind->get_member_var(m_var_name))
 				return member_var->get_variable(real_inst);
 			else
-				SCR_RUNTIME_EXCEPTION("Type ", real_inst.get_type_info().get_bare_std_type_info().name(),
-					" does not have the variable '", m_var_name, "' bound.");
+				return en.set_error(except::ErrorCode::UNBOUND_MEMBER, "Type ",
+									real_inst.get_type_info().get_bare_std_type_info().name(),
+									" does not have the variable '", m_var_name, "' bound.");
+		}
+
+		return en.set_error(except::ErrorCode::UNBOUND_MEMBER, "No data for type ",
+							real_inst.get_type_info().get_bare_std_type_info().name(), " found.");
+	}
+	void MemberVariableAccess::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_instance);
+	}
+	void MemberVariableAccess::collect_assigned(impl::LoopWrites & writes)
+	{
+		m_instance->collect_assigned(writes);
+	}
+	bool MemberVariableAccess::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return m_instance->is_invariant(writes);
+	}
+	const TypeInfo * MemberVariableAccess::infer_type(impl::TypeInference & inference)
+	{
+		m_instance->infer_type(inference);
+		return nullptr;
+	}
+
+	namespace impl
+	{
+		/// \brief	False if the index is not an integer, negative ones are out of any range.
+		bool get_native_index(const BoxedValue & bv, std::size_t & index)
+		{
+			const auto & typeinfo = bv.get_type_info();
+			if (typeinfo == get_type_info<int>())
+			{
+				const int i = boxed_cast<int>(bv);
+				index = i < 0 ? std::numeric_limits<std::size_t>::max() : static_cast<std::size_t>(i);
+				return true;
+			}
+			else if (typeinfo == get_type_info<std::size_t>())
+			{
+				index = boxed_cast<std::size_t>(bv);
+				return true;
+			}
+			return false;
 		}
 
-		SCR_RUNTIME_EXCEPTION("No data for type ", real_inst.get_type_info().get_bare_std_type_info().name(), " found.");
+		template <typename Container>
+		BoxedValue access_element(runtime::DispatchEngine & en, const Container & container,
+								  std::size_t index, bool in_range)
+		{
+			if (!in_range && index >= container.size())
+			{
+				return en.set_error(except::ErrorCode::INDEX_OUT_OF_RANGE, "Index out of the range of a ",
+									get_type_info<Container>().get_bare_std_type_info().name(),
+									" of size ", container.size(), '.');
+			}
+			return BoxedValue{ BoxedValueTemporary_t{}, container[index] };
+		}
 	}
 
 	VectorAccess::VectorAccess(std::unique_ptr<ASTNode> && vec,
@@ -411,13 +1975,197 @@ namespace ast
 		auto & real_inst = resolve_ref(inst);
 
 		BoxedValue index_bv = m_index->evaluate(en);
-		BoxedValue & index_bv_ref = resolve_ref(index_bv);
+		if (en.has_error())	return{};
+
+		// the builtin containers are read as const, the element is copied as the binding does
+		std::size_t index = 0;
+		if (impl::get_native_index(resolve_ref(index_bv), index))
+		{
+			const BoxedValue & container = real_inst;
+			if (container.is_storing<std::vector<BoxedValue>>())
+				return impl::access_element(en, boxed_cast<std::vector<BoxedValue>>(container), index, m_in_range);
+			else if (container.is_storing<std::string>())
+				return impl::access_element(en, boxed_cast<std::string>(container), index, m_in_range);
+		}
+
+		// the binding resolves the index if it is a reference
+		impl::ScratchArguments param{ en.get_scratch_arena() };
+		param.get().emplace_back(BoxedValueKeepBorrowed_t{}, std::move(index_bv));
+		return impl::perform_member_function_call(en, "[]", real_inst, param.get());
+	}
+	void VectorAccess::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_vector);
+		fn(m_index);
+	}
+	void VectorAccess::collect_assigned(impl::LoopWrites & writes)
+	{
+		m_vector->collect_assigned(writes);
+	}
+	bool VectorAccess::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return m_vector->is_invariant(writes) && m_index->is_invariant(writes);
+	}
+	const TypeInfo * VectorAccess::infer_type(impl::TypeInference & inference)
+	{
+		const TypeInfo * vector_type = m_vector->infer_type(inference);
+		const TypeInfo * index_type = m_index->infer_type(inference);
+
+		// the native accesses call nothing, the '[]' bindings may modify anything
+		const bool is_native_index = index_type &&
+			(*index_type == get_type_info<int>() || *index_type == get_type_info<std::size_t>());
+		if (vector_type && is_native_index)
+		{
+			if (*vector_type == get_type_info<std::string>())
+				return &get_type_info<char>();
+			if (*vector_type == get_type_info<std::vector<BoxedValue>>())
+				return nullptr;
+		}
+
+		inference.forget_names();
+		return nullptr;
+	}
+
+	ProfiledNode::ProfiledNode(std::unique_ptr<ASTNode> && node, std::size_t line, std::string && label)
+		: m_node(std::move(node))
+		, m_line(line)
+		, m_label(std::move(label))
+	{}
+	BoxedValue ProfiledNode::evaluate(runtime::DispatchEngine & en) const
+	{
+		if (auto * profiler = en.get_profiler())
+		{
+			const runtime::Profiler::ScopedSample sample{ *profiler, *this };
+			return m_node->evaluate(en);
+		}
+
+		return m_node->evaluate(en);
+	}
+	void ProfiledNode::execute(runtime::DispatchEngine & en) const
+	{
+		if (auto * profiler = en.get_profiler())
+		{
+			const runtime::Profiler::ScopedSample sample{ *profiler, *this };
+			m_node->execute(en);
+			return;
+		}
+
+		m_node->execute(en);
+	}
+	void ProfiledNode::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		fn(m_node);
+	}
+	void ProfiledNode::collect_assigned(impl::LoopWrites & writes)
+	{
+		m_node->collect_assigned(writes);
+	}
+	bool ProfiledNode::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return m_node->is_invariant(writes);
+	}
+	BoxedValue ProfiledNode::evaluate_constant() const
+	{
+		return m_node->evaluate_constant();
+	}
+	const TypeInfo * ProfiledNode::infer_type(impl::TypeInference & inference)
+	{
+		return m_node->infer_type(inference);
+	}
+
+	TypedBinaryOperator::TypedBinaryOperator(std::unique_ptr<BinaryOperator> && op,
+											 binds::BinaryOperators::operation_fn fn,
+											 const TypeInfo & lhs_type, const TypeInfo & rhs_type)
+		: m_operator(std::move(op))
+		, m_fn(fn)
+		, m_lhs_type(lhs_type)
+		, m_rhs_type(rhs_type)
+		, m_pure(lhs_type.is_arithmetic() && rhs_type.is_arithmetic())
+	{}
+	BoxedValue TypedBinaryOperator::evaluate(runtime::DispatchEngine & en) const
+	{
+		return evaluate_impl(en, false);
+	}
+	void TypedBinaryOperator::execute(runtime::DispatchEngine & en) const
+	{
+		evaluate_impl(en, true);
+	}
+	BoxedValue TypedBinaryOperator::evaluate_impl(runtime::DispatchEngine & en, bool discard_result) const
+	{
+		BoxedValue lhs = m_operator->get_lhs().evaluate(en);
+		if (en.has_error())	return{};
+		BoxedValue rhs = m_operator->get_rhs().evaluate(en);
+		if (en.has_error())	return{};
+
+		BoxedValue & real_lhs = resolve_ref(lhs);
+		const BoxedValue & real_rhs = resolve_ref(rhs);
+		if (!real_lhs.empty() && !real_rhs.empty() &&
+			real_lhs.get_type_info() == m_lhs_type && real_rhs.get_type_info() == m_rhs_type)
+		{
+			if (!m_pure)
+				en.count_impure_call();
+			return m_fn(real_lhs, real_rhs);
+		}
+
+		return m_operator->apply(en, lhs, rhs, discard_result);
+	}
+	void TypedBinaryOperator::for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn)
+	{
+		m_operator->for_each_child(fn);
+	}
+	void TypedBinaryOperator::collect_writes(impl::LoopWrites & writes)
+	{
+		m_operator->collect_writes(writes);
+	}
+	bool TypedBinaryOperator::is_invariant(const impl::LoopWrites & writes) const
+	{
+		return m_operator->is_invariant(writes);
+	}
+	BoxedValue TypedBinaryOperator::evaluate_constant() const
+	{
+		return m_operator->evaluate_constant();
+	}
+	const TypeInfo * TypedBinaryOperator::infer_type(impl::TypeInference & inference)
+	{
+		return m_operator->infer_type(inference);
+	}
+
+	namespace impl
+	{
+		/// \brief	Replaces the operators decided by 'inference' in the tree of 'node'.
+		void make_typed(std::unique_ptr<ASTNode> & node, const TypeInference & inference)
+		{
+			node->for_each_child([&inference](std::unique_ptr<ASTNode> & child) { make_typed(child, inference); });
+			if (typeid(*node) != typeid(BinaryOperator))
+				return;
+
+			const auto * decision = inference.get_decision(static_cast<const BinaryOperator &>(*node));
+			if (!decision)
+				return;
+
+			// the operator is kept as it is, counted loops point to their conditions
+			std::unique_ptr<BinaryOperator> op{ static_cast<BinaryOperator *>(node.release()) };
+			node = std::make_unique<TypedBinaryOperator>(std::move(op), decision->m_fn,
+														 *decision->m_lhs_type, *decision->m_rhs_type);
+		}
+	}
+
+	void infer_types(std::unique_ptr<ASTNode> & root, const runtime::DispatchEngine & en)
+	{
+		// the functions do not know the types of their parameters, each body is inferred alone
+		std::vector<std::unique_ptr<ASTNode> *> bodies{ &root };
+		while (!bodies.empty())
+		{
+			std::unique_ptr<ASTNode> & body = *bodies.back();
+			bodies.pop_back();
 
-		// STUDY(Borja): checking if the value is an std::vector<BoxedValue> or std::string can improve performance
-		// This way we don't have to search in the maps and perform more virtual calls...
+			impl::TypeInference inference{ en };
+			body->infer_type(inference);
+			impl::make_typed(body, inference);
 
-		std::vector<BoxedValue> param{ index_bv_ref };
-		return impl::perform_member_function_call(en, "[]", real_inst, param);
+			for (auto * function_body : inference.take_functions())
+				bodies.push_back(function_body);
+		}
 	}
 
 }
@@ -448,6 +2196,37 @@ namespace ast
 		return std::make_unique<NamedVariable>(std::move(name), declaration);
 	}
 
+	std::unique_ptr<LocalVariable> make_local_variable(std::size_t slot, bool declaration)
+	{
+		return std::make_unique<LocalVariable>(slot, declaration);
+	}
+	std::unique_ptr<TopLevelVariable> make_top_level_variable(std::string && name)
+	{
+		return std::make_unique<TopLevelVariable>(std::move(name));
+	}
+
+	std::unique_ptr<FunctionDefinition> make_function_definition(std::string && name,
+																 std::size_t param_num,
+																 std::size_t local_num,
+																 std::unique_ptr<ASTNode> && body)
+	{
+		return std::make_unique<FunctionDefinition>(std::move(name), param_num, local_num,
+													std::move(body));
+	}
+	std::unique_ptr<Return> make_return(std::unique_ptr<ASTNode> && value)
+	{
+		return std::make_unique<Return>(std::move(value));
+	}
+
+	std::unique_ptr<Break> make_break()
+	{
+		return std::make_unique<Break>();
+	}
+	std::unique_ptr<Continue> make_continue()
+	{
+		return std::make_unique<Continue>();
+	}
+
 	std::unique_ptr<If> make_if(std::unique_ptr<ASTNode> && cond,
 								std::unique_ptr<ASTNode> && statements,
 								std::unique_ptr<ASTNode> && else_)
@@ -506,5 +2285,10 @@ namespace ast
 		return std::make_unique<ast::MemberVariableAccess>(std::move(name), std::move(inst));
 	}
 
-}
 
+	std::unique_ptr<ProfiledNode> make_profiled(std::unique_ptr<ASTNode> && node,
+												std::size_t line, std::string && label)
+	{
+		return std::make_unique<ProfiledNode>(std::move(node), line, std::move(label));
+	}
+}
\ No newline at end of file
@@ -2,13 +2,34 @@
 
 #include "Forwards.h"	// runtime::DispatchEngine &
 #include "BoxedValue.h"
-#include "Runtime\OperatorType.h"
+#include "Runtime/OperatorType.h"
+#include "Runtime/Operators.h"	// binds::BinaryOperators::operation_fn
 
+#include <functional>	// std::function
 #include <memory>	// std::unique_ptr
+#include <string>	// std::string
+#include <unordered_set>	// std::unordered_set
 #include <vector>	// std::vector
 
 namespace ast
 {
+	namespace impl
+	{
+		/// \brief	Variables a loop may modify in its iterations, see hoist_loop_invariants.
+		struct LoopWrites
+		{
+			bool writes(const std::string & name) const { return m_names.count(name) != 0; }
+			bool writes(std::size_t slot) const { return m_slots.count(slot) != 0; }
+			void add(const LoopWrites & other);
+
+			std::unordered_set<std::string> m_names;	///< named and top level variables
+			std::unordered_set<std::size_t> m_slots;	///< locals of the script function
+			bool m_unknown{ false };	///< something is modified that is not a variable
+		};
+
+		class TypeInference;
+	}
+
 	/// \brief	Abstract Sintax Tree node to represent the tree containing operations
 	class ASTNode
 	{
@@ -21,13 +42,42 @@ namespace ast
 		ASTNode& operator=(const ASTNode &) = delete;
 
 		virtual BoxedValue evaluate(runtime::DispatchEngine &) const = 0;
+		/// \brief	Evaluates the node when nobody reads its result (i.e. an statement of a
+		///			block or the increment of a for), nodes that can avoid building the result
+		///			override it.
+		virtual void execute(runtime::DispatchEngine & en) const { evaluate(en); }
+
+		/// \brief	Calls 'fn' with each child of the node, used to rewrite the tree after it is
+		///			built (see impl::hoist_loop_invariants).
+		virtual void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> &) {}
+		/// \brief	Adds the variables that evaluating the node may modify.
+		virtual void collect_writes(impl::LoopWrites & writes);
+		/// \brief	Adds what the node refers to when it is the target of an assignment, nodes
+		///			that do not refer to a variable cannot tell what is modified.
+		virtual void collect_assigned(impl::LoopWrites & writes) { writes.m_unknown = true; }
+		/// \brief	True if the node evaluates to the same value in all the iterations of a loop
+		///			that modifies 'writes', as long as the functions it calls are pure (which is
+		///			only known once they are resolved, see LoopInvariant).
+		virtual bool is_invariant(const impl::LoopWrites &) const { return false; }
+		/// \brief	Value of the node if it can be computed without an engine (i.e. literals and
+		///			the builtin operators applied to them), empty otherwise. Used by the parser
+		///			to prune the branches decided when parsing.
+		virtual BoxedValue evaluate_constant() const { return{}; }
+		/// \brief	Type of the values the node evaluates to if it is always the same, nullptr
+		///			otherwise. Updates the types known of the variables it modifies, see
+		///			ast::infer_types. By default the children are inferred in order and the
+		///			node may modify any named variable.
+		virtual const TypeInfo * infer_type(impl::TypeInference & inference);
 	};
 
 	class Noop final : public ASTNode
 	{
 		BoxedValue evaluate(runtime::DispatchEngine &) const override { return{}; }
+		void execute(runtime::DispatchEngine &) const override {}
 	};
 
+	/// \brief	Noops and the statements that follow a break, a continue or a return in the
+	///			same block are dropped when it is built, they would never be executed.
 	class Statements : public ASTNode
 	{
 	public:
@@ -37,6 +87,11 @@ namespace ast
 		explicit Statements(std::vector<std::unique_ptr<ASTNode>> && statements);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const std::vector<std::unique_ptr<ASTNode>> & get_statements() const { return m_statements; }
 
 	private:
 		std::vector<std::unique_ptr<ASTNode>> m_statements;
@@ -48,6 +103,8 @@ namespace ast
 		explicit Scope(std::vector<std::unique_ptr<ASTNode>> && statements);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
 
 	private:
 
@@ -59,14 +116,34 @@ namespace ast
 		explicit BinaryOperator(OperatorType op);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
 
 		void set_operands(std::unique_ptr<ASTNode> && lhs,
 						  std::unique_ptr<ASTNode> && rhs);
 
 		OperatorType get_operator_type() const;
 		bool has_operands() const;
+		const ASTNode & get_lhs() const { return *m_lhs; }
+		const ASTNode & get_rhs() const { return *m_rhs; }
+
+		/// \brief	Applies the operator to operands already evaluated and resolved.
+		BoxedValue operate(runtime::DispatchEngine & en, BoxedValue & lhs, const BoxedValue & rhs) const;
+		/// \brief	Applies the operator to operands already evaluated, as evaluating it does
+		///			(i.e. assigning to an empty variable does not look up an operator).
+		BoxedValue apply(runtime::DispatchEngine & en, BoxedValue & lhs, BoxedValue & rhs,
+						 bool discard_result) const;
+
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		BoxedValue evaluate_constant() const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
 
 	private:
+		BoxedValue evaluate_impl(runtime::DispatchEngine & en, bool discard_result) const;
+		/// \brief	Assignments and compound assignments.
+		bool modifies_lhs() const { return m_operator >= OperatorType::EQ; }
+
 		OperatorType m_operator;
 		std::unique_ptr<ASTNode> m_lhs;
 		std::unique_ptr<ASTNode> m_rhs;
@@ -78,10 +155,23 @@ namespace ast
 		UnaryOperator(OperatorType op, std::unique_ptr<ASTNode> && var);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		/// \brief	Increments and decrements do not copy the variable, 'i++' is done as '++i'.
+		void execute(runtime::DispatchEngine & en) const override;
 
 		inline OperatorType get_operator_type() const { return m_operator; }
+		const ASTNode & get_variable() const { return *m_variable; }
+
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		BoxedValue evaluate_constant() const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
 
 	private:
+		BoxedValue evaluate_impl(runtime::DispatchEngine & en, bool discard_result) const;
+		/// \brief	Increments and decrements.
+		bool modifies_value() const { return m_operator <= OperatorType::PRE_DEC; }
+
 		OperatorType m_operator;
 		std::unique_ptr<ASTNode> m_variable;
 
@@ -93,6 +183,12 @@ namespace ast
 		explicit Value(BoxedValue&& bv) : m_value(std::move(bv)) {}
 
 		BoxedValue evaluate(runtime::DispatchEngine &) const override;
+		void execute(runtime::DispatchEngine &) const override {}
+		bool is_invariant(const impl::LoopWrites &) const override { return true; }
+		BoxedValue evaluate_constant() const override { return m_value; }
+		const TypeInfo * infer_type(impl::TypeInference &) override;
+
+		const BoxedValue & get_value() const { return m_value; }
 
 	private:
 		BoxedValue m_value;
@@ -105,12 +201,160 @@ namespace ast
 		explicit NamedVariable(std::string && name, bool declaration = false);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const std::string & get_name() const { return m_variable_name; }
+		bool is_declaration() const { return m_declaration; }
 
 	private:
 		bool m_declaration{ false };	///< Determines if the variable needs to be created
 		std::string m_variable_name;
 	};
 
+	/// \brief	Parameter or local variable of a script function, stored in the slot
+	///			the parser gave it in the frame of the function.
+	class LocalVariable final : public ASTNode
+	{
+	public:
+		explicit LocalVariable(std::size_t slot, bool declaration = false);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		std::size_t get_slot() const { return m_slot; }
+		bool is_declaration() const { return m_declaration; }
+
+	private:
+		std::size_t m_slot;
+		bool m_declaration{ false };	///< Determines if the slot needs to be emptied
+	};
+
+	/// \brief	Variable used from a script function that is not one of its locals.
+	class TopLevelVariable final : public ASTNode
+	{
+	public:
+		explicit TopLevelVariable(std::string && name);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		/// \brief	The types of the variables of the caller are not known.
+		const TypeInfo * infer_type(impl::TypeInference &) override { return nullptr; }
+
+		const std::string & get_name() const { return m_variable_name; }
+
+	private:
+		std::string m_variable_name;
+	};
+
+	class FunctionDefinition final : public ASTNode
+	{
+	public:
+		FunctionDefinition(std::string && name, std::size_t param_num, std::size_t local_num,
+						   std::unique_ptr<ASTNode> && body);
+
+		/// \brief	Adds the function to the engine, it can be called from then on.
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		/// \brief	Calls may resolve to another function after it, nothing is invariant.
+		void collect_writes(impl::LoopWrites & writes) override { writes.m_unknown = true; }
+		/// \brief	The body is inferred on its own, once the rest of the tree is done, and
+		///			only while the function has not been added to an engine.
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const std::string & get_name() const { return m_name; }
+		const runtime::ScriptFunction & get_function() const { return *m_function; }
+
+	private:
+		std::string m_name;
+		std::shared_ptr<runtime::ScriptFunction> m_function;
+	};
+
+	class Return final : public ASTNode
+	{
+	public:
+		/// \note The parameter 'value' is null for a return without value.
+		explicit Return(std::unique_ptr<ASTNode> && value);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		/// \brief	nullptr for a return without value.
+		const ASTNode * get_value() const { return m_value.get(); }
+
+	private:
+		std::unique_ptr<ASTNode> m_value;
+	};
+
+	/// \brief	Stops the innermost loop, the statements left in it are not evaluated.
+	class Break final : public ASTNode
+	{
+	public:
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+	};
+	/// \brief	Skips the statements left in the current iteration of the innermost loop.
+	class Continue final : public ASTNode
+	{
+	public:
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+	};
+
+	namespace impl
+	{
+		/// \brief	Checked by loops after each iteration, consumes breaks and continues.
+		bool loop_must_stop(runtime::DispatchEngine & en);
+		/// \brief	Value of a condition already evaluated, false if it is not a bool or a number.
+		bool is_true(runtime::DispatchEngine & en, const BoxedValue & result);
+
+		/// \brief	Returns a local value to the parent node, which belongs to the same statement.
+		BoxedValue pass_up(BoxedValue & bv);
+
+		// what the operators and variables do once their children are evaluated, shared by the
+		// nodes and FlatTree
+
+		/// \brief	Looks up the operator of the types of the operands, 'lhs' is resolved.
+		BoxedValue operate(runtime::DispatchEngine & en, OperatorType op, BoxedValue & lhs, const BoxedValue & rhs);
+		/// \brief	See BinaryOperator::apply.
+		BoxedValue apply_binary_operator(runtime::DispatchEngine & en, OperatorType op,
+										 BoxedValue & lhs, BoxedValue & rhs, bool discard_result);
+		BoxedValue apply_unary_operator(runtime::DispatchEngine & en, OperatorType op, BoxedValue & value,
+										bool discard_result);
+		BoxedValue get_named_variable(runtime::DispatchEngine & en, const std::string & name, bool declaration);
+		BoxedValue get_local_variable(runtime::DispatchEngine & en, std::size_t slot, bool declaration);
+
+		enum class ConstantCondition { UNKNOWN, ALWAYS_TRUE, ALWAYS_FALSE };
+		/// \brief	How the condition of an if or a loop evaluates if it is a constant (see
+		///			ASTNode::evaluate_constant), conditions of types that cannot be evaluated
+		///			to true or false are left for the evaluation to report the error.
+		ConstantCondition get_constant_condition(const ASTNode & condition);
+
+		/// \brief	Induction variable of a for in the form 'for (var i = a; i < b; ++i)' (any
+		///			comparison and increments or decrements), which is kept as a native int while
+		///			the loop runs. The statements and the bound cannot assign the variable.
+		///			Profiled loops are not counted, so that all their nodes are measured.
+		///
+		///			In loops as 'for (var i = 0; i < v.size(); ++i)' whose statements call no
+		///			function nor assign 'v', the accesses 'v[i]' are known to be in range.
+		struct CountedLoop
+		{
+			const BinaryOperator * m_condition;	///< the bound is its rhs
+			int m_step;
+			std::string m_name;		///< of a named variable, empty for locals
+			std::size_t m_slot{ 0 };	///< of a local
+			/// \brief	The statements or the bound may read the variable (functions called may
+			///			read named variables), so it has to be updated in each iteration.
+			bool m_write_back{ false };
+		};
+	}
+
 	class If final : public ASTNode
 	{
 	public:
@@ -121,6 +365,14 @@ namespace ast
 		   std::unique_ptr<ASTNode> && else_);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const ASTNode & get_condition() const { return *m_condition; }
+		const ASTNode & get_statements() const { return *m_statements; }
+		/// \brief	nullptr if the if has no else.
+		const ASTNode * get_else() const { return m_else.get(); }
 
 	private:
 		std::unique_ptr<ASTNode> m_condition;
@@ -128,6 +380,9 @@ namespace ast
 		std::unique_ptr<ASTNode> m_else;
 	};
 
+	/// \brief	The subexpressions of the condition and the statements that do not change
+	///			in the iterations are hoisted out of the loop, see impl::hoist_loop_invariants.
+	///			A null condition is always true (the parser drops the constant ones).
 	class While final : public ASTNode
 	{
 	public:
@@ -135,12 +390,32 @@ namespace ast
 			  std::unique_ptr<ASTNode> && statements);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		/// \brief	nullptr if the loop has no condition.
+		const ASTNode * get_condition() const { return m_condition.get(); }
+		const ASTNode & get_statements() const { return *m_statements; }
+		/// \brief	Values hoisted out of the loop, see runtime::DispatchEngine::push_loop.
+		std::size_t get_invariant_num() const { return m_invariant_num; }
 
 	private:
+		void iterate(runtime::DispatchEngine & en) const;
+
 		std::unique_ptr<ASTNode> m_condition;
 		std::unique_ptr<ASTNode> m_statements;
+		impl::LoopWrites m_writes;	///< kept for the loops that contain this one
+		std::size_t m_invariant_num;
 	};
 
+	/// \brief	Hoists the invariant subexpressions of the condition, the increment and the
+	///			statements as While does, the initialization is only evaluated once anyway.
+	///			All the parts but the statements may be null, as in 'for (;;)'.
+	///			Counted loops do not evaluate the condition nor the increment, see
+	///			impl::CountedLoop. With SCRIPTING_JIT they are compiled to native code when
+	///			they only compute ints, see runtime::jit::compile_loop.
 	class For final : public ASTNode
 	{
 	public:
@@ -148,16 +423,82 @@ namespace ast
 			std::unique_ptr<ASTNode> && mid,
 			std::unique_ptr<ASTNode> && right,
 			std::unique_ptr<ASTNode> && statements);
+		~For();
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		/// \brief	The parts missing in the loop are nullptr.
+		const ASTNode * get_initialization() const { return m_left.get(); }
+		const ASTNode * get_condition() const { return m_condition.get(); }
+		const ASTNode * get_increment() const { return m_right.get(); }
+		const ASTNode & get_statements() const { return *m_statements; }
+		std::size_t get_invariant_num() const { return m_invariant_num; }
+		bool is_counted() const { return m_counted != nullptr; }
+		/// \brief	Compiled to native code, never without SCRIPTING_JIT.
+#ifdef SCRIPTING_JIT
+		bool is_compiled() const { return m_compiled != nullptr; }
+#else
+		bool is_compiled() const { return false; }
+#endif
 
 	private:
+		void iterate(runtime::DispatchEngine & en) const;
+		/// \brief	False if the loop has to go on as a generic one (i.e. the variable does not
+		///			store an int).
+		bool iterate_counted(runtime::DispatchEngine & en) const;
+
 		std::unique_ptr<ASTNode> m_left;
 		std::unique_ptr<ASTNode> m_condition;
 		std::unique_ptr<ASTNode> m_right;
 		std::unique_ptr<ASTNode> m_statements;
+		impl::LoopWrites m_writes;	///< of the iterations, the initialization is not included
+		std::size_t m_invariant_num;
+		std::unique_ptr<impl::CountedLoop> m_counted;
+#ifdef SCRIPTING_JIT
+		std::unique_ptr<runtime::jit::CompiledLoop> m_compiled;
+#endif
 	};
 
+	/// \brief	Subexpression of a loop that evaluates to the same value in all its iterations,
+	///			created by impl::hoist_loop_invariants. The value is computed the first time it
+	///			is needed in each run of the loop and reused by the next iterations, as long as
+	///			computing it only called pure functions and no impure function has been called
+	///			since then (which may have modified what it reads).
+	class LoopInvariant final : public ASTNode
+	{
+	public:
+		LoopInvariant(std::unique_ptr<ASTNode> && value, const ASTNode & loop, std::size_t slot);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const ASTNode & get_value() const { return *m_value; }
+
+	private:
+		std::unique_ptr<ASTNode> m_value;
+		const ASTNode * m_loop;
+		std::size_t m_slot;	///< of the value in the ones hoisted out of the loop
+	};
+
+	namespace impl
+	{
+		/// \brief	Wraps the biggest invariant subexpressions of 'parts' in LoopInvariant nodes
+		///			and returns how many, none if the loop modifies something that is not a
+		///			variable. Variables and literals are not worth hoisting. 'writes' gets
+		///			what the parts modify.
+		std::size_t hoist_loop_invariants(const ASTNode & loop,
+										  std::initializer_list<std::unique_ptr<ASTNode> *> parts,
+										  LoopWrites & writes);
+	}
+
 	namespace impl
 	{
 		class StatementList
@@ -166,7 +507,14 @@ namespace ast
 			explicit StatementList(std::vector<std::unique_ptr<ASTNode>> && statements);
 
 			std::vector<BoxedValue> evaluate_all(runtime::DispatchEngine & en) const;
+			/// \brief	As evaluate_all but the values are not moved out of the scratch arena,
+			///			'args' must not outlive the statement being evaluated.
+			void evaluate_arguments(runtime::DispatchEngine & en, std::vector<BoxedValue> & args) const;
 			std::size_t get_num() const;
+			const ASTNode & get(std::size_t i) const { return *m_statement_list[i]; }
+
+			void for_each(const std::function<void(std::unique_ptr<ASTNode> &)> & fn);
+			bool are_invariant(const LoopWrites & writes) const;
 
 		private:
 			std::vector<std::unique_ptr<ASTNode>> m_statement_list;
@@ -178,6 +526,8 @@ namespace ast
 	public:
 		VectorDecl(std::vector<std::unique_ptr<ASTNode>> && init_list);
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
 
 	private:
 		impl::StatementList m_init_list;
@@ -190,6 +540,12 @@ namespace ast
 						   std::vector<std::unique_ptr<ASTNode>> && params);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const std::string & get_name() const { return m_fn_name; }
+		const impl::StatementList & get_parameters() const { return m_parameters; }
 
 	private:
 		std::string m_fn_name;
@@ -203,6 +559,13 @@ namespace ast
 						   std::vector<std::unique_ptr<ASTNode>> && params);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const std::string & get_name() const { return m_fn_name; }
+		const ASTNode & get_instance() const { return *m_instance; }
+		std::size_t get_param_num() const { return m_parameters.get_num(); }
 
 	private:
 		std::string m_fn_name;
@@ -217,6 +580,10 @@ namespace ast
 							std::unique_ptr<ASTNode> && inst);
 
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
 
 	private:
 		std::string m_var_name;
@@ -224,18 +591,95 @@ namespace ast
 
 	};
 
+	/// \brief	Vectors of BoxedValue and strings indexed by integers are accessed natively,
+	///			checking the index, the rest of the types call their '[]' binding.
 	class VectorAccess final : public ASTNode
 	{
 	public:
 		VectorAccess(std::unique_ptr<ASTNode> && vec,
 			std::unique_ptr<ASTNode> && index);
 		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const ASTNode & get_vector() const { return *m_vector; }
+		const ASTNode & get_index() const { return *m_index; }
+		/// \brief	The index is always in range, checked by the condition of a counted loop
+		///			(see impl::CountedLoop), so the native accesses do not check it again.
+		void set_in_range() { m_in_range = true; }
 
 	private:
 		std::unique_ptr<ASTNode> m_vector;
 		std::unique_ptr<ASTNode> m_index;
+		bool m_in_range{ false };
 	};
 
+	/// \brief	Wraps a node to measure its evaluations, only created when parsing with
+	///			profiling enabled. If the engine has no profiler it just forwards the call.
+	class ProfiledNode final : public ASTNode
+	{
+	public:
+		ProfiledNode(std::unique_ptr<ASTNode> && node, std::size_t line, std::string && label);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_assigned(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		BoxedValue evaluate_constant() const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const ASTNode & get_node() const { return *m_node; }
+		std::size_t get_line() const { return m_line; }
+		const std::string & get_label() const { return m_label; }
+
+	private:
+		std::unique_ptr<ASTNode> m_node;
+		std::size_t m_line;
+		std::string m_label;
+	};
+
+	/// \brief	Operator whose operand types were proven by ast::infer_types, it calls the
+	///			operation of those types without looking it up. The types are still checked
+	///			(i.e. a variable assigned from a function that returned another type), when
+	///			they do not match it is applied as the operator it wraps.
+	class TypedBinaryOperator final : public ASTNode
+	{
+	public:
+		TypedBinaryOperator(std::unique_ptr<BinaryOperator> && op,
+							binds::BinaryOperators::operation_fn fn,
+							const TypeInfo & lhs_type, const TypeInfo & rhs_type);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+		void for_each_child(const std::function<void(std::unique_ptr<ASTNode> &)> & fn) override;
+		void collect_writes(impl::LoopWrites & writes) override;
+		bool is_invariant(const impl::LoopWrites & writes) const override;
+		BoxedValue evaluate_constant() const override;
+		const TypeInfo * infer_type(impl::TypeInference & inference) override;
+
+		const BinaryOperator & get_operator() const { return *m_operator; }
+
+	private:
+		BoxedValue evaluate_impl(runtime::DispatchEngine & en, bool discard_result) const;
+
+		std::unique_ptr<BinaryOperator> m_operator;
+		binds::BinaryOperators::operation_fn m_fn;
+		const TypeInfo & m_lhs_type;
+		const TypeInfo & m_rhs_type;
+		bool m_pure;	///< see impl::operate
+	};
+
+	/// \brief	Proves the types of the values of 'root' from its literals, the operators of
+	///			'en' and the return types of its bindings, following the assignments of the
+	///			variables through the branches and loops of the script. The operators whose
+	///			operand types are proven are replaced by TypedBinaryOperator, the rest of the
+	///			tree still looks up what to call when it is evaluated.
+	/// \note	The tree is typed for the bindings 'en' has, evaluating it in an engine that
+	///			binds other operators for the same types calls the ones of 'en'.
+	void infer_types(std::unique_ptr<ASTNode> & root, const runtime::DispatchEngine & en);
 }
 
 // functions to create ast nodes less verbosely
@@ -250,6 +694,12 @@ namespace ast
 	std::unique_ptr<UnaryOperator> make_unary_operator(OperatorType op,
 													   std::unique_ptr<ASTNode> && variable);
 
+	template <typename T>
+	std::unique_ptr<Value> make_value(T v)
+	{
+		return std::make_unique<Value>(BoxedValue{ v });
+	}
+
 	template <typename T1, typename T2>
 	std::unique_ptr<BinaryOperator> make_operator(T1 v1, OperatorType op, T2 v2)
 	{
@@ -261,15 +711,21 @@ namespace ast
 		return new_op;
 	}
 
-	template <typename T>
-	std::unique_ptr<Value> make_value(T v)
-	{
-		return std::make_unique<Value>(BoxedValue{ v });
-	}
-
 	std::unique_ptr<ASTNode> make_named_variable(std::string && name,
 												 bool declaration = false);
 
+	std::unique_ptr<LocalVariable> make_local_variable(std::size_t slot, bool declaration = false);
+	std::unique_ptr<TopLevelVariable> make_top_level_variable(std::string && name);
+
+	std::unique_ptr<FunctionDefinition> make_function_definition(std::string && name,
+																 std::size_t param_num,
+																 std::size_t local_num,
+																 std::unique_ptr<ASTNode> && body);
+	std::unique_ptr<Return> make_return(std::unique_ptr<ASTNode> && value = {});
+
+	std::unique_ptr<Break> make_break();
+	std::unique_ptr<Continue> make_continue();
+
 	std::unique_ptr<If> make_if(std::unique_ptr<ASTNode> && cond,
 								std::unique_ptr<ASTNode> && statements,
 								std::unique_ptr<ASTNode> && else_ = {});
@@ -295,4 +751,7 @@ namespace ast
 
 	std::unique_ptr<MemberVariableAccess> make_member_var_access(std::string name,
 		std::unique_ptr<ASTNode> && inst);
+
+	std::unique_ptr<ProfiledNode> make_profiled(std::unique_ptr<ASTNode> && node,
+												std::size_t line, std::string && label);
 }
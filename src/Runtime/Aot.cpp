@@ -0,0 +1,1145 @@
+
+#include "Aot.h"
+
+#include "DispatchEngine.h"		// runtime::DispatchEngine
+#include "ScriptFunction.h"		// runtime::ScriptFunction
+
+#include "Parse/OperatorParsing.h"	// parse::get_operator_str
+
+#include <cerrno>		// errno
+#include <cstdio>		// std::snprintf
+#include <fstream>		// std::ofstream
+#include <limits>		// std::numeric_limits
+#include <map>			// std::map
+#include <sstream>		// std::ostringstream
+#include <typeinfo>		// typeid
+#include <unordered_map>	// std::unordered_map
+#include <unordered_set>	// std::unordered_set
+#include <vector>		// std::vector
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>	// LoadLibraryA, GetProcAddress, CreateProcessA
+#else
+#include <dlfcn.h>		// dlopen, dlsym
+#include <fcntl.h>		// O_WRONLY
+#include <spawn.h>		// posix_spawnp
+#include <sys/wait.h>	// waitpid
+
+extern char ** environ;
+#endif
+
+#ifndef SCRIPTING_AOT_COMPILER
+#ifdef _WIN32
+#define SCRIPTING_AOT_COMPILER "cl"
+#else
+#define SCRIPTING_AOT_COMPILER "c++"
+#endif
+#endif
+
+namespace runtime
+{
+	namespace aot
+	{
+		namespace
+		{
+			const char * const s_entry_name = "scripting_native_script";
+
+			/// \brief	Types of the values the compiled code keeps, with their C++ spelling.
+			struct NativeType
+			{
+				const TypeInfo & m_type;
+				const char * m_name;
+			};
+			const std::vector<NativeType> & get_native_types()
+			{
+				static const std::vector<NativeType> s_types{
+					{ get_type_info<int>(), "int" },
+					{ get_type_info<unsigned int>(), "unsigned int" },
+					{ get_type_info<std::size_t>(), "std::size_t" },
+					{ get_type_info<char>(), "char" },
+					{ get_type_info<float>(), "float" },
+					{ get_type_info<double>(), "double" },
+					{ get_type_info<bool>(), "bool" },
+				};
+				return s_types;
+			}
+			const char * get_native_type_name(const TypeInfo & type)
+			{
+				for (const NativeType & native : get_native_types())
+				{
+					if (native.m_type == type)
+						return native.m_name;
+				}
+				return nullptr;
+			}
+
+			/// \brief	Name of the overloads of the generated code for each operator.
+			const std::map<OperatorType, const char *> & get_binary_operator_names()
+			{
+				static const std::map<OperatorType, const char *> s_names{
+					{ OperatorType::MUL, "op_mul" }, { OperatorType::DIV, "op_div" },
+					{ OperatorType::MOD, "op_mod" }, { OperatorType::ADD, "op_add" },
+					{ OperatorType::SUB, "op_sub" }, { OperatorType::LEFT_SHIFT, "op_shl" },
+					{ OperatorType::RIGHT_SHIFT, "op_shr" }, { OperatorType::LESS, "op_less" },
+					{ OperatorType::LESS_EQ, "op_less_eq" }, { OperatorType::GREATER, "op_greater" },
+					{ OperatorType::GREATER_EQ, "op_greater_eq" }, { OperatorType::EQEQ, "op_eqeq" },
+					{ OperatorType::NOT_EQ, "op_not_eq" }, { OperatorType::AND, "op_and" },
+					{ OperatorType::XOR, "op_xor" }, { OperatorType::OR, "op_or" },
+					{ OperatorType::LOGIC_AND, "op_logic_and" }, { OperatorType::LOGIC_OR, "op_logic_or" },
+					{ OperatorType::EQ, "op_eq" }, { OperatorType::ADD_EQ, "op_add_eq" },
+					{ OperatorType::SUB_EQ, "op_sub_eq" }, { OperatorType::MUL_EQ, "op_mul_eq" },
+					{ OperatorType::DIV_EQ, "op_div_eq" }, { OperatorType::MOD_EQ, "op_mod_eq" },
+					{ OperatorType::LEFT_SHIFT_EQ, "op_shl_eq" }, { OperatorType::RIGHT_SHIFT_EQ, "op_shr_eq" },
+					{ OperatorType::AND_EQ, "op_and_eq" }, { OperatorType::XOR_EQ, "op_xor_eq" },
+					{ OperatorType::OR_EQ, "op_or_eq" },
+				};
+				return s_names;
+			}
+			bool is_assignment(OperatorType op) { return op >= OperatorType::EQ; }
+
+			const char * get_unary_operator_name(OperatorType op)
+			{
+				switch (op)
+				{
+					case OperatorType::POST_INC:	return "op_post_inc";
+					case OperatorType::POST_DEC:	return "op_post_dec";
+					case OperatorType::PRE_INC:		return "op_pre_inc";
+					case OperatorType::PRE_DEC:		return "op_pre_dec";
+					case OperatorType::UNARY_MINUS:	return "op_minus";
+					case OperatorType::LOGIC_NOT:	return "op_logic_not";
+					case OperatorType::BITWISE_NOT:	return "op_bitwise_not";
+					default:						return nullptr;
+				}
+			}
+			bool modifies_value(OperatorType op) { return op <= OperatorType::PRE_DEC; }
+
+			/// \brief	Signature of a typed call as the generated code asks for it (i.e.
+			///			'float(int,float)'), empty if it takes or returns other types.
+			std::string get_signature(const binds::TypedCall & typed)
+			{
+				const char * result = typed.m_return_type ? get_native_type_name(*typed.m_return_type) : "void";
+				if (!result)
+					return{};
+
+				std::string signature = std::string{ result } + "(";
+				for (std::size_t i = 0; i < typed.m_param_types.size(); ++i)
+				{
+					const char * param = get_native_type_name(*typed.m_param_types[i]);
+					if (!param)
+						return{};
+					signature += (i == 0 ? "" : ",") + std::string{ param };
+				}
+				return signature + ")";
+			}
+
+			/// \brief	What all the generated sources start with. The deleted templates win over
+			///			the overloads that would convert an argument, so only the exact types
+			///			the engine has operators for compile.
+			const char * const s_preamble = R"code(// generated by runtime::aot::transpile, do not modify
+#include <cstddef>
+
+#ifdef _WIN32
+#define SCRIPTING_NATIVE_EXPORT extern "C" __declspec(dllexport)
+#else
+#define SCRIPTING_NATIVE_EXPORT extern "C"
+#endif
+
+namespace scripting_native
+{
+	// same layout as runtime::aot::NativeSink
+	struct Sink
+	{
+		void * m_engine;
+		void (*m_set_int)(void * engine, const char * name, int value);
+		void (*m_set_float)(void * engine, const char * name, float value);
+		void (*m_set_bool)(void * engine, const char * name, bool value);
+		void (*m_set_char)(void * engine, const char * name, char value);
+		void (*(*m_find_function)(void * engine, const char * name, const char * signature,
+								  const void ** binding))();
+	};
+
+	template <typename T> void export_variable(const Sink &, const char *, const T &) = delete;
+	inline void export_variable(const Sink & sink, const char * name, int value) { sink.m_set_int(sink.m_engine, name, value); }
+	inline void export_variable(const Sink & sink, const char * name, float value) { sink.m_set_float(sink.m_engine, name, value); }
+	inline void export_variable(const Sink & sink, const char * name, bool value) { sink.m_set_bool(sink.m_engine, name, value); }
+	inline void export_variable(const Sink & sink, const char * name, char value) { sink.m_set_char(sink.m_engine, name, value); }
+
+	// conditions of ifs and loops, as ast::impl::evaluate_condition
+	template <typename T> bool is_true(const T &) = delete;
+	inline bool is_true(bool value) { return value; }
+	inline bool is_true(int value) { return value != 0; }
+	inline bool is_true(float value) { return value != 0.f; }
+
+	// unary operators, as ast::UnaryOperator
+	template <typename T> void op_pre_inc(T &) = delete;
+	template <typename T> void op_pre_dec(T &) = delete;
+	template <typename T> void op_post_inc(T &) = delete;
+	template <typename T> void op_post_dec(T &) = delete;
+	template <typename T> void op_minus(const T &) = delete;
+	template <typename T> void op_logic_not(const T &) = delete;
+	template <typename T> void op_bitwise_not(const T &) = delete;
+	inline int & op_pre_inc(int & x) { return ++x; }
+	inline int & op_pre_dec(int & x) { return --x; }
+	inline int op_post_inc(int & x) { return x++; }
+	inline int op_post_dec(int & x) { return x--; }
+	inline int op_minus(int x) { return -x; }
+	inline bool op_logic_not(int x) { return !x; }
+	inline int op_bitwise_not(int x) { return ~x; }
+	inline float & op_pre_inc(float & x) { return ++x; }
+	inline float & op_pre_dec(float & x) { return --x; }
+	inline float op_post_inc(float & x) { return x++; }
+	inline float op_post_dec(float & x) { return x--; }
+	inline float op_minus(float x) { return -x; }
+	inline bool op_logic_not(float x) { return !x; }
+	inline bool op_logic_not(bool x) { return !x; }
+
+	// binary operators bound in the engine
+)code";
+
+			/// \brief	Body of the comparisons of an int and a size_t, which the engine does not
+			///			convert as C++ does (see the specializations of opts in Operators.h),
+			///			empty for the other operators.
+			std::string get_mixed_comparison(OperatorType op, bool int_lhs)
+			{
+				const char * lhs = int_lhs ? "static_cast<std::size_t>(l)" : "l";
+				const char * rhs = int_lhs ? "r" : "static_cast<std::size_t>(r)";
+				const char * negative = int_lhs ? "l < 0" : "r < 0";
+				const char * positive = int_lhs ? "l >= 0" : "r >= 0";
+				switch (op)
+				{
+					// opts::Greater compares as opts::Less does
+					case OperatorType::LESS:
+					case OperatorType::GREATER:
+						return int_lhs ? std::string{ negative } + " || " + lhs + " < " + rhs
+									   : std::string{ positive } + " && " + lhs + " < " + rhs;
+					case OperatorType::LESS_EQ:
+					case OperatorType::GREATER_EQ:
+						return int_lhs ? std::string{ negative } + " || " + lhs + " <= " + rhs
+									   : std::string{ positive } + " && " + lhs + " <= " + rhs;
+					case OperatorType::EQEQ:
+						return std::string{ positive } + " && " + lhs + " == " + rhs;
+					case OperatorType::NOT_EQ:
+						return std::string{ negative } + " || " + lhs + " != " + rhs;
+					default:
+						return{};
+				}
+			}
+
+			/// \brief	One overload per operator and pair of types bound in 'en', the operators of
+			///			the builtin types are the C++ ones (see binds::opts).
+			void write_binary_operators(const DispatchEngine & en, std::ostream & out)
+			{
+				for (const auto & op : get_binary_operator_names())
+				{
+					const std::string str = parse::get_operator_str(op.first).c_str();
+					if (is_assignment(op.first))
+						out << "\ttemplate <typename L, typename R> void " << op.second << "(L &, R) = delete;\n";
+					else
+						out << "\ttemplate <typename L, typename R> void " << op.second << "(L, R) = delete;\n";
+
+					for (const NativeType & lhs : get_native_types())
+					{
+						for (const NativeType & rhs : get_native_types())
+						{
+							const TypeInfo * result = en.get_binary_operator_result(lhs.m_type, op.first, rhs.m_type);
+							if (!result)
+								continue;
+
+							if (is_assignment(op.first))
+							{
+								if (!(*result == lhs.m_type))
+									continue;
+								out << "\tinline " << lhs.m_name << " & " << op.second << "(" << lhs.m_name
+									<< " & l, " << rhs.m_name << " r) { return l " << str << " r; }\n";
+							}
+							else if (const char * result_name = get_native_type_name(*result))
+							{
+								const bool int_lhs = lhs.m_type == get_type_info<int>() &&
+									rhs.m_type == get_type_info<std::size_t>();
+								const bool int_rhs = lhs.m_type == get_type_info<std::size_t>() &&
+									rhs.m_type == get_type_info<int>();
+								const std::string mixed = int_lhs || int_rhs ? get_mixed_comparison(op.first, int_lhs)
+																			 : std::string{};
+								out << "\tinline " << result_name << " " << op.second << "(" << lhs.m_name
+									<< " l, " << rhs.m_name << " r) { return "
+									<< (mixed.empty() ? "l " + str + " r" : mixed) << "; }\n";
+							}
+						}
+					}
+				}
+			}
+
+			/// \brief	Arguments of the bound functions, converted to their parameters as the
+			///			engine converts them (see binds::impl::ResolveParamTraits).
+			void write_argument_conversions(const DispatchEngine & en, std::ostream & out)
+			{
+				out << "\n\t// arguments of the bound functions\n"
+					<< "\ttemplate <typename T> struct to {};\n"
+					<< "\ttemplate <typename T, typename V> void arg(to<T>, V) = delete;\n";
+				for (const NativeType & param : get_native_types())
+				{
+					out << "\tinline " << param.m_name << " arg(to<" << param.m_name << ">, " << param.m_name
+						<< " v) { return v; }\n";
+					for (const NativeType & value : get_native_types())
+					{
+						if (value.m_type == param.m_type || !en.get_type_conversion(value.m_type, param.m_type))
+							continue;
+						out << "\tinline " << param.m_name << " arg(to<" << param.m_name << ">, " << value.m_name
+							<< " v) { return static_cast<" << param.m_name << ">(v); }\n";
+					}
+				}
+			}
+
+			/// \brief	Writes the body of the entry function, see transpile.
+			class Transpiler
+			{
+			public:
+				explicit Transpiler(const DispatchEngine & en) : m_engine(en) {}
+
+				bool transpile(const ast::ASTNode & root, std::ostream & out)
+				{
+					m_scopes.emplace_back();
+					if (!emit_statement(root))
+						return false;
+
+					out << "SCRIPTING_NATIVE_EXPORT void " << s_entry_name << "(const scripting_native::Sink * sink)\n{\n"
+						<< "\tusing namespace scripting_native;\n\n";
+					if (!m_bound_functions.empty())
+						out << m_lookups.str() << '\n';
+					out << m_out.str() << '\n';
+					for (const auto & name : m_exported)
+						out << "\texport_variable(*sink, \"" << name << "\", " << m_scopes.front()[name] << ");\n";
+					out << "}\n";
+					return true;
+				}
+
+			private:
+				bool emit_statement(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::Scope))
+					{
+						write_line("{");
+						if (!emit_block_statements(static_cast<const ast::Statements &>(node)))
+							return false;
+						write_line("}");
+						return true;
+					}
+					else if (type == typeid(ast::Statements))
+					{
+						for (const auto & statement : static_cast<const ast::Statements &>(node).get_statements())
+						{
+							if (!emit_statement(*statement))
+								return false;
+						}
+						return true;
+					}
+					else if (type == typeid(ast::Noop))
+					{
+						return true;
+					}
+					else if (type == typeid(ast::ProfiledNode))
+					{
+						return emit_statement(static_cast<const ast::ProfiledNode &>(node).get_node());
+					}
+					else if (type == typeid(ast::BinaryOperator) || type == typeid(ast::TypedBinaryOperator))
+					{
+						const ast::BinaryOperator & op = get_binary_operator(node);
+						if (op.get_operator_type() == OperatorType::EQ && is_declaration(op.get_lhs()))
+							return emit_declaration(op.get_lhs(), op.get_rhs());
+					}
+					else if (type == typeid(ast::If))
+					{
+						const auto & if_ = static_cast<const ast::If &>(node);
+						if (!emit_condition("if", if_.get_condition()) || !emit_body(if_.get_statements()))
+							return false;
+						if (const ast::ASTNode * else_ = if_.get_else())
+						{
+							write_line("else");
+							return emit_body(*else_);
+						}
+						return true;
+					}
+					else if (type == typeid(ast::While))
+					{
+						const auto & while_ = static_cast<const ast::While &>(node);
+						if (const ast::ASTNode * condition = while_.get_condition())
+						{
+							if (!emit_condition("while", *condition))
+								return false;
+						}
+						else
+						{
+							write_line("for (;;)");
+						}
+						return emit_body(while_.get_statements());
+					}
+					else if (type == typeid(ast::For))
+					{
+						return emit_for(static_cast<const ast::For &>(node));
+					}
+					else if (type == typeid(ast::Break))
+					{
+						write_line("break;");
+						return true;
+					}
+					else if (type == typeid(ast::Continue))
+					{
+						write_line("continue;");
+						return true;
+					}
+					else if (type == typeid(ast::Return))
+					{
+						return emit_return(static_cast<const ast::Return &>(node));
+					}
+					else if (type == typeid(ast::FunctionDefinition))
+					{
+						return emit_function(static_cast<const ast::FunctionDefinition &>(node));
+					}
+
+					write_indentation();
+					if (!emit_expression(node))
+						return false;
+					m_out << ";\n";
+					return true;
+				}
+
+				/// \brief	Statements of a block, in a scope of their own.
+				bool emit_block_statements(const ast::Statements & block)
+				{
+					++m_indentation;
+					m_scopes.emplace_back();
+					for (const auto & statement : block.get_statements())
+					{
+						if (!emit_statement(*statement))
+							return false;
+					}
+					m_scopes.pop_back();
+					--m_indentation;
+					return true;
+				}
+				/// \brief	Body of an if or a loop, always in braces so what it declares ends
+				///			with it (the engine may keep the locals of functions longer, but the
+				///			parser does not let them be used after their block).
+				bool emit_body(const ast::ASTNode & node, const char * end = "}")
+				{
+					write_line("{");
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::Scope) || type == typeid(ast::Statements))
+					{
+						if (!emit_block_statements(static_cast<const ast::Statements &>(node)))
+							return false;
+					}
+					else
+					{
+						++m_indentation;
+						m_scopes.emplace_back();
+						if (!emit_statement(node))
+							return false;
+						m_scopes.pop_back();
+						--m_indentation;
+					}
+					write_line(end);
+					return true;
+				}
+
+				bool emit_condition(const char * statement, const ast::ASTNode & condition)
+				{
+					write_indentation();
+					m_out << statement << " (is_true(";
+					if (!emit_expression(condition))
+						return false;
+					m_out << "))\n";
+					return true;
+				}
+
+				/// \brief	The initialization is declared in the enclosing block, as the engine
+				///			does not push an scope for the loop.
+				bool emit_for(const ast::For & node)
+				{
+					if (const ast::ASTNode * initialization = node.get_initialization())
+					{
+						if (!emit_statement(*initialization))
+							return false;
+					}
+
+					write_indentation();
+					m_out << "for (; ";
+					if (const ast::ASTNode * condition = node.get_condition())
+					{
+						m_out << "is_true(";
+						if (!emit_expression(*condition))
+							return false;
+						m_out << ")";
+					}
+					m_out << "; ";
+					if (const ast::ASTNode * increment = node.get_increment())
+					{
+						if (!emit_expression(*increment))
+							return false;
+					}
+					m_out << ")\n";
+					return emit_body(node.get_statements());
+				}
+
+				bool emit_declaration(const ast::ASTNode & variable, const ast::ASTNode & value)
+				{
+					// the functions would keep reading the variable declared before
+					const std::string key = get_key(variable);
+					const bool top_level = !m_function && m_scopes.size() == 1;
+					if (top_level && m_captured.count(key) != 0)
+						return false;
+
+					// the value cannot see the variable being declared, it is added after it
+					const std::string identifier = make_identifier(variable);
+					write_indentation();
+					m_out << "auto " << identifier << " = ";
+					if (!emit_expression(value))
+						return false;
+					m_out << ";\n";
+
+					auto & scope = m_scopes.back();
+					if (top_level && scope.count(key) == 0)
+						m_exported.push_back(key);
+					scope[key] = identifier;
+					return true;
+				}
+
+				bool emit_return(const ast::Return & node)
+				{
+					// a return in the top level ends the script before its variables are given back
+					if (!m_function)
+						return false;
+
+					write_indentation();
+					if (const ast::ASTNode * value = node.get_value())
+					{
+						m_returns_value = true;
+						m_out << "return ";
+						if (!emit_expression(*value))
+							return false;
+					}
+					else
+					{
+						m_returns_nothing = true;
+						m_out << "return";
+					}
+					m_out << ";\n";
+					return true;
+				}
+
+				/// \brief	Lambda capturing the top level variables, which are the only ones a
+				///			script function sees besides its locals.
+				bool emit_function(const ast::FunctionDefinition & node)
+				{
+					const runtime::ScriptFunction & function = node.get_function();
+					const auto key = std::make_pair(node.get_name(), function.get_param_num());
+					if (m_function || m_scopes.size() != 1 || m_functions.count(key) != 0 ||
+						m_bound_functions.count(key) != 0)
+					{
+						return false;
+					}
+
+					const std::string identifier = "f_" + node.get_name() + "_" + std::to_string(key.second);
+					write_indentation();
+					m_out << "const auto " << identifier << " = [&](";
+					m_scopes.emplace_back();
+					for (std::size_t i = 0; i < key.second; ++i)
+					{
+						const std::string local = "l_" + std::to_string(i);
+						m_scopes.back()["#" + std::to_string(i)] = local;
+						m_out << (i == 0 ? "" : ", ") << "auto " << local;
+					}
+					m_out << ")\n";
+
+					m_function = &function;
+					m_returns_value = false;
+					m_returns_nothing = false;
+					const bool valid = emit_body(function.get_body(), "};") &&
+						is_returning_on_all_paths(function.get_body());
+					m_function = nullptr;
+					m_scopes.pop_back();
+					if (!valid)
+						return false;
+
+					m_functions[key] = identifier;
+					return true;
+				}
+				/// \brief	Functions returning a value have to end returning one, a C++ function
+				///			would return garbage where the script returns nothing.
+				bool is_returning_on_all_paths(const ast::ASTNode & body) const
+				{
+					if (!m_returns_value)
+						return true;
+					if (m_returns_nothing)
+						return false;
+
+					const ast::ASTNode * last = &body;
+					const std::type_info & type = typeid(body);
+					if (type == typeid(ast::Scope) || type == typeid(ast::Statements))
+					{
+						const auto & statements = static_cast<const ast::Statements &>(body).get_statements();
+						if (statements.empty())
+							return false;
+						last = statements.back().get();
+					}
+					return typeid(*last) == typeid(ast::Return);
+				}
+
+				bool emit_expression(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::Value))
+					{
+						return emit_value(node.evaluate_constant());
+					}
+					else if (type == typeid(ast::NamedVariable) || type == typeid(ast::LocalVariable) ||
+							 type == typeid(ast::TopLevelVariable))
+					{
+						return emit_variable(node);
+					}
+					else if (type == typeid(ast::BinaryOperator) || type == typeid(ast::TypedBinaryOperator))
+					{
+						return emit_binary_operator(get_binary_operator(node));
+					}
+					else if (type == typeid(ast::UnaryOperator))
+					{
+						const auto & op = static_cast<const ast::UnaryOperator &>(node);
+						const char * name = get_unary_operator_name(op.get_operator_type());
+						if (!name)
+							return false;
+
+						m_out << name << "(";
+						const bool valid = modifies_value(op.get_operator_type()) ? emit_variable(op.get_variable())
+																				  : emit_expression(op.get_variable());
+						m_out << ")";
+						return valid;
+					}
+					else if (type == typeid(ast::LoopInvariant))
+					{
+						// the compiler hoists what it proves invariant
+						return emit_expression(static_cast<const ast::LoopInvariant &>(node).get_value());
+					}
+					else if (type == typeid(ast::ProfiledNode))
+					{
+						return emit_expression(static_cast<const ast::ProfiledNode &>(node).get_node());
+					}
+					else if (type == typeid(ast::GlobalFunctionCall))
+					{
+						return emit_call(static_cast<const ast::GlobalFunctionCall &>(node));
+					}
+
+					return false;
+				}
+
+				bool emit_value(const BoxedValue & value)
+				{
+					if (value.is_storing<int>())
+					{
+						const int i = boxed_cast<int>(value);
+						if (i == (std::numeric_limits<int>::min)())	m_out << "(" << i + 1 << " - 1)";
+						else										m_out << i;
+					}
+					else if (value.is_storing<float>())
+					{
+						// 9 significant digits give back the same float
+						char buffer[64];
+						std::snprintf(buffer, sizeof(buffer), "%.8ef", static_cast<double>(boxed_cast<float>(value)));
+						m_out << buffer;
+					}
+					else if (value.is_storing<bool>())
+					{
+						m_out << (boxed_cast<bool>(value) ? "true" : "false");
+					}
+					else if (value.is_storing<char>())
+					{
+						m_out << "static_cast<char>(" << static_cast<int>(boxed_cast<char>(value)) << ")";
+					}
+					else
+					{
+						return false;
+					}
+					return true;
+				}
+
+				bool emit_variable(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (is_declaration(node) || (type != typeid(ast::NamedVariable) &&
+												 type != typeid(ast::LocalVariable) &&
+												 type != typeid(ast::TopLevelVariable)))
+					{
+						return false;
+					}
+
+					// functions only see the top level variables declared before them, the rest
+					// are bound global variables or declared later
+					const std::string key = get_key(node);
+					const bool captured = type == typeid(ast::TopLevelVariable);
+					for (std::size_t i = captured ? 1 : m_scopes.size(); i-- > 0; )
+					{
+						const auto it = m_scopes[i].find(key);
+						if (it != m_scopes[i].end())
+						{
+							if (captured)
+								m_captured.insert(key);
+							m_out << it->second;
+							return true;
+						}
+					}
+					return false;
+				}
+
+				bool emit_binary_operator(const ast::BinaryOperator & op)
+				{
+					const auto & names = get_binary_operator_names();
+					const auto name = names.find(op.get_operator_type());
+					if (name == names.end())
+						return false;
+
+					// the variable assigned is evaluated first, as the engine does
+					if (is_assignment(op.get_operator_type()))
+					{
+						m_out << name->second << "(";
+						if (!emit_variable(op.get_lhs()))
+							return false;
+						m_out << ", ";
+						if (!emit_expression(op.get_rhs()))
+							return false;
+						m_out << ")";
+						return true;
+					}
+
+					return emit_ordered_call(name->second, { &op.get_lhs(), &op.get_rhs() });
+				}
+
+				bool emit_call(const ast::GlobalFunctionCall & call)
+				{
+					const ast::impl::StatementList & parameters = call.get_parameters();
+					const auto key = std::make_pair(call.get_name(), parameters.get_num());
+					std::string identifier;
+					if (const binds::IGlobalFunctionBinding * binding = m_engine.get_global_fn(call.get_name()))
+					{
+						// the engine would not call the function the script defines
+						if (m_functions.count(key) != 0 || !emit_lookup(key, *binding))
+							return false;
+						identifier = m_bound_functions[key];
+					}
+					else
+					{
+						const auto fn = m_functions.find(key);
+						if (fn == m_functions.end())
+							return false;
+						identifier = fn->second;
+					}
+
+					std::vector<const ast::ASTNode *> args;
+					for (std::size_t i = 0; i < parameters.get_num(); ++i)
+						args.push_back(&parameters.get(i));
+					return emit_ordered_call(identifier, args);
+				}
+
+				/// \brief	Looks up the bound function when the script starts, the first time it
+				///			is called, as a lambda converting its arguments for its typed call.
+				bool emit_lookup(const std::pair<std::string, std::size_t> & key,
+								 const binds::IGlobalFunctionBinding & binding)
+				{
+					if (m_bound_functions.count(key) != 0)
+						return true;
+
+					// the engine chooses the overload by the arguments, the C++ compiler could pick another
+					const auto * function = dynamic_cast<const binds::GlobalFunctionBinding *>(&binding);
+					if (!function)
+						return false;
+
+					const binds::TypedCall typed = function->get_typed_call();
+					const std::string signature = get_signature(typed);
+					if (!typed.m_fn || typed.m_param_types.size() != key.second || signature.empty())
+						return false;
+
+					const std::string identifier = "b_" + key.first + "_" + std::to_string(key.second);
+					m_lookups << "\tconst void * " << identifier << "_binding = nullptr;\n"
+							  << "\tconst auto " << identifier << "_fn = reinterpret_cast<"
+							  << signature.substr(0, signature.find('(')) << "(*)(const void *";
+					for (const TypeInfo * param : typed.m_param_types)
+						m_lookups << ", " << get_native_type_name(*param);
+					m_lookups << ")>(sink->m_find_function(sink->m_engine, \"" << key.first << "\", \"" << signature
+							  << "\", &" << identifier << "_binding));\n"
+							  << "\tif (!" << identifier << "_fn)\n"
+							  << "\t\treturn;\n"
+							  << "\tconst auto " << identifier << " = [&](";
+					for (std::size_t i = 0; i < key.second; ++i)
+						m_lookups << (i == 0 ? "" : ", ") << "auto a" << i;
+					m_lookups << ") { return " << identifier << "_fn(" << identifier << "_binding";
+					for (std::size_t i = 0; i < key.second; ++i)
+						m_lookups << ", arg(to<" << get_native_type_name(*typed.m_param_types[i]) << ">{}, a" << i << ")";
+					m_lookups << "); };\n";
+
+					m_bound_functions[key] = identifier;
+					return true;
+				}
+
+				/// \brief	C++ does not specify the order the arguments are evaluated in, when
+				///			any of them has side effects they are evaluated one by one as the
+				///			engine does. The variables are kept as references and the results of
+				///			the operators as copies, as the engine passes them.
+				bool emit_ordered_call(const std::string & fn, const std::vector<const ast::ASTNode *> & args)
+				{
+					bool ordered = false;
+					for (std::size_t i = 0; i < args.size() && args.size() > 1; ++i)
+						ordered = ordered || has_side_effects(*args[i]);
+
+					if (!ordered)
+					{
+						m_out << fn << "(";
+						for (std::size_t i = 0; i < args.size(); ++i)
+						{
+							m_out << (i == 0 ? "" : ", ");
+							if (!emit_expression(*args[i]))
+								return false;
+						}
+						m_out << ")";
+						return true;
+					}
+
+					m_out << "[&]() -> decltype(auto) { ";
+					for (std::size_t i = 0; i < args.size(); ++i)
+					{
+						m_out << (is_variable(*args[i]) ? "auto && a" : "auto a") << i << " = ";
+						if (!emit_expression(*args[i]))
+							return false;
+						m_out << "; ";
+					}
+					m_out << "return " << fn << "(";
+					for (std::size_t i = 0; i < args.size(); ++i)
+						m_out << (i == 0 ? "" : ", ") << "a" << i;
+					m_out << "); }()";
+					return true;
+				}
+
+				static bool has_side_effects(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::GlobalFunctionCall))
+					{
+						return true;
+					}
+					else if (type == typeid(ast::BinaryOperator) || type == typeid(ast::TypedBinaryOperator))
+					{
+						const ast::BinaryOperator & op = get_binary_operator(node);
+						return is_assignment(op.get_operator_type()) ||
+							has_side_effects(op.get_lhs()) || has_side_effects(op.get_rhs());
+					}
+					else if (type == typeid(ast::UnaryOperator))
+					{
+						const auto & op = static_cast<const ast::UnaryOperator &>(node);
+						return modifies_value(op.get_operator_type()) || has_side_effects(op.get_variable());
+					}
+					else if (type == typeid(ast::LoopInvariant))
+					{
+						return has_side_effects(static_cast<const ast::LoopInvariant &>(node).get_value());
+					}
+					else if (type == typeid(ast::ProfiledNode))
+					{
+						return has_side_effects(static_cast<const ast::ProfiledNode &>(node).get_node());
+					}
+					return false;
+				}
+
+				static bool is_variable(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					return type == typeid(ast::NamedVariable) || type == typeid(ast::LocalVariable) ||
+						type == typeid(ast::TopLevelVariable);
+				}
+				static const ast::BinaryOperator & get_binary_operator(const ast::ASTNode & node)
+				{
+					if (typeid(node) == typeid(ast::TypedBinaryOperator))
+						return static_cast<const ast::TypedBinaryOperator &>(node).get_operator();
+					return static_cast<const ast::BinaryOperator &>(node);
+				}
+				static bool is_declaration(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::NamedVariable))
+						return static_cast<const ast::NamedVariable &>(node).is_declaration();
+					if (type == typeid(ast::LocalVariable))
+						return static_cast<const ast::LocalVariable &>(node).is_declaration();
+					return false;
+				}
+				/// \brief	Name of named variables, '#slot' for the locals of functions.
+				static std::string get_key(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::NamedVariable))
+						return static_cast<const ast::NamedVariable &>(node).get_name();
+					if (type == typeid(ast::LocalVariable))
+						return "#" + std::to_string(static_cast<const ast::LocalVariable &>(node).get_slot());
+					return static_cast<const ast::TopLevelVariable &>(node).get_name();
+				}
+				/// \brief	Declaring a variable again creates another one, which may be of
+				///			another type.
+				std::string make_identifier(const ast::ASTNode & variable)
+				{
+					const std::string key = get_key(variable);
+					const std::string base = key[0] == '#' ? "l_" + key.substr(1) : "v_" + key;
+					const std::size_t count = m_declarations[base]++;
+					return count == 0 ? base : base + "_" + std::to_string(count);
+				}
+
+				void write_indentation()
+				{
+					for (int i = 0; i < m_indentation; ++i)
+						m_out << '\t';
+				}
+				void write_line(const char * line)
+				{
+					write_indentation();
+					m_out << line << '\n';
+				}
+
+				const DispatchEngine & m_engine;
+				std::ostringstream m_out;
+				int m_indentation{ 1 };
+
+				/// \brief	C++ identifiers of the variables declared in each block.
+				std::vector<std::unordered_map<std::string, std::string>> m_scopes;
+				std::unordered_map<std::string, std::size_t> m_declarations;
+				/// \brief	Top level variables read by functions.
+				std::unordered_set<std::string> m_captured;
+				/// \brief	Top level variables, in the order they are declared.
+				std::vector<std::string> m_exported;
+
+				std::map<std::pair<std::string, std::size_t>, std::string> m_functions;
+				/// \brief	Bound functions the script calls, looked up by m_lookups.
+				std::map<std::pair<std::string, std::size_t>, std::string> m_bound_functions;
+				std::ostringstream m_lookups;
+				const runtime::ScriptFunction * m_function{ nullptr };
+				bool m_returns_value{ false };
+				bool m_returns_nothing{ false };
+			};
+
+			template <typename T>
+			void set_variable(void * engine, const char * name, T value)
+			{
+				static_cast<DispatchEngine *>(engine)->create_variable(name, BoxedValue{ value });
+			}
+			NativeSink::function_type find_function(void * engine, const char * name, const char * signature,
+													const void ** binding)
+			{
+				DispatchEngine & en = *static_cast<DispatchEngine *>(engine);
+				const auto * function = dynamic_cast<const binds::GlobalFunctionBinding *>(en.get_global_fn(name));
+				if (!function)
+				{
+					en.set_error(except::ErrorCode::UNKNOWN_FUNCTION,
+								 "The compiled script calls the function '", name, "', which is not bound.");
+					return nullptr;
+				}
+
+				const binds::TypedCall typed = function->get_typed_call();
+				if (!typed.m_fn || get_signature(typed) != signature)
+				{
+					en.set_error(except::ErrorCode::NO_MATCHING_CALL, "The compiled script calls the function '",
+								 name, "' as '", signature, "', which is not how it is bound.");
+					return nullptr;
+				}
+
+				*binding = typed.m_binding;
+				return typed.m_fn;
+			}
+
+#ifdef _WIN32
+			/// \brief	As CommandLineToArgvW splits the command line back into the arguments.
+			std::string quote_argument(const std::string & arg)
+			{
+				std::string quoted = "\"";
+				std::size_t backslashes = 0;
+				for (const char c : arg)
+				{
+					if (c == '\\')
+					{
+						++backslashes;
+						continue;
+					}
+
+					// the backslashes before a quote escape themselves, and the quote
+					quoted.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+					quoted += c;
+					backslashes = 0;
+				}
+				quoted.append(backslashes * 2, '\\');
+				return quoted + '"';
+			}
+#endif
+
+			/// \brief	Runs 'args[0]' without a shell, hiding its output, true if it succeeds.
+			bool run(const std::vector<std::string> & args)
+			{
+#ifdef _WIN32
+				std::string command_line;
+				for (const auto & arg : args)
+					command_line += (command_line.empty() ? "" : " ") + quote_argument(arg);
+
+				SECURITY_ATTRIBUTES inherited{ sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+				HANDLE null = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &inherited, OPEN_EXISTING, 0, nullptr);
+				if (null == INVALID_HANDLE_VALUE)
+					return false;
+
+				STARTUPINFOA startup{};
+				startup.cb = sizeof(startup);
+				startup.dwFlags = STARTF_USESTDHANDLES;
+				startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+				startup.hStdOutput = null;
+				startup.hStdError = null;
+				PROCESS_INFORMATION process{};
+				const BOOL created = CreateProcessA(nullptr, &command_line[0], nullptr, nullptr, TRUE,
+													CREATE_NO_WINDOW, nullptr, nullptr, &startup, &process);
+				CloseHandle(null);
+				if (!created)
+					return false;
+
+				WaitForSingleObject(process.hProcess, INFINITE);
+				DWORD exit_code = 1;
+				GetExitCodeProcess(process.hProcess, &exit_code);
+				CloseHandle(process.hThread);
+				CloseHandle(process.hProcess);
+				return exit_code == 0;
+#else
+				std::vector<char *> argv;
+				for (const auto & arg : args)
+					argv.push_back(const_cast<char *>(arg.c_str()));
+				argv.push_back(nullptr);
+
+				posix_spawn_file_actions_t actions;
+				if (posix_spawn_file_actions_init(&actions) != 0)
+					return false;
+				posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+				posix_spawn_file_actions_adddup2(&actions, 1, 2);
+
+				pid_t pid;
+				const int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+				posix_spawn_file_actions_destroy(&actions);
+				if (spawned != 0)
+					return false;
+
+				int status = 0;
+				while (waitpid(pid, &status, 0) < 0)
+				{
+					if (errno != EINTR)
+						return false;
+				}
+				return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+			}
+		}
+
+		NativeScript::NativeScript(void * library, entry_fn entry)
+			: m_library(library)
+			, m_entry(entry)
+		{}
+		NativeScript::~NativeScript()
+		{
+#ifdef _WIN32
+			FreeLibrary(static_cast<HMODULE>(m_library));
+#else
+			dlclose(m_library);
+#endif
+		}
+
+		BoxedValue NativeScript::evaluate(DispatchEngine & en) const
+		{
+			NativeSink sink;
+			sink.m_engine = &en;
+			sink.m_set_int = &set_variable<int>;
+			sink.m_set_float = &set_variable<float>;
+			sink.m_set_bool = &set_variable<bool>;
+			sink.m_set_char = &set_variable<char>;
+			sink.m_find_function = &find_function;
+			m_entry(&sink);
+			return{};
+		}
+
+		bool transpile(const ast::ASTNode & root, const DispatchEngine & en, std::string & source)
+		{
+			std::ostringstream out;
+			out << s_preamble;
+			write_binary_operators(en, out);
+			write_argument_conversions(en, out);
+			out << "}\n\n";
+
+			Transpiler transpiler{ en };
+			if (!transpiler.transpile(root, out))
+				return false;
+
+			source = out.str();
+			return true;
+		}
+
+		bool compile(const std::string & source, const std::string & library_path)
+		{
+			const std::string source_path = library_path + ".cpp";
+			{
+				std::ofstream file{ source_path };
+				file << source;
+				if (!file)
+					return false;
+			}
+
+#ifdef _WIN32
+			return run({ SCRIPTING_AOT_COMPILER, "/nologo", "/LD", "/O2", "/EHsc", "/w", source_path,
+						 "/Fe" + library_path });
+#else
+			return run({ SCRIPTING_AOT_COMPILER, "-std=c++14", "-O2", "-shared", "-fPIC", "-w", "-o",
+						 library_path, source_path });
+#endif
+		}
+
+		std::unique_ptr<NativeScript> load(const std::string & library_path)
+		{
+#ifdef _WIN32
+			HMODULE library = LoadLibraryA(library_path.c_str());
+			if (!library)
+				return nullptr;
+
+			const auto entry = reinterpret_cast<NativeScript::entry_fn>(GetProcAddress(library, s_entry_name));
+			if (!entry)
+			{
+				FreeLibrary(library);
+				return nullptr;
+			}
+#else
+			// without a slash dlopen would look for it in the system paths
+			const std::string path = library_path.find('/') == std::string::npos ? "./" + library_path
+																				   : library_path;
+			void * library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+			if (!library)
+				return nullptr;
+
+			const auto entry = reinterpret_cast<NativeScript::entry_fn>(dlsym(library, s_entry_name));
+			if (!entry)
+			{
+				dlclose(library);
+				return nullptr;
+			}
+#endif
+			return std::make_unique<NativeScript>(library, entry);
+		}
+
+		std::unique_ptr<NativeScript> make_native_script(const ast::ASTNode & root,
+														 const DispatchEngine & en,
+														 const std::string & library_path)
+		{
+			std::string source;
+			if (!transpile(root, en, source) || !compile(source, library_path))
+				return nullptr;
+
+			return load(library_path);
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "AST.h"	// ast::ASTNode, runtime::DispatchEngine
+
+#include <memory>	// std::unique_ptr
+#include <string>	// std::string
+
+// Ahead of time compilation of the scripts that do not change, see make_native_script.
+namespace runtime
+{
+	namespace aot
+	{
+		/// \brief	What the compiled code receives to give its variables back to the engine.
+		///			Plain C so that it does not depend on the compiler of the library, the
+		///			generated source declares the same struct (see transpile).
+		struct NativeSink
+		{
+			using function_type = void(*)();
+
+			void * m_engine;
+			void (*m_set_int)(void * engine, const char * name, int value);
+			void (*m_set_float)(void * engine, const char * name, float value);
+			void (*m_set_bool)(void * engine, const char * name, bool value);
+			void (*m_set_char)(void * engine, const char * name, char value);
+			/// \brief	binds::TypedCall of the function 'name' bound in the engine, which fills
+			///			'binding' with what it has to be called with. nullptr (and an error set
+			///			in the engine) if it does not bind one with the 'signature' the script
+			///			was compiled for (i.e. 'float(int,float)').
+			function_type (*m_find_function)(void * engine, const char * name, const char * signature,
+											 const void ** binding);
+		};
+
+		/// \brief	Script loaded from a library built by compile, evaluating it creates the
+		///			variables declared in the top level of the script with the values they end
+		///			with, as evaluating the tree it was transpiled from does.
+		/// \note	The functions the script defines are only called by the script, they are
+		///			not added to the engine.
+		class NativeScript final : public ast::ASTNode
+		{
+		public:
+			using entry_fn = void(*)(const NativeSink * sink);
+
+			NativeScript(void * library, entry_fn entry);
+			~NativeScript();
+
+			BoxedValue evaluate(DispatchEngine & en) const override;
+
+		private:
+			void * m_library;
+			entry_fn m_entry;
+		};
+
+		/// \brief	Writes in 'source' a C++ translation unit computing the same as 'root', false
+		///			if the script uses something it cannot translate:
+		///				- values that are not int, float, bool or char (strings, vectors, the
+		///				  instances of bound types)
+		///				- bound functions that are overloaded or take or return other types,
+		///				  members and bound global variables
+		///				- recursive functions, functions returning a value on some paths only
+		///				  and top level variables declared again after a function reads them
+		///			The operators are overloads generated from the ones bound in 'en' for those
+		///			types, so the C++ compiler rejects the operations the engine would not find
+		///			(i.e. 'float + int'), and the script has to be evaluated then.
+		///			The bound functions are called through their binds::TypedCall, looked up in
+		///			the engine evaluating the script, and their arguments are converted as
+		///			the conversions bound in 'en' convert them.
+		bool transpile(const ast::ASTNode & root, const DispatchEngine & en, std::string & source);
+
+		/// \brief	Builds a shared library from 'source' with the compiler of the system
+		///			(SCRIPTING_AOT_COMPILER, 'c++' by default), run without a shell so the
+		///			paths are passed as they are. The source is kept next to the library
+		///			with the extension '.cpp' added.
+		bool compile(const std::string & source, const std::string & library_path);
+
+		/// \brief	nullptr if the library cannot be loaded or was not built by compile.
+		std::unique_ptr<NativeScript> load(const std::string & library_path);
+
+		/// \brief	Transpiles, compiles and loads 'root', which can be evaluated in its place.
+		///			nullptr if one of the steps fails, the tree has to be evaluated then.
+		std::unique_ptr<NativeScript> make_native_script(const ast::ASTNode & root,
+														 const DispatchEngine & en,
+														 const std::string & library_path);
+	}
+}
@@ -2,45 +2,81 @@
 #include "Bindings.h"
 #include "RuntimeException.h"
 
-#include <algorithm>	// std::sort
+#include <algorithm>	// std::find_if
 
 namespace binds
 {
 	namespace impl
 	{
+		/// \brief	Adds 'overload' to the ones taking as many parameters, after the ones
+		///			checking the type of as many parameters or more (so that typed overloads are
+		///			preferred to the ones taking anything, as script functions).
+		template <typename T>
+		void insert_overload(std::vector<std::vector<std::shared_ptr<T>>> & overloads,
+							 std::shared_ptr<T> && overload)
+		{
+			const std::size_t param_num = overload->get_param_num();
+			if (overloads.size() <= param_num)
+				overloads.resize(param_num + 1);
+
+			auto & same_arity = overloads[param_num];
+			const std::size_t typed = overload->get_typed_param_num();
+			const auto it = std::find_if(same_arity.begin(), same_arity.end(),
+										 [typed](const auto & other) { return other->get_typed_param_num() < typed; });
+			same_arity.insert(it, std::move(overload));
+		}
+
+		/// \brief	Leaves in 'plan' the conversions the arguments need to call the returned
+		///			overload. Only the overloads taking as many parameters as arguments are
+		///			scored, and the first one all the arguments match exactly is taken.
 		template <typename T>
 		const T * find_best_overload(
-			const std::vector<std::unique_ptr<T>> & overloads,
+			const std::vector<std::vector<std::shared_ptr<T>>> & overloads,
 			runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args)
+			std::vector<BoxedValue> & args,
+			ConversionPlan & plan)
 		{
-			// TODO(Borja): short the overloads by the parameter number they take and then only loop through 
-			// the ones that have exactly the parameter number equal to args.size()
+			if (args.size() >= overloads.size())
+				return nullptr;
 
+			SCR_COUNT(m_overload_resolutions);
+
+			const auto & same_arity = overloads[args.size()];
+			const FunctionCallMatchScore exact_match = static_cast<int>(args.size());
 			binds::impl::FunctionCallMatchScore best_score = binds::impl::FunctionCallMatchScore::invalid;
-			std::size_t call_idx = overloads.size();
-			for (std::size_t i = 0; i < overloads.size(); ++i)
+			std::size_t call_idx = same_arity.size();
+			ConversionPlan candidate;
+			for (std::size_t i = 0; i < same_arity.size(); ++i)
 			{
-				const auto score = overloads[i]->get_call_score(en, args);
+				candidate.clear();
+				const auto score = same_arity[i]->get_call_score(en, args, candidate);
 				if (score > best_score)
 				{
 					call_idx = i;
 					best_score = score;
+					plan = candidate;
+					if (score == exact_match)
+						break;
 				}
 			}
 
-			if (call_idx < overloads.size())
-				return overloads[call_idx].get();
+			if (call_idx < same_arity.size())
+				return same_arity[call_idx].get();
 
 			return nullptr;
 		}
+
+		/// \brief	The overloads return the same type or the type depends on the call.
+		const TypeInfo * get_common_return_type(const TypeInfo * lhs, const TypeInfo * rhs)
+		{
+			return lhs && rhs && *lhs == *rhs ? lhs : nullptr;
+		}
 	}
 
 	OverloadedGlobalFunctionBinding::OverloadedGlobalFunctionBinding(
-		std::unique_ptr<GlobalFunctionBinding> && overload0,
-		std::unique_ptr<GlobalFunctionBinding> && overload1)
+		std::shared_ptr<GlobalFunctionBinding> overload0,
+		std::shared_ptr<GlobalFunctionBinding> overload1)
 	{
-		m_overloads.reserve(2);
 		add_overload(std::move(overload0));
 		add_overload(std::move(overload1));
 	}
@@ -48,22 +84,27 @@ namespace binds
 	BoxedValue OverloadedGlobalFunctionBinding::do_call(runtime::DispatchEngine & en,
 		std::vector<BoxedValue> & args) const
 	{
-		if (auto * fn = impl::find_best_overload(m_overloads, en, args))
-			return fn->do_call(en, args);
+		impl::ConversionPlan plan;
+		if (auto * fn = impl::find_best_overload(m_overloads, en, args, plan))
+			return fn->call_planned(en, args, plan);
 
-		SCR_RUNTIME_EXCEPTION("Could not find a valid overload.");
+		return except::make_boxed_runtime_error();
 	}
 
-	void OverloadedGlobalFunctionBinding::add_overload(std::unique_ptr<GlobalFunctionBinding> && overload)
+	void OverloadedGlobalFunctionBinding::add_overload(std::shared_ptr<GlobalFunctionBinding> overload)
 	{
-		m_overloads.emplace_back(std::move(overload));
+		// pure only if all the overloads are
+		set_pure((m_overloads.empty() || is_pure()) && overload->is_pure());
+		set_return_type(impl::get_common_return_type(m_overloads.empty() ? overload->get_return_type()
+																		  : get_return_type(),
+													 overload->get_return_type()));
+		impl::insert_overload(m_overloads, std::move(overload));
 	}
 
 	OverloadedMemberFunctionBinding::OverloadedMemberFunctionBinding(
-		std::unique_ptr<MemberFunctionBinding> && overload0,
-		std::unique_ptr<MemberFunctionBinding> && overload1)
+		std::shared_ptr<MemberFunctionBinding> overload0,
+		std::shared_ptr<MemberFunctionBinding> overload1)
 	{
-		m_overloads.reserve(2);
 		add_overload(std::move(overload0));
 		add_overload(std::move(overload1));
 	}
@@ -71,14 +112,20 @@ namespace binds
 	BoxedValue OverloadedMemberFunctionBinding::do_call(runtime::DispatchEngine & en,
 		BoxedValue & inst, std::vector<BoxedValue> & args) const
 	{
-		if (auto * fn = impl::find_best_overload(m_overloads, en, args))
-			return fn->do_call(en, inst, args);
+		impl::ConversionPlan plan;
+		if (auto * fn = impl::find_best_overload(m_overloads, en, args, plan))
+			return fn->call_planned(en, inst, args, plan);
 
-		SCR_RUNTIME_EXCEPTION("Could not find a valid overload.");
+		return except::make_boxed_runtime_error();
 	}
 
-	void OverloadedMemberFunctionBinding::add_overload(std::unique_ptr<MemberFunctionBinding> && overload)
+	void OverloadedMemberFunctionBinding::add_overload(std::shared_ptr<MemberFunctionBinding> overload)
 	{
-		m_overloads.emplace_back(std::move(overload));
+		// pure only if all the overloads are
+		set_pure((m_overloads.empty() || is_pure()) && overload->is_pure());
+		set_return_type(impl::get_common_return_type(m_overloads.empty() ? overload->get_return_type()
+																		  : get_return_type(),
+													 overload->get_return_type()));
+		impl::insert_overload(m_overloads, std::move(overload));
 	}
 }
@@ -5,12 +5,18 @@
 #include "static_if.h"
 #include "RuntimeException.h"
 
+#include <array>		// std::array
 #include <functional>	// std::function
+#include <new>			// placement new
+#include <type_traits>	// std::aligned_storage_t
 #include <utility>		// std::integer_sequence
+#include <vector>		// std::vector
 
 // function bindings
 namespace binds
 {
+	class ITypeConversion;
+
 	namespace impl
 	{
 		enum class ResolutionType : unsigned 
@@ -20,35 +26,93 @@ namespace binds
 			CONVERSION_REQUIRED = 2,
 		};
 
+		/// \brief	Conversion each argument needs to reach the type of its parameter, found
+		///			while scoring an overload so that calling it does not inspect the arguments
+		///			again (see find_best_overload). Only the arguments of the parameters taken by
+		///			value are planned, and only the first s_max_args of them, the others are
+		///			resolved when the function is called.
+		class ConversionPlan
+		{
+		public:
+			static constexpr std::size_t s_max_args{ 8 };
+
+			void clear() { m_planned = 0; }
+			void set(std::size_t arg, const ITypeConversion * conversion)
+			{
+				if (arg >= s_max_args)	return;
+
+				m_conversions[arg] = conversion;
+				m_planned |= 1u << arg;
+			}
+
+			bool is_planned(std::size_t arg) const { return arg < s_max_args && (m_planned & (1u << arg)) != 0; }
+			/// \brief	nullptr if the argument already stores the type of the parameter.
+			const ITypeConversion * get(std::size_t arg) const { return m_conversions[arg]; }
+
+		private:
+			std::array<const ITypeConversion *, s_max_args> m_conversions{};
+			unsigned m_planned{ 0 };
+		};
+
 		template<typename T>
 		struct ResolveParamTraits
 		{
 			using cast_type = std::remove_reference_t<std::remove_pointer_t<T>>;
 			using type = cast_type;
-			static type cast(BoxedValue & bv, runtime::DispatchEngine & en)
+			static type cast(BoxedValue & bv, runtime::DispatchEngine & en, const ConversionPlan * plan,
+							 std::size_t arg)
 			{
-				auto & resolved_bv = resolve_ref(bv);
+				// the parameter is a copy, reading it as const avoids cloning a shared value
+				const auto & resolved_bv = resolve_ref(bv);
+
+				if (plan && plan->is_planned(arg))
+				{
+					const auto * conv = plan->get(arg);
+					return conv ? convert(*conv, resolved_bv) : resolved_bv.get_as<cast_type>();
+				}
 
 				if (resolved_bv.is_storing<cast_type>())
 					return resolved_bv.get_as<cast_type>();
 
-				if (const auto * conv = en.get_type_conversion(resolved_bv.get_type_info(), get_type_info<T>()))
-					return conv->convert<cast_type>(resolved_bv);
+				if (const auto * conv = find_conversion(en, resolved_bv))
+					return convert(*conv, resolved_bv);
 
 				SCR_RUNTIME_EXCEPTION("Cannot convert parameter of type '",
 									  resolved_bv.get_type_info().get_bare_std_type_info().name(), "' to '",
 									  typeid(cast_type).name(), "' to call function.");
 			}
 
-			static ResolutionType convertible(BoxedValue & bv, runtime::DispatchEngine & en)
+			static ResolutionType convertible(BoxedValue & bv, runtime::DispatchEngine & en, ConversionPlan & plan,
+											  std::size_t arg)
 			{
 				auto & resolved_bv = resolve_ref(bv);
 
 				if (resolved_bv.is_storing<cast_type>())
+				{
+					plan.set(arg, nullptr);
 					return ResolutionType::EXACT_MATCH;
+				}
+
+				const auto * conv = find_conversion(en, resolved_bv);
+				if (conv == nullptr)
+					return ResolutionType::NOT_CONVERTIBLE;
+
+				plan.set(arg, conv);
+				return ResolutionType::CONVERSION_REQUIRED;
+			}
 
-				const auto * conv = en.get_type_conversion(resolved_bv.get_type_info(), get_type_info<T>());
-				return conv == nullptr ? ResolutionType::NOT_CONVERTIBLE : ResolutionType::CONVERSION_REQUIRED;
+		private:
+			/// \brief	Template so that DispatchEngine is only needed when it is instantiated.
+			template <typename Engine>
+			static const ITypeConversion * find_conversion(const Engine & en, const BoxedValue & bv)
+			{
+				return en.get_type_conversion(bv.get_type_info(), get_type_info<T>());
+			}
+			/// \brief	Template so that ITypeConversion is only needed when it is instantiated.
+			template <typename Conversion>
+			static type convert(const Conversion & conv, const BoxedValue & bv)
+			{
+				return conv.template convert<std::remove_cv_t<cast_type>>(bv);
 			}
 		};
 		template<typename T>
@@ -56,7 +120,7 @@ namespace binds
 		{
 			using cast_type = std::remove_reference_t<std::remove_pointer_t<T>>;
 			using type = cast_type &;
-			static type & cast(BoxedValue & bv, runtime::DispatchEngine &)
+			static type & cast(BoxedValue & bv, runtime::DispatchEngine &, const ConversionPlan *, std::size_t)
 			{
 				auto & resolved_bv = resolve_ref(bv);
 
@@ -68,7 +132,8 @@ namespace binds
 									  typeid(cast_type).name(), " &' to call function.");
 			}
 
-			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &)
+			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &, ConversionPlan &,
+											  std::size_t)
 			{
 				return resolve_ref(bv).is_storing<cast_type>() ? ResolutionType::EXACT_MATCH : ResolutionType::NOT_CONVERTIBLE;
 			}
@@ -78,12 +143,13 @@ namespace binds
 		struct ResolveParamTraits<const char *>
 		{
 			using type = const char *;
-			static const char * cast(BoxedValue & bv, runtime::DispatchEngine &)
+			static const char * cast(BoxedValue & bv, runtime::DispatchEngine &, const ConversionPlan *, std::size_t)
 			{
 				return resolve_ref_cast<std::string>(bv).c_str();
 			}
 
-			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &)
+			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &, ConversionPlan &,
+											  std::size_t)
 			{
 				return resolve_ref(bv).is_storing<std::string>() ? ResolutionType::EXACT_MATCH : ResolutionType::NOT_CONVERTIBLE;
 			}
@@ -92,11 +158,12 @@ namespace binds
 		struct ResolveParamTraits<BoxedValue>
 		{
 			using type = BoxedValue;
-			static BoxedValue & cast(BoxedValue & bv, runtime::DispatchEngine &) 
+			static BoxedValue & cast(BoxedValue & bv, runtime::DispatchEngine &, const ConversionPlan *, std::size_t)
 			{
 				return resolve_ref(bv); 
 			}
-			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &)
+			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &, ConversionPlan &,
+											  std::size_t)
 			{
 				return bv.is_storing<type>() ? ResolutionType::EXACT_MATCH : ResolutionType::NOT_CONVERTIBLE;
 			}
@@ -105,12 +172,13 @@ namespace binds
 		struct ResolveParamTraits<BoxedValue &>
 		{
 			using type = BoxedValue &;
-			static BoxedValue & cast(BoxedValue & bv, runtime::DispatchEngine &)
+			static BoxedValue & cast(BoxedValue & bv, runtime::DispatchEngine &, const ConversionPlan *, std::size_t)
 			{ 
 				return resolve_ref(bv); 
 			}
 			
-			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &)
+			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &, ConversionPlan &,
+											  std::size_t)
 			{
 				return bv.is_storing<type>() ? ResolutionType::EXACT_MATCH : ResolutionType::NOT_CONVERTIBLE;
 			}
@@ -119,55 +187,70 @@ namespace binds
 		struct ResolveParamTraits<BoxedValue &&>
 		{
 			using type = BoxedValue &;
-			static BoxedValue & cast(BoxedValue & bv, runtime::DispatchEngine &) 
+			static BoxedValue & cast(BoxedValue & bv, runtime::DispatchEngine &, const ConversionPlan *, std::size_t)
 			{ 
 				return resolve_ref(bv); 
 			}
-			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &)
+			static ResolutionType convertible(const BoxedValue & bv, const runtime::DispatchEngine &, ConversionPlan &,
+											  std::size_t)
 			{
 				return bv.is_storing<type>() ? ResolutionType::EXACT_MATCH : ResolutionType::NOT_CONVERTIBLE;
 			}
 		};
 
+		/// \brief	Argument 'arg' of a call, converted to the parameter as 'plan' says if it
+		///			is not nullptr.
 		template <typename T>
 		class ResolveParamType
 		{
 		public:
 			ResolveParamType(BoxedValue & bv,
-				runtime::DispatchEngine & engine)
+				runtime::DispatchEngine & engine,
+				const ConversionPlan * plan = nullptr,
+				std::size_t arg = 0)
 				: m_bv{ bv }
 				, m_engine{ engine }
+				, m_plan{ plan }
+				, m_arg{ arg }
 			{}
 
 			using traits = ResolveParamTraits<T>;
 			using type = typename traits::type;
-			operator type () { return traits::cast(m_bv, m_engine); }
+			operator type () { return traits::cast(m_bv, m_engine, m_plan, m_arg); }
 
-			ResolutionType is_convertible() { return traits::convertible(m_bv, m_engine); }
+			ResolutionType is_convertible(ConversionPlan & plan) { return traits::convertible(m_bv, m_engine, plan, m_arg); }
 
 		private:
 			BoxedValue & m_bv;
 			runtime::DispatchEngine & m_engine;
+			const ConversionPlan * m_plan;
+			std::size_t m_arg;
 		};
 		template <typename T>
 		class ResolveParamType< T && >
 		{
 		public:
 			ResolveParamType(BoxedValue & bv,
-				runtime::DispatchEngine & engine)
+				runtime::DispatchEngine & engine,
+				const ConversionPlan * plan = nullptr,
+				std::size_t arg = 0)
 				: m_bv{ bv }
 				, m_engine{ engine }
+				, m_plan{ plan }
+				, m_arg{ arg }
 			{}
 
 			using traits = ResolveParamTraits<T>;
 			using type = typename ResolveParamTraits<T>::type;
-			operator T && () { return std::move(traits::cast(m_bv, m_engine)); }
+			operator T && () { return std::move(traits::cast(m_bv, m_engine, m_plan, m_arg)); }
 
-			ResolutionType is_convertible() const { return traits::convertible(m_bv, m_engine); }
+			ResolutionType is_convertible(ConversionPlan & plan) const { return traits::convertible(m_bv, m_engine, plan, m_arg); }
 
 		private:
 			BoxedValue & m_bv;
 			runtime::DispatchEngine & m_engine;
+			const ConversionPlan * m_plan;
+			std::size_t m_arg;
 		};
 
 		template <typename T>
@@ -178,6 +261,18 @@ namespace binds
 		template <typename T>
 		using ResolveReturnType = typename ResolveReturnType_impl<T>::type;
 
+		/// \brief	Type of the values a function returning R creates, nullptr if it returns
+		///			nothing or a BoxedValue, whose type is only known when called.
+		template <typename R>
+		const TypeInfo * get_return_type_info()
+		{
+			using value_type = std::decay_t<ResolveReturnType<R>>;
+			if (std::is_void<value_type>::value || std::is_same<value_type, BoxedValue>::value)
+				return nullptr;
+
+			return &::get_type_info<value_type>();
+		}
+
 		class FunctionCallMatchScore
 		{
 		public:
@@ -199,6 +294,8 @@ namespace binds
 				case ResolutionType::EXACT_MATCH:
 					m_score++;
 					break;
+				case ResolutionType::CONVERSION_REQUIRED:
+					break;
 				}
 
 				return *this;
@@ -215,20 +312,34 @@ namespace binds
 			int m_score{ 0 };
 		};
 
+		/// \brief	Parameters whose type is checked when scoring a call, the ones taking a
+		///			BoxedValue take anything.
+		template <typename ... Args>
+		constexpr std::size_t get_typed_param_num()
+		{
+			std::size_t num = 0;
+			const bool typed[] = { !std::is_same<std::decay_t<Args>, BoxedValue>::value ..., false };
+			for (bool t : typed)
+				num += t ? 1 : 0;
+			return num;
+		}
+
+		/// \brief	Fills 'plan' with the conversions the arguments need.
 		template <typename ... Args, std::size_t ... Is>
 		FunctionCallMatchScore get_function_call_score(runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args,
+			std::vector<BoxedValue> & args, ConversionPlan & plan,
 			std::index_sequence<Is ...>)
 		{
 			(void)en;
 			(void)args;
+			(void)plan;
 
 			if (sizeof...(Args) != args.size())
 				return{ FunctionCallMatchScore::invalid };
 
 			FunctionCallMatchScore score = 0;
-			const std::initializer_list<int> are_convertible{
-				(score += impl::ResolveParamType<Args>(args[Is], en).is_convertible(), 0) ...
+			(void)std::initializer_list<int>{
+				(score += impl::ResolveParamType<Args>(args[Is], en, nullptr, Is).is_convertible(plan), 0) ...
 			};
 
 			return score;
@@ -239,20 +350,85 @@ namespace binds
 	{
 	public:
 		IGlobalFunctionBinding() = default;
+		IGlobalFunctionBinding(const IGlobalFunctionBinding &) = default;	// overloaded bindings are copied before modifying a shared one
 		IGlobalFunctionBinding(IGlobalFunctionBinding &&) = default;
 		IGlobalFunctionBinding& operator=(IGlobalFunctionBinding &&) = default;
 		virtual ~IGlobalFunctionBinding() = default;
 
+		/// \brief	Returns except::make_boxed_runtime_error() if the function cannot be
+		///			called with 'args', instead of throwing.
 		virtual BoxedValue do_call(runtime::DispatchEngine & en, 
 								   std::vector<BoxedValue> & args) const = 0;
+
+		/// \brief	Pure functions have no side effects and their result only depends on their
+		///			parameters, see binds::pure.
+		bool is_pure() const { return m_pure; }
+		void set_pure(bool pure) { m_pure = pure; }
+
+		/// \brief	Type of the values the function returns, nullptr if it is not always the
+		///			same, used by ast::infer_types.
+		const TypeInfo * get_return_type() const { return m_return_type; }
+
+	protected:
+		void set_return_type(const TypeInfo * type) { m_return_type = type; }
+
+	private:
+		bool m_pure{ false };
+		const TypeInfo * m_return_type{ nullptr };
+	};
+
+	/// \brief	Function calling a binding with its arguments unboxed, as
+	///			'R(*)(const void * binding, Args...)' once cast back to the types of the
+	///			binding. Used by the compiled scripts, see runtime::aot.
+	struct TypedCall
+	{
+		using fn_type = void(*)();
+
+		fn_type m_fn{ nullptr };					///< nullptr if the binding cannot be called so
+		const void * m_binding{ nullptr };
+		const TypeInfo * m_return_type{ nullptr };	///< nullptr if the function returns void
+		std::vector<const TypeInfo *> m_param_types;
 	};
 
+	namespace impl
+	{
+		/// \brief	Functions taking and returning values only, which are called the same
+		///			with their arguments unboxed.
+		template <typename R, typename ... Args>
+		constexpr bool is_typed_callable()
+		{
+			bool callable = std::is_void<R>::value ||
+				(std::is_same<R, std::decay_t<R>>::value && !std::is_pointer<R>::value &&
+				 !std::is_same<R, BoxedValue>::value);
+			const bool values[] = { (std::is_same<Args, std::decay_t<Args>>::value &&
+									 !std::is_pointer<Args>::value && !std::is_same<Args, BoxedValue>::value) ..., true };
+			for (bool value : values)
+				callable = callable && value;
+			return callable;
+		}
+	}
+
 	class GlobalFunctionBinding 
 		: public IGlobalFunctionBinding
 	{
 	public:
+		/// \brief	Empty if the function cannot be called without boxing its arguments.
+		virtual TypedCall get_typed_call() const { return{}; }
+
+		/// \brief	Fills 'plan' with the conversions the arguments need to call the function.
 		virtual impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args) const = 0;
+			std::vector<BoxedValue> & args, impl::ConversionPlan & plan) const = 0;
+		/// \brief	As do_call, converting the arguments as get_call_score planned for them.
+		virtual BoxedValue call_planned(runtime::DispatchEngine & en, std::vector<BoxedValue> & args,
+										const impl::ConversionPlan &) const
+		{
+			return do_call(en, args);
+		}
+
+		/// \brief	Overloads are only scored for calls with as many arguments.
+		virtual std::size_t get_param_num() const = 0;
+		/// \brief	Overloads checking the type of more parameters are scored first.
+		virtual std::size_t get_typed_param_num() const = 0;
 	};
 	
 	class OverloadedGlobalFunctionBinding
@@ -260,88 +436,169 @@ namespace binds
 	{
 	public:
 		OverloadedGlobalFunctionBinding(
-			std::unique_ptr<GlobalFunctionBinding> && overload0,
-			std::unique_ptr<GlobalFunctionBinding> && overload1);
+			std::shared_ptr<GlobalFunctionBinding> overload0,
+			std::shared_ptr<GlobalFunctionBinding> overload1);
 
 		BoxedValue do_call(runtime::DispatchEngine & en,
 				std::vector<BoxedValue> & args) const override;
 
-		void add_overload(std::unique_ptr<GlobalFunctionBinding> && overload);
+		void add_overload(std::shared_ptr<GlobalFunctionBinding> overload);
 
 	private:
-		std::vector<std::unique_ptr<GlobalFunctionBinding>> m_overloads;
+		/// \brief	Indexed by the number of parameters, see impl::insert_overload.
+		std::vector<std::vector<std::shared_ptr<GlobalFunctionBinding>>> m_overloads;
 	};
 
-	template <typename R, typename ... Args>
-	class GlobalFnBinding : public GlobalFunctionBinding
+	/// \brief	Calls an FN (function pointer, lambda, functor or std::function) taking Args and
+	///			returning R, kept as it is so that the call is direct when FN is not a
+	///			std::function (see binds::func).
+	template <typename FN, typename R, typename ... Args>
+	class GlobalFunctionBindingImpl : public GlobalFunctionBinding
 	{
 	public:
-		using fn_type = std::function<R(Args...)>;
-		GlobalFnBinding(R(*fn)(Args ...))
-			: m_fn(fn)
-		{}
-		GlobalFnBinding(fn_type && fn)
+		using fn_type = FN;
+		GlobalFunctionBindingImpl(fn_type fn)
 			: m_fn(std::move(fn))
-		{}
+		{
+			set_return_type(impl::get_return_type_info<R>());
+		}
 
 		BoxedValue do_call(runtime::DispatchEngine & en,
 						   std::vector<BoxedValue> & args) const override
+		{
+			return call(en, args, nullptr);
+		}
+		BoxedValue call_planned(runtime::DispatchEngine & en, std::vector<BoxedValue> & args,
+								const impl::ConversionPlan & plan) const override
+		{
+			return call(en, args, &plan);
+		}
+
+		std::size_t get_param_num() const override { return sizeof...(Args); }
+		std::size_t get_typed_param_num() const override { return impl::get_typed_param_num<Args...>(); }
+
+		TypedCall get_typed_call() const override
+		{
+			if (!impl::is_typed_callable<R, Args...>())
+				return{};
+
+			using typed_fn_type = R(*)(const void *, Args...);
+			const typed_fn_type fn = &call_typed;
+			return{ reinterpret_cast<TypedCall::fn_type>(fn), this, impl::get_return_type_info<R>(),
+					{ &::get_type_info<std::decay_t<Args>>() ... } };
+		}
+	private:
+		impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
+			std::vector<BoxedValue> & args, impl::ConversionPlan & plan) const override
+		{
+			return impl::get_function_call_score<Args...>(en, args, plan, std::index_sequence_for<Args...>{});
+		}
+
+		static R call_typed(const void * binding, Args ... args)
+		{
+			return static_cast<const GlobalFunctionBindingImpl *>(binding)->m_fn(std::forward<Args>(args) ...);
+		}
+
+		BoxedValue call(runtime::DispatchEngine & en, std::vector<BoxedValue> & args,
+						const impl::ConversionPlan * plan) const
 		{
 			if (sizeof...(Args) != args.size())
-				SCR_RUNTIME_EXCEPTION("Invalid parameter number, expecting ", sizeof...(Args), " and received ", args.size());
+				return except::make_boxed_runtime_error();
 
 			return meta::static_if(std::is_same < R, void>{})
 				// returning void
-				.then([this](auto & en, auto & args)
+				.then([this, plan](auto & en, auto & args)
 			{
-				do_call_impl(en, args, std::index_sequence_for<Args ...>{});
+				do_call_impl(en, args, plan, std::index_sequence_for<Args ...>{});
 				return BoxedValue{};
 			})
 				// returning parameter
-				.else_([this](auto & en, auto & args)
+				.else_([this, plan](auto & en, auto & args)
 			{
-				return BoxedValue{ do_call_impl(en, args, std::index_sequence_for<Args ...>{}) };
+				return BoxedValue{
+					BoxedValueTemporary_t{},
+					do_call_impl(en, args, plan, std::index_sequence_for<Args ...>{})
+				};
 			})(en, args);
 		}
-	private:
-		impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args) const override
-		{
-			return impl::get_function_call_score<Args...>(en, args, std::index_sequence_for<Args...>{});
-		}
 
 		template <std::size_t ... Is>
 		impl::ResolveReturnType<R> do_call_impl(runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args,
+			std::vector<BoxedValue> & args, const impl::ConversionPlan * plan,
 			std::index_sequence<Is ...>) const
 		{
 			(void)en;
 			(void)args;
+			(void)plan;
 
-			return m_fn(impl::ResolveParamType<Args>(args[Is], en) ...);
+			// cast to the parameters so that FN may take other types, as std::function does
+			return m_fn(static_cast<Args>(impl::ResolveParamType<Args>(args[Is], en, plan, Is)) ...);
 		}
 
-		fn_type m_fn;
+		mutable fn_type m_fn;	///< functors with a non const call operator are called as std::function does
 	};
 
+	template <typename R, typename ... Args>
+	using GlobalFnBinding = GlobalFunctionBindingImpl<std::function<R(Args...)>, R, Args...>;
+
+	template <typename R, typename ... Args>
+	using GlobalFnPtrBinding = GlobalFunctionBindingImpl<R(*)(Args...), R, Args...>;
+
+	namespace impl
+	{
+		/// \brief	Binding calling an FN as a function with the signature F.
+		template <typename FN, typename F>
+		struct GlobalFnBindingOf;
+		template <typename FN, typename R, typename ... Args>
+		struct GlobalFnBindingOf<FN, R(Args...)>
+		{
+			using type = GlobalFunctionBindingImpl<FN, R, Args...>;
+		};
+	}
+
 	class IMemberFunctionBinding
 	{
 	public:
 		IMemberFunctionBinding() = default;
+		IMemberFunctionBinding(const IMemberFunctionBinding &) = default;	// overloaded bindings are copied before modifying a shared one
 		IMemberFunctionBinding(IMemberFunctionBinding &&) = default;
 		IMemberFunctionBinding& operator=(IMemberFunctionBinding &&) = default;
 		virtual ~IMemberFunctionBinding() = default;
 
+		/// \brief	Returns except::make_boxed_runtime_error() if the function cannot be
+		///			called with 'args', instead of throwing.
 		virtual BoxedValue do_call(runtime::DispatchEngine & en, 
 								   BoxedValue & inst, std::vector<BoxedValue> & args) const = 0;
+
+		/// \brief	Pure functions have no side effects and their result only depends on their
+		///			parameters, see binds::pure.
+		bool is_pure() const { return m_pure; }
+		void set_pure(bool pure) { m_pure = pure; }
+
+		/// \brief	Type of the values the function returns, nullptr if it is not always the
+		///			same, used by ast::infer_types.
+		const TypeInfo * get_return_type() const { return m_return_type; }
+
+	protected:
+		void set_return_type(const TypeInfo * type) { m_return_type = type; }
+
+	private:
+		bool m_pure{ false };
+		const TypeInfo * m_return_type{ nullptr };
 	};
 
 	class MemberFunctionBinding
 		: public IMemberFunctionBinding
 	{
 	public:
+		/// \brief	See GlobalFunctionBinding::get_call_score.
 		virtual impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args) const = 0;
+			std::vector<BoxedValue> & args, impl::ConversionPlan & plan) const = 0;
+		virtual BoxedValue call_planned(runtime::DispatchEngine & en, BoxedValue & inst,
+										std::vector<BoxedValue> & args, const impl::ConversionPlan & plan) const = 0;
+		/// \brief	See GlobalFunctionBinding::get_param_num.
+		virtual std::size_t get_param_num() const = 0;
+		virtual std::size_t get_typed_param_num() const = 0;
 		virtual const TypeInfo & get_class_type_info() const = 0;
 	};
 
@@ -350,17 +607,18 @@ namespace binds
 	{
 	public:
 		OverloadedMemberFunctionBinding(
-			std::unique_ptr<MemberFunctionBinding> && overload0,
-			std::unique_ptr<MemberFunctionBinding> && overload1);
+			std::shared_ptr<MemberFunctionBinding> overload0,
+			std::shared_ptr<MemberFunctionBinding> overload1);
 
 		BoxedValue do_call(
 			runtime::DispatchEngine & en, BoxedValue & inst,
 			std::vector<BoxedValue> & args) const override;
 
-		void add_overload(std::unique_ptr<MemberFunctionBinding> && overload);
+		void add_overload(std::shared_ptr<MemberFunctionBinding> overload);
 
 	private:
-		std::vector<std::unique_ptr<MemberFunctionBinding>> m_overloads;
+		/// \brief	Indexed by the number of parameters, see impl::insert_overload.
+		std::vector<std::vector<std::shared_ptr<MemberFunctionBinding>>> m_overloads;
 	};
 
 	template <typename T, typename FN, typename R, typename ... Args>
@@ -368,47 +626,78 @@ namespace binds
 	{
 	public:
 		using fn_type = FN;
-		MemberFunctionBindingImpl(fn_type fn) : m_fn{ fn } {}
+		MemberFunctionBindingImpl(fn_type fn) : m_fn{ fn }
+		{
+			set_return_type(impl::get_return_type_info<R>());
+		}
+
+		/// const member functions read the instance as const, so that a shared one is not cloned
+		static constexpr bool s_is_const = std::is_same<FN, R(T::*)(Args...) const>::value;
+		using instance_type = std::conditional_t<s_is_const, const T, T>;
+		using boxed_instance_type = std::conditional_t<s_is_const, const BoxedValue, BoxedValue>;
 
 		BoxedValue do_call(runtime::DispatchEngine & en,
 						   BoxedValue & inst,
 						   std::vector<BoxedValue> & args) const
 		{
+			return call(en, inst, args, nullptr);
+		}
+		BoxedValue call_planned(runtime::DispatchEngine & en, BoxedValue & inst,
+								std::vector<BoxedValue> & args, const impl::ConversionPlan & plan) const override
+		{
+			return call(en, inst, args, &plan);
+		}
+
+		std::size_t get_param_num() const override { return sizeof...(Args); }
+		std::size_t get_typed_param_num() const override { return impl::get_typed_param_num<Args...>(); }
+
+		const TypeInfo & get_class_type_info() const
+		{
+			return ::get_type_info<T>();
+		}
+
+	private:
+		impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
+			std::vector<BoxedValue> & args, impl::ConversionPlan & plan) const override
+		{
+			return impl::get_function_call_score<Args...>(en, args, plan, std::index_sequence_for<Args...>{});
+		}
+
+		BoxedValue call(runtime::DispatchEngine & en, BoxedValue & inst, std::vector<BoxedValue> & args,
+						const impl::ConversionPlan * plan) const
+		{
+			if (sizeof...(Args) != args.size())
+				return except::make_boxed_runtime_error();
+
 			return meta::static_if(std::is_same <R, void>{})
 				// function returns void
-				.then([this](auto & en, auto & inst, auto & args)
+				.then([this, plan](auto & en, auto & inst, auto & args)
 			{
-				do_call_impl(en, boxed_cast<T>(inst), args, std::index_sequence_for<Args ...>{});
+				do_call_impl(en, boxed_cast<T>(static_cast<boxed_instance_type &>(inst)), args, plan,
+							 std::index_sequence_for<Args ...>{});
 				return BoxedValue{};
 			})
 				// function does not return void
-				.else_([this](auto & en, auto & inst, auto & args)
+				.else_([this, plan](auto & en, auto & inst, auto & args)
 			{
 				return BoxedValue{
-					do_call_impl(en, boxed_cast<T>(inst), args, std::index_sequence_for<Args ...>{})
+					BoxedValueTemporary_t{},
+					do_call_impl(en, boxed_cast<T>(static_cast<boxed_instance_type &>(inst)), args, plan,
+								 std::index_sequence_for<Args ...>{})
 				};
 			})(en, inst, args);
 		}
 
-		const TypeInfo & get_class_type_info() const
-		{
-			return ::get_type_info<T>();
-		}
-
-	private:
-		impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
-			std::vector<BoxedValue> & args) const override
-		{
-			return impl::get_function_call_score<Args...>(en, args, std::index_sequence_for<Args...>{});
-		}
 		template <std::size_t ... Is>
 		impl::ResolveReturnType<R> do_call_impl(runtime::DispatchEngine & en,
-												T & inst, std::vector<BoxedValue> & args,
+												instance_type & inst, std::vector<BoxedValue> & args,
+												const impl::ConversionPlan * plan,
 												std::index_sequence<Is ...>) const
 		{
 			(void)en;
 			(void)args;
-			return (inst.*m_fn)(impl::ResolveParamType<Args>(args[Is], en) ...);
+			(void)plan;
+			return (inst.*m_fn)(impl::ResolveParamType<Args>(args[Is], en, plan, Is) ...);
 		}
 
 		fn_type m_fn{ nullptr };
@@ -459,7 +748,7 @@ namespace binds
 		BoxedValue get_variable(BoxedValue & instance) const override
 		{
 			CLASS & class_inst = boxed_cast<CLASS>(instance);
-			return{ BoxedValueStoreRef_t{}, class_inst.*m_member_var };
+			return{ BoxedValueTemporary_t{}, &(class_inst.*m_member_var) };
 		}
 		const TypeInfo & get_class_type_info() const override
 		{
@@ -478,13 +767,22 @@ namespace binds
 	class ITypeConversion
 	{
 	public:
+		/// \brief	T has to be the type the conversion creates, the value is not boxed.
 		template <typename T>
 		T convert(const BoxedValue & bv) const
 		{
-			return convert(bv).get_as<T>();
+			std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+			convert_into(bv, &storage);
+
+			T & converted = *reinterpret_cast<T *>(&storage);
+			T result = std::move(converted);
+			converted.~T();
+			return result;
 		}
 
 		virtual BoxedValue convert(const BoxedValue & bv) const = 0;
+		/// \brief	Constructs the converted value in 'to', which has room for it.
+		virtual void convert_into(const BoxedValue & bv, void * to) const = 0;
 		virtual type_pair_key get_type_pair_hash() const = 0;
 	};
 
@@ -494,7 +792,11 @@ namespace binds
 	public:
 		BoxedValue convert(const BoxedValue & bv) const override
 		{
-			return BoxedValue{ static_cast<TO>(boxed_cast<FROM>(bv)) };
+			return BoxedValue{ BoxedValueTemporary_t{}, static_cast<TO>(boxed_cast<FROM>(bv)) };
+		}
+		void convert_into(const BoxedValue & bv, void * to) const override
+		{
+			new (to) TO(static_cast<TO>(boxed_cast<FROM>(bv)));
 		}
 		type_pair_key get_type_pair_hash() const override
 		{
@@ -537,18 +839,19 @@ namespace binds
 		return std::make_unique<GlobalFnBinding<R, Ts ...>>(std::move(fn));
 	}
 	
-	// global function
+	// global function, called through the pointer
 	template <typename R, typename ... Ts>
 	auto func(R(*fn)(Ts ...))
 	{
-		return func(std::function<R(Ts ...)>{ fn });
+		return std::make_unique<GlobalFnPtrBinding<R, Ts ...>>(fn);
 	}
 
-	// lambda function
+	// lambda function or functor with the signature F, the binding stores a copy of it
 	template <typename F, typename T>
 	auto func(T && fn)
 	{
-		return func(std::function<F>(std::forward<T>(fn)));
+		using binding_type = typename impl::GlobalFnBindingOf<std::decay_t<T>, F>::type;
+		return std::make_unique<binding_type>(std::forward<T>(fn));
 	}
 
 	namespace impl
@@ -577,6 +880,16 @@ namespace binds
 		return std::make_unique<ConstMemberFnBinding<real_t, R, Args ...>>(fn);
 	}
 
+	/// \brief	Marks a function as pure (i.e. 'eng.add("size", pure(func(&T::size)))'), the
+	///			calls to it inside a loop are evaluated once while their parameters do not
+	///			change (see ast::LoopInvariant). Functions are impure by default.
+	template <typename Binding>
+	std::unique_ptr<Binding> pure(std::unique_ptr<Binding> && binding)
+	{
+		binding->set_pure(true);
+		return std::move(binding);
+	}
+
 	// global variables
 	template <typename T>
 	GlobalVariableBinding var(T & x)
@@ -6,22 +6,76 @@ BadBoxedCast::BadBoxedCast(const std::type_info & from, const std::type_info & t
 {}
 
 BoxedValue::BoxedValue(const BoxedValue & other)
-	: m_boxed_value{ other.m_boxed_value->clone() }
-{}
+	: m_boxed_value{ other.m_boxed_value }
+{
+	if (is_borrowed())
+		take_ownership();
+	else if (!other.empty())
+		SCR_COUNT(m_boxed_shares);
+}
 
 BoxedValue & BoxedValue::operator=(const BoxedValue & rhs)
 {
 	if (this != &rhs)
-		m_boxed_value = rhs.m_boxed_value->clone();
+	{
+		m_boxed_value = rhs.m_boxed_value;
+		if (is_borrowed())
+			take_ownership();
+		else if (!rhs.empty())
+			SCR_COUNT(m_boxed_shares);
+	}
+	return *this;
+}
+
+BoxedValue::BoxedValue(BoxedValue && other) noexcept
+	: m_boxed_value{ std::move(other.m_boxed_value) }
+{
+	take_ownership();
+}
+
+BoxedValue & BoxedValue::operator=(BoxedValue && rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		m_boxed_value = std::move(rhs.m_boxed_value);
+		take_ownership();
+	}
 	return *this;
 }
 
+void BoxedValue::take_ownership()
+{
+	if (!is_borrowed())
+		return;
+
+	if (m_boxed_value->m_in_scratch_arena)
+	{
+		m_boxed_value = m_boxed_value->clone();
+	}
+	else
+	{
+		m_boxed_value = m_boxed_value->shared_from_this();
+		SCR_COUNT(m_boxed_shares);
+	}
+}
+
+BoxedValue::IValue & BoxedValue::get_unique_value()
+{
+	if (is_shared())
+	{
+		m_boxed_value = m_boxed_value->clone();
+		SCR_COUNT(m_boxed_clones);
+	}
+	return *m_boxed_value;
+}
+
 // STUDY(Borja): in the future problems may arise when we need to return a const reference...
 BoxedValue & resolve_ref(BoxedValue & bv)
 {
-	// if we are storing a 'reference' to an other BoxedValue, return actual BoxedValue
+	// if we are storing a 'reference' to an other BoxedValue, return actual BoxedValue,
+	// the pointer is not modified so there is no need to unshare the reference
 	if (bv.is_storing<BoxedValue>())
-		return bv.get_as<BoxedValue>();
+		return const_cast<BoxedValue &>(static_cast<const BoxedValue &>(bv).get_as<BoxedValue>());
 
 	return bv;
 }
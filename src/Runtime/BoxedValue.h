@@ -1,10 +1,15 @@
 #pragma once
 
 #include "Runtime/TypeInfo.h"
+#include "Runtime/Statistics.h"	// runtime::get_thread_statistics
+#include "Runtime/ScratchArena.h"	// runtime::get_thread_scratch_arena
 
 #include <vector>	// std::vector
+#include <string>	// std::string
+#include <cstring>	// std::memcpy
 #include <typeinfo>	// std::type_info
-#include <memory>	// std::unique_ptr, std::make_unique
+#include <memory>	// std::unique_ptr, std::shared_ptr, std::make_shared
+#include <new>		// placement new
 #include <type_traits>	// std::enable_if_t, std::is_arithmetic, std::remove_pointer_t, std::remove_reference_t
 
 class BadBoxedCast : public std::exception
@@ -18,6 +23,9 @@ private:
 };
 
 struct BoxedValueStoreRef_t {};
+struct BoxedValueKeepBorrowed_t {};
+/// \brief	Tag of the temporaries created by the evaluator, see BoxedValue.
+struct BoxedValueTemporary_t {};
 
 template <typename T, std::size_t N>
 class inline_unique_ptr;
@@ -78,7 +86,7 @@ public:
 	using Deleter = ::impl::inline_unique_ptr_deleter<T, N>;
 	using Base = std::unique_ptr<T, Deleter>;
 
-	template <typename T, std::size_t N, bool>
+	template <typename U, std::size_t M, bool>
 	friend struct ::impl::make_inline_unique_ptr_impl;
 
 public:
@@ -112,14 +120,14 @@ private:
 	{
 		if (other.is_inlined())
 		{
-			auto * obj = reinterpret_cast<T *>(get_deleter().m_buffer);
-			reset(obj);
+			auto * obj = reinterpret_cast<T *>(this->get_deleter().m_buffer);
+			this->reset(obj);
 			std::memcpy(obj, other.release(), Deleter::buffer_size);
 			m_inlined = true;
 		}
 		else
 		{
-			reset(other.release());
+			this->reset(other.release());
 			m_inlined = false;
 		}
 	}
@@ -135,6 +143,23 @@ static inline_unique_ptr<T, N> make_inline_unique_ptr(Ts && ... vs)
 
 /// \brief	Stores any value of the script, this allows dynamic variable typing 
 ///			(i.e. change the type of a variable while the script is running).
+///
+///			Copies share the stored value, it is only cloned when one of the copies that
+///			share it is accessed as non const (copy on write), so passing big strings or
+///			vectors around costs a reference count increment.
+///
+///			A borrowed BoxedValue (see borrow) reads the value of an other one without
+///			owning it, which costs nothing, it takes shared ownership when it is copied
+///			or moved and clones the value when it is modified.
+///
+///			While an engine is evaluating an script, the trivially destructible temporaries
+///			it creates (i.e. numbers, booleans and references, built with BoxedValueTemporary_t)
+///			are created in its scratch arena and borrowed from it, they are moved to the heap
+///			only if they are copied out of the statement. Values built without the tag always
+///			own theirs, they may be stored where the engine does not see them (i.e. in a
+///			container filled by a bound function).
+/// \note	A non const reference obtained with get_as is only safe to modify while the
+///			BoxedValue is not copied, the copy would share the modified value.
 class BoxedValue
 {
 private:
@@ -149,11 +174,27 @@ private:
 		return make_inline_unique_ptr<Value<T>, value_ptr::buffer_size>(std::forward<Ts>(vs) ...);
 	}
 #else
-	using value_ptr = std::unique_ptr<IValue>;
+	using value_ptr = std::shared_ptr<IValue>;
 	template <typename T, typename ... Ts>
 	static auto make_value(Ts && ... vs)
 	{
-		return std::make_unique<Value<T>>(std::forward<Ts>(vs) ...);
+		SCR_COUNT(m_boxed_allocations);
+		return std::make_shared<Value<T>>(std::forward<Ts>(vs) ...);
+	}
+	/// \brief	Temporaries created while an script is evaluated, they are borrowed from the
+	///			scratch arena if they don't need a destructor.
+	template <typename T, typename ... Ts>
+	static value_ptr make_temporary_value(Ts && ... vs)
+	{
+		auto * arena = runtime::get_thread_scratch_arena();
+		if (!arena || !std::is_trivially_destructible<T>::value)
+			return make_value<T>(std::forward<Ts>(vs) ...);
+
+		SCR_COUNT(m_scratch_allocations);
+		void * memory = arena->allocate(sizeof(Value<T>), alignof(Value<T>));
+		auto * value = ::new (memory) Value<T>(std::forward<Ts>(vs) ...);
+		value->m_in_scratch_arena = true;
+		return value_ptr{ value_ptr{}, value };
 	}
 #endif
 
@@ -167,7 +208,7 @@ private:
 	template <typename T>
 	using enable_if_not_BoxedValue_t = std::enable_if_t<!std::is_same<BoxedValue, std::decay_t<T>>::value>;
 
-	struct IValue
+	struct IValue : public std::enable_shared_from_this<IValue>
 	{
 		virtual ~IValue() = default;
 		IValue() = default;
@@ -178,6 +219,8 @@ private:
 
 		virtual const TypeInfo & get_type_info() const = 0;
 		virtual value_ptr clone() const = 0;
+
+		bool m_in_scratch_arena{ false };	///< not owned by anyone, see make_temporary_value
 	};
 
 	template <typename T>
@@ -199,15 +242,15 @@ private:
 		Value(const Value & other) : m_v{ other.m_v } {}
 
 		Value(const T & t) : m_v(t) {}
-		template <typename = enable_if_not_arithmetic_t<T>>
+		template <typename U = T, typename = enable_if_not_arithmetic_t<U>>
 		Value(T && t) : m_v(std::forward<T>(t)) {}
 
 		const TypeInfo & get_type_info() const override { return ::get_type_info<T>(); }
 
 		value_ptr clone() const override { return make_value<T>(*this); }
 
-		get_value_return_t & get_value() override { return m_v; }
-		const get_value_return_t & get_value() const override { return m_v; }
+		typename ValueTraits<T>::get_value_return_t & get_value() override { return m_v; }
+		const typename ValueTraits<T>::get_value_return_t & get_value() const override { return m_v; }
 
 		T m_v;
 	};
@@ -216,8 +259,13 @@ public:
 	BoxedValue() = default;
 	BoxedValue(const BoxedValue & other);
 	BoxedValue& operator=(const BoxedValue & rhs);
-	BoxedValue(BoxedValue &&) = default;
-	BoxedValue& operator=(BoxedValue &&) = default;
+	BoxedValue(BoxedValue && other) noexcept;
+	BoxedValue& operator=(BoxedValue && rhs) noexcept;
+	/// \brief	Moves 'other' without taking ownership if it is borrowed, only for values that
+	///			cannot outlive the statement being evaluated (i.e. the arguments of a call).
+	BoxedValue(BoxedValueKeepBorrowed_t, BoxedValue && other) noexcept
+		: m_boxed_value{ std::move(other.m_boxed_value) }
+	{}
 
 	template <typename T,
 		typename = enable_if_not_arithmetic_t<T>,
@@ -237,16 +285,52 @@ public:
 		: m_boxed_value{ make_value<T *>(&t) }
 	{}
 
+	/// \brief	Temporary of the statement being evaluated, only for the values created by the
+	///			evaluator (i.e. the results of operators and calls), see make_temporary_value.
+	template <typename T,
+		typename = enable_if_not_arithmetic_t<T>,
+		typename = enable_if_not_BoxedValue_t<T>
+	>
+		BoxedValue(BoxedValueTemporary_t, T && t)
+		: m_boxed_value{ make_temporary_value<std::remove_reference_t<T>>(std::forward<T>(t)) }
+	{}
+
+	template <typename T, typename = enable_if_arithmetic_t<T>>
+	BoxedValue(BoxedValueTemporary_t, T t)
+		: m_boxed_value{ make_temporary_value<std::decay_t<T>>(t) }
+	{}
+
+	/// \brief	Functions returning a BoxedValue already made it.
+	BoxedValue(BoxedValueTemporary_t, const BoxedValue & other)
+		: BoxedValue{ other }
+	{}
+	BoxedValue(BoxedValueTemporary_t, BoxedValue && other) noexcept
+		: BoxedValue{ std::move(other) }
+	{}
+
+	/// \brief	Returns a BoxedValue that reads the value of 'owner' without owning it, used
+	///			for values that outlive their readers (i.e. the literals of the AST) so that
+	///			reading them needs neither an allocation nor a reference count increment.
+	/// \note	'owner' must outlive the returned BoxedValue, unless it is copied or moved.
+	static BoxedValue borrow(const BoxedValue & owner)
+	{
+		BoxedValue borrowed;
+		borrowed.m_boxed_value = value_ptr{ value_ptr{}, owner.m_boxed_value.get() };
+		return borrowed;
+	}
+
 	inline const TypeInfo & get_type_info() const { return get_value().get_type_info(); }
 
 	// STUDY(Borja): instead of dynamic casting storing the typeid and then comparing it with
 	// this types may speed up things.
 	// We could also store flags about the type, is it a pointer? reference? ...
+	/// \note	Only a T stored by value needs to be unshared, the ones stored by pointer
+	///			can be modified from any of the copies.
 	template <typename T>
 	T & get_as()
 	{
-		if (auto val = dynamic_cast<ValueTraits<T > *>(&get_value()))
-			return val->get_value();
+		if (dynamic_cast<ValueTraits<T > *>(&get_value()))
+			return static_cast<ValueTraits<T> &>(get_unique_value()).get_value();
 		if (auto val = dynamic_cast<ValueTraits<T *> *>(&get_value()))
 			return *val->get_value();
 		if (auto val = dynamic_cast<ValueTraits<T &> *>(&get_value()))
@@ -289,6 +373,10 @@ public:
 	}
 
 	bool empty() const { return !m_boxed_value.operator bool(); }
+	/// \return true if the stored value is shared with other copies of 'this' or borrowed.
+	bool is_shared() const { return m_boxed_value.use_count() != 1; }
+	/// \return true if 'this' was returned by borrow and has not taken ownership yet.
+	bool is_borrowed() const { return !empty() && m_boxed_value.use_count() == 0; }
 
 	///	\return true if 'this' BoxedValue stores a T, T& or T*
 	template <typename T>
@@ -299,6 +387,11 @@ public:
 private:
 	IValue & get_value() { return *m_boxed_value; }
 	const IValue & get_value() const { return *m_boxed_value; }
+	/// \brief	Clones the stored value if it is shared, before it is modified.
+	IValue & get_unique_value();
+	/// \brief	Shares the value with its owner if 'this' is borrowed, values borrowed from
+	///			the scratch arena have no owner and are cloned.
+	void take_ownership();
 
 	value_ptr m_boxed_value{ nullptr };
 };
@@ -312,7 +405,18 @@ const T & boxed_cast(const BoxedValue & bv) { return bv.get_as<T>(); }
 /// \brief	Returns a BoxedValue containing a reference to the input one.
 ///			The returned BoxedValue stores a BoxedValue * to the input one, 
 ///			that is how the refernce works.
-inline BoxedValue make_ref(BoxedValue & bv) { return BoxedValue{ &bv }; }
+inline BoxedValue make_ref(BoxedValue & bv)
+{
+	SCR_COUNT(m_references);
+	return BoxedValue{ &bv };
+}
+/// \brief	make_ref for the references the evaluator reads within the statement that
+///			creates them, see BoxedValueTemporary_t.
+inline BoxedValue make_temporary_ref(BoxedValue & bv)
+{
+	SCR_COUNT(m_references);
+	return BoxedValue{ BoxedValueTemporary_t{}, &bv };
+}
 
 ///	\brief	Checks if the input boxed value has a reference stored in it, if so returns it,
 ///			if it doesn't just returns the input one 'bv'
@@ -135,26 +135,26 @@ namespace binds
 		using iterator = typename T::iterator;
 		using const_iterator = typename T::const_iterator;
 
-		eng.add("size", func(&T::size));
+		eng.add("size", binds::pure(func(&T::size)));
 		eng.add("push_back", func<T, void, value_type &&>(&T::push_back));
 		eng.add("pop_back", func(&T::pop_back));
-		eng.add("empty", func(&T::empty));
+		eng.add("empty", binds::pure(func(&T::empty)));
 		eng.add("resize", func<T, void, std::size_t>(&T::resize));
 		eng.add("reserve", func(&T::reserve));
-		eng.add("capacity", func(&T::capacity));
+		eng.add("capacity", binds::pure(func(&T::capacity)));
 		eng.add("begin", func(&T::begin, binds::non_const_t{}));
 
-		eng.add("[]", func(&T::operator[], binds::non_const_t{}));
+		eng.add("[]", binds::pure(func(&T::operator[], binds::non_const_t{})));
 	}
 
 	template <typename std_string_type>
 	void add_string_functions(runtime::DispatchEngine & eng, BinaryOperators & binary_operators)
 	{
-		eng.add("size", func(&std_string_type::size));
-		eng.add("length", func(&std_string_type::length));
+		eng.add("size", binds::pure(func(&std_string_type::size)));
+		eng.add("length", binds::pure(func(&std_string_type::length)));
 		eng.add("push_back", func(&std_string_type::push_back));
 		eng.add("substr", func(&std_string_type::push_back));
-		eng.add("[]", func(&std_string_type::operator[], binds::non_const_t{}));
+		eng.add("[]", binds::pure(func(&std_string_type::operator[], binds::non_const_t{})));
 
 		using namespace opts;
 		binary_operators.add_operators<std_string_type, std_string_type,
@@ -199,11 +199,11 @@ namespace binds
 		template <typename FROM, typename TO>
 		auto make_conversion_func()
 		{
-			return func<BoxedValue(FROM &)>(
+			return binds::pure(func<BoxedValue(FROM &)>(
 				[](FROM & val) -> BoxedValue
 			{
-				return BoxedValue{ static_cast<TO>(val) };
-			});
+				return BoxedValue{ BoxedValueTemporary_t{}, static_cast<TO>(val) };
+			}));
 		}
 	}
 
@@ -259,14 +259,22 @@ namespace binds
 			// overloaded function
 			auto & old_function = it->second;
 
-			// include it in its overloads
+			// include it in its overloads, copying them first if other engines share them
 			if (auto * overloaded = dynamic_cast<binds::OverloadedMemberFunctionBinding *>(old_function.get()))
+			{
+				if (old_function.use_count() > 1)
+				{
+					auto copy = std::make_shared<binds::OverloadedMemberFunctionBinding>(*overloaded);
+					overloaded = copy.get();
+					old_function = std::move(copy);
+				}
 				overloaded->add_overload(std::move(fn));
+			}
 			else
 			{
 				// create an overloaded function type and store both overloads
-				std::unique_ptr<binds::MemberFunctionBinding> func1{ dynamic_cast<binds::MemberFunctionBinding *>(old_function.release()) };
-				old_function = std::make_unique<binds::OverloadedMemberFunctionBinding>(std::move(func1), std::move(fn));
+				auto func1 = std::dynamic_pointer_cast<binds::MemberFunctionBinding>(std::move(old_function));
+				old_function = std::make_shared<binds::OverloadedMemberFunctionBinding>(std::move(func1), std::move(fn));
 			}
 		}
 	}
@@ -305,32 +313,107 @@ namespace runtime
 		m_stk.pop_scope();
 	}
 
+	DispatchEngine::FrameGuard::FrameGuard(DispatchEngine & en, std::size_t local_num)
+		: m_engine(en)
+		, m_prev_frame(en.m_frame)
+		, m_local_num(local_num)
+	{
+		if (en.m_frame_depth == en.m_frames.size())
+			en.m_frames.emplace_back();
+
+		// the frame of this depth is not in use, it can be replaced if it is too small
+		auto & frame = en.m_frames[en.m_frame_depth];
+		if (frame.second < local_num)
+		{
+			frame.first.reset(new BoxedValue[local_num]);
+			frame.second = local_num;
+		}
+		++en.m_frame_depth;
+		en.m_frame = frame.first.get();
+	}
+	DispatchEngine::FrameGuard::~FrameGuard()
+	{
+		// the values of the call must not outlive it
+		BoxedValue * locals = m_engine.m_frames[--m_engine.m_frame_depth].first.get();
+		for (std::size_t i = 0; i < m_local_num; ++i)
+			locals[i] = BoxedValue{};
+
+		m_engine.m_frame = m_prev_frame;
+	}
+
+	DispatchEngine::LoopGuard::LoopGuard(DispatchEngine & en, const ast::ASTNode & loop,
+										 std::size_t invariant_num)
+		: m_engine(en)
+	{
+		m_engine.m_loops.emplace_back(&loop, m_engine.m_hoisted_values.size());
+		m_engine.m_hoisted_values.resize(m_engine.m_hoisted_values.size() + invariant_num);
+	}
+	DispatchEngine::LoopGuard::~LoopGuard()
+	{
+		m_engine.m_hoisted_values.resize(m_engine.m_loops.back().second);
+		m_engine.m_loops.pop_back();
+	}
+
 	DispatchEngine::DispatchEngine()
+		: m_bindings(std::make_shared<EngineBindings>())
 	{
 		// TODO(Borja): we should be able to add operatos without exposing m_binary_operators
-		binds::add_all_default(*this, m_binary_opts);
+		binds::add_all_default(*this, m_bindings->m_binary_opts);
+	}
+	DispatchEngine::DispatchEngine(std::shared_ptr<const EngineImage> image)
+		: m_global_scope(&image->m_variables)
+		, m_bindings(image->m_bindings)
+		, m_image(std::move(image))
+	{}
+
+	std::shared_ptr<const EngineImage> DispatchEngine::snapshot() const
+	{
+		auto image = std::make_shared<EngineImage>();
+		image->m_bindings = m_bindings;
+		m_global_scope.copy_variables(image->m_variables);
+		// variables in the stack oclude global variables
+		m_stack.copy_top_level_variables(image->m_variables);
+		return image;
+	}
+
+	EngineBindings & DispatchEngine::get_own_bindings()
+	{
+		// the tables are copied, the bindings in them are shared (see EngineBindings)
+		if (m_bindings.use_count() > 1)
+			m_bindings = std::make_shared<EngineBindings>(*m_bindings);
+
+		return *m_bindings;
 	}
 
 	void DispatchEngine::add(std::string name, std::unique_ptr<binds::GlobalFunctionBinding> && fn)
 	{
-		auto it = m_global_functions.find(name);
+		auto & global_functions = get_own_bindings().m_global_functions;
+		auto it = global_functions.find(name);
 
 		// first function with this name
-		if (it == m_global_functions.end())
-			m_global_functions.emplace(std::move(name), std::move(fn));
+		if (it == global_functions.end())
+			global_functions.emplace(std::move(name), std::move(fn));
 		else
 		{
 			// is an overloaded function
 			auto & old_function = it->second;
 
-			// include it in its overloads
+			// include it in its overloads, copying them first if other engines share them
 			if (auto * overloaded = dynamic_cast<binds::OverloadedGlobalFunctionBinding *>(old_function.get()))
+			{
+				if (old_function.use_count() > 1)
+				{
+					auto copy = std::make_shared<binds::OverloadedGlobalFunctionBinding>(*overloaded);
+					overloaded = copy.get();
+					old_function = std::move(copy);
+				}
 				overloaded->add_overload(std::move(fn));
+			}
 			else
 			{
 				// create an overloaded function type and store both overloads
-				std::unique_ptr<binds::GlobalFunctionBinding> func1{ dynamic_cast<binds::GlobalFunctionBinding *>(old_function.release()) };
-				old_function = std::make_unique<binds::OverloadedGlobalFunctionBinding>(std::move(func1), std::move(fn));
+				auto func1 = std::dynamic_pointer_cast<binds::GlobalFunctionBinding>(std::move(old_function));
+				old_function = std::make_shared<binds::OverloadedGlobalFunctionBinding>(std::move(func1), std::move(fn));
 			}
 		}
 	}
@@ -341,42 +424,101 @@ namespace runtime
 	void DispatchEngine::add(std::string name, std::unique_ptr<binds::MemberFunctionBinding> && fn)
 	{
 		const std::type_info & class_type = fn->get_class_type_info().get_std_type_info();
-		m_type_bindings[class_type].add(std::move(name), std::move(fn));
+		get_own_bindings().m_type_bindings[class_type].add(std::move(name), std::move(fn));
 	}
 	void DispatchEngine::add(std::string name, std::unique_ptr<binds::MemberVariableBinding> && member_var)
 	{
 		const std::type_info & class_type = member_var->get_class_type_info().get_std_type_info();
-		m_type_bindings[class_type].add(std::move(name), std::move(member_var));
+		get_own_bindings().m_type_bindings[class_type].add(std::move(name), std::move(member_var));
 	}
 	void DispatchEngine::add(std::unique_ptr<binds::ITypeConversion> && type_conv)
 	{
 		const auto key = type_conv->get_type_pair_hash();
-		m_type_conversions[key] = std::move(type_conv);
+		get_own_bindings().m_type_conversions[key] = std::move(type_conv);
+	}
+	void DispatchEngine::define_function(std::string name, std::shared_ptr<const ScriptFunction> fn)
+	{
+		EngineBindings & bindings = get_own_bindings();
+		const std::size_t param_num = fn->get_param_num();
+		const auto slot = bindings.m_script_function_slots.emplace(
+			std::make_pair(name, param_num), bindings.m_script_functions.size());
+
+		if (!slot.second)
+			bindings.m_script_functions[slot.first->second] = std::move(fn);
+		else
+		{
+			bindings.m_script_functions.push_back(std::move(fn));
+			add(std::move(name), std::make_unique<binds::ScriptFunctionBinding>(slot.first->second, param_num));
+		}
 	}
 	
 	const binds::IGlobalFunctionBinding * DispatchEngine::get_global_fn(const std::string & fn_name) const
 	{
-		const auto it = m_global_functions.find(fn_name);
-			return it != m_global_functions.end() ? it->second.get() : nullptr;
+		const auto it = m_bindings->m_global_functions.find(fn_name);
+			return it != m_bindings->m_global_functions.end() ? it->second.get() : nullptr;
 	}
 	const binds::ClassBindings * DispatchEngine::get_class_bindings(const TypeInfo & type) const
 	{
-		const auto it = m_type_bindings.find(type.get_bare_std_type_info());
-		return it != m_type_bindings.end() ? &it->second : nullptr;
+		const auto it = m_bindings->m_type_bindings.find(type.get_bare_std_type_info());
+		return it != m_bindings->m_type_bindings.end() ? &it->second : nullptr;
 	}
 
 	const binds::ITypeConversion * DispatchEngine::get_type_conversion(const TypeInfo & from, 
 		const TypeInfo & to) const
 	{
+		SCR_COUNT(m_conversion_lookups);
+
 		const auto key = get_type_pair_hash(from, to);
-		const auto it = m_type_conversions.find(key);
-		return it != m_type_conversions.end() ? it->second.get() : nullptr;
+		const auto it = m_bindings->m_type_conversions.find(key);
+		return it != m_bindings->m_type_conversions.end() ? it->second.get() : nullptr;
 	}
 
 	BoxedValue DispatchEngine::evaluate(ast::ASTNode & root)
+	{
+		BoxedValue result = evaluate_script(root);
+		if (m_completion == Completion::FAILED)
+		{
+			m_completion = Completion::NORMAL;
+			SCR_RUNTIME_EXCEPTION(m_error.get_message());
+		}
+		return result;
+	}
+	EvaluationResult DispatchEngine::try_evaluate(ast::ASTNode & root)
+	{
+		EvaluationResult result;
+		try
+		{
+			result.m_value = evaluate_script(root);
+		}
+		catch (const std::exception & ex)
+		{
+			set_error(except::ErrorCode::EXCEPTION, std::string{ ex.what() });
+		}
+
+		if (m_completion == Completion::FAILED)
+		{
+			m_completion = Completion::NORMAL;
+			result.m_value = BoxedValue{};
+			result.m_error = std::move(m_error);
+		}
+		return result;
+	}
+	BoxedValue DispatchEngine::evaluate_script(ast::ASTNode & root)
 	{
 		m_stack.clear_all();
-		return root.evaluate(*this);
+		m_frame = nullptr;
+		m_completion = Completion::NORMAL;
+
+		const ScratchArena::Activation arena_activation{ m_scratch_arena };
+		const ScratchArena::Scope arena_scope{ m_scratch_arena };
+		BoxedValue result = root.evaluate(*this);
+
+		// a return in the top level of the script ends it
+		if (m_completion == Completion::RETURN)
+			return take_return_value();
+		// the result may be borrowed from a literal of the script or from the scratch arena,
+		// which do not live as long as it
+		return BoxedValue{ std::move(result) };
 	}
 
 	DispatchEngine::StackScopeGuard DispatchEngine::new_scope()
@@ -389,12 +531,46 @@ namespace runtime
 		return m_stack.create_variable(name, std::move(bv));
 	}
 
+	DispatchEngine::LoopGuard DispatchEngine::push_loop(const ast::ASTNode & loop, std::size_t invariant_num)
+	{
+		return{ *this, loop, invariant_num };
+	}
+	HoistedValue * DispatchEngine::get_hoisted_value(const ast::ASTNode & loop, std::size_t slot)
+	{
+		// the innermost run, a recursive call may be running the same loop again
+		for (auto it = m_loops.rbegin(); it != m_loops.rend(); ++it)
+		{
+			if (it->first == &loop)
+				return &m_hoisted_values[it->second + slot];
+		}
+
+		return nullptr;
+	}
+
+	void DispatchEngine::set_return_value(BoxedValue && bv)
+	{
+		m_return_value = std::move(bv);
+		m_completion = Completion::RETURN;
+	}
+	BoxedValue DispatchEngine::take_return_value()
+	{
+		m_completion = Completion::NORMAL;
+		return std::move(m_return_value);
+	}
+
 	const binds::BinaryOperators::operation_fn *
 		DispatchEngine::get_binary_operator(const TypeInfo & lhs,
 			OperatorType op,
 			const TypeInfo & rhs) const
 	{
-		return m_binary_opts.get_operator(lhs, op, rhs);
+		SCR_COUNT(m_operator_lookups);
+		return m_bindings->m_binary_opts.get_operator(lhs, op, rhs);
+	}
+	const TypeInfo * DispatchEngine::get_binary_operator_result(const TypeInfo & lhs,
+																OperatorType op,
+																const TypeInfo & rhs) const
+	{
+		return m_bindings->m_binary_opts.get_result_type(lhs, op, rhs);
 	}
 
 	BoxedValue * DispatchEngine::get_variable(const std::string & name)
@@ -417,10 +593,26 @@ namespace runtime
 	{
 		return m_global_scope.get_variable(name);
 	}
+	BoxedValue * DispatchEngine::get_top_level_variable(const std::string & name)
+	{
+		if (BoxedValue * p_val = m_stack.get_top_level_variable(name))
+			return p_val;
+
+		return m_global_scope.get_variable(name);
+	}
 
 	std::size_t DispatchEngine::get_variable_num() const
 	{
 		return m_stack.get_var_num();
 	}
 
+	Statistics DispatchEngine::get_statistics() const
+	{
+		return get_thread_statistics();
+	}
+	void DispatchEngine::reset_statistics()
+	{
+		get_thread_statistics() = Statistics{};
+	}
+
 }
@@ -4,13 +4,20 @@
 #include "Forwards.h"
 #include "Stack.h"
 #include "Bindings.h"
-#include "Runtime\Operators.h"
+#include "Runtime/Operators.h"
+#include "Runtime/Statistics.h"	// runtime::Statistics
+#include "Runtime/ScratchArena.h"	// runtime::ScratchArena
+#include "Runtime/ScriptFunction.h"	// binds::ScriptFunctionBinding
+#include "Runtime/RuntimeException.h"	// except::EvaluationError
 
+#include <map>				// std::map
 #include <typeindex>		// std::type_index
 #include <unordered_map>	// std::unordered_map
 
 namespace binds
 {
+	/// \brief	Copied when an engine adds bindings to a class while sharing them with other
+	///			engines (see runtime::EngineBindings).
 	class ClassBindings
 	{
 	public:
@@ -21,13 +28,77 @@ namespace binds
 		const MemberVariableBinding * get_member_var(const std::string & name) const;
 
 	private:
-		std::unordered_map<std::string, std::unique_ptr<IMemberFunctionBinding>> m_member_functions;
-		std::unordered_map<std::string, std::unique_ptr<MemberVariableBinding>> m_member_varaibles;
+		std::unordered_map<std::string, std::shared_ptr<IMemberFunctionBinding>> m_member_functions;
+		std::unordered_map<std::string, std::shared_ptr<MemberVariableBinding>> m_member_varaibles;
 	};
 }
 
 namespace runtime
 {
+	/// \brief	How the last evaluated statement finished. Anything but NORMAL makes the
+	///			statements, loops and functions being evaluated stop, without unwinding
+	///			the evaluation with exceptions.
+	enum class Completion
+	{
+		NORMAL,
+		BREAK,
+		CONTINUE,
+		RETURN,
+		FAILED
+	};
+
+	/// \brief	Result of DispatchEngine::try_evaluate, the value is empty if there was an error.
+	struct EvaluationResult
+	{
+		BoxedValue m_value;
+		except::EvaluationError m_error;
+
+		bool succeeded() const { return !m_error; }
+	};
+
+	/// \brief	Functions, classes, conversions and operators bound to an engine. Engines
+	///			forked from the same image share them until one of them adds something (see
+	///			DispatchEngine::get_own_bindings), which makes a copy of the tables but not of
+	///			the bindings. Bindings shared by several tables are never modified, they are
+	///			copied and replaced.
+	struct EngineBindings
+	{
+		std::unordered_map<std::string, std::shared_ptr<binds::IGlobalFunctionBinding>> m_global_functions;
+
+		/// stores the member functions and variables of a class
+		std::unordered_map<std::type_index, binds::ClassBindings> m_type_bindings;
+
+		std::unordered_map<type_pair_key, std::shared_ptr<binds::ITypeConversion>> m_type_conversions;
+
+		binds::BinaryOperators m_binary_opts;
+
+		/// slot of each script function in m_script_functions by name and number of parameters
+		std::map<std::pair<std::string, std::size_t>, std::size_t> m_script_function_slots;
+		/// last definition of each script function, see binds::ScriptFunctionBinding
+		std::vector<std::shared_ptr<const ScriptFunction>> m_script_functions;
+	};
+
+	/// \brief	Immutable copy of the state of an engine made by DispatchEngine::snapshot.
+	///			Engines created from it start with its bindings and variables, without
+	///			evaluating again the scripts that made them.
+	class EngineImage
+	{
+	private:
+		friend class DispatchEngine;
+
+		std::shared_ptr<EngineBindings> m_bindings;
+		VariableMap m_variables;	///< global variables and top level ones of the last script
+	};
+
+	/// \brief	Value of a loop invariant subexpression (see ast::LoopInvariant), computed the
+	///			first time it is needed in each run of its loop.
+	struct HoistedValue
+	{
+		BoxedValue m_value;
+		std::size_t m_impure_calls{ 0 };	///< impure calls made by the engine when it was computed
+		bool m_computed{ false };
+	};
+
 	class DispatchEngine
 	{
 	private:
@@ -44,21 +115,72 @@ namespace runtime
 			Stack & m_stk;
 		};
 
+		class LoopGuard
+		{
+		public:
+			LoopGuard(DispatchEngine & en, const ast::ASTNode & loop, std::size_t invariant_num);
+			~LoopGuard();
+			LoopGuard(LoopGuard &&) = default;	// needed by DispatchEngine::push_loop
+			LoopGuard(const LoopGuard &) = delete;
+			LoopGuard& operator=(const LoopGuard &) = delete;
+
+		private:
+			DispatchEngine & m_engine;
+		};
+
 	public:
+		/// \brief	Gives the script function being called a frame of 'local_num' empty slots
+		///			until it is destroyed, it is built where it is used and never moved. The
+		///			frames are kept by the engine and reused by the next calls at the same
+		///			depth, so calls only allocate the first time the script gets that deep.
+		class FrameGuard
+		{
+		public:
+			FrameGuard(DispatchEngine & en, std::size_t local_num);
+			~FrameGuard();
+			FrameGuard(FrameGuard &&) = delete;
+			FrameGuard(const FrameGuard &) = delete;
+			FrameGuard& operator=(const FrameGuard &) = delete;
+
+		private:
+			DispatchEngine & m_engine;
+			BoxedValue * m_prev_frame;
+			std::size_t m_local_num;
+		};
+
 		DispatchEngine();
+		/// \brief	Forks the engine the image was taken from, creating it costs the same no
+		///			matter the number of bindings and variables in the image. Its variables are
+		///			the global variables of the new engine, which share their values with the
+		///			image until they are modified (variables bound to C++ ones keep referencing
+		///			them, all the forks modify the same C++ variable).
+		explicit DispatchEngine(std::shared_ptr<const EngineImage> image);
+
+		/// \brief	Takes the bindings, the global variables and the variables declared in the
+		///			top level of the last evaluated script. Modifying the engine afterwards
+		///			does not modify the image.
+		std::shared_ptr<const EngineImage> snapshot() const;
 
 		///	\brief	Main function for evaluating an script
+		/// \brief	Throws except::RuntimeException if the script fails.
 		BoxedValue evaluate(ast::ASTNode & root);
+		/// \brief	Never throws, errors are returned with their code and their message is
+		///			only built if asked for. Exceptions thrown by bound functions are
+		///			caught and returned as ErrorCode::EXCEPTION.
+		EvaluationResult try_evaluate(ast::ASTNode & root);
 
 		void add(std::string name, std::unique_ptr<binds::GlobalFunctionBinding> && fn);
 		void add(std::string name, binds::GlobalVariableBinding && var);
 		void add(std::string name, std::unique_ptr<binds::MemberFunctionBinding> && fn);
 		void add(std::string name, std::unique_ptr<binds::MemberVariableBinding> && member_var);
 		void add(std::unique_ptr<binds::ITypeConversion> && type_conv);
+		/// \brief	Adds a function defined in an script, defining again a function with the
+		///			same name and number of parameters replaces the previous definition.
+		void define_function(std::string name, std::shared_ptr<const ScriptFunction> fn);
 		template <typename T1, typename T2, typename ... OPs>
 		void add(binds::impl::OptBind<T1, T2, OPs ...>)
 		{
-			m_binary_opts.add_operators<T1, T2, OPs ...>();
+			get_own_bindings().m_binary_opts.add_operators<T1, T2, OPs ...>();
 		}
 
 		const binds::ClassBindings * get_class_bindings(const TypeInfo & type) const;
@@ -67,11 +189,22 @@ namespace runtime
 		const binds::BinaryOperators::operation_fn * get_binary_operator(const TypeInfo & lhs,
 																		 OperatorType op,
 																		 const TypeInfo & rhs) const;
+		/// \brief	Type of the values the operator creates, nullptr if it is not bound.
+		const TypeInfo * get_binary_operator_result(const TypeInfo & lhs, OperatorType op,
+													const TypeInfo & rhs) const;
 		const binds::ITypeConversion * get_type_conversion(const TypeInfo & from, const TypeInfo & to) const;
+		/// \brief	Last definition of the script function in 'slot', see binds::ScriptFunctionBinding.
+		const ScriptFunction & get_script_function(std::size_t slot) const
+		{
+			return *m_bindings->m_script_functions[slot];
+		}
 		
 		BoxedValue * get_variable(const std::string & name);
 		BoxedValue * get_stack_variable(const std::string & name);
 		BoxedValue * get_global_variable(const std::string & name);
+		/// \brief	Variables visible from a script function that are not its locals,
+		///			the ones declared in the script top level and the bound global ones.
+		BoxedValue * get_top_level_variable(const std::string & name);
 
 		template <typename T>
 		T & get_variable_as(const std::string & name)
@@ -92,26 +225,103 @@ namespace runtime
 					var = conv->convert(var);
 			}
 
-			return boxed_cast<T>(var);
+			const BoxedValue & value = var;
+			return boxed_cast<T>(value);
 		}
 
 		std::size_t get_variable_num() const;
+		/// \brief	See Stack::get_generation, used by VariableHandle to know when to look up
+		///			its variable again.
+		std::size_t get_stack_generation() const { return m_stack.get_generation(); }
+
+		/// \brief	Nodes parsed with profiling enabled report to this profiler, nullptr disables it.
+		///			The engine does not take ownership.
+		void set_profiler(Profiler * profiler) { m_profiler = profiler; }
+		Profiler * get_profiler() const { return m_profiler; }
+
+		/// \brief	Snapshot of the allocation and dispatch counters, call reset_statistics
+		///			before evaluating an script to get the numbers of that run only.
+		///	\note	Counters are per thread, engines evaluating in the same thread share them,
+		///			and they stay at zero unless the library is built with SCRIPTING_STATISTICS.
+		Statistics get_statistics() const;
+		void reset_statistics();
+
+		/// \brief	Memory for the temporaries of the statement being evaluated, statements and
+		///			loop iterations release what they allocate in it when they end.
+		ScratchArena & get_scratch_arena() { return m_scratch_arena; }
 
 		StackScopeGuard new_scope();
 		BoxedValue & create_variable(const std::string & name, BoxedValue && bv = BoxedValue{});
 
+		/// \brief	Slot of the frame of the script function being called, see FrameGuard.
+		BoxedValue & get_local(std::size_t slot) { return m_frame[slot]; }
+
+		/// \brief	Makes room for the values hoisted out of a run of 'loop' until the returned
+		///			guard is destroyed, see ast::LoopInvariant.
+		LoopGuard push_loop(const ast::ASTNode & loop, std::size_t invariant_num);
+		/// \brief	nullptr if 'loop' is not running.
+		HoistedValue * get_hoisted_value(const ast::ASTNode & loop, std::size_t slot);
+
+		/// \brief	Calls to bindings that are not pure, a hoisted value is only valid while
+		///			the count does not change.
+		void count_impure_call() { ++m_impure_calls; }
+		std::size_t get_impure_calls() const { return m_impure_calls; }
+
+		/// \brief	Set by break and continue, loops consume them, see ast::impl::loop_must_stop.
+		void set_completion(Completion completion) { m_completion = completion; }
+		Completion get_completion() const { return m_completion; }
+		/// \brief	Return statements store the value and set the completion to RETURN, the
+		///			function being called takes it back and completes normally.
+		void set_return_value(BoxedValue && bv);
+		BoxedValue take_return_value();
+
+		/// \brief	Stops the evaluation as a return does, nodes check has_error after
+		///			evaluating their children. Only the first error is kept, the ones found
+		///			after it are caused by it. Returns an empty value for convenience.
+		template <typename ... Ts>
+		BoxedValue set_error(except::ErrorCode code, Ts && ... args)
+		{
+			if (m_completion != Completion::FAILED)
+			{
+				m_error = except::EvaluationError{ code, std::forward<Ts>(args)... };
+				m_completion = Completion::FAILED;
+			}
+			return{};
+		}
+		bool has_error() const { return m_completion == Completion::FAILED; }
+
+	private:
+		/// \brief	Evaluates 'root' leaving the errors in m_error.
+		BoxedValue evaluate_script(ast::ASTNode & root);
+		/// \brief	Bindings that can be modified, copies them first if they are shared with
+		///			an image.
+		EngineBindings & get_own_bindings();
+
 	private:
 		Stack m_stack;
 		Scope m_global_scope;
 
-		std::unordered_map<std::string, std::unique_ptr<binds::IGlobalFunctionBinding>> m_global_functions;
+		std::shared_ptr<EngineBindings> m_bindings;
+		/// image the engine was forked from, m_global_scope takes its variables from it
+		std::shared_ptr<const EngineImage> m_image;
 
-		/// stores the member functions and variables of a class
-		std::unordered_map<std::type_index, binds::ClassBindings> m_type_bindings;
+		Profiler * m_profiler{ nullptr };
+		ScratchArena m_scratch_arena;
 
-		std::unordered_map<type_pair_key, std::unique_ptr<binds::ITypeConversion>> m_type_conversions;
+		BoxedValue * m_frame{ nullptr };	///< locals of the script function being evaluated
+		/// frames of the calls being evaluated (the first m_frame_depth) and the number of
+		/// slots of each, see FrameGuard
+		std::vector<std::pair<std::unique_ptr<BoxedValue[]>, std::size_t>> m_frames;
+		std::size_t m_frame_depth{ 0 };
 
-		binds::BinaryOperators m_binary_opts;
+		/// running loops that hoist values and the first of their values in m_hoisted_values
+		std::vector<std::pair<const ast::ASTNode *, std::size_t>> m_loops;
+		std::vector<HoistedValue> m_hoisted_values;
+		std::size_t m_impure_calls{ 0 };
+
+		BoxedValue m_return_value;
+		except::EvaluationError m_error;
+		Completion m_completion{ Completion::NORMAL };
 
 	};
 }
@@ -0,0 +1,303 @@
+
+#include "FlatTree.h"
+
+#include "DispatchEngine.h"	// runtime::DispatchEngine
+#include "ScratchArena.h"	// runtime::ScratchArena
+
+#include <typeinfo>	// typeid
+
+namespace ast
+{
+	FlatTree::FlatTree(const ASTNode & root)
+		: m_root(add(&root))
+	{}
+	BoxedValue FlatTree::evaluate(runtime::DispatchEngine & en) const
+	{
+		return evaluate_node(en, m_root);
+	}
+	void FlatTree::execute(runtime::DispatchEngine & en) const
+	{
+		execute_node(en, m_root);
+	}
+
+	std::uint32_t FlatTree::add(const ASTNode * node)
+	{
+		if (!node)	return s_none;
+
+		const std::type_info & type = typeid(*node);
+		if (type == typeid(Statements) || type == typeid(Scope))
+		{
+			std::vector<const ASTNode *> statements;
+			for (const auto & statement : static_cast<const Statements *>(node)->get_statements())
+				statements.push_back(statement.get());
+
+			const std::uint32_t first = add_children(statements);
+			return add_node(type == typeid(Scope) ? Kind::SCOPE : Kind::STATEMENTS, first,
+							static_cast<std::uint32_t>(statements.size()));
+		}
+		else if (type == typeid(Value))
+		{
+			m_values.push_back(static_cast<const Value *>(node)->get_value());
+			return add_node(Kind::VALUE, static_cast<std::uint32_t>(m_values.size() - 1));
+		}
+		else if (type == typeid(NamedVariable))
+		{
+			const auto * var = static_cast<const NamedVariable *>(node);
+			m_names.push_back(var->get_name());
+			const std::uint32_t index = add_node(Kind::NAMED_VARIABLE,
+												 static_cast<std::uint32_t>(m_names.size() - 1));
+			m_nodes[index].m_declaration = var->is_declaration();
+			return index;
+		}
+		else if (type == typeid(LocalVariable))
+		{
+			const auto * var = static_cast<const LocalVariable *>(node);
+			const std::uint32_t index = add_node(Kind::LOCAL_VARIABLE, static_cast<std::uint32_t>(var->get_slot()));
+			m_nodes[index].m_declaration = var->is_declaration();
+			return index;
+		}
+		else if (type == typeid(BinaryOperator) && static_cast<const BinaryOperator *>(node)->has_operands())
+		{
+			const auto * op = static_cast<const BinaryOperator *>(node);
+			const std::uint32_t lhs = add(&op->get_lhs());
+			const std::uint32_t rhs = add(&op->get_rhs());
+			const std::uint32_t index = add_node(Kind::BINARY, lhs, rhs);
+			m_nodes[index].m_operator = static_cast<std::uint8_t>(op->get_operator_type());
+			return index;
+		}
+		else if (type == typeid(UnaryOperator))
+		{
+			const auto * op = static_cast<const UnaryOperator *>(node);
+			const std::uint32_t index = add_node(Kind::UNARY, add(&op->get_variable()));
+			m_nodes[index].m_operator = static_cast<std::uint8_t>(op->get_operator_type());
+			return index;
+		}
+		else if (type == typeid(If))
+		{
+			const auto * if_ = static_cast<const If *>(node);
+			const std::uint32_t condition = add(&if_->get_condition());
+			const std::uint32_t statements = add(&if_->get_statements());
+			return add_node(Kind::IF, condition, statements, add(if_->get_else()));
+		}
+		else if (type == typeid(While))
+		{
+			const auto * loop = static_cast<const While *>(node);
+			const std::uint32_t condition = add(loop->get_condition());
+			const std::uint32_t statements = add(&loop->get_statements());
+			return add_node(Kind::WHILE, condition, statements, add_loop(*node, loop->get_invariant_num()));
+		}
+		else if (type == typeid(For) && !static_cast<const For *>(node)->is_counted())
+		{
+			// counted loops keep their counter native, which only the tree knows how to do
+			const auto * loop = static_cast<const For *>(node);
+			const std::uint32_t first = add_children({ loop->get_initialization(), loop->get_condition(),
+													   loop->get_increment(), &loop->get_statements() });
+			return add_node(Kind::FOR, first, add_loop(*node, loop->get_invariant_num()));
+		}
+
+		m_trees.push_back(node);
+		return add_node(Kind::TREE, static_cast<std::uint32_t>(m_trees.size() - 1));
+	}
+	std::uint32_t FlatTree::add_node(Kind kind, std::uint32_t first, std::uint32_t second,
+									 std::uint32_t third)
+	{
+		m_nodes.push_back(Node{ kind, static_cast<std::uint8_t>(OperatorType::EQ), false, first, second, third });
+		return static_cast<std::uint32_t>(m_nodes.size() - 1);
+	}
+	std::uint32_t FlatTree::add_children(const std::vector<const ASTNode *> & children)
+	{
+		// the children are flattened before taking their range, which has to be contiguous
+		std::vector<std::uint32_t> indices;
+		for (const auto * child : children)
+			indices.push_back(add(child));
+
+		const auto first = static_cast<std::uint32_t>(m_children.size());
+		m_children.insert(m_children.end(), indices.begin(), indices.end());
+		return first;
+	}
+	std::uint32_t FlatTree::add_loop(const ASTNode & node, std::size_t invariant_num)
+	{
+		m_loops.push_back(Loop{ &node, invariant_num });
+		return static_cast<std::uint32_t>(m_loops.size() - 1);
+	}
+
+	BoxedValue FlatTree::evaluate_node(runtime::DispatchEngine & en, std::uint32_t index) const
+	{
+		const Node & node = m_nodes[index];
+		switch (node.m_kind)
+		{
+			case Kind::STATEMENTS:
+				return evaluate_statements(en, node);
+			case Kind::SCOPE:
+			{
+				auto scope = en.new_scope();
+				return evaluate_statements(en, node);
+			}
+			case Kind::VALUE:
+				return BoxedValue::borrow(m_values[node.m_first]);
+			case Kind::NAMED_VARIABLE:
+				return impl::get_named_variable(en, m_names[node.m_first], node.m_declaration);
+			case Kind::LOCAL_VARIABLE:
+				return impl::get_local_variable(en, node.m_first, node.m_declaration);
+			case Kind::BINARY:
+			case Kind::UNARY:
+				return evaluate_operator(en, node, false);
+			case Kind::IF:
+				execute_if(en, node);
+				return{};
+			case Kind::WHILE:
+			case Kind::FOR:
+				execute_loop(en, node);
+				return{};
+			case Kind::TREE:
+				return m_trees[node.m_first]->evaluate(en);
+		}
+		return{};
+	}
+	void FlatTree::execute_node(runtime::DispatchEngine & en, std::uint32_t index) const
+	{
+		const Node & node = m_nodes[index];
+		switch (node.m_kind)
+		{
+			case Kind::STATEMENTS:
+				execute_statements(en, node);
+				break;
+			case Kind::SCOPE:
+			{
+				auto scope = en.new_scope();
+				execute_statements(en, node);
+				break;
+			}
+			case Kind::VALUE:
+				break;
+			case Kind::BINARY:
+			case Kind::UNARY:
+				evaluate_operator(en, node, true);
+				break;
+			case Kind::IF:
+				execute_if(en, node);
+				break;
+			case Kind::WHILE:
+			case Kind::FOR:
+				execute_loop(en, node);
+				break;
+			case Kind::TREE:
+				m_trees[node.m_first]->execute(en);
+				break;
+			default:
+				evaluate_node(en, index);
+				break;
+		}
+	}
+	BoxedValue FlatTree::evaluate_operator(runtime::DispatchEngine & en, const Node & node,
+										   bool discard_result) const
+	{
+		if (node.m_kind == Kind::UNARY)
+		{
+			BoxedValue value = evaluate_node(en, node.m_first);
+			if (en.has_error())	return{};
+
+			return impl::apply_unary_operator(en, static_cast<OperatorType>(node.m_operator), value, discard_result);
+		}
+
+		BoxedValue lhs = evaluate_node(en, node.m_first);
+		if (en.has_error())	return{};
+		BoxedValue rhs = evaluate_node(en, node.m_second);
+		if (en.has_error())	return{};
+
+		return impl::apply_binary_operator(en, static_cast<OperatorType>(node.m_operator), lhs, rhs,
+										   discard_result);
+	}
+	BoxedValue FlatTree::evaluate_statements(runtime::DispatchEngine & en, const Node & node) const
+	{
+		if (node.m_second == 0)	return{};
+
+		const std::uint32_t last = node.m_first + node.m_second - 1;
+		for (std::uint32_t i = node.m_first; i < last; ++i)
+		{
+			// the value of the statement is discarded, nothing it allocated is needed anymore
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			execute_node(en, m_children[i]);
+			if (en.get_completion() != runtime::Completion::NORMAL)
+				return{};
+		}
+
+		return evaluate_node(en, m_children[last]);
+	}
+	void FlatTree::execute_statements(runtime::DispatchEngine & en, const Node & node) const
+	{
+		for (std::uint32_t i = node.m_first; i < node.m_first + node.m_second; ++i)
+		{
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			execute_node(en, m_children[i]);
+			if (en.get_completion() != runtime::Completion::NORMAL)
+				return;
+		}
+	}
+	void FlatTree::execute_if(runtime::DispatchEngine & en, const Node & node) const
+	{
+		if (evaluate_condition(en, node.m_first))
+			execute_node(en, node.m_second);
+		else if (node.m_third != s_none && !en.has_error())
+			execute_node(en, node.m_third);
+	}
+	void FlatTree::execute_loop(runtime::DispatchEngine & en, const Node & node) const
+	{
+		std::uint32_t condition = node.m_first;
+		std::uint32_t statements = node.m_second;
+		std::uint32_t increment = s_none;
+		const Loop * loop = nullptr;
+		if (node.m_kind == Kind::WHILE)
+			loop = &m_loops[node.m_third];
+		else
+		{
+			const std::uint32_t * parts = &m_children[node.m_first];
+			if (parts[0] != s_none)
+			{
+				execute_node(en, parts[0]);
+				if (en.has_error())	return;
+			}
+			condition = parts[1];
+			increment = parts[2];
+			statements = parts[3];
+			loop = &m_loops[node.m_second];
+		}
+
+		if (loop->m_invariant_num == 0)
+		{
+			iterate(en, condition, statements, increment);
+			return;
+		}
+
+		const auto guard = en.push_loop(*loop->m_node, loop->m_invariant_num);
+		iterate(en, condition, statements, increment);
+	}
+	void FlatTree::iterate(runtime::DispatchEngine & en, std::uint32_t condition, std::uint32_t statements,
+						   std::uint32_t increment) const
+	{
+		for (;;)
+		{
+			const runtime::ScratchArena::Scope scratch{ en.get_scratch_arena() };
+			if (condition != s_none && !evaluate_condition(en, condition))
+				break;
+
+			execute_node(en, statements);
+			if (impl::loop_must_stop(en))
+				break;
+
+			if (increment != s_none)
+			{
+				execute_node(en, increment);
+				if (en.has_error())
+					break;
+			}
+		}
+	}
+	bool FlatTree::evaluate_condition(runtime::DispatchEngine & en, std::uint32_t condition) const
+	{
+		const BoxedValue result = evaluate_node(en, condition);
+		if (en.has_error())	return false;
+
+		return impl::is_true(en, result);
+	}
+}
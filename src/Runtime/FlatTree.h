@@ -0,0 +1,93 @@
+#pragma once
+
+#include "AST.h"	// ast::ASTNode, runtime::DispatchEngine
+
+#include <cstddef>	// std::size_t
+#include <cstdint>	// std::uint8_t, std::uint32_t
+#include <string>	// std::string
+#include <vector>	// std::vector
+
+namespace ast
+{
+	/// \brief	Copy of a tree with its nodes stored one after the other in a vector, evaluated
+	///			by a switch over the kind of each node instead of virtual calls. The children
+	///			are referenced by their index, the names and the literals are kept in tables
+	///			of their own so that a node takes 16 bytes.
+	///			The statements, scopes, operators, variables, literals, ifs, whiles and fors
+	///			are copied, everything else (calls, typed operators, hoisted values, counted
+	///			fors...) is evaluated by the node of the original tree, which has to outlive
+	///			the flat one.
+	class FlatTree final : public ASTNode
+	{
+	public:
+		explicit FlatTree(const ASTNode & root);
+
+		BoxedValue evaluate(runtime::DispatchEngine & en) const override;
+		void execute(runtime::DispatchEngine & en) const override;
+
+		std::size_t get_node_num() const { return m_nodes.size(); }
+		/// \brief	Nodes evaluated by the original tree.
+		std::size_t get_tree_node_num() const { return m_trees.size(); }
+
+	private:
+		enum class Kind : std::uint8_t
+		{
+			STATEMENTS,		///< children in m_children [first, first + second)
+			SCOPE,			///< as STATEMENTS
+			VALUE,			///< m_values[first]
+			NAMED_VARIABLE,	///< m_names[first]
+			LOCAL_VARIABLE,	///< slot first
+			BINARY,			///< lhs first, rhs second
+			UNARY,			///< operand first
+			IF,				///< condition first, statements second, else third
+			WHILE,			///< condition first, statements second, m_loops[third]
+			FOR,			///< m_children[first] to [first + 3], m_loops[second]
+			TREE			///< m_trees[first]
+		};
+		struct Node
+		{
+			Kind m_kind;
+			std::uint8_t m_operator;	///< OperatorType, which is as wide as an int
+			bool m_declaration;
+			std::uint32_t m_first;
+			std::uint32_t m_second;
+			std::uint32_t m_third;
+		};
+		static_assert(sizeof(Node) == 16, "The nodes of the flat trees should take 16 bytes");
+		static_assert(OperatorType::MAX_TYPES <= 0xff, "The operators should fit in Node::m_operator");
+		/// \brief	The original node is the one the hoisted values are looked up by, see
+		///			runtime::DispatchEngine::push_loop.
+		struct Loop
+		{
+			const ASTNode * m_node;
+			std::size_t m_invariant_num;
+		};
+		static constexpr std::uint32_t s_none{ ~std::uint32_t{ 0 } };
+
+		/// \brief	Index of the copy of 'node' (s_none for nullptr).
+		std::uint32_t add(const ASTNode * node);
+		std::uint32_t add_node(Kind kind, std::uint32_t first, std::uint32_t second = s_none,
+							   std::uint32_t third = s_none);
+		std::uint32_t add_children(const std::vector<const ASTNode *> & children);
+		std::uint32_t add_loop(const ASTNode & node, std::size_t invariant_num);
+
+		BoxedValue evaluate_node(runtime::DispatchEngine & en, std::uint32_t index) const;
+		void execute_node(runtime::DispatchEngine & en, std::uint32_t index) const;
+		BoxedValue evaluate_operator(runtime::DispatchEngine & en, const Node & node, bool discard_result) const;
+		BoxedValue evaluate_statements(runtime::DispatchEngine & en, const Node & node) const;
+		void execute_statements(runtime::DispatchEngine & en, const Node & node) const;
+		void execute_if(runtime::DispatchEngine & en, const Node & node) const;
+		void execute_loop(runtime::DispatchEngine & en, const Node & node) const;
+		void iterate(runtime::DispatchEngine & en, std::uint32_t condition, std::uint32_t statements,
+					 std::uint32_t increment) const;
+		bool evaluate_condition(runtime::DispatchEngine & en, std::uint32_t condition) const;
+
+		std::vector<Node> m_nodes;
+		std::vector<std::uint32_t> m_children;
+		std::vector<BoxedValue> m_values;
+		std::vector<std::string> m_names;
+		std::vector<Loop> m_loops;
+		std::vector<const ASTNode *> m_trees;
+		std::uint32_t m_root;
+	};
+}
@@ -0,0 +1,494 @@
+
+#include "Jit.h"
+
+#ifdef SCRIPTING_JIT
+
+#if !defined(__x86_64__) && !defined(_M_X64)
+#error "SCRIPTING_JIT emits x86-64 code, disable it for this target"
+#endif
+
+#include "AST.h"				// ast::impl::CountedLoop
+#include "DispatchEngine.h"		// runtime::DispatchEngine
+
+#include <array>		// std::array
+#include <cstring>		// std::memcpy
+#include <typeinfo>		// typeid
+
+#ifdef _WIN32
+#include <windows.h>	// VirtualAlloc, VirtualProtect
+#else
+#include <sys/mman.h>	// mmap, mprotect
+#endif
+
+namespace runtime
+{
+	namespace jit
+	{
+		ExecutableCode::ExecutableCode(const std::vector<std::uint8_t> & code)
+			: m_size(code.size())
+		{
+#ifdef _WIN32
+			void * memory = VirtualAlloc(nullptr, m_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (!memory)
+				return;
+
+			std::memcpy(memory, code.data(), m_size);
+			DWORD old_protection;
+			if (!VirtualProtect(memory, m_size, PAGE_EXECUTE_READ, &old_protection))
+			{
+				VirtualFree(memory, 0, MEM_RELEASE);
+				return;
+			}
+			FlushInstructionCache(GetCurrentProcess(), memory, m_size);
+#else
+			void * memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+				return;
+
+			std::memcpy(memory, code.data(), m_size);
+			if (mprotect(memory, m_size, PROT_READ | PROT_EXEC) != 0)
+			{
+				munmap(memory, m_size);
+				return;
+			}
+#endif
+			m_memory = memory;
+		}
+		ExecutableCode::~ExecutableCode()
+		{
+			if (!m_memory)
+				return;
+#ifdef _WIN32
+			VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+			munmap(m_memory, m_size);
+#endif
+		}
+
+		CompiledLoop::CompiledLoop(std::vector<Variable> && variables, const std::vector<std::uint8_t> & code)
+			: m_variables(std::move(variables))
+			, m_code(code)
+		{}
+
+		bool CompiledLoop::run(DispatchEngine & en) const
+		{
+			// all the variables are checked before running, the code cannot change their types
+			std::array<BoxedValue *, s_max_variables> variables;
+			std::array<std::int32_t, s_max_variables> values;
+			for (std::size_t i = 0; i < m_variables.size(); ++i)
+			{
+				const Variable & variable = m_variables[i];
+				variables[i] = variable.m_name.empty() ? &en.get_local(variable.m_slot)
+													   : en.get_variable(variable.m_name);
+				if (!variables[i] || !variables[i]->is_storing<int>())
+					return false;
+
+				// read as const, a shared value is only cloned if it is assigned
+				const BoxedValue & value = *variables[i];
+				values[i] = boxed_cast<int>(value);
+			}
+
+			const auto entry = reinterpret_cast<entry_fn>(const_cast<void *>(m_code.get()));
+			entry(values.data());
+
+			for (std::size_t i = 0; i < m_variables.size(); ++i)
+			{
+				if (m_variables[i].m_assigned)
+					boxed_cast<int>(*variables[i]) = values[i];
+			}
+			return true;
+		}
+
+		namespace
+		{
+			/// \brief	Writes the few x86-64 instructions the loops need. Values are computed
+			///			in eax, with ecx as second operand, and the variables are 32 bit slots
+			///			of the array r8 points to.
+			class Assembler
+			{
+			public:
+				/// \brief	Condition codes of the signed comparisons, the low nibble of 'jcc'.
+				enum Condition : std::uint8_t
+				{
+					EQUAL = 0x4, NOT_EQUAL = 0x5,
+					LESS = 0xC, GREATER_EQUAL = 0xD, LESS_EQUAL = 0xE, GREATER = 0xF,
+				};
+				/// \brief	Position of a jump whose target is not known yet.
+				using Label = std::size_t;
+
+				void prologue()
+				{
+					// the array of variables is the first argument, mov r8, rdi (or rcx)
+#ifdef _WIN32
+					emit({ 0x49, 0x89, 0xC8 });
+#else
+					emit({ 0x49, 0x89, 0xF8 });
+#endif
+				}
+				void ret() { emit({ 0xC3 }); }
+
+				void mov_eax_imm(std::int32_t value) { emit({ 0xB8 }); emit_int(value); }
+				void load_eax(std::size_t variable) { emit({ 0x41, 0x8B, 0x80 }); emit_offset(variable); }
+				void store_eax(std::size_t variable) { emit({ 0x41, 0x89, 0x80 }); emit_offset(variable); }
+				void add_variable(std::size_t variable, std::int8_t value)
+				{
+					emit({ 0x41, 0x83, 0x80 });
+					emit_offset(variable);
+					emit({ static_cast<std::uint8_t>(value) });
+				}
+
+				void push_eax() { emit({ 0x50 }); }
+				void pop_ecx() { emit({ 0x59 }); }
+				void mov_ecx_eax() { emit({ 0x89, 0xC1 }); }
+
+				void add() { emit({ 0x01, 0xC8 }); }
+				void sub() { emit({ 0x29, 0xC8 }); }
+				void imul() { emit({ 0x0F, 0xAF, 0xC1 }); }
+				void and_() { emit({ 0x21, 0xC8 }); }
+				void or_() { emit({ 0x09, 0xC8 }); }
+				void xor_() { emit({ 0x31, 0xC8 }); }
+				void neg() { emit({ 0xF7, 0xD8 }); }
+				void not_() { emit({ 0xF7, 0xD0 }); }
+				void cmp() { emit({ 0x39, 0xC8 }); }
+
+				/// \brief	Jumps to a label bound later.
+				Label jcc(Condition condition) { emit({ 0x0F, static_cast<std::uint8_t>(0x80 | condition) }); return emit_label(); }
+				Label jmp() { emit({ 0xE9 }); return emit_label(); }
+				/// \brief	Jumps back to 'position'.
+				void jmp_to(std::size_t position)
+				{
+					emit({ 0xE9 });
+					emit_int(static_cast<std::int32_t>(position) - static_cast<std::int32_t>(m_code.size() + 4));
+				}
+				void bind(Label label)
+				{
+					const std::int32_t offset = static_cast<std::int32_t>(m_code.size() - (label + 4));
+					std::memcpy(&m_code[label], &offset, sizeof(offset));
+				}
+
+				std::size_t get_position() const { return m_code.size(); }
+				const std::vector<std::uint8_t> & get_code() const { return m_code; }
+
+			private:
+				void emit(std::initializer_list<std::uint8_t> bytes) { m_code.insert(m_code.end(), bytes); }
+				void emit_int(std::int32_t value)
+				{
+					std::uint8_t bytes[sizeof(value)];
+					std::memcpy(bytes, &value, sizeof(value));
+					m_code.insert(m_code.end(), bytes, bytes + sizeof(value));
+				}
+				void emit_offset(std::size_t variable)
+				{
+					emit_int(static_cast<std::int32_t>(variable * sizeof(std::int32_t)));
+				}
+				Label emit_label()
+				{
+					emit_int(0);
+					return m_code.size() - 4;
+				}
+
+				std::vector<std::uint8_t> m_code;
+			};
+
+			/// \brief	Condition that does not hold when 'op' does.
+			bool get_negated_condition(OperatorType op, Assembler::Condition & condition)
+			{
+				switch (op)
+				{
+					case OperatorType::LESS:		condition = Assembler::GREATER_EQUAL;	return true;
+					case OperatorType::LESS_EQ:		condition = Assembler::GREATER;			return true;
+					case OperatorType::GREATER:		condition = Assembler::LESS_EQUAL;		return true;
+					case OperatorType::GREATER_EQ:	condition = Assembler::LESS;			return true;
+					case OperatorType::EQEQ:		condition = Assembler::NOT_EQUAL;		return true;
+					case OperatorType::NOT_EQ:		condition = Assembler::EQUAL;			return true;
+					default:						return false;
+				}
+			}
+
+			class LoopCompiler
+			{
+			public:
+				explicit LoopCompiler(const ast::impl::CountedLoop & loop)
+				{
+					CompiledLoop::Variable counter;
+					counter.m_name = loop.m_name;
+					counter.m_slot = loop.m_slot;
+					counter.m_assigned = true;
+					m_variables.push_back(std::move(counter));
+				}
+
+				/// \brief	False if something in the loop cannot be compiled.
+				bool compile(const ast::impl::CountedLoop & loop, const ast::ASTNode & statements)
+				{
+					Assembler::Condition exit_condition;
+					if (!get_negated_condition(loop.m_condition->get_operator_type(), exit_condition))
+						return false;
+
+					m_asm.prologue();
+					const std::size_t head = m_asm.get_position();
+					if (!emit_value(loop.m_condition->get_rhs()))
+						return false;
+					m_asm.mov_ecx_eax();
+					m_asm.load_eax(0);
+					m_asm.cmp();
+					const Assembler::Label exit = m_asm.jcc(exit_condition);
+
+					if (!emit_statement(statements))
+						return false;
+					m_asm.add_variable(0, static_cast<std::int8_t>(loop.m_step));
+					m_asm.jmp_to(head);
+
+					m_asm.bind(exit);
+					m_asm.ret();
+					return true;
+				}
+
+				std::vector<CompiledLoop::Variable> take_variables() { return std::move(m_variables); }
+				const std::vector<std::uint8_t> & get_code() const { return m_asm.get_code(); }
+
+			private:
+				bool emit_statement(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::Statements))
+					{
+						for (const auto & statement : static_cast<const ast::Statements &>(node).get_statements())
+						{
+							if (!emit_statement(*statement))
+								return false;
+						}
+						return true;
+					}
+					else if (type == typeid(ast::BinaryOperator))
+					{
+						return emit_assignment(static_cast<const ast::BinaryOperator &>(node));
+					}
+					else if (type == typeid(ast::UnaryOperator))
+					{
+						const auto & op = static_cast<const ast::UnaryOperator &>(node);
+						std::size_t variable;
+						if (!get_variable(op.get_variable(), true, variable))
+							return false;
+
+						switch (op.get_operator_type())
+						{
+							case OperatorType::PRE_INC:	case OperatorType::POST_INC:	m_asm.add_variable(variable, 1);	return true;
+							case OperatorType::PRE_DEC:	case OperatorType::POST_DEC:	m_asm.add_variable(variable, -1);	return true;
+							default:														return false;
+						}
+					}
+					else if (type == typeid(ast::If))
+					{
+						return emit_if(static_cast<const ast::If &>(node));
+					}
+
+					// scopes are only kept when something is declared
+					return false;
+				}
+
+				bool emit_assignment(const ast::BinaryOperator & op)
+				{
+					std::size_t variable;
+					if (!get_variable(op.get_lhs(), true, variable) || !emit_value(op.get_rhs()))
+						return false;
+
+					if (op.get_operator_type() == OperatorType::EQ)
+					{
+						m_asm.store_eax(variable);
+						return true;
+					}
+
+					m_asm.mov_ecx_eax();
+					m_asm.load_eax(variable);
+					switch (op.get_operator_type())
+					{
+						case OperatorType::ADD_EQ:	m_asm.add();	break;
+						case OperatorType::SUB_EQ:	m_asm.sub();	break;
+						case OperatorType::MUL_EQ:	m_asm.imul();	break;
+						case OperatorType::AND_EQ:	m_asm.and_();	break;
+						case OperatorType::OR_EQ:	m_asm.or_();	break;
+						case OperatorType::XOR_EQ:	m_asm.xor_();	break;
+						default:					return false;
+					}
+					m_asm.store_eax(variable);
+					return true;
+				}
+
+				bool emit_if(const ast::If & node)
+				{
+					// the condition has to be a comparison, other values would need a conversion
+					const ast::ASTNode & condition = node.get_condition();
+					if (typeid(condition) != typeid(ast::BinaryOperator))
+						return false;
+					const auto & compare = static_cast<const ast::BinaryOperator &>(condition);
+					Assembler::Condition skip_condition;
+					if (!get_negated_condition(compare.get_operator_type(), skip_condition) ||
+						!emit_operands(compare))
+					{
+						return false;
+					}
+
+					m_asm.cmp();
+					const Assembler::Label skip = m_asm.jcc(skip_condition);
+					if (!emit_statement(node.get_statements()))
+						return false;
+
+					if (const ast::ASTNode * else_ = node.get_else())
+					{
+						const Assembler::Label end = m_asm.jmp();
+						m_asm.bind(skip);
+						if (!emit_statement(*else_))
+							return false;
+						m_asm.bind(end);
+					}
+					else
+					{
+						m_asm.bind(skip);
+					}
+					return true;
+				}
+
+				/// \brief	Leaves the lhs in eax and the rhs in ecx.
+				bool emit_operands(const ast::BinaryOperator & op)
+				{
+					if (!emit_value(op.get_rhs()))
+						return false;
+					m_asm.push_eax();
+					if (!emit_value(op.get_lhs()))
+						return false;
+					m_asm.pop_ecx();
+					return true;
+				}
+
+				/// \brief	Computes the value of 'node' in eax.
+				bool emit_value(const ast::ASTNode & node)
+				{
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::Value))
+					{
+						const BoxedValue value = node.evaluate_constant();
+						if (!value.is_storing<int>())
+							return false;
+
+						m_asm.mov_eax_imm(boxed_cast<int>(value));
+						return true;
+					}
+					else if (type == typeid(ast::LoopInvariant))
+					{
+						// ints are cheaper to compute again than to read from the interpreter
+						return emit_value(static_cast<const ast::LoopInvariant &>(node).get_value());
+					}
+					else if (type == typeid(ast::UnaryOperator))
+					{
+						const auto & op = static_cast<const ast::UnaryOperator &>(node);
+						if (op.get_operator_type() != OperatorType::UNARY_MINUS &&
+							op.get_operator_type() != OperatorType::BITWISE_NOT)
+						{
+							return false;
+						}
+						if (!emit_value(op.get_variable()))
+							return false;
+
+						if (op.get_operator_type() == OperatorType::UNARY_MINUS)	m_asm.neg();
+						else														m_asm.not_();
+						return true;
+					}
+					else if (type == typeid(ast::BinaryOperator))
+					{
+						const auto & op = static_cast<const ast::BinaryOperator &>(node);
+						switch (op.get_operator_type())
+						{
+							case OperatorType::ADD:	case OperatorType::SUB:	case OperatorType::MUL:
+							case OperatorType::AND:	case OperatorType::OR:	case OperatorType::XOR:
+								break;
+							default:
+								return false;
+						}
+						if (!emit_operands(op))
+							return false;
+
+						switch (op.get_operator_type())
+						{
+							case OperatorType::ADD:	m_asm.add();	break;
+							case OperatorType::SUB:	m_asm.sub();	break;
+							case OperatorType::MUL:	m_asm.imul();	break;
+							case OperatorType::AND:	m_asm.and_();	break;
+							case OperatorType::OR:	m_asm.or_();	break;
+							default:				m_asm.xor_();	break;
+						}
+						return true;
+					}
+
+					std::size_t variable;
+					if (!get_variable(node, false, variable))
+						return false;
+					m_asm.load_eax(variable);
+					return true;
+				}
+
+				/// \brief	Index of the variable 'node' refers to, false if it is not a variable
+				///			or there are too many.
+				bool get_variable(const ast::ASTNode & node, bool assigned, std::size_t & index)
+				{
+					CompiledLoop::Variable variable;
+					const std::type_info & type = typeid(node);
+					if (type == typeid(ast::NamedVariable))
+					{
+						const auto & named = static_cast<const ast::NamedVariable &>(node);
+						if (named.is_declaration())
+							return false;
+						variable.m_name = named.get_name();
+					}
+					else if (type == typeid(ast::LocalVariable))
+					{
+						const auto & local = static_cast<const ast::LocalVariable &>(node);
+						if (local.is_declaration())
+							return false;
+						variable.m_slot = local.get_slot();
+					}
+					else
+					{
+						return false;
+					}
+
+					for (index = 0; index < m_variables.size(); ++index)
+					{
+						CompiledLoop::Variable & known = m_variables[index];
+						if (known.m_name == variable.m_name && known.m_slot == variable.m_slot)
+						{
+							known.m_assigned = known.m_assigned || assigned;
+							return true;
+						}
+					}
+					if (m_variables.size() == CompiledLoop::s_max_variables)
+						return false;
+
+					variable.m_assigned = assigned;
+					m_variables.push_back(std::move(variable));
+					return true;
+				}
+
+				Assembler m_asm;
+				std::vector<CompiledLoop::Variable> m_variables;
+			};
+		}
+
+		std::unique_ptr<CompiledLoop> compile_loop(const ast::impl::CountedLoop & loop,
+												   const ast::ASTNode & statements)
+		{
+			// the counters step by '++' and '--' only (see ast::impl::make_counted_loop), larger
+			// steps could make '!=' skip the bound
+			if (loop.m_step != 1 && loop.m_step != -1)
+				return nullptr;
+
+			LoopCompiler compiler{ loop };
+			if (!compiler.compile(loop, statements))
+				return nullptr;
+
+			auto compiled = std::make_unique<CompiledLoop>(compiler.take_variables(), compiler.get_code());
+			return compiled->is_executable() ? std::move(compiled) : nullptr;
+		}
+	}
+}
+
+#endif
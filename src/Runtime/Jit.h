@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Forwards.h"	// ast::ASTNode, runtime::DispatchEngine
+
+#include <cstddef>	// std::size_t
+#include <cstdint>	// std::int32_t, std::uint8_t
+#include <memory>	// std::unique_ptr
+#include <string>	// std::string
+#include <vector>	// std::vector
+
+namespace ast
+{
+	namespace impl
+	{
+		struct CountedLoop;
+	}
+}
+
+// Optional tier, only built with SCRIPTING_JIT defined (see the option in CMakeLists.txt).
+namespace runtime
+{
+	namespace jit
+	{
+		/// \brief	Pages holding machine code, writable while they are filled and only
+		///			executable after that.
+		class ExecutableCode
+		{
+		public:
+			explicit ExecutableCode(const std::vector<std::uint8_t> & code);
+			~ExecutableCode();
+			ExecutableCode(const ExecutableCode &) = delete;
+			ExecutableCode& operator=(const ExecutableCode &) = delete;
+
+			/// \brief	nullptr if the system did not give executable memory.
+			const void * get() const { return m_memory; }
+
+		private:
+			void * m_memory{ nullptr };
+			std::size_t m_size{ 0 };
+		};
+
+		/// \brief	Counted loop (see ast::impl::CountedLoop) compiled to x86-64 code that keeps
+		///			its variables as native ints. The variables are read when the loop starts
+		///			and the assigned ones are written back when it ends, the statements call
+		///			nothing so nobody can see them in between.
+		class CompiledLoop
+		{
+		public:
+			/// \brief	Variable of the script the loop uses, the code reads it from the slot
+			///			with its index.
+			struct Variable
+			{
+				std::string m_name;			///< of a named variable, empty for locals
+				std::size_t m_slot{ 0 };	///< of a local
+				bool m_assigned{ false };
+			};
+			/// \brief	The counter is always the first one.
+			static constexpr std::size_t s_max_variables{ 16 };
+
+			CompiledLoop(std::vector<Variable> && variables, const std::vector<std::uint8_t> & code);
+
+			/// \brief	Runs the whole loop. Returns false without running anything if one of the
+			///			variables does not exist or does not store an int, the interpreter
+			///			has to run the loop then.
+			bool run(DispatchEngine & en) const;
+
+			bool is_executable() const { return m_code.get() != nullptr; }
+
+		private:
+			using entry_fn = void(*)(std::int32_t * variables);
+
+			std::vector<Variable> m_variables;
+			ExecutableCode m_code;
+		};
+
+		/// \brief	nullptr if the loop uses something but int literals, variables, the
+		///			operators that cannot trap (+, -, *, &, |, ^, unary - and ~), assignments,
+		///			increments, decrements and ifs comparing ints.
+		std::unique_ptr<CompiledLoop> compile_loop(const ast::impl::CountedLoop & loop,
+												   const ast::ASTNode & statements);
+	}
+}
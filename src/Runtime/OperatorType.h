@@ -1,6 +1,6 @@
 #pragma once
 
-enum OperatorType
+enum OperatorType : int
 {
 	POST_INC, POST_DEC, PRE_INC, PRE_DEC,
 	UNARY_PLUS, UNARY_MINUS,
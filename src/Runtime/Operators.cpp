@@ -1,5 +1,5 @@
 
-#include "Runtime\Operators.h"
+#include "Runtime/Operators.h"
 
 #include <iostream>
 
@@ -8,6 +8,19 @@ namespace binds
 	const BinaryOperators::operation_fn * BinaryOperators::get_operator(const TypeInfo & lhs_type,
 																OperatorType op,
 																const TypeInfo & rhs_type) const
+	{
+		const Operation * operation = get_operation(lhs_type, op, rhs_type);
+		return operation ? &operation->m_fn : nullptr;
+	}
+	const TypeInfo * BinaryOperators::get_result_type(const TypeInfo & lhs_type, OperatorType op,
+													  const TypeInfo & rhs_type) const
+	{
+		const Operation * operation = get_operation(lhs_type, op, rhs_type);
+		return operation ? operation->m_result_type : nullptr;
+	}
+	const BinaryOperators::Operation * BinaryOperators::get_operation(const TypeInfo & lhs_type,
+																	  OperatorType op,
+																	  const TypeInfo & rhs_type) const
 	{
 		const auto it = m_all_operations.find(op);
 		if (it != m_all_operations.end())
@@ -1,11 +1,13 @@
 
 #pragma once
 
-#include "Runtime\BoxedValue.h"
-#include "Runtime\OperatorType.h"	// OperatorType
+#include "Runtime/BoxedValue.h"
+#include "Runtime/OperatorType.h"	// OperatorType
 #include "static_if.h"				// meta::static_if
 
 #include <typeinfo>
+#include <utility>		// std::declval
+#include <type_traits>	// std::conditional_t, std::decay_t
 #include <unordered_map>
 
 namespace binds
@@ -42,27 +44,52 @@ namespace binds
 
 		const operation_fn * get_operator(const TypeInfo & lhs_type, OperatorType op,
 										  const TypeInfo & rhs_type) const;
+		/// \brief	Type of the values the operator creates, nullptr if there is no such operator.
+		const TypeInfo * get_result_type(const TypeInfo & lhs_type, OperatorType op,
+										 const TypeInfo & rhs_type) const;
 
 	private:
+		struct Operation
+		{
+			operation_fn m_fn;
+			const TypeInfo * m_result_type;
+		};
+
 		template <typename T1, typename T2, typename OP>
 		void add_operator_impl()
 		{
-			// lhs is non const in case the operator modifies it (i.e. += or -=)
-			m_all_operations[OP::s_type][get_type_pair_hash<T1, T2>()] =
+			// copy the operator type, binding OP::s_type to a reference would odr-use it
+			const OperatorType op_type = OP::s_type;
+
+			// lhs is non const in case the operator modifies it (i.e. += or -=), the rest
+			// read it as const so that a shared value is not cloned (see BoxedValue)
+			using lhs_type = std::conditional_t<OP::s_modifies_lhs, BoxedValue &, const BoxedValue &>;
+			using lhs_arg_type = std::conditional_t<OP::s_modifies_lhs, T1 &, const T1 &>;
+			using result_type = std::decay_t<decltype(OP::call(std::declval<lhs_arg_type>(),
+															   std::declval<const T2 &>()))>;
+			m_all_operations[op_type][get_type_pair_hash<T1, T2>()] = Operation{
 				[](BoxedValue & lhs, const BoxedValue & rhs)
 			{
-				return BoxedValue{ OP::call(boxed_cast<T1>(lhs), boxed_cast<T2>(rhs)) };
-			};
+				lhs_type real_lhs = lhs;
+				return BoxedValue{ BoxedValueTemporary_t{}, OP::call(boxed_cast<T1>(real_lhs), boxed_cast<T2>(rhs)) };
+			}, &get_type_info<result_type>() };
 		}
 
+		const Operation * get_operation(const TypeInfo & lhs_type, OperatorType op,
+										const TypeInfo & rhs_type) const;
+
 		///	\brief	Containter that will hold an operation for all the types.
 		///			(i.e. for the operator '+' will hold float + float, float + int...
-		using operator_operations = std::unordered_map<type_pair_key, operation_fn >;
+		using operator_operations = std::unordered_map<type_pair_key, Operation>;
 
 		///	\brief	Holds all the operations for all the types
 		std::unordered_map<OperatorType, operator_operations > m_all_operations;
 	};
 
+	/// \brief	Operators between the builtin types that all the engines have, also used to
+	///			fold constant expressions when parsing (see ast::ASTNode::evaluate_constant).
+	void add_default_binary_operations(BinaryOperators & group);
+
 	namespace impl
 	{
 		template <typename T1, typename T2, typename ... OPs>
@@ -79,6 +106,7 @@ namespace binds
 #define DECLARE_OPERATOR(name, op, type)							\
 		struct name {												\
 			static constexpr OperatorType s_type = OperatorType::type;	\
+			static constexpr bool s_modifies_lhs = false;			\
 			template <typename T1, typename T2>						\
 			static auto call(const T1 & lhs, const T2 & rhs)		\
 			{ return lhs op rhs; }							\
@@ -87,31 +115,35 @@ namespace binds
 #define DECLARE_COMPOUND_OPERATOR(name, op, type)					\
 		struct name {												\
 			static constexpr OperatorType s_type = OperatorType::type;	\
+			static constexpr bool s_modifies_lhs = true;			\
 			template <typename T1, typename T2>						\
 			static auto call(T1 & lhs, const T2 & rhs)				\
 			{ return lhs op static_cast<T1>(rhs); }					\
 		}
 
-#define DECLARE_OPERATOR_AND_COMPOUND(name, op, type)		\
-	DECLARE_OPERATOR(name, op, type);						\
-	DECLARE_COMPOUND_OPERATOR(name##Eq, op=, type##_EQ)
+#define DECLARE_OPERATOR_AND_COMPOUND(name, op, compound_op, type)	\
+	DECLARE_OPERATOR(name, op, type);								\
+	DECLARE_COMPOUND_OPERATOR(name##Eq, compound_op, type##_EQ)
 
 namespace opts
 {
-	DECLARE_OPERATOR_AND_COMPOUND(Add, +, ADD);
-	DECLARE_OPERATOR_AND_COMPOUND(Sub, -, SUB);
-	DECLARE_OPERATOR_AND_COMPOUND(Mul, *, MUL);
-	DECLARE_OPERATOR_AND_COMPOUND(Div, /, DIV);
-	DECLARE_OPERATOR_AND_COMPOUND(Mod, %, MOD);
-
-	DECLARE_OPERATOR_AND_COMPOUND(LeftShift, << , LEFT_SHIFT);
-	DECLARE_OPERATOR_AND_COMPOUND(RightShift, >> , RIGHT_SHIFT);
-	DECLARE_OPERATOR_AND_COMPOUND(And, &, AND);
-	DECLARE_OPERATOR_AND_COMPOUND(Or, |, OR);
-	DECLARE_OPERATOR_AND_COMPOUND(Xor, ^, XOR);
-
-	DECLARE_OPERATOR_AND_COMPOUND(Less, <, LESS);
-	DECLARE_OPERATOR_AND_COMPOUND(Greater, >, GREATER);
+	DECLARE_OPERATOR_AND_COMPOUND(Add, +, +=, ADD);
+	DECLARE_OPERATOR_AND_COMPOUND(Sub, -, -=, SUB);
+	DECLARE_OPERATOR_AND_COMPOUND(Mul, *, *=, MUL);
+	DECLARE_OPERATOR_AND_COMPOUND(Div, /, /=, DIV);
+	DECLARE_OPERATOR_AND_COMPOUND(Mod, %, %=, MOD);
+
+	DECLARE_OPERATOR_AND_COMPOUND(LeftShift, << , <<=, LEFT_SHIFT);
+	DECLARE_OPERATOR_AND_COMPOUND(RightShift, >> , >>=, RIGHT_SHIFT);
+	DECLARE_OPERATOR_AND_COMPOUND(And, &, &=, AND);
+	DECLARE_OPERATOR_AND_COMPOUND(Or, |, |=, OR);
+	DECLARE_OPERATOR_AND_COMPOUND(Xor, ^, ^=, XOR);
+
+	// <= and >= only read their operands, they are not compound operators
+	DECLARE_OPERATOR(Less, <, LESS);
+	DECLARE_OPERATOR(LessEq, <=, LESS_EQ);
+	DECLARE_OPERATOR(Greater, >, GREATER);
+	DECLARE_OPERATOR(GreaterEq, >=, GREATER_EQ);
 	DECLARE_OPERATOR(EqEq, ==, EQEQ);
 	DECLARE_OPERATOR(NotEq, != , NOT_EQ);
 
@@ -122,7 +154,7 @@ namespace opts
 	DECLARE_COMPOUND_OPERATOR(Eq, =, EQ);
 }
 
-#undef DECLARE_BIN_OPERATOR_AND_COMPUND
+#undef DECLARE_OPERATOR_AND_COMPOUND
 #undef DECLARE_COMPOUND_OPERATOR
 #undef DECLARE_OPERATOR
 
@@ -0,0 +1,198 @@
+
+#include "Profiler.h"
+
+#include "AST.h"	// ast::ProfiledNode
+
+#include <algorithm>	// std::sort
+#include <iomanip>		// std::setw
+#include <map>			// std::map
+#include <ostream>		// std::ostream
+
+namespace runtime
+{
+	namespace
+	{
+		double to_ms(Profiler::clock::duration d)
+		{
+			return std::chrono::duration<double, std::milli>(d).count();
+		}
+	}
+
+	Profiler::ScopedSample::ScopedSample(Profiler & profiler, const ast::ProfiledNode & node)
+		: m_profiler(profiler)
+	{
+		m_profiler.enter(node);
+		m_start = clock::now();
+	}
+	Profiler::ScopedSample::~ScopedSample()
+	{
+		m_profiler.exit(clock::now() - m_start);
+	}
+
+	Profiler::Profiler() = default;
+	Profiler::~Profiler() = default;
+
+	Profiler::clock::duration Profiler::Frame::get_self() const
+	{
+		clock::duration children{ 0 };
+		for (const auto & child : m_children)
+			children += child.second->m_total;
+
+		return m_total - children;
+	}
+
+	void Profiler::enter(const ast::ProfiledNode & node)
+	{
+		auto & child = m_curr->m_children[&node];
+		if (!child)
+		{
+			child = std::make_unique<Frame>();
+			child->m_node = &node;
+			child->m_line = node.get_line();
+			child->m_label = node.get_label();
+			child->m_parent = m_curr;
+		}
+
+		++child->m_calls;
+		m_curr = child.get();
+	}
+	void Profiler::exit(clock::duration elapsed)
+	{
+		m_curr->m_total += elapsed;
+		m_curr = m_curr->m_parent;
+	}
+
+	void Profiler::reset()
+	{
+		m_root.m_children.clear();
+		m_curr = &m_root;
+	}
+
+	std::vector<Profiler::NodeReport> Profiler::get_node_report() const
+	{
+		struct Accumulated
+		{
+			const Frame * m_frame{ nullptr };	///< any of the frames of the node, to get its data
+			std::size_t m_calls{ 0 };
+			clock::duration m_total{ 0 };
+			clock::duration m_self{ 0 };
+			std::size_t m_active{ 0 };	///< times the node is in the current path
+		};
+		std::unordered_map<const ast::ProfiledNode *, Accumulated> nodes;
+
+		// the total time is only added by the outermost frame of a node, otherwise
+		// a node that is reached from itself would count the same time twice
+		auto accumulate = [&nodes](const Frame & frame, const auto & recurse) -> void
+		{
+			auto & acc = nodes[frame.m_node];
+			acc.m_frame = &frame;
+			acc.m_calls += frame.m_calls;
+			acc.m_self += frame.get_self();
+			if (acc.m_active == 0)
+				acc.m_total += frame.m_total;
+
+			++acc.m_active;
+			for (const auto & child : frame.m_children)
+				recurse(*child.second, recurse);
+			--acc.m_active;
+		};
+		for (const auto & child : m_root.m_children)
+			accumulate(*child.second, accumulate);
+
+		std::vector<NodeReport> report;
+		report.reserve(nodes.size());
+		for (const auto & node : nodes)
+		{
+			report.push_back(NodeReport{ node.second.m_frame->m_line, node.second.m_frame->m_label,
+							 node.second.m_calls, node.second.m_total, node.second.m_self });
+		}
+
+		std::sort(report.begin(), report.end(), [](const NodeReport & lhs, const NodeReport & rhs)
+		{
+			if (lhs.m_self != rhs.m_self)	return lhs.m_self > rhs.m_self;
+			return lhs.m_line < rhs.m_line;
+		});
+		return report;
+	}
+
+	std::vector<Profiler::LineReport> Profiler::get_line_report() const
+	{
+		std::map<std::size_t, clock::duration> lines;
+		for (const auto & node : get_node_report())
+			lines[node.m_line] += node.m_self;
+
+		std::vector<LineReport> report;
+		report.reserve(lines.size());
+		for (const auto & line : lines)
+			report.push_back(LineReport{ line.first, line.second });
+
+		std::stable_sort(report.begin(), report.end(), [](const LineReport & lhs, const LineReport & rhs)
+		{
+			return lhs.m_self > rhs.m_self;
+		});
+		return report;
+	}
+
+	Profiler::clock::duration Profiler::get_total_time() const
+	{
+		clock::duration total{ 0 };
+		for (const auto & child : m_root.m_children)
+			total += child.second->m_total;
+
+		return total;
+	}
+
+	void Profiler::write_report(std::ostream & os, std::size_t max_entries) const
+	{
+		const double total_ms = to_ms(get_total_time());
+		const auto percentage = [total_ms](clock::duration d)
+		{
+			return total_ms > 0.0 ? to_ms(d) * 100.0 / total_ms : 0.0;
+		};
+
+		os << std::fixed << std::setprecision(3);
+		os << "total: " << total_ms << " ms\n\n";
+
+		os << "hot lines\n";
+		os << std::setw(8) << "line" << std::setw(14) << "self ms" << std::setw(10) << "%" << '\n';
+		const auto lines = get_line_report();
+		for (std::size_t i = 0; i < lines.size() && i < max_entries; ++i)
+		{
+			os << std::setw(8) << lines[i].m_line
+				<< std::setw(14) << to_ms(lines[i].m_self)
+				<< std::setw(10) << std::setprecision(1) << percentage(lines[i].m_self)
+				<< std::setprecision(3) << '\n';
+		}
+
+		os << "\nhot nodes\n";
+		os << std::setw(8) << "line" << std::setw(12) << "calls" << std::setw(14) << "self ms"
+			<< std::setw(14) << "total ms" << "  node\n";
+		const auto nodes = get_node_report();
+		for (std::size_t i = 0; i < nodes.size() && i < max_entries; ++i)
+		{
+			os << std::setw(8) << nodes[i].m_line
+				<< std::setw(12) << nodes[i].m_calls
+				<< std::setw(14) << to_ms(nodes[i].m_self)
+				<< std::setw(14) << to_ms(nodes[i].m_total)
+				<< "  " << nodes[i].m_label << '\n';
+		}
+	}
+
+	void Profiler::write_folded_stacks(std::ostream & os) const
+	{
+		auto write = [&os](const Frame & frame, const std::string & path, const auto & recurse) -> void
+		{
+			const std::string frame_path = path + ';' + frame.m_label + " (" + std::to_string(frame.m_line) + ")";
+
+			const auto self = std::chrono::duration_cast<std::chrono::nanoseconds>(frame.get_self());
+			if (self.count() > 0)
+				os << frame_path << ' ' << self.count() << '\n';
+
+			for (const auto & child : frame.m_children)
+				recurse(*child.second, frame_path, recurse);
+		};
+
+		for (const auto & child : m_root.m_children)
+			write(*child.second, "script", write);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Forwards.h"	// ast::ProfiledNode
+
+#include <chrono>			// std::chrono::steady_clock
+#include <iosfwd>			// std::ostream
+#include <memory>			// std::unique_ptr
+#include <string>			// std::string
+#include <unordered_map>	// std::unordered_map
+#include <vector>			// std::vector
+
+namespace runtime
+{
+	/// \brief	Collects how many times and for how long each profiled node of an script is
+	///			evaluated. Nodes are only profiled if the script was parsed with profiling
+	///			enabled (parse::Parser::set_profiling) and the profiler has been given to the
+	///			engine (DispatchEngine::set_profiler), scripts parsed without it have no overhead.
+	///
+	///			Samples are stored in a call tree, so the same node reached from different
+	///			paths (i.e. a statement inside a loop nested in another loop) is kept apart,
+	///			this is what allows writing folded stacks for flamegraphs.
+	class Profiler
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		/// \brief	Measures the evaluation of a node while it's alive.
+		class ScopedSample
+		{
+		public:
+			ScopedSample(Profiler & profiler, const ast::ProfiledNode & node);
+			~ScopedSample();
+			ScopedSample(const ScopedSample &) = delete;
+			ScopedSample& operator=(const ScopedSample &) = delete;
+
+		private:
+			Profiler & m_profiler;
+			clock::time_point m_start;
+		};
+
+		/// \brief	Accumulated data of one node, 'total' includes the time spent in the nodes
+		///			evaluated from it and 'self' doesn't.
+		struct NodeReport
+		{
+			std::size_t m_line;
+			std::string m_label;
+			std::size_t m_calls;
+			clock::duration m_total;
+			clock::duration m_self;
+		};
+
+		/// \brief	Time spent evaluating the nodes of one line of the script.
+		struct LineReport
+		{
+			std::size_t m_line;
+			clock::duration m_self;
+		};
+
+		Profiler();
+		~Profiler();
+		Profiler(const Profiler &) = delete;
+		Profiler& operator=(const Profiler &) = delete;
+
+		/// \brief	Discards all the samples taken.
+		void reset();
+
+		/// \brief	Nodes sorted by self time, the most expensive first.
+		std::vector<NodeReport> get_node_report() const;
+		/// \brief	Lines sorted by self time, the most expensive first.
+		std::vector<LineReport> get_line_report() const;
+		/// \brief	Time spent in all the profiled nodes.
+		clock::duration get_total_time() const;
+
+		/// \brief	Human readable report with the hottest 'max_entries' lines and nodes.
+		void write_report(std::ostream & os, std::size_t max_entries = 20) const;
+		/// \brief	One line per call path with the self time in nanoseconds, in the format
+		///			used by flamegraph.pl and similar tools (i.e. "script;for (3);+= (4) 1200").
+		void write_folded_stacks(std::ostream & os) const;
+
+	private:
+		/// \note	The line and label are copied so that the samples can be read after the
+		///			script has been destroyed, nodes are still identified by their address so
+		///			the profiler needs to be reset before profiling a different script.
+		struct Frame
+		{
+			const ast::ProfiledNode * m_node{ nullptr };
+			std::size_t m_line{ 0 };
+			std::string m_label;
+			Frame * m_parent{ nullptr };
+			std::size_t m_calls{ 0 };
+			clock::duration m_total{ 0 };
+			std::unordered_map<const ast::ProfiledNode *, std::unique_ptr<Frame>> m_children;
+
+			clock::duration get_self() const;
+		};
+
+		void enter(const ast::ProfiledNode & node);
+		void exit(clock::duration elapsed);
+
+		Frame m_root;
+		Frame * m_curr{ &m_root };
+	};
+}
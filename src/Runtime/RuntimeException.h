@@ -47,6 +47,10 @@ namespace except
 {
 	namespace impl
 	{
+		inline const char * concat_exception()
+		{
+			return "";
+		}
 		template <typename T, typename ... Ts>
 		std::string concat_exception(T && t, Ts && ... vs)
 		{
@@ -54,10 +58,6 @@ namespace except
 			ss << t;
 			return ss.str() + concat_exception(std::forward<Ts>(vs)...);
 		}
-		inline const char * concat_exception()
-		{
-			return "";
-		}
 	}
 }
 
@@ -70,3 +70,50 @@ namespace except
 		_SCR_DEBUG_STOP_EXECUTION();			\
 		_SCR_RUNTIME_EXCEPTION(__VA_ARGS__);	\
 	} while(0)
+
+#include <initializer_list>	// std::initializer_list
+#include <sstream>			// std::stringstream
+#include <string>			// std::string
+
+namespace except
+{
+	/// \brief	Kind of the errors reported by DispatchEngine::try_evaluate.
+	enum class ErrorCode
+	{
+		NONE,
+		INVALID_OPERATION,		///< operator not bound for the types of its operands
+		INVALID_CONDITION,		///< condition that cannot be evaluated to true or false
+		UNKNOWN_VARIABLE,
+		UNKNOWN_FUNCTION,
+		NO_MATCHING_CALL,		///< no overload can be called with the arguments given
+		UNBOUND_MEMBER,			///< member function or variable not bound for the type
+		INDEX_OUT_OF_RANGE,		///< access past the end of a vector or an string
+		EXCEPTION				///< an exception was thrown, i.e. by a bound function
+	};
+
+	/// \brief	Error found while evaluating an script without throwing. Only the first error
+	///			of an evaluation is kept (see DispatchEngine::set_error), so the message is
+	///			built where the error is found.
+	class EvaluationError
+	{
+	public:
+		EvaluationError() = default;
+		template <typename ... Ts>
+		explicit EvaluationError(ErrorCode code, Ts && ... args)
+			: m_code(code)
+		{
+			std::stringstream ss;
+			(void)std::initializer_list<int>{ ((ss << args), 0)... };
+			m_message = ss.str();
+		}
+
+		ErrorCode get_code() const { return m_code; }
+		const std::string & get_message() const { return m_message; }
+
+		explicit operator bool() const { return m_code != ErrorCode::NONE; }
+
+	private:
+		ErrorCode m_code{ ErrorCode::NONE };
+		std::string m_message;
+	};
+}
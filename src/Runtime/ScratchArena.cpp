@@ -0,0 +1,67 @@
+
+#include "ScratchArena.h"
+
+#include "BoxedValue.h"
+
+#include <algorithm>	// std::max
+
+namespace runtime
+{
+	ScratchArena::ScratchArena() = default;
+	ScratchArena::~ScratchArena() = default;
+
+	void * ScratchArena::allocate(std::size_t size, std::size_t alignment)
+	{
+		for (; m_curr_chunk < m_chunks.size(); ++m_curr_chunk, m_offset = 0)
+		{
+			const Chunk & chunk = m_chunks[m_curr_chunk];
+			void * ptr = chunk.m_data.get() + m_offset;
+			std::size_t space = chunk.m_size - m_offset;
+			if (std::align(alignment, size, ptr, space))
+			{
+				m_offset = static_cast<unsigned char *>(ptr) - chunk.m_data.get() + size;
+				return ptr;
+			}
+		}
+
+		// the chunks are kept when released, so this only happens until the arena is big enough
+		// copy the minimum size, std::max binding s_chunk_size to a reference would odr-use it
+		const std::size_t min_chunk_size = s_chunk_size;
+		const std::size_t chunk_size = std::max(min_chunk_size, size + alignment);
+		m_chunks.push_back(Chunk{ std::make_unique<unsigned char[]>(chunk_size), chunk_size });
+		m_offset = 0;
+		return allocate(size, alignment);
+	}
+
+	void ScratchArena::release(Mark mark)
+	{
+		m_curr_chunk = mark.m_chunk;
+		m_offset = mark.m_offset;
+	}
+
+	std::vector<BoxedValue> ScratchArena::take_vector()
+	{
+		if (m_vectors.empty())
+			return{};
+
+		std::vector<BoxedValue> values = std::move(m_vectors.back());
+		m_vectors.pop_back();
+		return values;
+	}
+
+	void ScratchArena::give_back_vector(std::vector<BoxedValue> && values)
+	{
+		values.clear();
+		if (m_vectors.size() < s_max_vectors)
+			m_vectors.push_back(std::move(values));
+	}
+
+	std::size_t ScratchArena::get_capacity() const
+	{
+		std::size_t capacity = 0;
+		for (const auto & chunk : m_chunks)
+			capacity += chunk.m_size;
+
+		return capacity;
+	}
+}
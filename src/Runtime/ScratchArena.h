@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Forwards.h"	// BoxedValue
+
+#include <cstddef>	// std::size_t
+#include <memory>	// std::unique_ptr
+#include <vector>	// std::vector
+
+namespace runtime
+{
+	class ScratchArena;
+
+	/// \brief	Arena used by the BoxedValues created in this thread, nullptr while no engine
+	///			is evaluating an script. Kept per thread as the statistics, BoxedValue knows
+	///			nothing about the engine that is using it.
+	inline ScratchArena *& get_thread_scratch_arena()
+	{
+		static thread_local ScratchArena * s_arena{ nullptr };
+		return s_arena;
+	}
+
+	/// \brief	Bump allocator for the temporaries created while evaluating an statement
+	///			(i.e. operands, results of operators and references to variables), which are
+	///			released all at once when the statement or the loop iteration ends. Releasing
+	///			keeps the memory, so evaluating the same statement again does not allocate.
+	///
+	///			Objects in the arena never get their destructor called, only trivially
+	///			destructible values are stored in it (see BoxedValue::take_ownership for
+	///			how a value gets out of it when it has to outlive the statement).
+	class ScratchArena
+	{
+	public:
+		/// \brief	Position of the arena, releasing it frees everything allocated after it.
+		struct Mark
+		{
+			std::size_t m_chunk;
+			std::size_t m_offset;
+		};
+
+		/// \brief	Releases the memory allocated while it's alive, nested scopes leave the
+		///			allocations of the outer ones untouched.
+		class Scope
+		{
+		public:
+			explicit Scope(ScratchArena & arena) : m_arena(arena), m_mark(arena.get_mark()) {}
+			~Scope() { m_arena.release(m_mark); }
+			Scope(const Scope &) = delete;
+			Scope& operator=(const Scope &) = delete;
+
+		private:
+			ScratchArena & m_arena;
+			Mark m_mark;
+		};
+
+		/// \brief	Makes the arena the one of this thread while it's alive.
+		class Activation
+		{
+		public:
+			explicit Activation(ScratchArena & arena) : m_previous(get_thread_scratch_arena())
+			{
+				get_thread_scratch_arena() = &arena;
+			}
+			~Activation() { get_thread_scratch_arena() = m_previous; }
+			Activation(const Activation &) = delete;
+			Activation& operator=(const Activation &) = delete;
+
+		private:
+			ScratchArena * m_previous;
+		};
+
+		ScratchArena();
+		~ScratchArena();
+		ScratchArena(const ScratchArena &) = delete;
+		ScratchArena& operator=(const ScratchArena &) = delete;
+
+		void * allocate(std::size_t size, std::size_t alignment);
+		Mark get_mark() const { return{ m_curr_chunk, m_offset }; }
+		void release(Mark mark);
+
+		/// \brief	Empty vector that keeps the capacity it had when it was given back,
+		///			used for the arguments of the calls.
+		std::vector<BoxedValue> take_vector();
+		/// \brief	Destroys the values of 'values' and keeps its memory for take_vector.
+		void give_back_vector(std::vector<BoxedValue> && values);
+
+		/// \brief	Bytes reserved by the arena, used or not.
+		std::size_t get_capacity() const;
+
+	private:
+		static constexpr std::size_t s_chunk_size{ 16 * 1024 };
+		static constexpr std::size_t s_max_vectors{ 64 };
+
+		struct Chunk
+		{
+			std::unique_ptr<unsigned char[]> m_data;
+			std::size_t m_size;
+		};
+
+		std::vector<Chunk> m_chunks;
+		std::size_t m_curr_chunk{ 0 };
+		std::size_t m_offset{ 0 };	///< first free byte of the current chunk
+
+		std::vector<std::vector<BoxedValue>> m_vectors;
+	};
+}
@@ -0,0 +1,63 @@
+
+#include "ScriptFunction.h"
+
+#include "AST.h"				// ast::ASTNode
+#include "DispatchEngine.h"		// runtime::DispatchEngine
+#include "RuntimeException.h"
+
+namespace runtime
+{
+	ScriptFunction::ScriptFunction(std::size_t param_num, std::size_t local_num,
+								   std::unique_ptr<ast::ASTNode> && body)
+		: m_param_num(param_num)
+		, m_local_num(local_num)
+		, m_body(std::move(body))
+	{}
+	ScriptFunction::~ScriptFunction() = default;
+
+	BoxedValue ScriptFunction::call(DispatchEngine & en, std::vector<BoxedValue> & args) const
+	{
+		if (args.size() != m_param_num)
+			return except::make_boxed_runtime_error();
+
+		// the parameters take the first slots of the frame
+		const DispatchEngine::FrameGuard frame{ en, m_local_num };
+		for (std::size_t i = 0; i < m_param_num; ++i)
+		{
+			const BoxedValue & value = resolve_ref(args[i]);
+			if (&value == &args[i])		en.get_local(i) = std::move(args[i]);
+			else						en.get_local(i) = value;
+		}
+
+		m_body->execute(en);
+		if (en.has_error())
+			return{};
+
+		return en.take_return_value();
+	}
+}
+
+namespace binds
+{
+	ScriptFunctionBinding::ScriptFunctionBinding(std::size_t slot, std::size_t param_num)
+		: m_slot(slot)
+		, m_param_num(param_num)
+	{}
+
+	BoxedValue ScriptFunctionBinding::do_call(runtime::DispatchEngine & en,
+											  std::vector<BoxedValue> & args) const
+	{
+		return en.get_script_function(m_slot).call(en, args);
+	}
+
+	impl::FunctionCallMatchScore ScriptFunctionBinding::get_call_score(runtime::DispatchEngine &,
+																	   std::vector<BoxedValue> & args,
+																	   impl::ConversionPlan &) const
+	{
+		// parameters have no type, any argument is valid but it is not an exact match
+		if (args.size() != m_param_num)
+			return{ impl::FunctionCallMatchScore::invalid };
+
+		return{ 0 };
+	}
+}
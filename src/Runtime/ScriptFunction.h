@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Forwards.h"	// ast::ASTNode, runtime::DispatchEngine
+#include "Bindings.h"	// binds::GlobalFunctionBinding
+
+#include <memory>	// std::unique_ptr
+#include <vector>	// std::vector
+
+namespace runtime
+{
+	/// \brief	Function defined inside an script (i.e. 'def add(a, b) { return a + b }').
+	///			The parser gives each parameter and local variable of the function an slot,
+	///			so a call gets all of them at once, in one contiguous frame reused by the
+	///			engine (see DispatchEngine::FrameGuard), and the blocks inside the function
+	///			do not push scopes into the stack.
+	class ScriptFunction
+	{
+	public:
+		ScriptFunction(std::size_t param_num, std::size_t local_num,
+					   std::unique_ptr<ast::ASTNode> && body);
+		~ScriptFunction();
+
+		/// \brief	Parameters are passed by value, references to variables are copied.
+		BoxedValue call(DispatchEngine & en, std::vector<BoxedValue> & args) const;
+
+		std::size_t get_param_num() const { return m_param_num; }
+		/// \brief	Number of slots of the frame, parameters included.
+		std::size_t get_local_num() const { return m_local_num; }
+		/// \brief	Only modified before the function is defined in an engine, see
+		///			ast::infer_types.
+		std::unique_ptr<ast::ASTNode> & get_body() { return m_body; }
+		const ast::ASTNode & get_body() const { return *m_body; }
+
+	private:
+		std::size_t m_param_num;
+		std::size_t m_local_num;
+		std::unique_ptr<ast::ASTNode> m_body;
+	};
+}
+
+namespace binds
+{
+	/// \brief	Makes script functions callable as any other global function, so they can
+	///			overload bound functions (they take any type, so typed overloads win).
+	///
+	///			The definition is taken from the engine (see DispatchEngine::get_script_function),
+	///			so that defining the function again does not modify the binding, which may be
+	///			shared with other engines (see runtime::EngineBindings).
+	class ScriptFunctionBinding final : public GlobalFunctionBinding
+	{
+	public:
+		ScriptFunctionBinding(std::size_t slot, std::size_t param_num);
+
+		BoxedValue do_call(runtime::DispatchEngine & en,
+						   std::vector<BoxedValue> & args) const override;
+		impl::FunctionCallMatchScore get_call_score(runtime::DispatchEngine & en,
+													std::vector<BoxedValue> & args,
+													impl::ConversionPlan & plan) const override;
+		std::size_t get_param_num() const override { return m_param_num; }
+		/// \brief	Script functions take anything.
+		std::size_t get_typed_param_num() const override { return 0; }
+
+	private:
+		std::size_t m_slot;
+		std::size_t m_param_num;
+	};
+}
@@ -5,70 +5,151 @@
 
 namespace runtime
 {
+	Scope::Scope(const VariableMap * base)
+		: m_base(base)
+	{}
+
 	BoxedValue * Scope::get_variable(const std::string & name)
 	{
 		const auto it = m_scope_vars.find(name);
-		return it != m_scope_vars.end() ? &it->second : nullptr;
+		if (it != m_scope_vars.end())
+			return &it->second;
+
+		if (m_base)
+		{
+			// the base is shared by other scopes, the variable is copied before anyone modifies it
+			const auto base_it = m_base->find(name);
+			if (base_it != m_base->end())
+				return &m_scope_vars.emplace(name, base_it->second).first->second;
+		}
+
+		return nullptr;
 	}
 	BoxedValue & Scope::create_variable(std::string name, BoxedValue && bv)
 	{
-		const auto result = m_scope_vars.emplace(std::move(name), std::move(bv));
-		if (result.second)
-			return result.first->second;
+		if (m_scope_vars.count(name) == 0 && (!m_base || m_base->count(name) == 0))
+			return m_scope_vars.emplace(std::move(name), std::move(bv)).first->second;
 
 		SCR_RUNTIME_EXCEPTION("Already exists a variable named '", name, "'");
 	}
-	std::size_t Scope::get_var_num() const
+	void Scope::copy_variables(VariableMap & vars) const
 	{
-		return m_scope_vars.size();
+		if (m_base)
+			vars = *m_base;
+
+		for (const auto & var : m_scope_vars)
+			vars[var.first] = var.second;
 	}
 
 	Stack::Stack()
-		: m_stack_scopes(1)	// initialize the first stack frame (global)
-	{}
-	BoxedValue * Stack::get_variable(const std::string & name)
 	{
-		for (auto stk_it = m_stack_scopes.rbegin();
-			 stk_it != m_stack_scopes.rend();
-			 ++stk_it)
-		{
-			if (auto bv = stk_it->get_variable(name))
-				return bv;
-		}
+		m_scope_starts.push_back(0);	// initialize the first stack frame (global)
+	}
+	Stack::~Stack() = default;
 
-		return nullptr;
+	Stack::Variable & Stack::get_slot(std::size_t index)
+	{
+		return m_chunks[index / s_chunk_size][index % s_chunk_size];
+	}
+	const Stack::Variable & Stack::get_slot(std::size_t index) const
+	{
+		return m_chunks[index / s_chunk_size][index % s_chunk_size];
+	}
+
+	std::size_t Stack::get_top_level_index(std::size_t innermost) const
+	{
+		// the top level scope is the first one, skip the variables that occlude it
+		const std::size_t top_level_end = m_scope_starts.size() > 1 ? m_scope_starts[1] : m_size;
+		std::size_t index = innermost;
+		while (index != s_no_variable && index >= top_level_end)
+			index = get_slot(index).m_occluded;
+
+		return index;
 	}
 
-	Scope & Stack::get_curr_stack_frame()
+	BoxedValue * Stack::get_variable(const std::string & name)
 	{
-		return m_stack_scopes.back();
+		const auto it = m_name_index.find(name);
+		if (it == m_name_index.end() || it->second == s_no_variable)
+			return nullptr;
+
+		return &get_slot(it->second).m_value;
 	}
-	const Scope & Stack::get_curr_stack_frame() const
+
+	BoxedValue * Stack::get_top_level_variable(const std::string & name)
 	{
-		return m_stack_scopes.back();
+		const auto it = m_name_index.find(name);
+		if (it == m_name_index.end())
+			return nullptr;
+
+		const std::size_t index = get_top_level_index(it->second);
+		return index != s_no_variable ? &get_slot(index).m_value : nullptr;
 	}
 
 	void Stack::clear_all()
 	{
-		m_stack_scopes.clear();
-		m_stack_scopes.emplace_back();
+		shrink(0);
+		m_scope_starts.resize(1);
 	}
 	void Stack::push_new_scope()
 	{
-		m_stack_scopes.emplace_back();
+		SCR_COUNT(m_scope_pushes);
+		m_scope_starts.push_back(m_size);
 	}
 	void Stack::pop_scope()
 	{
-		m_stack_scopes.pop_back();
+		shrink(m_scope_starts.back());
+		m_scope_starts.pop_back();
+	}
+
+	void Stack::shrink(std::size_t size)
+	{
+		if (m_size > size)
+			++m_generation;
+
+		// innermost first, so each name ends pointing to the outermost variable left
+		while (m_size > size)
+		{
+			Variable & var = get_slot(--m_size);
+			*var.m_innermost = var.m_occluded;
+			var.m_value = BoxedValue{};
+		}
 	}
 
 	BoxedValue & Stack::create_variable(const std::string & name, BoxedValue && bv)
 	{
-		return get_curr_stack_frame().create_variable(name, std::move(bv));
+		// copy the marker, emplace binding s_no_variable to a reference would odr-use it
+		const std::size_t no_variable = s_no_variable;
+		std::size_t & innermost = m_name_index.emplace(name, no_variable).first->second;
+		if (innermost != s_no_variable && innermost >= m_scope_starts.back())
+			SCR_RUNTIME_EXCEPTION("Already exists a variable named '", name, "'");
+
+		// the chunks are kept when the variables are popped, so this only happens until the
+		// stack is as deep as the deepest block of the script
+		if (m_size == m_chunks.size() * s_chunk_size)
+			m_chunks.push_back(std::make_unique<Variable[]>(s_chunk_size));
+
+		Variable & var = get_slot(m_size);
+		var.m_value = std::move(bv);
+		var.m_innermost = &innermost;
+		var.m_occluded = innermost;
+		innermost = m_size++;
+		++m_generation;
+		return var.m_value;
+	}
+
+	void Stack::copy_top_level_variables(VariableMap & vars) const
+	{
+		for (const auto & entry : m_name_index)
+		{
+			const std::size_t index = get_top_level_index(entry.second);
+			if (index != s_no_variable)
+				vars[entry.first] = get_slot(index).m_value;
+		}
 	}
 
 	std::size_t Stack::get_var_num() const
 	{
-		return get_curr_stack_frame().get_var_num();
+		return m_size - m_scope_starts.back();
 	}
 }
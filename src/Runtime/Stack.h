@@ -6,29 +6,55 @@
 #include <string>	// std::string
 #include <vector>	// std::vector
 #include <map>		// std::map
+#include <unordered_map>	// std::unordered_map
+#include <memory>	// std::unique_ptr
 
 namespace runtime
 {
+	using VariableMap = std::map<std::string, BoxedValue>;
+
+	/// \brief	Variables bound to the engine and, in engines forked from an image, the ones
+	///			of the image (see DispatchEngine::snapshot).
 	struct Scope
 	{
+		Scope() = default;
+		/// \brief	Starts with the variables of 'base', which are copied into the scope the
+		///			first time they are accessed, so creating it does not depend on their number.
+		///			'base' must outlive the scope.
+		explicit Scope(const VariableMap * base);
+
 		BoxedValue * get_variable(const std::string & name);
 		BoxedValue & create_variable(std::string name, BoxedValue && bv);
 
-		std::size_t get_var_num() const;
+		/// \brief	Copies all the variables into 'vars', the values are shared, not cloned.
+		void copy_variables(VariableMap & vars) const;
 
 	private:
-		std::map<std::string, BoxedValue>	m_scope_vars;
+		VariableMap m_scope_vars;
+		const VariableMap * m_base{ nullptr };
 	};
 
+	/// \brief	Variables of the blocks of the script, from the top level statements to the
+	///			innermost block being evaluated. All of them live in one contiguous array and
+	///			each scope only remembers where its variables start, so pushing or popping an
+	///			scope moves a mark instead of allocating.
+	///
+	///			The array grows in chunks that are never moved nor freed (the engine hands out
+	///			references to the variables) and lookups go through a name index that points
+	///			to the innermost variable with that name, each variable remembers the one it
+	///			occludes.
 	class Stack
 	{
 	public:
 		Stack();
+		~Stack();
 		Stack(const Stack &) = delete;
 		Stack& operator=(const Stack &) = delete;
 
 		BoxedValue * get_variable(const std::string & name);
 		BoxedValue & create_variable(const std::string & name, BoxedValue && bv = BoxedValue{});
+		/// \brief	Only searches in the first scope, the one of the script top level statements.
+		BoxedValue * get_top_level_variable(const std::string & name);
 
 		void clear_all();
 		void push_new_scope();
@@ -38,10 +64,40 @@ namespace runtime
 		///			current scope.
 		std::size_t get_var_num() const;
 
+		/// \brief	Copies the variables of the first scope into 'vars', replacing the ones
+		///			with the same name. The values are shared, not cloned.
+		void copy_top_level_variables(VariableMap & vars) const;
+
+		/// \brief	Changes each time a variable is created or destroyed, pointers to variables
+		///			obtained before may be dangling or point to an occluded variable.
+		std::size_t get_generation() const { return m_generation; }
+
 	private:
-		Scope & get_curr_stack_frame();
-		const Scope & get_curr_stack_frame() const;
+		static constexpr std::size_t s_chunk_size{ 64 };
+		static constexpr std::size_t s_no_variable{ static_cast<std::size_t>(-1) };
+
+		struct Variable
+		{
+			BoxedValue m_value;
+			std::size_t * m_innermost{ nullptr };	///< entry of the name index of its name
+			std::size_t m_occluded{ s_no_variable };	///< variable with the same name of an outer scope
+		};
+
+		Variable & get_slot(std::size_t index);
+		const Variable & get_slot(std::size_t index) const;
+		/// \brief	Variable of the first scope occluded by 'innermost' (or itself), s_no_variable
+		///			if there is none.
+		std::size_t get_top_level_index(std::size_t innermost) const;
+		/// \brief	Destroys the variables after 'size' and gives their names back to the
+		///			variables they occluded.
+		void shrink(std::size_t size);
 
-		std::vector<Scope> m_stack_scopes;
+		std::vector<std::unique_ptr<Variable[]>> m_chunks;
+		std::size_t m_size{ 0 };					///< variables alive
+		std::size_t m_generation{ 0 };
+		std::vector<std::size_t> m_scope_starts;	///< first variable of each scope
+		/// entries are kept when their variables are popped, a name is only allocated the
+		/// first time it's seen
+		std::unordered_map<std::string, std::size_t> m_name_index;
 	};
 }
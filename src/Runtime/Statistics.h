@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>	// std::size_t
+
+namespace runtime
+{
+	/// \brief	Counters of the operations that usually dominate the cost of running an script,
+	///			used to find out if an script is bound by allocations or by dispatching.
+	struct Statistics
+	{
+		std::size_t m_boxed_allocations{ 0 };	///< values allocated by BoxedValue (clones and references included)
+		std::size_t m_boxed_clones{ 0 };		///< BoxedValue deep copies, done when a shared value is modified
+		std::size_t m_boxed_shares{ 0 };		///< BoxedValue copies that share the value instead of cloning it
+		std::size_t m_scratch_allocations{ 0 };	///< temporary values created in the scratch arena instead of the heap
+		std::size_t m_references{ 0 };			///< references created with make_ref
+		std::size_t m_operator_lookups{ 0 };	///< searches in the binary operator tables
+		std::size_t m_conversion_lookups{ 0 };	///< searches for a type conversion
+		std::size_t m_overload_resolutions{ 0 };///< calls to overloaded functions that had to pick an overload
+		std::size_t m_scope_pushes{ 0 };		///< scopes pushed into the stack
+	};
+
+	/// \brief	The counters are kept per thread, BoxedValue knows nothing about the engine
+	///			that is using it, so all the engines running in the same thread share them.
+	inline Statistics & get_thread_statistics()
+	{
+		static thread_local Statistics s_statistics;
+		return s_statistics;
+	}
+}
+
+/// \brief	Increments a counter of runtime::Statistics. The counters are only updated with
+///			SCRIPTING_STATISTICS defined (see the option in CMakeLists.txt), otherwise they stay
+///			at zero and counting costs nothing.
+#ifdef SCRIPTING_STATISTICS
+#	define SCR_COUNT(counter)	(++::runtime::get_thread_statistics().counter)
+#else
+#	define SCR_COUNT(counter)	((void)0)
+#endif
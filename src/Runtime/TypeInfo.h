@@ -12,8 +12,10 @@ public:
 private:
 	TypeInfo(id_type id,
 		const std::type_info & type_info,
-		const std::type_info & bare_type_info)
+		const std::type_info & bare_type_info,
+		bool arithmetic)
 		: m_unique_id{ id }
+		, m_arithmetic{ arithmetic }
 		, m_type_info{ &type_info }
 		, m_bare_type_info{ &bare_type_info }
 	{}
@@ -34,11 +36,15 @@ public:
 	bool empty() const { return m_unique_id == invalid_id; }
 
 	id_type get_unique_id() const { return m_unique_id; }
+	/// \brief	Numbers and booleans (or pointers to them), the operators between them are
+	///			the builtin ones, which do nothing but computing the result.
+	bool is_arithmetic() const { return m_arithmetic; }
 	const std::type_info & get_std_type_info() const { return *m_type_info; }
 	const std::type_info & get_bare_std_type_info() const { return *m_bare_type_info; }
 	
 private:
 	id_type m_unique_id{ invalid_id };
+	bool m_arithmetic{ false };
 	const std::type_info * m_type_info{ nullptr };
 	const std::type_info * m_bare_type_info{ nullptr };
 };
@@ -62,6 +68,7 @@ inline bool operator!=(const TypeInfo & lhs, const std::type_info & rhs)
 }
 
 #include <memory>
+#include <type_traits>	// std::is_arithmetic
 
 namespace impl
 {
@@ -97,7 +104,8 @@ template <typename T>
 const TypeInfo & get_type_info()
 {
 	using bare_type = ::impl::bare_type_t<T>;
-	static const TypeInfo s_type_info{ ::impl::unique_id_for<bare_type>(), typeid(T), typeid(bare_type) };
+	static const TypeInfo s_type_info{ ::impl::unique_id_for<bare_type>(), typeid(T), typeid(bare_type),
+									   std::is_arithmetic<bare_type>::value };
 	return s_type_info;
 }
 
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "DispatchEngine.h"	// runtime::DispatchEngine
+#include "RuntimeException.h"
+
+#include <string>	// std::string
+
+namespace runtime
+{
+	/// \brief	Variable of an engine looked up by name once, for the host code that reads or
+	///			writes the same variables over and over (i.e. each frame). The name is only
+	///			looked up again when variables have been created or destroyed in the stack
+	///			since the last time (see Stack::get_generation), otherwise accessing the
+	///			variable costs a comparison.
+	///
+	///			The conversion used by get_value is looked up once per type the variable
+	///			stores, not in each call.
+	template <typename T>
+	class VariableHandle
+	{
+	public:
+		VariableHandle(DispatchEngine & en, std::string name)
+			: m_engine(&en)
+			, m_name(std::move(name))
+		{}
+
+		/// \brief	Returns nullptr if the engine has no variable with that name.
+		BoxedValue * get_boxed()
+		{
+			const std::size_t generation = m_engine->get_stack_generation();
+			if (!m_variable || m_generation != generation)
+			{
+				m_variable = m_engine->get_variable(m_name);
+				m_generation = generation;
+			}
+			return m_variable;
+		}
+		bool exists() { return get_boxed() != nullptr; }
+
+		/// \brief	Throws BadBoxedCast if the variable does not store a T, the value is
+		///			cloned before if it is shared (use read when it is not going to be modified).
+		T & get() { return boxed_cast<T>(get_existing()); }
+		const T & read()
+		{
+			const BoxedValue & var = get_existing();
+			return boxed_cast<T>(var);
+		}
+
+		/// \brief	Copy of the value, converted to T if the variable stores another type.
+		T get_value()
+		{
+			const BoxedValue & var = get_existing();
+			if (var.is_storing<T>())
+				return boxed_cast<T>(var);
+
+			// only found conversions are kept, one may be added after failing to find it
+			if (&var.get_type_info() != m_conversion_from)
+			{
+				m_conversion = m_engine->get_type_conversion(var.get_type_info(), get_type_info<T>());
+				m_conversion_from = m_conversion ? &var.get_type_info() : nullptr;
+			}
+
+			// without conversion the cast throws BadBoxedCast
+			return m_conversion ? m_conversion->template convert<T>(var) : boxed_cast<T>(var);
+		}
+
+		/// \brief	Variables storing another type are replaced by 'value'.
+		void set(T value)
+		{
+			BoxedValue & var = get_existing();
+			if (var.is_storing<T>())	boxed_cast<T>(var) = std::move(value);
+			else						var = BoxedValue{ std::move(value) };
+		}
+
+	private:
+		BoxedValue & get_existing()
+		{
+			if (BoxedValue * p_var = get_boxed())
+				return *p_var;
+
+			SCR_RUNTIME_EXCEPTION("Requesting nonexistent variable with name '", m_name, "'");
+		}
+
+		DispatchEngine * m_engine;
+		std::string m_name;
+
+		BoxedValue * m_variable{ nullptr };
+		std::size_t m_generation{ 0 };
+
+		const TypeInfo * m_conversion_from{ nullptr };	///< type the conversion was looked up for
+		const binds::ITypeConversion * m_conversion{ nullptr };
+	};
+}
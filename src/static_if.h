@@ -24,12 +24,12 @@ namespace meta
 			explicit static_if_result(F && f) : mFn(std::forward<F>(f)) {}
 
 			// we already have the function we need to call, ignore all calls to this ones
-			template <typename F>
-			auto else_(F &&) const { return *this; }
+			template <typename G>
+			auto else_(G &&) const { return *this; }
 			template <typename Pred>
 			auto else_if(Pred&&) const { return *this; }
-			template <typename F>
-			const static_if_result & then(F &&) const { return *this; }
+			template <typename G>
+			const static_if_result & then(G &&) const { return *this; }
 
 			// call to the function we need to call
 			template <typename ... Args>
@@ -1,13 +1,13 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Runtime\AST.h"	// namespace ast
+#include "Runtime/AST.h"	// namespace ast
 using namespace ast;
 
-#include "Parse\OperatorParsing.h"	// parser::get_operator_type
+#include "Parse/OperatorParsing.h"	// parser::get_operator_type
 
-#include "Runtime\DispatchEngine.h"	// runtime::DispatchEngine
+#include "Runtime/DispatchEngine.h"	// runtime::DispatchEngine
 
 class ASTTest : public Test
 {
@@ -1,8 +1,8 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Parse\Alphabet.h"
+#include "Parse/Alphabet.h"
 
 TEST(AlphabetTest, alphabet_does_not_contain_anything_by_default)
 {
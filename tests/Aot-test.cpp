@@ -0,0 +1,276 @@
+
+#include "gmock/gmock.h"
+using namespace testing;
+
+#include "Parse/Parser.h"			// parser::Parser
+#include "Runtime/Aot.h"			// runtime::aot::transpile
+#include "Runtime/DispatchEngine.h"	// runtime::DispatchEngine
+
+#include <cstdio>	// std::remove
+#include <string>	// std::string
+
+class AotTest : public Test
+{
+public:
+	parse::Parser p;
+	runtime::DispatchEngine eng;
+
+	bool transpile(const char * str)
+	{
+		p.parse(str);
+		std::string source;
+		return runtime::aot::transpile(*p.get_root(), eng, source);
+	}
+
+	/// \brief	The tests building libraries are skipped without a compiler.
+	static bool has_compiler()
+	{
+		static const bool s_found = []()
+		{
+			const bool found = runtime::aot::compile("", "aot_test_probe.so");
+			std::remove("aot_test_probe.so");
+			std::remove("aot_test_probe.so.cpp");
+			return found;
+		}();
+		return s_found;
+	}
+};
+
+namespace
+{
+	int twice(int x) { return x * 2; }
+	std::string name_of(int) { return "name"; }
+}
+
+TEST_F(AotTest, scripts_using_what_the_compiled_code_cannot_keep_are_not_transpiled)
+{
+	ASSERT_TRUE(transpile("var a = 1 + 2"));
+
+	ASSERT_FALSE(transpile("var a = \"text\""));
+	ASSERT_FALSE(transpile("var v = [1, 2]"));
+	ASSERT_FALSE(transpile("var a = 3 \n var s = a.to_string()"));
+	ASSERT_FALSE(transpile("var a = b"));
+	ASSERT_FALSE(transpile("def f(n) { if (n > 0) { return 1 } } \n var a = f(2)"));
+	ASSERT_FALSE(transpile("def f(n) { return f(n - 1) }"));
+	ASSERT_FALSE(transpile("var x = 1 \n def f() { return x } \n var x = 2"));
+}
+TEST_F(AotTest, only_the_bound_functions_taking_and_returning_native_values_are_transpiled)
+{
+	eng.add("twice", binds::func(twice));
+	eng.add("name_of", binds::func(name_of));
+	eng.add("scale", binds::func<float(float, int)>([](float x, int n) { return x * n; }));
+
+	ASSERT_TRUE(transpile("var a = twice(2)"));
+	ASSERT_TRUE(transpile("var a = scale(1.5, 2)"));
+	ASSERT_FALSE(transpile("var a = name_of(2)"));
+	ASSERT_FALSE(transpile("var a = twice(2, 3)"));
+	ASSERT_FALSE(transpile("def twice(n) { return n } \n var a = twice(2)"));
+
+	eng.add("twice", binds::func<float(float)>([](float x) { return x * 2.f; }));
+	ASSERT_FALSE(transpile("var a = twice(2)"));
+}
+TEST_F(AotTest, only_the_operators_the_engine_binds_are_declared)
+{
+	p.parse("var a = 1");
+	std::string source;
+	ASSERT_TRUE(runtime::aot::transpile(*p.get_root(), eng, source));
+
+	ASSERT_THAT(source, HasSubstr("inline float op_add(int l, float r) { return l + r; }"));
+	ASSERT_THAT(source, Not(HasSubstr("op_add(bool l, int r)")));
+	ASSERT_THAT(source, HasSubstr("export_variable(*sink, \"a\", v_a);"));
+}
+
+#ifndef _WIN32
+TEST_F(AotTest, compiled_scripts_create_the_same_variables_as_the_evaluated_ones)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	const char * script = R"script(
+	def collatz(n)
+	{
+		var steps = 0
+		while (n != 1) {
+			if (n % 2 == 0) { n = n / 2 } else { n = n * 3 + 1 }
+			++steps
+		}
+		return steps
+	}
+	var total = 0
+	var longest = 0
+	for (var i = 1; i < 200; ++i)
+	{
+		var steps = collatz(i)
+		total += steps
+		if (steps > longest) { longest = steps }
+	}
+	var ratio = 0.5
+	ratio *= 3.0
+	var done = total > 1000
+)script";
+
+	p.parse(script);
+	auto root = p.get_root();
+	auto native = runtime::aot::make_native_script(*root, eng, "aot_test_script.so");
+	ASSERT_NE(native, nullptr);
+
+	runtime::DispatchEngine interpreted;
+	interpreted.evaluate(*root);
+	eng.evaluate(*native);
+
+	ASSERT_EQ(eng.get_variable_as<int>("total"), interpreted.get_variable_as<int>("total"));
+	ASSERT_EQ(eng.get_variable_as<int>("longest"), interpreted.get_variable_as<int>("longest"));
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 200);
+	ASSERT_FLOAT_EQ(eng.get_variable_as<float>("ratio"), 1.5f);
+	ASSERT_TRUE(eng.get_variable_as<bool>("done"));
+	ASSERT_EQ(eng.get_variable("steps"), nullptr);
+
+	native.reset();
+	std::remove("aot_test_script.so");
+	std::remove("aot_test_script.so.cpp");
+}
+TEST_F(AotTest, scripts_with_operations_the_engine_does_not_bind_do_not_compile)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	p.parse("var a = true + 1");
+	auto native = runtime::aot::make_native_script(*p.get_root(), eng, "aot_test_invalid.so");
+
+	ASSERT_EQ(native, nullptr);
+	std::remove("aot_test_invalid.so");
+	std::remove("aot_test_invalid.so.cpp");
+}
+TEST_F(AotTest, compiled_scripts_call_the_bound_functions_they_were_compiled_for)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	int calls = 0;
+	eng.add("twice", binds::func(twice));
+	eng.add("scale", binds::func<float(float, int)>([&calls](float x, int n) { ++calls; return x * n; }));
+	p.parse("var a = twice(21) \n var b = scale(1.5, 2) \n for (var i = 0; i < 4; ++i) { b = scale(b, twice(1)) }");
+	auto native = runtime::aot::make_native_script(*p.get_root(), eng, "aot_test_calls.so");
+	ASSERT_NE(native, nullptr);
+
+	eng.evaluate(*native);
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 42);
+	ASSERT_FLOAT_EQ(eng.get_variable_as<float>("b"), 48.f);
+	ASSERT_EQ(calls, 5);
+
+	// the engine evaluating the script has to bind the same functions
+	runtime::DispatchEngine other;
+	other.add("twice", binds::func(twice));
+	other.add("scale", binds::func<float(int, int)>([](int x, int n) { return static_cast<float>(x * n); }));
+	ASSERT_THROW(other.evaluate(*native), std::exception);
+	ASSERT_EQ(other.get_variable("a"), nullptr);
+
+	native.reset();
+	std::remove("aot_test_calls.so");
+	std::remove("aot_test_calls.so.cpp");
+}
+TEST_F(AotTest, scripts_calling_bound_functions_with_arguments_the_engine_does_not_convert_do_not_compile)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	eng.add("twice", binds::func(twice));
+	p.parse("var a = twice(1.5)");
+	auto native = runtime::aot::make_native_script(*p.get_root(), eng, "aot_test_unconverted.so");
+
+	ASSERT_EQ(native, nullptr);
+	std::remove("aot_test_unconverted.so");
+	std::remove("aot_test_unconverted.so.cpp");
+}
+TEST_F(AotTest, compiled_scripts_evaluate_the_operands_in_the_order_the_interpreter_does)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	p.parse(R"script(
+	var i = 1
+	var post = i++ + i
+	var j = 1
+	var assigned = (j = 5) * j
+	var k = 1
+	var pre = k + ++k
+	var l = 2
+	var compound = (l += 3) - l++
+	var m = 1
+	var read = m - m++
+	var n = 1
+	var incremented = ++n - n++
+)script");
+	auto root = p.get_root();
+	auto native = runtime::aot::make_native_script(*root, eng, "aot_test_order.so");
+	ASSERT_NE(native, nullptr);
+
+	runtime::DispatchEngine interpreted;
+	interpreted.evaluate(*root);
+	eng.evaluate(*native);
+
+	for (const char * name : { "post", "i", "assigned", "j", "pre", "k", "compound", "l", "read", "m",
+							   "incremented", "n" })
+		ASSERT_EQ(eng.get_variable_as<int>(name), interpreted.get_variable_as<int>(name)) << name;
+
+	native.reset();
+	std::remove("aot_test_order.so");
+	std::remove("aot_test_order.so.cpp");
+}
+TEST_F(AotTest, compiled_scripts_compare_ints_and_sizes_as_the_interpreter_does)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	runtime::DispatchEngine interpreted;
+	for (runtime::DispatchEngine * en : { &eng, &interpreted })
+		en->add("count", binds::func<std::size_t()>([]() { return std::size_t{ 3 }; }));
+
+	p.parse(R"script(
+	var less = -1 < count()
+	var greater = 5 > count()
+	var less_eq = -1 <= count()
+	var greater_eq = -1 >= count()
+	var eq = -3 == count()
+	var not_eq = -3 != count()
+	var size_less = count() < -1
+	var size_greater = count() > 5
+	var size_less_eq = count() <= 3
+	var size_eq = count() == 3
+	var size_not_eq = count() != -1
+)script");
+	auto root = p.get_root();
+	auto native = runtime::aot::make_native_script(*root, eng, "aot_test_sizes.so");
+	ASSERT_NE(native, nullptr);
+
+	interpreted.evaluate(*root);
+	eng.evaluate(*native);
+
+	for (const char * name : { "less", "greater", "less_eq", "greater_eq", "eq", "not_eq", "size_less",
+							   "size_greater", "size_less_eq", "size_eq", "size_not_eq" })
+	{
+		ASSERT_EQ(eng.get_variable_as<bool>(name), interpreted.get_variable_as<bool>(name)) << name;
+	}
+
+	native.reset();
+	std::remove("aot_test_sizes.so");
+	std::remove("aot_test_sizes.so.cpp");
+}
+TEST_F(AotTest, libraries_are_built_at_paths_the_shell_would_split_or_expand)
+{
+	if (!has_compiler())
+		GTEST_SKIP() << "No compiler to build the script with";
+
+	const std::string path = "aot test $(echo x) \"quoted\".so";
+	p.parse("var a = 3");
+	auto native = runtime::aot::make_native_script(*p.get_root(), eng, path);
+	ASSERT_NE(native, nullptr);
+
+	eng.evaluate(*native);
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 3);
+
+	native.reset();
+	std::remove(path.c_str());
+	std::remove((path + ".cpp").c_str());
+}
+#endif
@@ -1,9 +1,9 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Runtime\Bindings.h"
-#include "Runtime\DispatchEngine.h"
+#include "Runtime/Bindings.h"
+#include "Runtime/DispatchEngine.h"
 
 class GlobalFunctionBindingTest : public Test
 {
@@ -86,6 +86,22 @@ TEST_F(GlobalFunctionBindingTest, provides_interface_to_bind_functions)
 	const BoxedValue bv = binded_fn->do_call(engine, args);
 	ASSERT_EQ(boxed_cast<int>(bv), std::pow(4, 3));
 }
+TEST_F(GlobalFunctionBindingTest, keeps_the_callable_instead_of_a_std_function)
+{
+	const auto pointer_fn = binds::func(pow_fn);
+	static_assert(std::is_same<std::decay_t<decltype(*pointer_fn)>, binds::GlobalFnPtrBinding<int, int, int>>::value,
+				  "function pointers are called directly");
+
+	int calls = 0;
+	const auto lambda_fn = binds::func<int(int)>([&calls](int x) { ++calls; return x * 2; });
+	using lambda_fn_type = std::decay_t<decltype(*lambda_fn)>::fn_type;
+	static_assert(!std::is_same<lambda_fn_type, std::function<int(int)>>::value, "lambdas are called directly");
+
+	std::vector<BoxedValue> args{ BoxedValue{ 21 } };
+	const BoxedValue bv = lambda_fn->do_call(engine, args);
+	ASSERT_EQ(boxed_cast<int>(bv), 42);
+	ASSERT_EQ(calls, 1);
+}
 TEST_F(GlobalFunctionBindingTest, can_bind_functions_that_return_void)
 {
 	// we just want this to compile
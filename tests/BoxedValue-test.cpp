@@ -1,8 +1,8 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Runtime\BoxedValue.h"
+#include "Runtime/BoxedValue.h"
 
 #include <string>	// std::string
 
@@ -109,3 +109,86 @@ TEST_F(BoxedValueTest, boxed_value_calls_correctly_to_the_objects_dtor)
 
 	ASSERT_EQ(dtor_calls, 4);
 }
+TEST_F(BoxedValueTest, copies_share_the_value_until_one_of_them_is_modified)
+{
+	BoxedValue bv0{ std::vector<int>(10000, 1) };
+	BoxedValue bv1 = bv0;
+
+	ASSERT_TRUE(bv0.is_shared());
+	ASSERT_EQ(&boxed_cast<std::vector<int>>(static_cast<const BoxedValue &>(bv0)),
+			  &boxed_cast<std::vector<int>>(static_cast<const BoxedValue &>(bv1)));
+
+	boxed_cast<std::vector<int>>(bv1)[0] = 2;
+
+	ASSERT_FALSE(bv0.is_shared());
+	ASSERT_FALSE(bv1.is_shared());
+	ASSERT_EQ(boxed_cast<std::vector<int>>(bv0)[0], 1);
+	ASSERT_EQ(boxed_cast<std::vector<int>>(bv1)[0], 2);
+}
+TEST_F(BoxedValueTest, copies_do_not_clone_the_value)
+{
+	const BoxedValue bv0{ std::string(1000, 'a') };
+	runtime::get_thread_statistics() = runtime::Statistics{};
+
+	std::vector<BoxedValue> copies(100, bv0);
+
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(runtime::get_thread_statistics().m_boxed_clones, 0u);
+	ASSERT_EQ(runtime::get_thread_statistics().m_boxed_allocations, 0u);
+	ASSERT_EQ(runtime::get_thread_statistics().m_boxed_shares, 100u);
+#endif
+}
+TEST_F(BoxedValueTest, values_stored_by_reference_are_not_unshared)
+{
+	int i = 3;
+	BoxedValue bv0{ BoxedValueStoreRef_t{}, i };
+	BoxedValue bv1 = bv0;
+
+	boxed_cast<int>(bv1) = 4;
+
+	ASSERT_TRUE(bv0.is_shared());
+	ASSERT_EQ(boxed_cast<int>(bv0), 4);
+	ASSERT_EQ(i, 4);
+}
+TEST_F(BoxedValueTest, borrowed_values_read_the_value_of_the_owner)
+{
+	const BoxedValue owner{ std::string{ "literal" } };
+	runtime::get_thread_statistics() = runtime::Statistics{};
+
+	const BoxedValue borrowed = BoxedValue::borrow(owner);
+
+	ASSERT_TRUE(borrowed.is_borrowed());
+	ASSERT_EQ(&boxed_cast<std::string>(borrowed), &boxed_cast<std::string>(owner));
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(runtime::get_thread_statistics().m_boxed_shares, 0u);
+	ASSERT_EQ(runtime::get_thread_statistics().m_boxed_allocations, 0u);
+#endif
+}
+TEST_F(BoxedValueTest, borrowed_values_take_ownership_when_copied_or_moved)
+{
+	BoxedValue copy;
+	BoxedValue moved;
+	{
+		const BoxedValue owner{ std::string{ "literal" } };
+		BoxedValue borrowed = BoxedValue::borrow(owner);
+
+		copy = borrowed;
+		moved = std::move(borrowed);
+	}
+
+	ASSERT_FALSE(copy.is_borrowed());
+	ASSERT_FALSE(moved.is_borrowed());
+	ASSERT_EQ(boxed_cast<std::string>(copy), "literal");
+	ASSERT_EQ(boxed_cast<std::string>(moved), "literal");
+}
+TEST_F(BoxedValueTest, modifying_a_borrowed_value_does_not_modify_the_owner)
+{
+	const BoxedValue owner{ 3 };
+	BoxedValue borrowed = BoxedValue::borrow(owner);
+
+	boxed_cast<int>(borrowed) = 4;
+
+	ASSERT_FALSE(borrowed.is_borrowed());
+	ASSERT_EQ(boxed_cast<int>(borrowed), 4);
+	ASSERT_EQ(boxed_cast<int>(owner), 3);
+}
@@ -0,0 +1,77 @@
+
+#include "gmock/gmock.h"
+using namespace testing;
+
+#include "Parse/Parser.h"			// parser::Parser
+#include "Runtime/DispatchEngine.h"	// runtime::DispatchEngine
+#include "Runtime/FlatTree.h"		// ast::FlatTree
+
+class FlatTreeTest : public Test
+{
+public:
+	parse::Parser p;
+	runtime::DispatchEngine eng;
+	runtime::DispatchEngine interpreted;
+};
+
+TEST_F(FlatTreeTest, flat_trees_create_the_same_variables_as_the_trees)
+{
+	p.parse(R"script(
+	def collatz(n)
+	{
+		var steps = 0
+		while (n != 1) {
+			if (n % 2 == 0) { n = n / 2 } else { n = n * 3 + 1 }
+			++steps
+		}
+		return steps
+	}
+	var total = 0
+	var odd = 0
+	var i = 1
+	while (i < 100) {
+		var steps = collatz(i)
+		total += steps
+		++i
+		if (steps % 2 == 0) { continue }
+		odd += 1
+	}
+	var last = 0
+	for (var j = 10; ; j -= 3) {
+		if (j < 0) { break }
+		last = j
+	}
+	var ratio = 0.5
+	ratio *= 3.0
+	var name = "flat"
+	var negated = -total
+)script");
+	auto root = p.get_root();
+	ast::FlatTree flat{ *root };
+
+	interpreted.evaluate(*root);
+	eng.evaluate(flat);
+
+	ASSERT_EQ(eng.get_variable_as<int>("total"), interpreted.get_variable_as<int>("total"));
+	ASSERT_EQ(eng.get_variable_as<int>("odd"), interpreted.get_variable_as<int>("odd"));
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 100);
+	ASSERT_EQ(eng.get_variable_as<int>("last"), 1);
+	ASSERT_FLOAT_EQ(eng.get_variable_as<float>("ratio"), 1.5f);
+	ASSERT_EQ(eng.get_variable_as<std::string>("name"), "flat");
+	ASSERT_EQ(eng.get_variable_as<int>("negated"), -interpreted.get_variable_as<int>("total"));
+	ASSERT_EQ(eng.get_variable("steps"), nullptr);
+
+	// the definition of the function, the call to it, the break and the continue
+	ASSERT_EQ(flat.get_tree_node_num(), 4u);
+	ASSERT_GT(flat.get_node_num(), 40u);
+}
+TEST_F(FlatTreeTest, errors_stop_flat_trees_as_they_stop_trees)
+{
+	p.parse("var a = 1 \n while (a < 10) { a += 1 \n var b = c } \n var d = 2");
+	auto root = p.get_root();
+	ast::FlatTree flat{ *root };
+
+	ASSERT_THROW(eng.evaluate(flat), std::exception);
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 2);
+	ASSERT_EQ(eng.get_variable("d"), nullptr);
+}
@@ -1,10 +1,10 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Parse\Parser.h"			// parser::Parser
-#include "Runtime\DispatchEngine.h"	// runtime::DispatchEngine
-#include "Runtime\RuntimeException.h"
+#include "Parse/Parser.h"			// parser::Parser
+#include "Runtime/DispatchEngine.h"	// runtime::DispatchEngine
+#include "Runtime/RuntimeException.h"
 
 class ParserEvaluationTest : public Test
 {
@@ -411,6 +411,40 @@ TEST_F(ScopeParseEvalTest, scope_implements_correclty_the_stack)
 	evaluate_parsed_data();
 	ASSERT_EQ(eng.get_variable_as<int>("a"), 4);
 }
+TEST_F(ScopeParseEvalTest, blocks_that_declare_nothing_do_not_push_scopes)
+{
+	eng.reset_statistics();
+	parse_and_evaluate(R"script(
+				var a = 0
+				for (var i = 0; i < 10; ++i)
+				{
+					a += i
+					if (a > 5) { a -= 1 }
+				}
+			)script");
+
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_scope_pushes, 0u);
+#endif
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 38);
+}
+TEST_F(ScopeParseEvalTest, blocks_that_declare_push_an_scope_each_time)
+{
+	eng.reset_statistics();
+	parse_and_evaluate(R"script(
+				var a = 0
+				for (var i = 0; i < 10; ++i)
+				{
+					var b = i
+					a += b
+				}
+			)script");
+
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_scope_pushes, 10u);
+#endif
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 45);
+}
 
 
 class IfStatementParseEvalTest : public ParserEvaluationTest {};
@@ -1047,4 +1081,1186 @@ TEST_F(EvaluationTest, stress_test)
 
 	const int c = eng.get_variable_value<int>("c");
 	ASSERT_EQ(eng.get_variable_value<int>("count"), c * c);
-}
\ No newline at end of file
+}
+class StatisticsParseEvalTest : public ParserEvaluationTest {};
+#ifdef SCRIPTING_STATISTICS
+TEST_F(StatisticsParseEvalTest, reset_sets_all_the_counters_to_zero)
+{
+	parse_and_evaluate("var a = 3 * 4 + 3");
+	eng.reset_statistics();
+
+	const runtime::Statistics stats = eng.get_statistics();
+	ASSERT_EQ(stats.m_boxed_allocations, 0u);
+	ASSERT_EQ(stats.m_boxed_clones, 0u);
+	ASSERT_EQ(stats.m_boxed_shares, 0u);
+	ASSERT_EQ(stats.m_scratch_allocations, 0u);
+	ASSERT_EQ(stats.m_references, 0u);
+	ASSERT_EQ(stats.m_operator_lookups, 0u);
+	ASSERT_EQ(stats.m_conversion_lookups, 0u);
+	ASSERT_EQ(stats.m_overload_resolutions, 0u);
+	ASSERT_EQ(stats.m_scope_pushes, 0u);
+}
+TEST_F(StatisticsParseEvalTest, counts_the_operations_of_the_evaluated_script)
+{
+	p.parse(R"script(
+	var count = 0
+	for (var a = 0; a < 10; ++a)
+	{
+		count += 1
+	}
+)script");
+	auto root = p.get_root();
+
+	eng.reset_statistics();
+	eng.evaluate(*root);
+	const runtime::Statistics stats = eng.get_statistics();
+
+	// the body of the loop declares nothing, it does not need an scope
+	ASSERT_EQ(stats.m_scope_pushes, 0u);
+#ifdef SCRIPTING_JIT
+	// the loop is compiled, nothing is looked up
+	ASSERT_EQ(stats.m_operator_lookups, 0u);
+#else
+	// (count += 1) 10 times, the counter of the loop is compared natively and 2 assignments
+	// to empty variables don't need lookup
+	ASSERT_EQ(stats.m_operator_lookups, 10u);
+#endif
+	ASSERT_GT(stats.m_references, 0u);
+	ASSERT_GE(stats.m_boxed_allocations + stats.m_scratch_allocations, stats.m_references);
+	ASSERT_EQ(stats.m_overload_resolutions, 0u);
+}
+#endif
+TEST_F(StatisticsParseEvalTest, copies_of_variables_share_the_value_until_modified)
+{
+	eng.reset_statistics();
+	parse_and_evaluate(R"script(
+	var v = [1, 2, 3, 4, 5, 6, 7, 8]
+	var w = v
+	var x = v
+)script");
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_boxed_clones, 0u);
+#endif
+
+	parse_and_evaluate(R"script(
+	var v = [1, 2, 3, 4, 5, 6, 7, 8]
+	var w = v
+	w.push_back(9)
+	var size_v = v.size()
+	var size_w = w.size()
+)script");
+	ASSERT_EQ(eng.get_variable_value<std::size_t>("size_v"), 8u);
+	ASSERT_EQ(eng.get_variable_value<std::size_t>("size_w"), 9u);
+}
+TEST_F(StatisticsParseEvalTest, literals_are_borrowed_from_the_script)
+{
+	eng.reset_statistics();
+	parse_and_evaluate(R"script(
+	var s = "abc"
+	var n = 0
+	for (var i = 0; i < 10; i += 1) { if (s == "abc") { n += 1 } }
+)script");
+
+#ifdef SCRIPTING_STATISTICS
+	// only the three variables initialized with literals own them
+	ASSERT_EQ(eng.get_statistics().m_boxed_shares, 3u);
+#endif
+	ASSERT_EQ(eng.get_variable_value<int>("n"), 10);
+}
+TEST_F(StatisticsParseEvalTest, temporaries_of_loops_do_not_allocate_in_the_heap)
+{
+	const auto heap_allocations = [this](int iterations)
+	{
+		eng.reset_statistics();
+		parse_and_evaluate((R"script(
+	var n = 0
+	var v = [1, 2, 3]
+	for (var i = 0; i < )script" + std::to_string(iterations) + R"script(; i += 1)
+	{
+		if (v[1] == 2 && i * 2 >= 0) { n += v.size() }
+	}
+)script").c_str());
+		return eng.get_statistics().m_boxed_allocations;
+	};
+
+#ifdef SCRIPTING_STATISTICS
+	const std::size_t allocations_10 = heap_allocations(10);
+	ASSERT_EQ(heap_allocations(100), allocations_10);
+	ASSERT_GT(eng.get_statistics().m_scratch_allocations, 0u);
+#else
+	heap_allocations(100);
+#endif
+	ASSERT_EQ(eng.get_variable_value<int>("n"), 300);
+}
+TEST_F(StatisticsParseEvalTest, temporaries_stored_in_variables_outlive_the_statement)
+{
+	parse_and_evaluate(R"script(
+	var v = [0]
+	var last = 0
+	for (var i = 1; i < 100; ++i)
+	{
+		v.push_back(i * 2)
+		last = i * 3
+	}
+	var fifth = v[5]
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("fifth"), 10);
+	ASSERT_EQ(eng.get_variable_value<int>("last"), 297);
+}
+std::vector<BoxedValue> stats_host_built(int n)
+{
+	std::vector<BoxedValue> values;
+	for (int i = 0; i < n; ++i)
+		values.emplace_back(i * 10);
+	return values;
+}
+TEST_F(StatisticsParseEvalTest, values_built_by_bound_functions_outlive_the_statement)
+{
+	eng.add("host_built", binds::func(stats_host_built));
+
+	parse_and_evaluate(R"script(
+	var v = host_built(4)
+	var last = 0
+	for (var i = 0; i < 100; ++i)
+	{
+		last = i * 3 + 1
+	}
+	var second = v[1]
+	var fourth = v[3]
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("second"), 10);
+	ASSERT_EQ(eng.get_variable_value<int>("fourth"), 30);
+}
+TEST_F(StatisticsParseEvalTest, the_result_of_the_script_outlives_it)
+{
+	BoxedValue result;
+	{
+		parse::Parser parser;
+		parser.parse(R"script("abc")script");
+		result = eng.evaluate(*parser.get_root());
+	}
+
+	ASSERT_FALSE(result.is_borrowed());
+	ASSERT_EQ(boxed_cast<std::string>(result), "abc");
+}
+#ifdef SCRIPTING_STATISTICS
+int stats_overloaded(int a) { return a; }
+int stats_overloaded(int a, int b) { return a + b; }
+TEST_F(StatisticsParseEvalTest, counts_overload_resolutions)
+{
+	eng.add("overloaded", binds::func(static_cast<int(*)(int)>(stats_overloaded)));
+	eng.add("overloaded", binds::func(static_cast<int(*)(int, int)>(stats_overloaded)));
+
+	eng.reset_statistics();
+	parse_and_evaluate(R"script(
+	var a = overloaded(1)
+	var b = overloaded(1, 2)
+)script");
+
+	ASSERT_EQ(eng.get_statistics().m_overload_resolutions, 2u);
+}
+#endif
+double stats_converted(double a) { return a; }
+double stats_converted(double a, double b) { return a + b; }
+TEST_F(StatisticsParseEvalTest, overloads_convert_their_arguments_as_planned_when_scoring_them)
+{
+	eng.add("converted", binds::func(static_cast<double(*)(double)>(stats_converted)));
+	eng.add("converted", binds::func(static_cast<double(*)(double, double)>(stats_converted)));
+
+	eng.reset_statistics();
+	parse_and_evaluate("var a = converted(1.5)");
+
+	ASSERT_DOUBLE_EQ(eng.get_variable_value<double>("a"), 1.5);
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_conversion_lookups, 1u);
+#endif
+}
+class ExecuteParseEvalTest : public ParserEvaluationTest {};
+TEST_F(ExecuteParseEvalTest, increments_whose_result_is_not_read_still_modify_the_variable)
+{
+	parse_and_evaluate(R"script(
+	var i = 0
+	i++
+	++i
+	i--
+	i++
+	var j = i
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("j"), 2);
+}
+TEST_F(ExecuteParseEvalTest, the_last_statement_is_still_the_result_of_the_script)
+{
+	ASSERT_EQ(parse_and_evaluate<int>(R"script(
+	var i = 3
+	i++
+)script"), 3);
+}
+#ifdef SCRIPTING_STATISTICS
+TEST_F(ExecuteParseEvalTest, statements_do_not_copy_results_nobody_reads)
+{
+	const auto shares = [this](int iterations)
+	{
+		eng.reset_statistics();
+		parse_and_evaluate((R"script(
+	var n = 0
+	for (var i = 0; i < )script" + std::to_string(iterations) + R"script(; ++i)
+	{
+		n++
+		--n
+	}
+	var done = 1
+)script").c_str());
+		return eng.get_statistics().m_boxed_shares;
+	};
+
+	const std::size_t shares_10 = shares(10);
+	const std::size_t shares_100 = shares(100);
+
+	ASSERT_EQ(shares_10, shares_100);
+}
+#endif
+class ScriptFunctionParseEvalTest : public ParserEvaluationTest {};
+TEST_F(ScriptFunctionParseEvalTest, functions_receive_parameters_and_return_values)
+{
+	parse_and_evaluate(R"script(
+	def add(a, b)
+	{
+		return a + b
+	}
+	var result = add(3, 4)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("result"), 7);
+}
+TEST_F(ScriptFunctionParseEvalTest, parameters_are_passed_by_value)
+{
+	parse_and_evaluate(R"script(
+	def change(a) { a = 10 }
+	var a = 3
+	change(a)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("a"), 3);
+}
+TEST_F(ScriptFunctionParseEvalTest, functions_can_be_recursive)
+{
+	parse_and_evaluate(R"script(
+	def fib(n)
+	{
+		if (n < 2) { return n }
+		return fib(n - 1) + fib(n - 2)
+	}
+	var result = fib(15)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("result"), 610);
+}
+TEST_F(ScriptFunctionParseEvalTest, locals_declared_in_inner_blocks_and_loops)
+{
+	parse_and_evaluate(R"script(
+	def sum_to(n)
+	{
+		var total = 0
+		for (var i = 1; i <= n; ++i)
+		{
+			var twice = i * 2
+			total += twice
+		}
+		return total
+	}
+	var result = sum_to(10)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("result"), 110);
+}
+TEST_F(ScriptFunctionParseEvalTest, return_stops_the_loops_of_the_function)
+{
+	parse_and_evaluate(R"script(
+	def first_multiple(n, of)
+	{
+		var i = n
+		while (true) {
+			if (i % of == 0) { return i }
+			++i
+		}
+		return -1
+	}
+	var result = first_multiple(10, 7)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("result"), 14);
+}
+TEST_F(ScriptFunctionParseEvalTest, functions_can_use_top_level_variables)
+{
+	parse_and_evaluate(R"script(
+	var count = 0
+	def increment(n) { count += n }
+	for (var i = 0; i < 5; ++i) { increment(i) }
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("count"), 10);
+}
+TEST_F(ScriptFunctionParseEvalTest, functions_without_return_value_return_nothing)
+{
+	const BoxedValue result = parse_and_evaluate(R"script(
+	def nothing() { return }
+	nothing()
+)script");
+
+	ASSERT_TRUE(result.empty());
+}
+TEST_F(ScriptFunctionParseEvalTest, defining_a_function_again_replaces_it)
+{
+	parse_and_evaluate(R"script(
+	def value() { return 1 }
+	var a = value()
+	def value() { return 2 }
+	var b = value()
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("a"), 1);
+	ASSERT_EQ(eng.get_variable_value<int>("b"), 2);
+}
+int script_fn_twice(int a) { return a * 2; }
+TEST_F(ScriptFunctionParseEvalTest, functions_overload_by_parameter_number_with_bound_functions)
+{
+	eng.add("twice", binds::func(script_fn_twice));
+
+	parse_and_evaluate(R"script(
+	def twice(a, b) { return a * 2 + b * 2 }
+	var a = twice(3)
+	var b = twice(3, 4)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("a"), 6);
+	ASSERT_EQ(eng.get_variable_value<int>("b"), 14);
+}
+double script_fn_half(double a) { return a / 2; }
+TEST_F(ScriptFunctionParseEvalTest, bound_overloads_are_preferred_to_functions_taking_anything)
+{
+	parse_and_evaluate("def half(a) { return a }");
+	eng.add("half", binds::func(script_fn_half));
+
+	// the float argument needs a conversion, it does not match the bound function better
+	parse_and_evaluate(R"script(
+	var a = half(3.0)
+	var b = half("text")
+)script");
+
+	ASSERT_DOUBLE_EQ(eng.get_variable_value<double>("a"), 1.5);
+	ASSERT_EQ(eng.get_variable_value<std::string>("b"), "text");
+}
+TEST_F(ScriptFunctionParseEvalTest, calling_with_wrong_parameter_number_throws)
+{
+	ASSERT_THROW(parse_and_evaluate(R"script(
+	def add(a, b) { return a + b }
+	var result = add(3)
+)script"), except::RuntimeException);
+}
+TEST_F(ScriptFunctionParseEvalTest, recursive_calls_do_not_share_their_locals)
+{
+	parse_and_evaluate(R"script(
+	def sum_to(n)
+	{
+		if (n == 0) { return 0 }
+		var rest = sum_to(n - 1)
+		return n + rest
+	}
+	var a = sum_to(10)
+	var b = sum_to(3)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("a"), 55);
+	ASSERT_EQ(eng.get_variable_value<int>("b"), 6);
+}
+TEST_F(ScriptFunctionParseEvalTest, nested_functions_cannot_use_the_locals_of_the_enclosing_one)
+{
+	ASSERT_THROW(p.parse(R"script(
+	def outer(a)
+	{
+		def inner() { return a }
+		return inner()
+	}
+)script"), std::runtime_error);
+
+	// their own locals can take the names of the enclosing ones
+	parse_and_evaluate(R"script(
+	def outer(a)
+	{
+		def inner(a) { return a * 2 }
+		return inner(a + 1)
+	}
+	var result = outer(3)
+)script");
+	ASSERT_EQ(eng.get_variable_value<int>("result"), 8);
+}
+class LoopControlParseEvalTest : public ParserEvaluationTest {};
+TEST_F(LoopControlParseEvalTest, break_stops_the_loop)
+{
+	parse_and_evaluate(R"script(
+	var i = 0
+	while (true) {
+		++i
+		if (i == 10) { break }
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("i"), 10);
+}
+TEST_F(LoopControlParseEvalTest, continue_skips_the_rest_of_the_iteration)
+{
+	parse_and_evaluate(R"script(
+	var sum = 0
+	for (var i = 0; i < 10; ++i)
+	{
+		if (i % 2 == 0) { continue }
+		sum += i
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("sum"), 25);
+}
+TEST_F(LoopControlParseEvalTest, break_only_stops_the_innermost_loop)
+{
+	parse_and_evaluate(R"script(
+	var count = 0
+	for (var a = 0; a < 5; ++a)
+	{
+		for (var b = 0; b < 5; ++b)
+		{
+			if (b == 2) { break }
+			count += 1
+		}
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("count"), 10);
+}
+TEST_F(LoopControlParseEvalTest, return_stops_all_the_loops_of_the_function)
+{
+	parse_and_evaluate(R"script(
+	def find(n)
+	{
+		for (var a = 0; a < 10; ++a)
+		{
+			for (var b = 0; b < 10; ++b)
+			{
+				if (a * b == n) { return a * 100 + b }
+			}
+		}
+		return -1
+	}
+	var result = find(12)
+)script");
+
+	ASSERT_EQ(eng.get_variable_value<int>("result"), 206);
+}
+TEST_F(LoopControlParseEvalTest, break_and_continue_outside_of_loops_are_parse_errors)
+{
+	ASSERT_THROW(p.parse("break"), except::ParseException);
+	ASSERT_THROW(p.parse("if (true) { continue }"), except::ParseException);
+	ASSERT_THROW(p.parse(R"script(
+	while (true) {
+		def stop() { break }
+	}
+)script"), except::ParseException);
+}
+class TryEvaluateParseEvalTest : public ParserEvaluationTest
+{
+public:
+	runtime::EvaluationResult parse_and_try_evaluate(const char * str)
+	{
+		p.parse(str);
+		return eng.try_evaluate(*p.get_root());
+	}
+};
+TEST_F(TryEvaluateParseEvalTest, successful_scripts_return_their_value)
+{
+	const auto result = parse_and_try_evaluate("3 * 4");
+
+	ASSERT_TRUE(result.succeeded());
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::NONE);
+	ASSERT_EQ(boxed_cast<int>(result.m_value), 12);
+}
+TEST_F(TryEvaluateParseEvalTest, errors_are_returned_with_their_code_and_message)
+{
+	const auto result = parse_and_try_evaluate("var a = not_a_function(3)");
+
+	ASSERT_FALSE(result.succeeded());
+	ASSERT_TRUE(result.m_value.empty());
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::UNKNOWN_FUNCTION);
+	ASSERT_THAT(result.m_error.get_message(), HasSubstr("not_a_function"));
+}
+int try_eval_overloaded(int a) { return a; }
+int try_eval_overloaded(int a, int b) { return a + b; }
+TEST_F(TryEvaluateParseEvalTest, statements_after_an_error_are_not_evaluated)
+{
+	eng.add("overloaded", binds::func(static_cast<int(*)(int)>(try_eval_overloaded)));
+	eng.add("overloaded", binds::func(static_cast<int(*)(int, int)>(try_eval_overloaded)));
+
+	const auto result = parse_and_try_evaluate(R"script(
+	var count = 0
+	for (var i = 0; i < 10; ++i)
+	{
+		count += 1
+		if (i == 3) { overloaded(1, 2, 3) }
+	}
+)script");
+
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::NO_MATCHING_CALL);
+	ASSERT_EQ(eng.get_variable_value<int>("count"), 4);
+}
+TEST_F(TryEvaluateParseEvalTest, errors_inside_script_functions_stop_the_caller)
+{
+	const auto result = parse_and_try_evaluate(R"script(
+	var after = false
+	def fail(a) { return a + unknown }
+	var r = fail(1)
+	after = true
+)script");
+
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::UNKNOWN_VARIABLE);
+	ASSERT_FALSE(eng.get_variable_value<bool>("after"));
+}
+int try_eval_calls = 0;
+int try_eval_counted(int a) { ++try_eval_calls; return a; }
+TEST_F(TryEvaluateParseEvalTest, operands_after_an_error_are_not_evaluated)
+{
+	eng.add("counted", binds::func(try_eval_counted));
+	try_eval_calls = 0;
+
+	const auto result = parse_and_try_evaluate("var r = unknown + counted(1)");
+
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::UNKNOWN_VARIABLE);
+	ASSERT_EQ(try_eval_calls, 0);
+}
+int try_eval_throwing(int) { throw std::runtime_error{ "thrown by bound function" }; }
+TEST_F(TryEvaluateParseEvalTest, exceptions_thrown_by_bound_functions_are_returned_as_errors)
+{
+	eng.add("throwing", binds::func(try_eval_throwing));
+
+	const auto result = parse_and_try_evaluate("throwing(1)");
+
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::EXCEPTION);
+	ASSERT_EQ(result.m_error.get_message(), "thrown by bound function");
+}
+TEST_F(TryEvaluateParseEvalTest, evaluate_throws_the_same_errors)
+{
+	try
+	{
+		parse_and_evaluate("var a = 3 + unknown");
+		FAIL();
+	}
+	catch (const except::RuntimeException & ex)
+	{
+		ASSERT_THAT(ex.what(), HasSubstr("unknown"));
+	}
+
+	ASSERT_EQ(parse_and_evaluate<int>("3 + 4"), 7);
+}
+class SnapshotParseEvalTest : public ParserEvaluationTest
+{
+public:
+	BoxedValue evaluate_in(runtime::DispatchEngine & en, const char * str)
+	{
+		p.parse(str);
+		return en.evaluate(*p.get_root());
+	}
+
+	template <typename T>
+	T evaluate_in(runtime::DispatchEngine & en, const char * str)
+	{
+		const BoxedValue result = evaluate_in(en, str);
+		return boxed_cast<T>(result);
+	}
+};
+TEST_F(SnapshotParseEvalTest, forks_start_with_the_variables_and_functions_of_the_image)
+{
+	int global_int = 3;
+	eng.add("the_global_int", binds::var(global_int));
+	parse_and_evaluate(R"script(
+	def add(a, b) { return a + b }
+	var a = 5
+)script");
+
+	runtime::DispatchEngine fork{ eng.snapshot() };
+
+	ASSERT_EQ(evaluate_in<int>(fork, "add(a, the_global_int)"), 8);
+}
+TEST_F(SnapshotParseEvalTest, forks_do_not_modify_the_image_nor_other_forks)
+{
+	parse_and_evaluate(R"script(
+	def twice(a) { return a * 2 }
+	var a = 5
+)script");
+	const auto image = eng.snapshot();
+
+	runtime::DispatchEngine fork0{ image };
+	evaluate_in(fork0, "a = 10");
+	evaluate_in(fork0, "def twice(a) { return a * 3 }");
+	ASSERT_EQ(evaluate_in<int>(fork0, "twice(a)"), 30);
+
+	runtime::DispatchEngine fork1{ image };
+	ASSERT_EQ(evaluate_in<int>(fork1, "twice(a)"), 10);
+}
+int snapshot_negate(int a) { return -a; }
+float snapshot_pow(float a, int p) { return std::pow(a, p); }
+TEST_F(SnapshotParseEvalTest, bindings_added_after_the_snapshot_are_not_in_the_image)
+{
+	eng.add("foo", binds::func(snapshot_negate));
+	const auto image = eng.snapshot();
+
+	eng.add("foo", binds::func(snapshot_pow));
+	eng.add("bar", binds::func(snapshot_negate));
+	ASSERT_EQ(parse_and_evaluate<float>("foo(2.0, 2)"), 4.0f);
+
+	runtime::DispatchEngine fork{ image };
+	ASSERT_EQ(evaluate_in<int>(fork, "foo(3)"), -3);
+	ASSERT_EQ(fork.get_global_fn("bar"), nullptr);
+}
+TEST_F(SnapshotParseEvalTest, forks_share_the_values_of_the_image_until_they_modify_them)
+{
+	parse_and_evaluate("var v = [1, 2, 3]");
+	runtime::DispatchEngine fork{ eng.snapshot() };
+
+	eng.reset_statistics();
+	ASSERT_EQ(evaluate_in<std::size_t>(fork, "v.size()"), 3u);
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(fork.get_statistics().m_boxed_clones, 0u);
+#endif
+
+	evaluate_in(fork, "v.push_back(4)");
+	ASSERT_EQ(evaluate_in<std::size_t>(fork, "v.size()"), 4u);
+
+	runtime::DispatchEngine other_fork{ eng.snapshot() };
+	ASSERT_EQ(evaluate_in<std::size_t>(other_fork, "v.size()"), 3u);
+}
+
+class LoopInvariantParseEvalTest : public ParserEvaluationTest
+{
+public:
+	static int s_calls;
+	static int s_limit;
+
+	static int counted_limit()
+	{
+		++s_calls;
+		return s_limit;
+	}
+	static void grow_limit()
+	{
+		++s_limit;
+	}
+
+	void SetUp() override
+	{
+		s_calls = 0;
+		s_limit = 5;
+	}
+};
+int LoopInvariantParseEvalTest::s_calls = 0;
+int LoopInvariantParseEvalTest::s_limit = 0;
+
+TEST_F(LoopInvariantParseEvalTest, pure_calls_with_invariant_arguments_are_made_once_per_loop)
+{
+	eng.add("limit", binds::pure(binds::func(counted_limit)));
+	parse_and_evaluate(R"script(
+	var n = 0
+	for (var i = 0; i < limit(); ++i)
+		n += 1
+	var m = 0
+	while (m < limit() * 2) { m += 1 }
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 5);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 10);
+	ASSERT_EQ(s_calls, 2);
+}
+TEST_F(LoopInvariantParseEvalTest, impure_calls_compute_the_invariants_again)
+{
+	eng.add("limit", binds::pure(binds::func(counted_limit)));
+	eng.add("grow_limit", binds::func(grow_limit));
+	parse_and_evaluate(R"script(
+	var n = 0
+	for (var i = 0; i < limit(); ++i)
+	{
+		if (i < 3) { grow_limit() }
+		n += 1
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 8);
+
+	parse_and_evaluate(R"script(
+	var v = [1, 2, 3]
+	var count = 0
+	for (var j = 0; j < v.size(); ++j)
+	{
+		if (count < 2) { v.push_back(0) }
+		count += 1
+	}
+)script");
+	ASSERT_EQ(eng.get_variable_as<int>("count"), 5);
+}
+struct InvariantMeter { int m_value; };
+int invariant_meter_reads = 0;
+int operator+(const InvariantMeter & meter, int i) { ++invariant_meter_reads; return meter.m_value + i; }
+int operator+(int i, const InvariantMeter & meter) { return meter + i; }
+InvariantMeter make_invariant_meter() { return{ 10 }; }
+TEST_F(LoopInvariantParseEvalTest, operators_bound_for_other_types_are_impure)
+{
+	eng.add(binds::opts_for<InvariantMeter, int, opts::Add>());
+	eng.add("make_meter", binds::func(make_invariant_meter));
+	invariant_meter_reads = 0;
+
+	parse_and_evaluate(R"script(
+	var meter = make_meter()
+	var total = 0
+	for (var i = 0; i < 4; ++i)
+	{
+		total += meter + 1
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("total"), 44);
+	ASSERT_EQ(invariant_meter_reads, 4);
+}
+TEST_F(LoopInvariantParseEvalTest, expressions_reading_variables_written_in_the_loop_are_not_hoisted)
+{
+	parse_and_evaluate(R"script(
+	var a = 2
+	var n = 0
+	while (n < a * 10) {
+		n += 1
+		if (n == 5) { a = 1 }
+	}
+	var b = 3
+	var k = 0
+	while (k < b * 2) {
+		--b
+		k += 1
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 10);
+	ASSERT_EQ(eng.get_variable_as<int>("k"), 2);
+}
+TEST_F(LoopInvariantParseEvalTest, functions_running_the_same_loop_recursively_keep_their_own_values)
+{
+	eng.add("limit", binds::pure(binds::func(counted_limit)));
+	parse_and_evaluate(R"script(
+	def count(depth)
+	{
+		var n = 0
+		for (var i = 0; i < limit() - depth; ++i)
+		{
+			if (depth < 2) { n += count(depth + 1) }
+			n += 1
+		}
+		return n
+	}
+	var total = count(0)
+)script");
+
+	// 5 iterations at depth 0, each calling count(1) with 4 iterations calling count(2) with 3
+	ASSERT_EQ(eng.get_variable_as<int>("total"), 5 * (1 + 4 * (1 + 3)));
+}
+
+class DeadBranchParseEvalTest : public ParserEvaluationTest
+{
+public:
+	bool parses_to_noop(const char * str)
+	{
+		p.parse(str);
+		const auto root = p.get_root();
+		return dynamic_cast<const ast::Noop *>(root.get()) != nullptr;
+	}
+};
+
+TEST_F(DeadBranchParseEvalTest, branches_decided_by_constants_are_pruned_when_parsing)
+{
+	ASSERT_TRUE(parses_to_noop("if (1 > 2) { a = 1 }"));
+	ASSERT_TRUE(parses_to_noop("while (false) { a = 1 }"));
+	ASSERT_TRUE(parses_to_noop("for (; !true; ) { a = 1 }"));
+	ASSERT_FALSE(parses_to_noop("if (a > 2) { a = 1 }"));
+
+	parse_and_evaluate(R"script(
+	var n = 0
+	if (1 == 2) { n = 1 } else { n = 2 }
+	var m = 0
+	if (2.5 * 2 > 4) { m = 3 }
+)script");
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 2);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 3);
+}
+TEST_F(DeadBranchParseEvalTest, constants_of_the_parser_decide_branches)
+{
+	p.define_constant("DEBUG", BoxedValue{ false });
+	ASSERT_TRUE(parses_to_noop("if (DEBUG) { a = 1 }"));
+
+	parse_and_evaluate(R"script(
+	var n = 0
+	if (!DEBUG) { n = 1 }
+	def f(DEBUG) { return DEBUG }
+	var m = f(4)
+)script");
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 1);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 4);
+	ASSERT_THROW(p.parse("var DEBUG = true"), std::runtime_error);
+}
+TEST_F(DeadBranchParseEvalTest, constants_cannot_be_assigned)
+{
+	p.define_constant("LEVEL", BoxedValue{ 5 });
+
+	ASSERT_THROW(p.parse("LEVEL = 5"), std::runtime_error);
+	ASSERT_THROW(p.parse("LEVEL += 1"), std::runtime_error);
+	ASSERT_THROW(p.parse("var a = 0 \n if (a == 0) { LEVEL <<= 1 }"), std::runtime_error);
+
+	parse_and_evaluate("var same = LEVEL == 5");
+	ASSERT_TRUE(eng.get_variable_as<bool>("same"));
+}
+TEST_F(DeadBranchParseEvalTest, constants_cannot_be_incremented)
+{
+	p.define_constant("LEVEL", BoxedValue{ 5 });
+
+	ASSERT_THROW(p.parse("++LEVEL"), std::runtime_error);
+	ASSERT_THROW(p.parse("--LEVEL"), std::runtime_error);
+	ASSERT_THROW(p.parse("LEVEL++"), std::runtime_error);
+	ASSERT_THROW(p.parse("var a = LEVEL--"), std::runtime_error);
+
+	parse_and_evaluate("var i = LEVEL \n ++i");
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 6);
+}
+TEST_F(DeadBranchParseEvalTest, loops_with_constant_true_conditions_run_until_they_break)
+{
+	parse_and_evaluate(R"script(
+	var n = 0
+	for (;;) { if (++n == 3) { break } }
+	var m = 0
+	while (1) { if (++m == 4) { break } }
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 3);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 4);
+}
+TEST_F(DeadBranchParseEvalTest, statements_after_a_return_are_not_evaluated)
+{
+	parse_and_evaluate(R"script(
+	var n = 0
+	def f()
+	{
+		return 1
+		n = 5
+	}
+	var m = f()
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 0);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 1);
+}
+
+class CountedLoopParseEvalTest : public ParserEvaluationTest {};
+
+TEST_F(CountedLoopParseEvalTest, counters_keep_their_last_value_after_the_loop)
+{
+	parse_and_evaluate(R"script(
+	var n = 0
+	for (var i = 0; i < 10; ++i) { n += i }
+	var m = 0
+	for (var j = 5; j >= 0; j--) { if (j == 2) { continue } else { m += 1 } }
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 45);
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 10);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 5);
+	ASSERT_EQ(eng.get_variable_as<int>("j"), -1);
+}
+TEST_F(CountedLoopParseEvalTest, counters_are_compared_with_bounds_of_any_type)
+{
+	parse_and_evaluate(R"script(
+	var v = [1, 2, 3]
+	var n = 0
+	for (var i = 0; i < v.size(); ++i) { n += v[i] }
+	var m = 0
+	for (var j = 0; j <= 2.5; ++j) { m += 1 }
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 6);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 3);
+}
+TEST_F(CountedLoopParseEvalTest, counters_are_compared_with_sizes_as_the_operators_compare_them)
+{
+	parse_and_evaluate(R"script(
+	var v = [1, 2, 3]
+	var counted_up = 0
+	for (var i = -1; i < v.size(); ++i) { counted_up += 1 }
+	var up = 0
+	var j = -1
+	while (j < v.size()) {
+		up += 1
+		++j
+	}
+	var counted_down = 0
+	for (var k = 5; k > v.size(); --k) { counted_down += 1 }
+	var down = 0
+	var l = 5
+	while (l > v.size()) {
+		down += 1
+		--l
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("counted_up"), eng.get_variable_as<int>("up"));
+	ASSERT_EQ(eng.get_variable_as<int>("i"), eng.get_variable_as<int>("j"));
+	ASSERT_EQ(eng.get_variable_as<int>("counted_down"), eng.get_variable_as<int>("down"));
+	ASSERT_EQ(eng.get_variable_as<int>("k"), eng.get_variable_as<int>("l"));
+}
+TEST_F(CountedLoopParseEvalTest, functions_called_in_the_loop_see_and_modify_the_counter)
+{
+	parse_and_evaluate(R"script(
+	def skip() { i = i + 2 }
+	var n = 0
+	for (var i = 0; i < 10; ++i)
+	{
+		n += 1
+		skip()
+	}
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 4);
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 12);
+}
+TEST_F(CountedLoopParseEvalTest, counters_of_script_functions_are_locals)
+{
+	parse_and_evaluate(R"script(
+	def sum(n)
+	{
+		var s = 0
+		for (var i = 0; i < n; ++i) { s += i }
+		return s
+	}
+	var a = sum(5)
+	var b = sum(0)
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 10);
+	ASSERT_EQ(eng.get_variable_as<int>("b"), 0);
+}
+
+TEST_F(CountedLoopParseEvalTest, loops_computing_ints_give_the_same_results_when_compiled)
+{
+	p.parse(R"script(
+	var a = 0
+	var b = 1
+	var k = 3
+	for (var i = 10; i > 0; --i)
+	{
+		a += i * k - (b & 7)
+		if (a >= 20) { b = b ^ i } else { b |= -a }
+		k = ~k
+	}
+)script");
+	const auto root = p.get_root();
+	const ast::For * loop = nullptr;
+	for (const auto & statement : static_cast<const ast::Statements &>(*root).get_statements())
+	{
+		if (const auto * for_ = dynamic_cast<const ast::For *>(statement.get()))
+			loop = for_;
+	}
+	ASSERT_NE(loop, nullptr);
+#ifdef SCRIPTING_JIT
+	ASSERT_TRUE(loop->is_compiled());
+#else
+	ASSERT_FALSE(loop->is_compiled());
+#endif
+	eng.evaluate(*root);
+
+	int a = 0, b = 1, k = 3;
+	for (int i = 10; i > 0; --i)
+	{
+		a += i * k - (b & 7);
+		if (a >= 20)	b = b ^ i;
+		else			b |= -a;
+		k = ~k;
+	}
+	ASSERT_EQ(eng.get_variable_as<int>("a"), a);
+	ASSERT_EQ(eng.get_variable_as<int>("b"), b);
+	ASSERT_EQ(eng.get_variable_as<int>("k"), k);
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 0);
+}
+TEST_F(CountedLoopParseEvalTest, loops_over_variables_of_other_types_are_interpreted)
+{
+	parse_and_evaluate(R"script(
+	var x = 0.5
+	for (var i = 0; i < 4; ++i) { x += 1 }
+	var n = 0
+	for (var j = 0; j < 3; ++j) { n = n + j }
+)script");
+
+	ASSERT_FLOAT_EQ(eng.get_variable_as<float>("x"), 4.5f);
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 3);
+}
+TEST_F(CountedLoopParseEvalTest, loops_of_script_functions_compute_their_locals)
+{
+	parse_and_evaluate(R"script(
+	def triangle(n)
+	{
+		var s = 0
+		for (var i = 1; i <= n; i++) { s = s + i }
+		return s
+	}
+	var a = triangle(4)
+	var b = triangle(100)
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 10);
+	ASSERT_EQ(eng.get_variable_as<int>("b"), 5050);
+}
+
+class VectorAccessParseEvalTest : public TryEvaluateParseEvalTest {};
+
+TEST_F(VectorAccessParseEvalTest, vectors_and_strings_are_indexed_by_integers)
+{
+	const auto result = parse_and_try_evaluate(R"script(
+	var v = [1, 2, 3]
+	var s = "abc"
+	var n = 0
+	for (var i = 0; i < v.size(); ++i) { n += v[i] }
+	var last = v[v.size() - 1]
+	var c = s[1]
+)script");
+
+	ASSERT_TRUE(result.succeeded());
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 6);
+	ASSERT_EQ(eng.get_variable_as<int>("last"), 3);
+	ASSERT_EQ(eng.get_variable_as<char>("c"), 'b');
+}
+TEST_F(VectorAccessParseEvalTest, accesses_out_of_range_are_errors)
+{
+	auto result = parse_and_try_evaluate("var v = [1, 2] \n var x = v[2]");
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::INDEX_OUT_OF_RANGE);
+
+	result = parse_and_try_evaluate("var s = \"abc\" \n var y = s[-1]");
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::INDEX_OUT_OF_RANGE);
+}
+TEST_F(VectorAccessParseEvalTest, loops_that_may_resize_the_vector_still_check_the_accesses)
+{
+	const auto result = parse_and_try_evaluate(R"script(
+	var v = [1, 2, 3]
+	var x = 0
+	for (var i = 0; i < v.size(); ++i)
+	{
+		v.pop_back()
+		x = v[i]
+	}
+)script");
+
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::INDEX_OUT_OF_RANGE);
+	ASSERT_EQ(eng.get_variable_as<int>("i"), 1);
+}
+TEST_F(VectorAccessParseEvalTest, loops_whose_counter_may_be_negative_still_check_the_accesses)
+{
+	auto result = parse_and_try_evaluate(R"script(
+	var v = [1, 2, 3]
+	var n = 0
+	for (var i = 2; i < v.size(); --i) { n += v[i] }
+)script");
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::INDEX_OUT_OF_RANGE);
+	ASSERT_EQ(eng.get_variable_as<int>("n"), 6);
+
+	result = parse_and_try_evaluate(R"script(
+	var w = [1, 2, 3]
+	var m = 0
+	for (var j = -1; j < w.size(); ++j) { m += w[j] }
+)script");
+	ASSERT_EQ(result.m_error.get_code(), except::ErrorCode::INDEX_OUT_OF_RANGE);
+	ASSERT_EQ(eng.get_variable_as<int>("m"), 0);
+}
+
+class TypeInferenceParseEvalTest : public ParserEvaluationTest
+{
+public:
+	BoxedValue parse_infer_and_evaluate(const char * str)
+	{
+		p.parse(str);
+		auto root = p.get_root();
+		ast::infer_types(root, eng);
+
+		eng.reset_statistics();
+		return eng.evaluate(*root);
+	}
+};
+
+TEST_F(TypeInferenceParseEvalTest, operators_with_proven_operand_types_are_not_looked_up)
+{
+	parse_infer_and_evaluate(R"script(
+	var a = 0
+	var b = 1.5
+	for (var i = 0; i < 10; ++i) { a += i }
+	var j = 0
+	while (j < 4) {
+		b = b * 2.0
+		++j
+	}
+	var c = a + j
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 45);
+	ASSERT_EQ(eng.get_variable_as<float>("b"), 24.f);
+	ASSERT_EQ(eng.get_variable_as<int>("c"), 49);
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_operator_lookups, 0u);
+#endif
+}
+TEST_F(TypeInferenceParseEvalTest, variables_with_a_type_per_branch_are_not_proven)
+{
+	parse_infer_and_evaluate(R"script(
+	var flag = true
+	var x
+	if (flag) { x = 1 } else { x = 1.5 }
+	var y = x + 1
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("y"), 2);
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_operator_lookups, 1u);
+#endif
+}
+TEST_F(TypeInferenceParseEvalTest, bodies_of_script_functions_are_inferred_without_the_arguments)
+{
+	parse_infer_and_evaluate(R"script(
+	def scale(x)
+	{
+		var k = 2
+		var m = k * 3
+		return m * x
+	}
+	var r = scale(2)
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<int>("r"), 12);
+	// only the operator with the parameter needs a look up
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_operator_lookups, 1u);
+#endif
+}
+TEST_F(TypeInferenceParseEvalTest, typed_operators_check_the_types_of_their_operands)
+{
+	// the call moves the value out of the local, which is assigned another type after it
+	parse_infer_and_evaluate(R"script(
+	def f()
+	{
+		var v = []
+		var j = 1
+		v.push_back(j)
+		j = 2.5
+		return j + 1
+	}
+	var r = f()
+)script");
+
+	ASSERT_EQ(eng.get_variable_as<float>("r"), 3.5f);
+}
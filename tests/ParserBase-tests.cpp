@@ -1,12 +1,12 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Parse\Alphabet.h"				// Alphabet
-#include "Parse\ParserBase.h"			// 
-#include "Parse\DummyParser.h"
-#include "Parse\OperatorParsing.h"
-#include "Runtime\OperatorType.h"
+#include "Parse/Alphabet.h"				// Alphabet
+#include "Parse/ParserBase.h"			// 
+#include "Parse/DummyParser.h"
+#include "Parse/OperatorParsing.h"
+#include "Runtime/OperatorType.h"
 using namespace parse;
 
 class DummyParserMock : public parse::DummyParser {};
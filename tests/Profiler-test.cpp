@@ -0,0 +1,134 @@
+
+#include "gmock/gmock.h"
+using namespace testing;
+
+#include "Parse/Parser.h"			// parser::Parser
+#include "Runtime/DispatchEngine.h"	// runtime::DispatchEngine
+#include "Runtime/Profiler.h"		// runtime::Profiler
+
+#include <algorithm>	// std::find_if
+#include <sstream>		// std::stringstream
+
+class ProfilerTest : public Test
+{
+public:
+	parse::Parser p;
+	runtime::DispatchEngine eng;
+	runtime::Profiler profiler;
+
+	BoxedValue parse_and_evaluate(const char * str)
+	{
+		p.parse(str);
+		return eng.evaluate(*p.get_root());
+	}
+
+	const runtime::Profiler::NodeReport * find_node(const std::vector<runtime::Profiler::NodeReport> & report,
+													const std::string & label, std::size_t line)
+	{
+		const auto it = std::find_if(report.begin(), report.end(),
+									 [&](const runtime::Profiler::NodeReport & node)
+		{
+			return node.m_label == label && node.m_line == line;
+		});
+		return it != report.end() ? &(*it) : nullptr;
+	}
+
+	static constexpr const char * s_script =
+		"var sum = 0\n"
+		"for (var i = 0; i < 10; ++i)\n"
+		"{\n"
+		"	sum += i\n"
+		"}\n"
+		"sum";
+};
+
+TEST_F(ProfilerTest, nodes_are_not_profiled_by_default)
+{
+	eng.set_profiler(&profiler);
+	p.parse(s_script);
+	auto root = p.get_root();
+
+	ASSERT_EQ(boxed_cast<int>(resolve_ref(eng.evaluate(*root))), 45);
+	ASSERT_TRUE(profiler.get_node_report().empty());
+	ASSERT_EQ(profiler.get_total_time().count(), 0);
+}
+
+TEST_F(ProfilerTest, profiled_scripts_evaluate_the_same_without_profiler)
+{
+	p.set_profiling(true);
+	ASSERT_EQ(boxed_cast<int>(resolve_ref(parse_and_evaluate(s_script))), 45);
+	ASSERT_EQ(boxed_cast<int>(resolve_ref(parse_and_evaluate("var a = 2 + 3 * 4\na"))), 14);
+}
+
+TEST_F(ProfilerTest, nodes_are_tagged_with_the_line_where_they_start)
+{
+	p.set_profiling(true);
+	eng.set_profiler(&profiler);
+	ASSERT_EQ(boxed_cast<int>(resolve_ref(parse_and_evaluate(s_script))), 45);
+
+	const auto report = profiler.get_node_report();
+
+	const auto * for_node = find_node(report, "for", 2);
+	ASSERT_NE(for_node, nullptr);
+	ASSERT_EQ(for_node->m_calls, 1u);
+
+	const auto * add_eq = find_node(report, "+=", 4);
+	ASSERT_NE(add_eq, nullptr);
+	ASSERT_EQ(add_eq->m_calls, 10u);
+
+	const auto * less = find_node(report, "<", 2);
+	ASSERT_NE(less, nullptr);
+	ASSERT_EQ(less->m_calls, 11u);
+
+	const auto * decl = find_node(report, "=", 1);
+	ASSERT_NE(decl, nullptr);
+	ASSERT_EQ(decl->m_calls, 1u);
+
+	// the loop includes everything evaluated inside it
+	ASSERT_GE(for_node->m_total, add_eq->m_total);
+	ASSERT_GE(for_node->m_total, for_node->m_self);
+}
+
+TEST_F(ProfilerTest, reports_are_sorted_by_self_time)
+{
+	p.set_profiling(true);
+	eng.set_profiler(&profiler);
+	parse_and_evaluate(s_script);
+
+	const auto nodes = profiler.get_node_report();
+	ASSERT_FALSE(nodes.empty());
+	for (std::size_t i = 1; i < nodes.size(); ++i)
+		ASSERT_GE(nodes[i - 1].m_self, nodes[i].m_self);
+
+	const auto lines = profiler.get_line_report();
+	ASSERT_FALSE(lines.empty());
+	for (std::size_t i = 1; i < lines.size(); ++i)
+		ASSERT_GE(lines[i - 1].m_self, lines[i].m_self);
+
+	std::stringstream ss;
+	profiler.write_report(ss);
+	ASSERT_THAT(ss.str(), HasSubstr("hot lines"));
+	ASSERT_THAT(ss.str(), HasSubstr("hot nodes"));
+}
+
+TEST_F(ProfilerTest, folded_stacks_contain_the_call_path_of_each_node)
+{
+	p.set_profiling(true);
+	eng.set_profiler(&profiler);
+	parse_and_evaluate(s_script);
+
+	std::stringstream ss;
+	profiler.write_folded_stacks(ss);
+	ASSERT_THAT(ss.str(), HasSubstr("script;for (2);scope (3);+= (4);sum (4) "));
+}
+
+TEST_F(ProfilerTest, reset_discards_the_samples)
+{
+	p.set_profiling(true);
+	eng.set_profiler(&profiler);
+	parse_and_evaluate(s_script);
+	ASSERT_FALSE(profiler.get_node_report().empty());
+
+	profiler.reset();
+	ASSERT_TRUE(profiler.get_node_report().empty());
+}
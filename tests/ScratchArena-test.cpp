@@ -0,0 +1,103 @@
+
+#include "gmock/gmock.h"
+using namespace testing;
+
+#include "Runtime/ScratchArena.h"
+#include "Runtime/BoxedValue.h"
+using namespace runtime;
+
+#include <cstdint>	// std::uintptr_t
+
+class ScratchArenaTest : public Test
+{
+public:
+	ScratchArena arena;
+};
+
+TEST_F(ScratchArenaTest, allocations_are_aligned)
+{
+	arena.allocate(1, 1);
+	void * ptr = arena.allocate(sizeof(double), alignof(double));
+
+	ASSERT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % alignof(double), 0u);
+}
+TEST_F(ScratchArenaTest, releasing_a_mark_reuses_the_memory_allocated_after_it)
+{
+	arena.allocate(16, 8);
+	const auto mark = arena.get_mark();
+	void * first = arena.allocate(16, 8);
+	arena.release(mark);
+
+	ASSERT_EQ(arena.allocate(16, 8), first);
+}
+TEST_F(ScratchArenaTest, nested_scopes_do_not_release_the_outer_allocations)
+{
+	void * outer = nullptr;
+	void * inner = nullptr;
+	{
+		const ScratchArena::Scope outer_scope{ arena };
+		outer = arena.allocate(16, 8);
+		{
+			const ScratchArena::Scope inner_scope{ arena };
+			inner = arena.allocate(16, 8);
+		}
+
+		ASSERT_NE(arena.allocate(16, 8), outer);
+	}
+
+	ASSERT_EQ(arena.allocate(16, 8), outer);
+	ASSERT_NE(inner, outer);
+}
+TEST_F(ScratchArenaTest, releasing_keeps_the_memory_reserved)
+{
+	{
+		const ScratchArena::Scope scope{ arena };
+		for (int i = 0; i < 10000; ++i)
+			arena.allocate(16, 8);
+	}
+	const std::size_t capacity = arena.get_capacity();
+
+	{
+		const ScratchArena::Scope scope{ arena };
+		for (int i = 0; i < 10000; ++i)
+			arena.allocate(16, 8);
+	}
+
+	ASSERT_GT(capacity, 0u);
+	ASSERT_EQ(arena.get_capacity(), capacity);
+}
+TEST_F(ScratchArenaTest, vectors_given_back_keep_their_capacity)
+{
+	auto values = arena.take_vector();
+	values.resize(10);
+	const std::size_t capacity = values.capacity();
+	arena.give_back_vector(std::move(values));
+
+	const auto reused = arena.take_vector();
+	ASSERT_TRUE(reused.empty());
+	ASSERT_EQ(reused.capacity(), capacity);
+}
+TEST_F(ScratchArenaTest, temporaries_created_while_active_are_borrowed_from_the_arena)
+{
+	const ScratchArena::Activation activation{ arena };
+	BoxedValue temporary{ BoxedValueTemporary_t{}, 3 };
+	ASSERT_TRUE(temporary.is_borrowed());
+
+	const BoxedValue stored = std::move(temporary);
+	ASSERT_FALSE(stored.is_borrowed());
+	ASSERT_EQ(boxed_cast<int>(stored), 3);
+}
+TEST_F(ScratchArenaTest, values_that_are_not_temporaries_are_not_created_in_the_arena)
+{
+	const ScratchArena::Activation activation{ arena };
+	const BoxedValue value{ 3 };
+
+	ASSERT_FALSE(value.is_borrowed());
+}
+TEST_F(ScratchArenaTest, values_that_need_a_destructor_are_not_created_in_the_arena)
+{
+	const ScratchArena::Activation activation{ arena };
+	const BoxedValue str{ BoxedValueTemporary_t{}, std::string{ "not trivially destructible" } };
+
+	ASSERT_FALSE(str.is_borrowed());
+}
@@ -1,11 +1,11 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Runtime\Stack.h"
+#include "Runtime/Stack.h"
 using namespace runtime;
 
-#include "Runtime\RuntimeException.h"
+#include "Runtime/RuntimeException.h"
 
 class StackTest : public Test
 {
@@ -94,3 +94,44 @@ TEST_F(StackTest, stack_scopes_occlude_outer_variables)
 	ASSERT_EQ(boxed_cast<float>(*stk.get_variable("a")), 2.74f);
 }
 
+TEST_F(StackTest, stack_top_level_variables_are_found_even_if_they_are_occluded)
+{
+	stk.create_variable("a", BoxedValue{ 2.74f });
+
+	stk.push_new_scope();
+	stk.create_variable("a", BoxedValue{ false });
+	stk.create_variable("b", BoxedValue{ true });
+
+	ASSERT_EQ(boxed_cast<float>(*stk.get_top_level_variable("a")), 2.74f);
+	ASSERT_EQ(stk.get_top_level_variable("b"), nullptr);
+	stk.pop_scope();
+}
+TEST_F(StackTest, stack_variables_do_not_move_when_the_stack_grows)
+{
+	BoxedValue & a = stk.create_variable("a", BoxedValue{ 2.74f });
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		stk.push_new_scope();
+		stk.create_variable("b", BoxedValue{ i });
+	}
+
+	ASSERT_EQ(stk.get_variable("a"), &a);
+	ASSERT_EQ(boxed_cast<int>(*stk.get_variable("b")), 999);
+
+	for (int i = 0; i < 1000; ++i)
+		stk.pop_scope();
+
+	ASSERT_EQ(stk.get_variable("b"), nullptr);
+	ASSERT_EQ(boxed_cast<float>(a), 2.74f);
+}
+TEST_F(StackTest, stack_popped_variables_can_be_created_again)
+{
+	stk.push_new_scope();
+	stk.create_variable("a", BoxedValue{ 2.74f });
+	stk.pop_scope();
+
+	stk.create_variable("a", BoxedValue{ false });
+	ASSERT_EQ(boxed_cast<bool>(*stk.get_variable("a")), false);
+	ASSERT_EQ(stk.get_var_num(), 1u);
+}
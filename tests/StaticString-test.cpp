@@ -1,8 +1,8 @@
 
-#include "gmock\gmock.h"
+#include "gmock/gmock.h"
 using namespace testing;
 
-#include "Parse\StaticString.h"
+#include "Parse/StaticString.h"
 using namespace parse;
 
 TEST(StaticStringTest, static_string_can_be_constructed_out_of_a_c_string)
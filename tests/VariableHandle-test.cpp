@@ -0,0 +1,84 @@
+
+#include "gmock/gmock.h"
+using namespace testing;
+
+#include "Parse/Parser.h"			// parser::Parser
+#include "Runtime/VariableHandle.h"	// runtime::VariableHandle
+#include "Runtime/RuntimeException.h"
+
+class VariableHandleTest : public Test
+{
+public:
+	parse::Parser p;
+	runtime::DispatchEngine eng;
+
+	void parse_and_evaluate(const char * str)
+	{
+		p.parse(str);
+		eng.evaluate(*p.get_root());
+	}
+};
+
+TEST_F(VariableHandleTest, handles_read_and_write_the_variables_of_the_script)
+{
+	parse_and_evaluate("var a = 5");
+	runtime::VariableHandle<int> a{ eng, "a" };
+
+	ASSERT_EQ(a.read(), 5);
+	a.set(8);
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 8);
+	a.get() += 1;
+	ASSERT_EQ(eng.get_variable_as<int>("a"), 9);
+}
+TEST_F(VariableHandleTest, handles_do_not_look_up_the_variable_while_the_stack_does_not_change)
+{
+	parse_and_evaluate("var a = 5");
+	runtime::VariableHandle<int> a{ eng, "a" };
+
+	BoxedValue * var = a.get_boxed();
+	ASSERT_EQ(var, eng.get_variable("a"));
+	ASSERT_EQ(a.get_boxed(), var);
+}
+TEST_F(VariableHandleTest, handles_look_up_the_variable_again_after_each_evaluation)
+{
+	runtime::VariableHandle<int> a{ eng, "a" };
+	ASSERT_FALSE(a.exists());
+
+	parse_and_evaluate("var a = 5");
+	ASSERT_EQ(a.read(), 5);
+
+	parse_and_evaluate("var b = 1 \n var a = 3");
+	ASSERT_EQ(a.read(), 3);
+	ASSERT_EQ(a.get_boxed(), eng.get_variable("a"));
+}
+TEST_F(VariableHandleTest, handles_access_the_bound_global_variables)
+{
+	int global_int = 3;
+	eng.add("the_global_int", binds::var(global_int));
+	runtime::VariableHandle<int> var{ eng, "the_global_int" };
+
+	var.set(4);
+	ASSERT_EQ(global_int, 4);
+
+	parse_and_evaluate("the_global_int = 7");
+	ASSERT_EQ(var.read(), 7);
+}
+TEST_F(VariableHandleTest, handles_convert_the_value_looking_up_the_conversion_once)
+{
+	parse_and_evaluate("var a = 5");
+	runtime::VariableHandle<std::size_t> a{ eng, "a" };
+
+	ASSERT_EQ(a.get_value(), 5u);
+
+	eng.reset_statistics();
+	ASSERT_EQ(a.get_value(), 5u);
+#ifdef SCRIPTING_STATISTICS
+	ASSERT_EQ(eng.get_statistics().m_conversion_lookups, 0u);
+#endif
+}
+TEST_F(VariableHandleTest, handles_throw_when_the_variable_does_not_exist)
+{
+	runtime::VariableHandle<int> a{ eng, "a" };
+
+	ASSERT_THROW(a.get(), except::RuntimeException);
+}
@@ -29,6 +29,7 @@
 //
 // Author: wan@google.com (Zhanyong Wan)
 
+#include <cstring>
 #include <iostream>
 
 #include "gmock/gmock.h"
@@ -45,6 +46,14 @@ int main(int argc, char** argv)
 
 	//testing::GTEST_FLAG(filter) = "BoxedValueTest.*";
 
-	if (RUN_ALL_TESTS())
+	// keeps the console open for the interactive runs only, ctest and CI would wait forever
+	bool pause_on_failure = false;
+	for (int i = 1; i < argc; ++i)
+		pause_on_failure = pause_on_failure || std::strcmp(argv[i], "--pause_on_failure") == 0;
+
+	const int result = RUN_ALL_TESTS();
+	if (result && pause_on_failure)
 		std::cin.get();
+
+	return result;
 }